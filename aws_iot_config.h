@@ -33,9 +33,11 @@
 // =================================================
 
 // MQTT PubSub
-#define AWS_IOT_MQTT_TX_BUF_LEN 512 ///< Any time a message is sent out through the MQTT layer. The message is copied into this buffer anytime a publish is done. This will also be used in the case of Thing Shadow
-#define AWS_IOT_MQTT_RX_BUF_LEN 512 ///< Any message that comes into the device should be less than this buffer size. If a received message is bigger than this buffer size the message will be dropped.
-#define AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS 5 ///< Maximum number of topic filters the MQTT client can handle at any given time. This should be increased appropriately when using Thing Shadow
+#define AWS_IOT_MQTT_TX_BUF_LEN 512 ///< Default TX buffer size, used when writeBufSize is not set in the init params. Any time a message is sent out through the MQTT layer. The message is copied into this buffer anytime a publish is done. This will also be used in the case of Thing Shadow
+#define AWS_IOT_MQTT_RX_BUF_LEN 512 ///< Default RX buffer size, used when readBufSize is not set in the init params. Any message that comes into the device should be less than this buffer size. If a received message is bigger than this buffer size, and the buffer cannot grow up to maxReadBufSize, the message will be dropped.
+#define AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS 5 ///< Default maximum number of topic filters the MQTT client can handle at any given time, used when maxSubscriptions is not set in the init params. This should be increased appropriately when using Thing Shadow
+#define AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES 16 ///< Size of the in-flight window for asynchronous QoS1 publishes. This many publishes can be waiting for their PUBACK at any given time
+#define AWS_IOT_MQTT_PUBLISH_RETRY_INTERVAL_MS 10000 ///< Time to wait for the PUBACK of an asynchronous QoS1 publish before it is sent again with the DUP flag set
 
 // Thing Shadow specific configs
 #define SHADOW_MAX_SIZE_OF_RX_BUFFER AWS_IOT_MQTT_RX_BUF_LEN+1 ///< Maximum size of the SHADOW buffer to store the received Shadow message
@@ -45,6 +47,9 @@
 #define MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME 10 ///< At Any given time we will wait for this many responses. This will correlate to the rate at which the shadow actions are requested
 #define MAX_THINGNAME_HANDLED_AT_ANY_GIVEN_TIME 10 ///< We could perform shadow action on any thing Name and this is maximum Thing Names we can act on at any given time
 #define MAX_JSON_TOKEN_EXPECTED 120 ///< These are the max tokens that is expected to be in the Shadow JSON document. Include the metadata that gets published
+#define MAX_JSON_DEPTH_EXPECTED 8 ///< Deepest nesting of objects in a received Shadow JSON document that is looked into for the keys registered on the delta
+#define MAX_REPORTED_ATTRIBUTES_REGISTERED 16 ///< Attributes that can be registered with aws_iot_shadow_register_reported. Each one keeps the value last accepted by the Shadow service to report only its changes
+#define MAX_SIZE_OF_REPORTED_ATTRIBUTE_JSON 64 ///< Longest JSON of a string or object attribute registered with aws_iot_shadow_register_reported that is kept to be compared with. Longer values are reported on every update
 #define MAX_SHADOW_TOPIC_LENGTH_WITHOUT_THINGNAME 60 ///< All shadow actions have to be published or subscribed to a topic which is of the format $aws/things/{thingName}/shadow/update/accepted. This refers to the size of the topic without the Thing Name
 #define MAX_SIZE_OF_THING_NAME 20 ///< The Thing Name should not be bigger than this value. Modify this if the Thing Name needs to be bigger
 #define MAX_SHADOW_TOPIC_LENGTH_BYTES MAX_SHADOW_TOPIC_LENGTH_WITHOUT_THINGNAME + MAX_SIZE_OF_THING_NAME ///< This size includes the length of topic with Thing Name
@@ -53,4 +58,28 @@
 #define AWS_IOT_MQTT_MIN_RECONNECT_WAIT_INTERVAL 1000 ///< Minimum time before the First reconnect attempt is made as part of the exponential back-off algorithm
 #define AWS_IOT_MQTT_MAX_RECONNECT_WAIT_INTERVAL 128000 ///< Maximum time interval after which exponential back-off will stop attempting to reconnect.
 
+// Client manager specific config
+#define AWS_IOT_MQTT_MANAGER_SERVICE_TIMEOUT_MS 100 ///< Longest time a manager worker spends reading and writing for one client before it moves on to the next
+#define AWS_IOT_MQTT_MANAGER_IDLE_CHECK_INTERVAL_MS 1000 ///< Clients without timer work are still looked at this often, to pick up connects made outside the manager
+#define AWS_IOT_MQTT_MANAGER_MAX_EVENTS 64 ///< Most readable clients a manager worker takes from the event set at once
+
+// Full duplex mode specific config
+#define AWS_IOT_MQTT_IO_THREAD_YIELD_TIMEOUT_MS 100 ///< Timeout of each yield of the RX thread, and longest time the I/O threads take to notice a stop
+
+// Dispatch pool specific config
+#define AWS_IOT_MQTT_DISPATCH_LANES 32 ///< Topics are hashed onto this many lanes, messages of one lane are handled in the order they arrived
+#define AWS_IOT_MQTT_DISPATCH_BUFFER_SIZE 512 ///< Size of the pooled message buffers, topic and payload of larger messages are copied into their own allocation
+#define AWS_IOT_MQTT_DISPATCH_POOLED_BUFFERS 64 ///< Most free message buffers the dispatch pool keeps for reuse
+#define AWS_IOT_MQTT_DISPATCH_MAX_QUEUED_JOBS 256 ///< Reading stops while this many handler calls are waiting for a worker
+
+// Network connect specific config
+#define AWS_IOT_NETWORK_MAX_ADDRESSES 8 ///< Most addresses of a host that a connect tries and an address cache keeps
+#define AWS_IOT_NETWORK_CONNECT_ATTEMPT_DELAY_MS 250 ///< Time a TCP connect to one address gets before a connect to the next address is started alongside it
+#define AWS_IOT_NETWORK_ADDRESS_CACHE_ENTRIES 8 ///< Host names an address cache holds, the one used least recently is replaced first
+#define AWS_IOT_NETWORK_ADDRESS_CACHE_TTL_SEC 60 ///< Time cached addresses are used before the host is resolved again, when the resolver does not tell
+
+// Network transport specific config
+#define AWS_IOT_NETWORK_MAX_TRANSPORTS 4 ///< Transports that can be registered besides the built in tls, tcp and memory transports
+#define AWS_IOT_NETWORK_MEMORY_MAX_LISTENERS 4 ///< Names the memory transport can be connected to at once, see iot_memory_listen
+
 #endif /* SRC_SHADOW_IOT_SHADOW_CONFIG_H_ */
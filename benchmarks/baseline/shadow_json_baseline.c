@@ -0,0 +1,215 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file shadow_json_baseline.c
+ * @brief The shadow JSON add/finalize API as it was before it was built on jsonBuilder_t
+ */
+
+#include "shadow_json_baseline.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "aws_iot_shadow_json.h"
+#include "aws_iot_shadow_key.h"
+
+static inline IoT_Error_t checkReturnValueOfSnPrintf(int32_t snPrintfReturn, size_t maxSizeOfJsonDocument) {
+	if(snPrintfReturn < 0) {
+		return SHADOW_JSON_ERROR;
+	} else if((size_t) snPrintfReturn >= maxSizeOfJsonDocument) {
+		return SHADOW_JSON_BUFFER_TRUNCATED;
+	}
+	return SUCCESS;
+}
+
+static IoT_Error_t convertDataToString(char *pStringBuffer, size_t maxSizoStringBuffer, JsonPrimitiveType type,
+									   void *pData) {
+	int32_t snPrintfReturn = 0;
+
+	if(maxSizoStringBuffer == 0) {
+		return SHADOW_JSON_ERROR;
+	}
+
+	if(type == SHADOW_JSON_INT32) {
+		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIi32",", *(int32_t *) (pData));
+	} else if(type == SHADOW_JSON_INT16) {
+		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIi16",", *(int16_t *) (pData));
+	} else if(type == SHADOW_JSON_INT8) {
+		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIi8",", *(int8_t *) (pData));
+	} else if(type == SHADOW_JSON_UINT32) {
+		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIu32",", *(uint32_t *) (pData));
+	} else if(type == SHADOW_JSON_UINT16) {
+		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIu16",", *(uint16_t *) (pData));
+	} else if(type == SHADOW_JSON_UINT8) {
+		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIu8",", *(uint8_t *) (pData));
+	} else if(type == SHADOW_JSON_DOUBLE) {
+		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%f,", *(double *) (pData));
+	} else if(type == SHADOW_JSON_FLOAT) {
+		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%f,", *(float *) (pData));
+	} else if(type == SHADOW_JSON_BOOL) {
+		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%s,", *(bool *) (pData) ? "true" : "false");
+	} else if(type == SHADOW_JSON_STRING) {
+		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "\"%s\",", (char *) (pData));
+	}
+
+	return checkReturnValueOfSnPrintf(snPrintfReturn, maxSizoStringBuffer);
+}
+
+IoT_Error_t baseline_aws_iot_shadow_init_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
+	int32_t snPrintfReturn = 0;
+
+	if(pJsonDocument == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	snPrintfReturn = snprintf(pJsonDocument, maxSizeOfJsonDocument, "{\"state\":{");
+
+	return checkReturnValueOfSnPrintf(snPrintfReturn, maxSizeOfJsonDocument);
+}
+
+/* The old aws_iot_shadow_add_desired and aws_iot_shadow_add_reported only differed in the key they wrote */
+static IoT_Error_t addSection(char *pJsonDocument, size_t maxSizeOfJsonDocument, const char *pSectionKey,
+							  uint8_t count, va_list pArgs) {
+	IoT_Error_t ret_val = SUCCESS;
+	int8_t i;
+	size_t remSizeOfJsonBuffer = maxSizeOfJsonDocument;
+	int32_t snPrintfReturn = 0;
+	size_t tempSize = 0;
+	jsonStruct_t *pTemporary;
+
+	if(pJsonDocument == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+
+	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
+	if(tempSize <= 1) {
+		return SHADOW_JSON_ERROR;
+	}
+	remSizeOfJsonBuffer = tempSize;
+
+	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"%s\":{", pSectionKey);
+	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+
+	if(ret_val != SUCCESS) {
+		return ret_val;
+	}
+
+	for(i = 0; i < count; i++) {
+		tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
+		if(tempSize <= 1) {
+			return SHADOW_JSON_ERROR;
+		}
+		remSizeOfJsonBuffer = tempSize;
+
+		pTemporary = va_arg (pArgs, jsonStruct_t *);
+		if(pTemporary != NULL) {
+			snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"%s\":",
+									  pTemporary->pKey);
+			ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+			if(ret_val != SUCCESS) {
+				return ret_val;
+			}
+			if(pTemporary->pKey != NULL && pTemporary->pData != NULL) {
+				ret_val = convertDataToString(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer,
+											  pTemporary->type, pTemporary->pData);
+			} else {
+				return NULL_VALUE_ERROR;
+			}
+			if(ret_val != SUCCESS) {
+				return ret_val;
+			}
+		} else {
+			return NULL_VALUE_ERROR;
+		}
+	}
+
+	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument) - 1, remSizeOfJsonBuffer, "},");
+	return checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+}
+
+IoT_Error_t baseline_aws_iot_shadow_add_desired(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count,
+												...) {
+	IoT_Error_t ret_val;
+	va_list pArgs;
+
+	va_start(pArgs, count);
+	ret_val = addSection(pJsonDocument, maxSizeOfJsonDocument, "desired", count, pArgs);
+	va_end(pArgs);
+
+	return ret_val;
+}
+
+IoT_Error_t baseline_aws_iot_shadow_add_reported(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count,
+												 ...) {
+	IoT_Error_t ret_val;
+	va_list pArgs;
+
+	va_start(pArgs, count);
+	ret_val = addSection(pJsonDocument, maxSizeOfJsonDocument, "reported", count, pArgs);
+	va_end(pArgs);
+
+	return ret_val;
+}
+
+IoT_Error_t baseline_aws_iot_finalize_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
+	size_t remSizeOfJsonBuffer = maxSizeOfJsonDocument;
+	int32_t snPrintfReturn = 0;
+	size_t tempSize = 0;
+	IoT_Error_t ret_val = SUCCESS;
+
+	if(pJsonDocument == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+
+	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
+	if(tempSize <= 1) {
+		return SHADOW_JSON_ERROR;
+	}
+	remSizeOfJsonBuffer = tempSize;
+
+	// strlen(ShadowTxBuffer) - 1 is to ensure we remove the last ,(comma) that was added
+	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument) - 1, remSizeOfJsonBuffer, "}, \"%s\":\"",
+							  SHADOW_CLIENT_TOKEN_STRING);
+	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+
+	if(ret_val != SUCCESS) {
+		return ret_val;
+	}
+
+	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
+	if(tempSize <= 1) {
+		return SHADOW_JSON_ERROR;
+	}
+	remSizeOfJsonBuffer = tempSize;
+
+	/* Formats "<client id>-<sequence number>" with snprintf, as FillWithClientTokenSize did */
+	ret_val = aws_iot_fill_with_client_token(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer);
+
+	if(ret_val != SUCCESS) {
+		return ret_val;
+	}
+	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
+	if(tempSize <= 1) {
+		return SHADOW_JSON_ERROR;
+	}
+	remSizeOfJsonBuffer = tempSize;
+
+	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"}");
+
+	return checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+}
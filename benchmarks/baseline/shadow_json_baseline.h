@@ -0,0 +1,44 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file shadow_json_baseline.h
+ * @brief The shadow JSON add/finalize API as it was before it was built on jsonBuilder_t
+ *
+ * These functions find the end of the document with strlen and write every key and value with
+ * snprintf, as aws_iot_shadow_add_reported and its neighbours used to. They are kept as the
+ * baseline the builder is measured against and must give the same documents as.
+ *
+ * Like the old code, a value that does not fit can be written past maxSizeOfJsonDocument, so
+ * callers give them a buffer larger than the size they pass.
+ */
+
+#ifndef BENCHMARKS_SHADOW_JSON_BASELINE_H_
+#define BENCHMARKS_SHADOW_JSON_BASELINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aws_iot_error.h"
+#include "aws_iot_shadow_json_data.h"
+
+IoT_Error_t baseline_aws_iot_shadow_init_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument);
+IoT_Error_t baseline_aws_iot_shadow_add_desired(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count,
+												...);
+IoT_Error_t baseline_aws_iot_shadow_add_reported(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count,
+												 ...);
+IoT_Error_t baseline_aws_iot_finalize_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument);
+
+#endif /* BENCHMARKS_SHADOW_JSON_BASELINE_H_ */
@@ -0,0 +1,751 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file local_broker.c
+ * @brief Local stand-in for the AWS IoT MQTT broker
+ *
+ * Each connection is read by its own thread with blocking socket calls. Publishes are written
+ * to the subscribers from the thread of the publisher under the write lock of the subscriber,
+ * so a subscriber that stops reading eventually blocks the publishers routed to it, as TCP
+ * back pressure would.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "jsmn.h"
+#include "network_interface.h"
+#include "local_broker.h"
+
+#define LOCAL_BROKER_MAX_JSON_TOKENS 128
+#define LOCAL_BROKER_SHADOW_PREFIX "$aws/things/"
+#define LOCAL_BROKER_SHADOW_INFIX "/shadow/"
+
+#define MQTT_CONNECT 1
+#define MQTT_PUBLISH 3
+#define MQTT_PUBACK 4
+#define MQTT_SUBSCRIBE 8
+#define MQTT_UNSUBSCRIBE 10
+#define MQTT_PINGREQ 12
+#define MQTT_DISCONNECT 14
+
+#define MQTT_SUBACK_FAILURE 0x80
+
+static bool _local_broker_send(int fd, const unsigned char *pBuf, size_t len) {
+	ssize_t ret;
+
+	while(0 < len) {
+		ret = send(fd, pBuf, len, MSG_NOSIGNAL);
+		if(0 > ret && EINTR == errno) {
+			continue;
+		}
+		if(0 >= ret) {
+			return false;
+		}
+		pBuf += ret;
+		len -= (size_t) ret;
+	}
+
+	return true;
+}
+
+/* Writes a packet with a fixed header, and a variable header and payload in up to two parts */
+static void _local_broker_write_packet(LocalBrokerConnection *pConnection, unsigned char header,
+									   const unsigned char *pFirst, size_t firstLen,
+									   const unsigned char *pSecond, size_t secondLen) {
+	size_t remLen = firstLen + secondLen;
+	size_t len = 0;
+	unsigned char digit;
+
+	if(LOCAL_BROKER_BUF_LEN < remLen + 5) {
+		return;
+	}
+
+	pthread_mutex_lock(&pConnection->writeLock);
+	pConnection->writeBuf[len++] = header;
+	do {
+		digit = (unsigned char) (remLen % 128);
+		remLen /= 128;
+		if(0 < remLen) {
+			digit |= 0x80;
+		}
+		pConnection->writeBuf[len++] = digit;
+	} while(0 < remLen);
+	if(0 < firstLen) {
+		memcpy(pConnection->writeBuf + len, pFirst, firstLen);
+		len += firstLen;
+	}
+	if(0 < secondLen) {
+		memcpy(pConnection->writeBuf + len, pSecond, secondLen);
+		len += secondLen;
+	}
+	_local_broker_send(pConnection->fd, pConnection->writeBuf, len);
+	pthread_mutex_unlock(&pConnection->writeLock);
+}
+
+static void _local_broker_write_publish(LocalBrokerConnection *pConnection, const char *pTopic, size_t topicLen,
+										const unsigned char *pPayload, size_t payloadLen, uint8_t qos) {
+	unsigned char variableHeader[LOCAL_BROKER_MAX_TOPIC_LEN + 4];
+	size_t len = 0;
+
+	if(LOCAL_BROKER_MAX_TOPIC_LEN < topicLen) {
+		return;
+	}
+
+	variableHeader[len++] = (unsigned char) (topicLen >> 8);
+	variableHeader[len++] = (unsigned char) (topicLen & 0xFF);
+	memcpy(variableHeader + len, pTopic, topicLen);
+	len += topicLen;
+	if(0 < qos) {
+		/* Packet ids of the broker are only unique per connection, and never 0 */
+		if(0 == ++pConnection->nextPacketId) {
+			pConnection->nextPacketId = 1;
+		}
+		variableHeader[len++] = (unsigned char) (pConnection->nextPacketId >> 8);
+		variableHeader[len++] = (unsigned char) (pConnection->nextPacketId & 0xFF);
+	}
+
+	_local_broker_write_packet(pConnection, (unsigned char) ((MQTT_PUBLISH << 4) | (qos << 1)), variableHeader, len,
+							   pPayload, payloadLen);
+}
+
+static bool _local_broker_topic_matches(const char *pFilter, const char *pTopic, size_t topicLen) {
+	const char *pEnd = pTopic + topicLen;
+
+	while('\0' != *pFilter) {
+		if('#' == *pFilter) {
+			return true;
+		}
+		if('+' == *pFilter) {
+			while(pTopic < pEnd && '/' != *pTopic) {
+				pTopic++;
+			}
+			pFilter++;
+			continue;
+		}
+		if(pTopic == pEnd) {
+			/* "a/#" matches "a" as well */
+			return 0 == strcmp(pFilter, "/#");
+		}
+		if(*pFilter != *pTopic) {
+			return false;
+		}
+		pFilter++;
+		pTopic++;
+	}
+
+	return pTopic == pEnd;
+}
+
+/* Sends a publish to every connection subscribed to a matching filter, at the lower of the two QoS */
+static void _local_broker_route(LocalBroker *pBroker, const char *pTopic, size_t topicLen,
+								const unsigned char *pPayload, size_t payloadLen, uint8_t qos) {
+	LocalBrokerConnection *pConnection;
+	size_t itr, sub;
+	int grantedQos;
+
+	pthread_mutex_lock(&pBroker->lock);
+	for(itr = 0; itr < LOCAL_BROKER_MAX_CONNECTIONS; itr++) {
+		pConnection = &pBroker->connections[itr];
+		if(0 > pConnection->fd || pConnection->isFinished) {
+			continue;
+		}
+
+		grantedQos = -1;
+		for(sub = 0; sub < pConnection->subscriptionCount; sub++) {
+			if(grantedQos < (int) pConnection->subscriptions[sub].qos
+			   && _local_broker_topic_matches(pConnection->subscriptions[sub].topicFilter, pTopic, topicLen)) {
+				grantedQos = pConnection->subscriptions[sub].qos;
+			}
+		}
+
+		if(0 <= grantedQos) {
+			_local_broker_write_publish(pConnection, pTopic, topicLen, pPayload, payloadLen,
+										(uint8_t) (grantedQos < qos ? grantedQos : qos));
+			pBroker->stats.deliveryCount++;
+		}
+	}
+	pthread_mutex_unlock(&pBroker->lock);
+}
+
+/* Index of the token after the value at index, skipping everything nested in it */
+static int _local_broker_json_skip(const jsmntok_t *pTokens, int index) {
+	int pending = 1;
+
+	while(0 < pending) {
+		pending += pTokens[index].size - 1;
+		index++;
+	}
+
+	return index;
+}
+
+/* Index of the value of a key of the object at index, or -1 */
+static int _local_broker_json_find(const char *pJson, const jsmntok_t *pTokens, int index, const char *pKey) {
+	int pairs = pTokens[index].size / 2;
+	int key = index + 1;
+	size_t keyLen = strlen(pKey);
+
+	if(JSMN_OBJECT != pTokens[index].type) {
+		return -1;
+	}
+
+	while(0 < pairs--) {
+		if(JSMN_STRING == pTokens[key].type && keyLen == (size_t) (pTokens[key].end - pTokens[key].start)
+		   && 0 == strncmp(pJson + pTokens[key].start, pKey, keyLen)) {
+			return key + 1;
+		}
+		key = _local_broker_json_skip(pTokens, key + 1);
+	}
+
+	return -1;
+}
+
+static LocalBrokerThing *_local_broker_find_thing(LocalBroker *pBroker, const char *pThingName, size_t nameLen,
+												  bool isCreate) {
+	LocalBrokerThing *pFree = NULL;
+	size_t itr;
+
+	for(itr = 0; itr < LOCAL_BROKER_MAX_THINGS; itr++) {
+		if('\0' == pBroker->things[itr].thingName[0]) {
+			if(NULL == pFree) {
+				pFree = &pBroker->things[itr];
+			}
+		} else if(nameLen == strlen(pBroker->things[itr].thingName)
+				  && 0 == strncmp(pBroker->things[itr].thingName, pThingName, nameLen)) {
+			return &pBroker->things[itr];
+		}
+	}
+
+	if(!isCreate || NULL == pFree || LOCAL_BROKER_MAX_THING_NAME_LEN < nameLen) {
+		return NULL;
+	}
+	memcpy(pFree->thingName, pThingName, nameLen);
+	pFree->thingName[nameLen] = '\0';
+	pFree->version = 0;
+	pFree->state[0] = '\0';
+
+	return pFree;
+}
+
+/* Answers a publish on the update, get or delete topic of a Thing Shadow */
+static void _local_broker_handle_shadow(LocalBroker *pBroker, const char *pTopic, size_t topicLen,
+										const unsigned char *pPayload, size_t payloadLen) {
+	char json[LOCAL_BROKER_MAX_DOCUMENT_LEN + 1];
+	char response[LOCAL_BROKER_MAX_DOCUMENT_LEN + 256];
+	char responseTopic[LOCAL_BROKER_MAX_TOPIC_LEN + 1];
+	char clientToken[128] = "";
+	jsmntok_t tokens[LOCAL_BROKER_MAX_JSON_TOKENS];
+	jsmn_parser parser;
+	LocalBrokerThing *pThing;
+	const char *pThingName, *pAction;
+	size_t prefixLen = strlen(LOCAL_BROKER_SHADOW_PREFIX);
+	size_t nameLen, actionLen, stateLen;
+	int tokenCount, state, desired, token;
+	int responseLen = 0, deltaLen = 0;
+	char delta[LOCAL_BROKER_MAX_DOCUMENT_LEN + 64];
+	const char *pAck = "accepted";
+	long timestamp = (long) time(NULL);
+
+	if(topicLen <= prefixLen || 0 != strncmp(pTopic, LOCAL_BROKER_SHADOW_PREFIX, prefixLen)) {
+		return;
+	}
+	pThingName = pTopic + prefixLen;
+	for(nameLen = 0; prefixLen + nameLen < topicLen && '/' != pThingName[nameLen]; nameLen++) {
+	}
+	if(prefixLen + nameLen + strlen(LOCAL_BROKER_SHADOW_INFIX) > topicLen
+	   || 0 != strncmp(pThingName + nameLen, LOCAL_BROKER_SHADOW_INFIX, strlen(LOCAL_BROKER_SHADOW_INFIX))) {
+		return;
+	}
+	pAction = pThingName + nameLen + strlen(LOCAL_BROKER_SHADOW_INFIX);
+	actionLen = topicLen - (size_t) (pAction - pTopic);
+	if(!(6 == actionLen && 0 == strncmp(pAction, "update", 6)) && !(3 == actionLen && 0 == strncmp(pAction, "get", 3))
+	   && !(6 == actionLen && 0 == strncmp(pAction, "delete", 6))) {
+		return;
+	}
+
+	tokenCount = -1;
+	if(LOCAL_BROKER_MAX_DOCUMENT_LEN >= payloadLen) {
+		memcpy(json, pPayload, payloadLen);
+		json[payloadLen] = '\0';
+		jsmn_init(&parser);
+		tokenCount = (int) jsmn_parse(&parser, json, payloadLen, tokens, LOCAL_BROKER_MAX_JSON_TOKENS);
+	}
+
+	pthread_mutex_lock(&pBroker->lock);
+
+	if(0 >= tokenCount || JSMN_OBJECT != tokens[0].type) {
+		pAck = "rejected";
+		responseLen = snprintf(response, sizeof(response), "{\"code\":400,\"message\":\"Bad Request\"}");
+	} else {
+		token = _local_broker_json_find(json, tokens, 0, "clientToken");
+		if(0 < token && JSMN_STRING == tokens[token].type
+		   && sizeof(clientToken) > (size_t) (tokens[token].end - tokens[token].start) + 18) {
+			snprintf(clientToken, sizeof(clientToken), ",\"clientToken\":\"%.*s\"",
+					 tokens[token].end - tokens[token].start, json + tokens[token].start);
+		}
+
+		pThing = _local_broker_find_thing(pBroker, pThingName, nameLen, 'u' == pAction[0]);
+		if('u' == pAction[0]) {
+			state = _local_broker_json_find(json, tokens, 0, "state");
+			stateLen = 0 < state ? (size_t) (tokens[state].end - tokens[state].start) : 0;
+			if(0 > state || JSMN_OBJECT != tokens[state].type) {
+				pAck = "rejected";
+				responseLen = snprintf(response, sizeof(response),
+									   "{\"code\":400,\"message\":\"Missing required node: state\"%s}", clientToken);
+			} else if(NULL == pThing || sizeof(pThing->state) <= stateLen) {
+				pAck = "rejected";
+				responseLen = snprintf(response, sizeof(response),
+									   "{\"code\":413,\"message\":\"Payload too large\"%s}", clientToken);
+			} else {
+				pThing->version++;
+				memcpy(pThing->state, json + tokens[state].start, stateLen);
+				pThing->state[stateLen] = '\0';
+				responseLen = snprintf(response, sizeof(response), "{\"state\":%s,\"version\":%u,\"timestamp\":%ld%s}",
+									   pThing->state, pThing->version, timestamp, clientToken);
+
+				desired = _local_broker_json_find(json, tokens, state, "desired");
+				if(0 < desired && JSMN_OBJECT == tokens[desired].type) {
+					deltaLen = snprintf(delta, sizeof(delta), "{\"version\":%u,\"timestamp\":%ld,\"state\":%.*s}",
+										pThing->version, timestamp, tokens[desired].end - tokens[desired].start,
+										json + tokens[desired].start);
+				}
+			}
+		} else if(NULL == pThing || '\0' == pThing->state[0]) {
+			pAck = "rejected";
+			responseLen = snprintf(response, sizeof(response),
+								   "{\"code\":404,\"message\":\"No shadow exists with name: '%.*s'\"%s}",
+								   (int) nameLen, pThingName, clientToken);
+		} else if('g' == pAction[0]) {
+			responseLen = snprintf(response, sizeof(response), "{\"state\":%s,\"version\":%u,\"timestamp\":%ld%s}",
+								   pThing->state, pThing->version, timestamp, clientToken);
+		} else {
+			pThing->version++;
+			pThing->state[0] = '\0';
+			responseLen = snprintf(response, sizeof(response), "{\"version\":%u,\"timestamp\":%ld%s}",
+								   pThing->version, timestamp, clientToken);
+		}
+	}
+
+	pBroker->stats.shadowResponseCount += 0 < deltaLen ? 2 : 1;
+	pthread_mutex_unlock(&pBroker->lock);
+
+	snprintf(responseTopic, sizeof(responseTopic), "%.*s/%s", (int) topicLen, pTopic, pAck);
+	_local_broker_route(pBroker, responseTopic, strlen(responseTopic), (const unsigned char *) response,
+						(size_t) responseLen, 1);
+	if(0 < deltaLen) {
+		snprintf(responseTopic, sizeof(responseTopic), "%.*s/delta", (int) topicLen, pTopic);
+		_local_broker_route(pBroker, responseTopic, strlen(responseTopic), (const unsigned char *) delta,
+							(size_t) deltaLen, 1);
+	}
+}
+
+static void _local_broker_handle_subscribe(LocalBrokerConnection *pConnection, const unsigned char *pData,
+										   size_t len) {
+	LocalBroker *pBroker = pConnection->pBroker;
+	LocalBrokerSubscription *pSubscription;
+	unsigned char suback[2 + LOCAL_BROKER_MAX_SUBSCRIPTIONS];
+	size_t pos = 2, count = 0, filterLen, itr;
+
+	suback[0] = pData[0];
+	suback[1] = pData[1];
+
+	pthread_mutex_lock(&pBroker->lock);
+	while(pos + 2 < len && count < LOCAL_BROKER_MAX_SUBSCRIPTIONS) {
+		filterLen = ((size_t) pData[pos] << 8) | pData[pos + 1];
+		pos += 2;
+		if(pos + filterLen >= len) {
+			break;
+		}
+
+		pSubscription = NULL;
+		for(itr = 0; itr < pConnection->subscriptionCount; itr++) {
+			if(filterLen == strlen(pConnection->subscriptions[itr].topicFilter)
+			   && 0 == strncmp(pConnection->subscriptions[itr].topicFilter, (const char *) pData + pos, filterLen)) {
+				pSubscription = &pConnection->subscriptions[itr];
+			}
+		}
+		if(NULL == pSubscription && LOCAL_BROKER_MAX_SUBSCRIPTIONS > pConnection->subscriptionCount
+		   && LOCAL_BROKER_MAX_TOPIC_LEN >= filterLen) {
+			pSubscription = &pConnection->subscriptions[pConnection->subscriptionCount++];
+			memcpy(pSubscription->topicFilter, pData + pos, filterLen);
+			pSubscription->topicFilter[filterLen] = '\0';
+		}
+
+		if(NULL == pSubscription) {
+			suback[2 + count] = MQTT_SUBACK_FAILURE;
+		} else {
+			/* QoS2 is not supported and granted as QoS1 */
+			pSubscription->qos = (uint8_t) (0 < pData[pos + filterLen] ? 1 : 0);
+			suback[2 + count] = pSubscription->qos;
+		}
+		pos += filterLen + 1;
+		count++;
+	}
+	pthread_mutex_unlock(&pBroker->lock);
+
+	_local_broker_write_packet(pConnection, 0x90, suback, 2 + count, NULL, 0);
+}
+
+static void _local_broker_handle_unsubscribe(LocalBrokerConnection *pConnection, const unsigned char *pData,
+											 size_t len) {
+	LocalBroker *pBroker = pConnection->pBroker;
+	size_t pos = 2, filterLen, itr;
+
+	pthread_mutex_lock(&pBroker->lock);
+	while(pos + 2 <= len) {
+		filterLen = ((size_t) pData[pos] << 8) | pData[pos + 1];
+		pos += 2;
+		if(pos + filterLen > len) {
+			break;
+		}
+		for(itr = 0; itr < pConnection->subscriptionCount; itr++) {
+			if(filterLen == strlen(pConnection->subscriptions[itr].topicFilter)
+			   && 0 == strncmp(pConnection->subscriptions[itr].topicFilter, (const char *) pData + pos, filterLen)) {
+				pConnection->subscriptions[itr] = pConnection->subscriptions[--pConnection->subscriptionCount];
+				break;
+			}
+		}
+		pos += filterLen;
+	}
+	pthread_mutex_unlock(&pBroker->lock);
+
+	_local_broker_write_packet(pConnection, 0xB0, pData, 2, NULL, 0);
+}
+
+static void _local_broker_handle_publish(LocalBrokerConnection *pConnection, unsigned char header,
+										 const unsigned char *pData, size_t len) {
+	LocalBroker *pBroker = pConnection->pBroker;
+	uint8_t qos = (uint8_t) ((header >> 1) & 0x03);
+	size_t topicLen, pos;
+	bool isDropped;
+
+	if(2 > len) {
+		return;
+	}
+	topicLen = ((size_t) pData[0] << 8) | pData[1];
+	pos = 2 + topicLen + (0 < qos ? 2 : 0);
+	if(pos > len) {
+		return;
+	}
+
+	pthread_mutex_lock(&pBroker->lock);
+	pBroker->stats.publishCount++;
+	isDropped = 0 < pBroker->params.lossPercent
+				&& (uint32_t) (rand_r(&pBroker->randState) % 100) < pBroker->params.lossPercent;
+	if(isDropped) {
+		pBroker->stats.droppedCount++;
+	}
+	pthread_mutex_unlock(&pBroker->lock);
+
+	if(isDropped) {
+		return;
+	}
+
+	if(0 < qos) {
+		_local_broker_write_packet(pConnection, MQTT_PUBACK << 4, pData + 2 + topicLen, 2, NULL, 0);
+	}
+
+	_local_broker_route(pBroker, (const char *) pData + 2, topicLen, pData + pos, len - pos, qos);
+	if(pBroker->params.isShadowEnabled) {
+		_local_broker_handle_shadow(pBroker, (const char *) pData + 2, topicLen, pData + pos, len - pos);
+	}
+}
+
+static void *_local_broker_connection_thread(void *pArg) {
+	LocalBrokerConnection *pConnection = (LocalBrokerConnection *) pArg;
+	LocalBroker *pBroker = pConnection->pBroker;
+	unsigned char connack[] = {0x00, 0x00};
+	struct timespec delay;
+	size_t len = 0, pos, remLen, hdrLen, mul;
+	unsigned char type;
+	ssize_t ret;
+	bool isRunning = true;
+
+	delay.tv_sec = pBroker->params.latencyMs / 1000;
+	delay.tv_nsec = (long) (pBroker->params.latencyMs % 1000) * 1000000L;
+
+	while(isRunning) {
+		ret = recv(pConnection->fd, pConnection->readBuf + len, sizeof(pConnection->readBuf) - len, 0);
+		if(0 > ret && EINTR == errno) {
+			continue;
+		}
+		if(0 >= ret) {
+			break;
+		}
+		len += (size_t) ret;
+
+		pos = 0;
+		while(isRunning && 2 <= len - pos) {
+			remLen = 0;
+			mul = 1;
+			hdrLen = 1;
+			do {
+				if(pos + hdrLen >= len) {
+					break;
+				}
+				remLen += (pConnection->readBuf[pos + hdrLen] & 127) * mul;
+				mul *= 128;
+			} while(0 != (pConnection->readBuf[pos + hdrLen++] & 128));
+			if(pos + hdrLen > len || 0 != (pConnection->readBuf[pos + hdrLen - 1] & 128)
+			   || pos + hdrLen + remLen > len) {
+				break;
+			}
+
+			if(0 < pBroker->params.latencyMs) {
+				nanosleep(&delay, NULL);
+			}
+
+			type = (unsigned char) (pConnection->readBuf[pos] >> 4);
+			if(MQTT_CONNECT == type) {
+				pthread_mutex_lock(&pBroker->lock);
+				pBroker->stats.connectCount++;
+				pthread_mutex_unlock(&pBroker->lock);
+				_local_broker_write_packet(pConnection, 0x20, connack, sizeof(connack), NULL, 0);
+			} else if(MQTT_PUBLISH == type) {
+				_local_broker_handle_publish(pConnection, pConnection->readBuf[pos],
+											 pConnection->readBuf + pos + hdrLen, remLen);
+			} else if(MQTT_SUBSCRIBE == type && 2 <= remLen) {
+				_local_broker_handle_subscribe(pConnection, pConnection->readBuf + pos + hdrLen, remLen);
+			} else if(MQTT_UNSUBSCRIBE == type && 2 <= remLen) {
+				_local_broker_handle_unsubscribe(pConnection, pConnection->readBuf + pos + hdrLen, remLen);
+			} else if(MQTT_PINGREQ == type) {
+				_local_broker_write_packet(pConnection, 0xD0, NULL, 0, NULL, 0);
+			} else if(MQTT_DISCONNECT == type) {
+				isRunning = false;
+			}
+			pos += hdrLen + remLen;
+
+			pConnection->packetCount++;
+			if(isRunning && 0 < pBroker->params.disconnectAfterPackets
+			   && pBroker->params.disconnectAfterPackets <= pConnection->packetCount) {
+				pthread_mutex_lock(&pBroker->lock);
+				pBroker->stats.disconnectCount++;
+				pthread_mutex_unlock(&pBroker->lock);
+				isRunning = false;
+			}
+		}
+		memmove(pConnection->readBuf, pConnection->readBuf + pos, len - pos);
+		len -= pos;
+
+		if(sizeof(pConnection->readBuf) == len) {
+			/* The packet does not fit in the buffer */
+			break;
+		}
+	}
+
+	shutdown(pConnection->fd, SHUT_RDWR);
+	pthread_mutex_lock(&pBroker->lock);
+	pConnection->isFinished = true;
+	pthread_mutex_unlock(&pBroker->lock);
+
+	return NULL;
+}
+
+/* Joins the threads of the connections that are done and frees their slots, called with the lock held */
+static void _local_broker_reap(LocalBroker *pBroker) {
+	LocalBrokerConnection *pConnection;
+	size_t itr;
+
+	for(itr = 0; itr < LOCAL_BROKER_MAX_CONNECTIONS; itr++) {
+		pConnection = &pBroker->connections[itr];
+		if(0 <= pConnection->fd && pConnection->isFinished) {
+			pthread_join(pConnection->thread, NULL);
+			close(pConnection->fd);
+			pthread_mutex_destroy(&pConnection->writeLock);
+			pConnection->fd = -1;
+		}
+	}
+}
+
+static IoT_Error_t _local_broker_serve(LocalBroker *pBroker, int fd) {
+	LocalBrokerConnection *pConnection = NULL;
+	size_t itr;
+
+	pthread_mutex_lock(&pBroker->lock);
+	_local_broker_reap(pBroker);
+	for(itr = 0; NULL == pConnection && itr < LOCAL_BROKER_MAX_CONNECTIONS; itr++) {
+		if(0 > pBroker->connections[itr].fd) {
+			pConnection = &pBroker->connections[itr];
+		}
+	}
+
+	if(pBroker->isStopping || NULL == pConnection) {
+		pthread_mutex_unlock(&pBroker->lock);
+		close(fd);
+		return NETWORK_ERR_NET_CONNECT_FAILED;
+	}
+
+	pConnection->pBroker = pBroker;
+	pConnection->fd = fd;
+	pConnection->isFinished = false;
+	pConnection->nextPacketId = 0;
+	pConnection->packetCount = 0;
+	pConnection->subscriptionCount = 0;
+	pthread_mutex_init(&pConnection->writeLock, NULL);
+	if(0 != pthread_create(&pConnection->thread, NULL, _local_broker_connection_thread, pConnection)) {
+		pthread_mutex_destroy(&pConnection->writeLock);
+		pConnection->fd = -1;
+		pthread_mutex_unlock(&pBroker->lock);
+		close(fd);
+		return THREAD_CREATE_ERROR;
+	}
+	pthread_mutex_unlock(&pBroker->lock);
+
+	return SUCCESS;
+}
+
+static IoT_Error_t _local_broker_memory_accept(int peerFd, void *pContext) {
+	return _local_broker_serve((LocalBroker *) pContext, peerFd);
+}
+
+static void *_local_broker_accept_thread(void *pArg) {
+	LocalBroker *pBroker = (LocalBroker *) pArg;
+	int fd, flag = 1;
+
+	for(;;) {
+		fd = accept(pBroker->listenFd, NULL, NULL);
+		if(0 > fd) {
+			if(EINTR == errno || ECONNABORTED == errno) {
+				continue;
+			}
+			/* The listening socket was shut down by local_broker_stop */
+			break;
+		}
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+		_local_broker_serve(pBroker, fd);
+	}
+
+	return NULL;
+}
+
+IoT_Error_t local_broker_start(LocalBroker *pBroker, const LocalBrokerParams *pParams) {
+	struct sockaddr_in addr;
+	size_t itr;
+	int flag = 1;
+	IoT_Error_t rc;
+
+	if(NULL == pBroker || NULL == pParams) {
+		return NULL_VALUE_ERROR;
+	}
+
+	memset(pBroker, 0, sizeof(LocalBroker));
+	pBroker->params = *pParams;
+	pBroker->randState = pParams->seed;
+	pBroker->listenFd = -1;
+	for(itr = 0; itr < LOCAL_BROKER_MAX_CONNECTIONS; itr++) {
+		pBroker->connections[itr].fd = -1;
+	}
+	pthread_mutex_init(&pBroker->lock, NULL);
+
+	if(0 != pParams->port) {
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(pParams->port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		pBroker->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+		if(0 > pBroker->listenFd
+		   || 0 != setsockopt(pBroker->listenFd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag))
+		   || 0 != bind(pBroker->listenFd, (struct sockaddr *) &addr, sizeof(addr))
+		   || 0 != listen(pBroker->listenFd, LOCAL_BROKER_MAX_CONNECTIONS)
+		   || 0 != pthread_create(&pBroker->acceptThread, NULL, _local_broker_accept_thread, pBroker)) {
+			if(0 <= pBroker->listenFd) {
+				close(pBroker->listenFd);
+			}
+			pthread_mutex_destroy(&pBroker->lock);
+			return TCP_SETUP_ERROR;
+		}
+	}
+
+	if(NULL != pParams->pMemoryName) {
+		rc = iot_memory_listen(pParams->pMemoryName, _local_broker_memory_accept, pBroker);
+		if(SUCCESS != rc) {
+			pBroker->params.pMemoryName = NULL;
+			local_broker_stop(pBroker);
+			return rc;
+		}
+	}
+
+	return SUCCESS;
+}
+
+void local_broker_disconnect_all(LocalBroker *pBroker) {
+	size_t itr;
+
+	pthread_mutex_lock(&pBroker->lock);
+	for(itr = 0; itr < LOCAL_BROKER_MAX_CONNECTIONS; itr++) {
+		if(0 <= pBroker->connections[itr].fd && !pBroker->connections[itr].isFinished) {
+			/* Wakes the connection thread, which frees the slot */
+			shutdown(pBroker->connections[itr].fd, SHUT_RDWR);
+			pBroker->stats.disconnectCount++;
+		}
+	}
+	pthread_mutex_unlock(&pBroker->lock);
+}
+
+void local_broker_get_stats(LocalBroker *pBroker, LocalBrokerStats *pStats, bool isReset) {
+	pthread_mutex_lock(&pBroker->lock);
+	*pStats = pBroker->stats;
+	if(isReset) {
+		memset(&pBroker->stats, 0, sizeof(LocalBrokerStats));
+	}
+	pthread_mutex_unlock(&pBroker->lock);
+}
+
+void local_broker_stop(LocalBroker *pBroker) {
+	LocalBrokerConnection *pConnection;
+	size_t itr;
+
+	if(NULL != pBroker->params.pMemoryName) {
+		iot_memory_unlisten(pBroker->params.pMemoryName);
+	}
+	if(0 <= pBroker->listenFd) {
+		shutdown(pBroker->listenFd, SHUT_RDWR);
+		pthread_join(pBroker->acceptThread, NULL);
+		close(pBroker->listenFd);
+		pBroker->listenFd = -1;
+	}
+
+	pthread_mutex_lock(&pBroker->lock);
+	pBroker->isStopping = true;
+	for(itr = 0; itr < LOCAL_BROKER_MAX_CONNECTIONS; itr++) {
+		if(0 <= pBroker->connections[itr].fd) {
+			shutdown(pBroker->connections[itr].fd, SHUT_RDWR);
+		}
+	}
+	pthread_mutex_unlock(&pBroker->lock);
+
+	/* The connection threads take the lock once more before they return */
+	for(itr = 0; itr < LOCAL_BROKER_MAX_CONNECTIONS; itr++) {
+		pConnection = &pBroker->connections[itr];
+		if(0 <= pConnection->fd) {
+			pthread_join(pConnection->thread, NULL);
+			close(pConnection->fd);
+			pthread_mutex_destroy(&pConnection->writeLock);
+			pConnection->fd = -1;
+		}
+	}
+	pthread_mutex_destroy(&pBroker->lock);
+}
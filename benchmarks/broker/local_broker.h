@@ -0,0 +1,173 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file local_broker.h
+ * @brief Local stand-in for the AWS IoT MQTT broker
+ *
+ * A small MQTT 3.1.1 broker that runs on threads of the process it is started in, so the client
+ * and the Thing Shadow can be exercised and measured on a machine without access to AWS IoT.
+ * It is reached over the "tcp" transport on a localhost port, over the "memory" transport under
+ * a name, or both.
+ *
+ * It speaks the subset of MQTT the SDK uses: CONNECT, SUBSCRIBE, UNSUBSCRIBE, PUBLISH at QoS0
+ * and QoS1, PINGREQ and DISCONNECT. Publishes are routed to every connection subscribed to a
+ * matching filter, including the sender. Sessions are not kept across connections, nothing is
+ * retained and QoS1 publishes to subscribers are not retried.
+ *
+ * Updates, gets and deletes on the Thing Shadow topics are answered like AWS IoT does: the
+ * accepted topics echo the document with a version and a timestamp, and the desired state of
+ * an update is published on the delta topic. The broker keeps the state of the last update
+ * of each thing, it does not merge updates.
+ *
+ * Latency, loss and disconnects can be injected to measure the client under bad networks.
+ */
+
+#ifndef BENCHMARKS_LOCAL_BROKER_H_
+#define BENCHMARKS_LOCAL_BROKER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "aws_iot_error.h"
+
+#define LOCAL_BROKER_MAX_CONNECTIONS 16		///< Connections served at once, more are closed when accepted
+#define LOCAL_BROKER_MAX_SUBSCRIPTIONS 16	///< Topic filters per connection, more are refused in the SUBACK
+#define LOCAL_BROKER_MAX_TOPIC_LEN 128		///< Longest topic filter kept for a subscription
+#define LOCAL_BROKER_MAX_THINGS 8			///< Thing Shadows the broker keeps a state for
+#define LOCAL_BROKER_MAX_THING_NAME_LEN 64
+#define LOCAL_BROKER_MAX_DOCUMENT_LEN 2048	///< Longest shadow state kept and longest shadow response sent
+#define LOCAL_BROKER_BUF_LEN 8192			///< Largest packet a connection reads or writes
+
+/**
+ * @brief Local Broker Parameters
+ */
+typedef struct {
+	uint16_t port;				///< Localhost port to listen on for the "tcp" transport, 0 for none
+	const char *pMemoryName;	///< Name to listen under for the "memory" transport, kept by reference, NULL for none
+	uint32_t latencyMs;			///< Delay before each packet received from a client is handled
+	uint32_t lossPercent;		///< Share of the publishes from clients dropped without a PUBACK or delivery
+	uint32_t disconnectAfterPackets;	///< Close each connection after it sent this many packets, 0 to never
+	bool isShadowEnabled;		///< Answer the Thing Shadow topics
+	unsigned int seed;			///< Seed of the loss injection, the same seed drops the same publishes
+} LocalBrokerParams;
+
+/**
+ * @brief Local Broker Statistics
+ */
+typedef struct {
+	uint32_t connectCount;			///< CONNECT packets accepted
+	uint32_t publishCount;			///< PUBLISH packets received from clients, dropped ones included
+	uint32_t droppedCount;			///< PUBLISH packets dropped by the loss injection
+	uint32_t deliveryCount;			///< PUBLISH packets sent to subscribers
+	uint32_t shadowResponseCount;	///< PUBLISH packets sent on the Thing Shadow response topics
+	uint32_t disconnectCount;		///< Connections closed by the disconnect injection or local_broker_disconnect_all
+} LocalBrokerStats;
+
+/**
+ * @brief Subscription of a connection
+ */
+typedef struct {
+	char topicFilter[LOCAL_BROKER_MAX_TOPIC_LEN + 1];
+	uint8_t qos;
+} LocalBrokerSubscription;
+
+struct LocalBroker;
+
+/**
+ * @brief Connection served by the broker
+ */
+typedef struct {
+	struct LocalBroker *pBroker;
+	int fd;							///< Socket of the connection, -1 if the slot is free
+	pthread_t thread;				///< Reads and handles the packets of the connection
+	bool isFinished;				///< The thread has returned and can be joined
+	pthread_mutex_t writeLock;		///< Keeps packets routed from other connections whole
+	uint16_t nextPacketId;
+	uint32_t packetCount;			///< Packets received on the connection
+	LocalBrokerSubscription subscriptions[LOCAL_BROKER_MAX_SUBSCRIPTIONS];
+	size_t subscriptionCount;
+	unsigned char readBuf[LOCAL_BROKER_BUF_LEN];
+	unsigned char writeBuf[LOCAL_BROKER_BUF_LEN];
+} LocalBrokerConnection;
+
+/**
+ * @brief Thing Shadow kept by the broker
+ */
+typedef struct {
+	char thingName[LOCAL_BROKER_MAX_THING_NAME_LEN + 1];	///< Empty if the slot is free
+	uint32_t version;
+	char state[LOCAL_BROKER_MAX_DOCUMENT_LEN];		///< State object of the last update, empty if none
+} LocalBrokerThing;
+
+/**
+ * @brief Local Broker
+ */
+typedef struct LocalBroker {
+	LocalBrokerParams params;
+	int listenFd;					///< Listening socket of the "tcp" transport, -1 if none
+	pthread_t acceptThread;
+	pthread_mutex_t lock;			///< Protects the connections, their subscriptions, the things and the statistics
+	LocalBrokerConnection connections[LOCAL_BROKER_MAX_CONNECTIONS];
+	LocalBrokerThing things[LOCAL_BROKER_MAX_THINGS];
+	LocalBrokerStats stats;
+	unsigned int randState;
+	bool isStopping;
+} LocalBroker;
+
+/**
+ * @brief Start a broker
+ *
+ * Listens on the port and under the memory name of the parameters and serves every
+ * connection on its own thread until the broker is stopped.
+ *
+ * @param pBroker - Broker to start, stays in use until local_broker_stop
+ * @param pParams - Parameters of the broker, copied
+ * @return IoT_Error_t - SUCCESS, TCP_SETUP_ERROR if the port cannot be listened on, or the
+ *                       error of iot_memory_listen
+ */
+IoT_Error_t local_broker_start(LocalBroker *pBroker, const LocalBrokerParams *pParams);
+
+/**
+ * @brief Close every connection of the broker
+ *
+ * Clients see the connection dropped by the network, as they would on a broker restart.
+ * New connections are accepted again right away.
+ *
+ * @param pBroker - Broker started with local_broker_start
+ */
+void local_broker_disconnect_all(LocalBroker *pBroker);
+
+/**
+ * @brief Read the statistics of a broker
+ *
+ * @param pBroker - Broker started with local_broker_start
+ * @param pStats - Set to the counts since the start or the last reset
+ * @param isReset - Set the counts back to 0
+ */
+void local_broker_get_stats(LocalBroker *pBroker, LocalBrokerStats *pStats, bool isReset);
+
+/**
+ * @brief Stop a broker
+ *
+ * Stops listening, closes every connection and waits for the threads of the broker.
+ *
+ * @param pBroker - Broker started with local_broker_start
+ */
+void local_broker_stop(LocalBroker *pBroker);
+
+#endif /* BENCHMARKS_LOCAL_BROKER_H_ */
@@ -0,0 +1,395 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file local_broker_benchmark.c
+ * @brief Measures connect, reconnect, publish and Thing Shadow round trips against the local broker
+ *
+ * Starts the broker of benchmarks/broker on localhost with the injected latency and loss, and runs
+ * over the "tcp" transport:
+ *  - connect:   a connect and disconnect of a new client, repeated
+ *  - detect:    the broker drops the connection and the client notices it in a yield, from the
+ *               closed socket, or else through the keep alive of BENCHMARK_RECONNECT_KEEP_ALIVE_SEC
+ *  - reconnect: the client connects and subscribes again after it noticed the drop
+ *  - qos0:      the messages at QoS0, and a QoS1 publish whose PUBACK stops the clock
+ *  - qos1:      the messages one by one at QoS1, a dropped publish times out after BENCHMARK_TIMEOUT_MS
+ *  - shadow:    Thing Shadow updates, each waited on until it is accepted
+ *
+ * No AWS IoT endpoint or certificate is needed, so the numbers are reproducible on any Linux machine.
+ *
+ * Usage: local_broker_benchmark [message count] [port] [latency ms] [loss percent]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_client_interface.h"
+#include "aws_iot_shadow_interface.h"
+#include "local_broker.h"
+
+#define BENCHMARK_DEFAULT_MESSAGES 1000
+#define BENCHMARK_DEFAULT_PORT 18899
+#define BENCHMARK_CONNECTS 50
+#define BENCHMARK_RECONNECTS 5
+#define BENCHMARK_RECONNECT_KEEP_ALIVE_SEC 2
+#define BENCHMARK_SHADOW_UPDATES 100
+#define BENCHMARK_SHADOW_TIMEOUT_SEC 1
+#define BENCHMARK_TIMEOUT_MS 500
+#define BENCHMARK_TOPIC "sensors/benchmark"
+#define BENCHMARK_THING_NAME "benchmarkThing"
+#define BENCHMARK_SEED 1
+
+typedef struct {
+	size_t count;
+	double p50Ms;
+	double p99Ms;
+	double maxMs;
+} LatencySummary;
+
+typedef struct {
+	Shadow_Ack_Status_t status;
+	bool isDone;
+} ShadowAck;
+
+static double now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+}
+
+static int compare_double(const void *pA, const void *pB) {
+	double a = *(const double *) pA, b = *(const double *) pB;
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static void summarize(double *pSamples, size_t count, LatencySummary *pSummary) {
+	memset(pSummary, 0, sizeof(LatencySummary));
+	pSummary->count = count;
+	if(0 < count) {
+		qsort(pSamples, count, sizeof(double), compare_double);
+		pSummary->p50Ms = pSamples[count / 2];
+		pSummary->p99Ms = pSamples[count * 99 / 100];
+		pSummary->maxMs = pSamples[count - 1];
+	}
+}
+
+static void print_summary(const char *pName, const LatencySummary *pSummary, size_t attempts) {
+	printf("%-10s %8zu/%-8zu %10.2f %10.2f %10.2f\n", pName, pSummary->count, attempts, pSummary->p50Ms,
+		   pSummary->p99Ms, pSummary->maxMs);
+}
+
+static void message_handler(AWS_IoT_Client *pClient, char *pTopicName, uint16_t topicNameLen,
+							IoT_Publish_Message_Params *pParams, void *pData) {
+	IOT_UNUSED(pClient);
+	IOT_UNUSED(pTopicName);
+	IOT_UNUSED(topicNameLen);
+	IOT_UNUSED(pParams);
+	IOT_UNUSED(pData);
+}
+
+static void shadow_update_handler(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+								  const char *pReceivedJsonDocument, void *pContextData) {
+	ShadowAck *pAck = (ShadowAck *) pContextData;
+
+	IOT_UNUSED(pThingName);
+	IOT_UNUSED(action);
+	IOT_UNUSED(pReceivedJsonDocument);
+
+	pAck->status = status;
+	pAck->isDone = true;
+}
+
+static IoT_Error_t client_init(AWS_IoT_Client *pClient, uint16_t port) {
+	IoT_Client_Init_Params initParams = iotClientInitParamsDefault;
+
+	initParams.enableAutoReconnect = false;
+	initParams.pTransportName = "tcp";
+	initParams.pHostURL = "127.0.0.1";
+	initParams.port = port;
+	initParams.mqttCommandTimeout_ms = BENCHMARK_TIMEOUT_MS;
+
+	return aws_iot_mqtt_init(pClient, &initParams);
+}
+
+static IoT_Error_t client_connect(AWS_IoT_Client *pClient) {
+	IoT_Client_Connect_Params connectParams = iotClientConnectParamsDefault;
+
+	connectParams.keepAliveIntervalInSec = 60;
+	connectParams.pClientID = "benchmark";
+	connectParams.clientIDLen = (uint16_t) strlen(connectParams.pClientID);
+
+	return aws_iot_mqtt_connect(pClient, &connectParams);
+}
+
+static void run_connect(uint16_t port, double *pSamples) {
+	AWS_IoT_Client client;
+	LatencySummary summary;
+	size_t itr, count = 0;
+	double start;
+
+	for(itr = 0; itr < BENCHMARK_CONNECTS && SUCCESS == client_init(&client, port); itr++) {
+		start = now_ms();
+		if(SUCCESS == client_connect(&client)) {
+			pSamples[count++] = now_ms() - start;
+			aws_iot_mqtt_disconnect(&client);
+		}
+		aws_iot_mqtt_free(&client);
+	}
+
+	summarize(pSamples, count, &summary);
+	print_summary("connect", &summary, BENCHMARK_CONNECTS);
+}
+
+static void run_reconnect(LocalBroker *pBroker, uint16_t port, double *pSamples) {
+	AWS_IoT_Client client;
+	IoT_Client_Connect_Params connectParams = iotClientConnectParamsDefault;
+	LatencySummary summary;
+	double detectSamples[BENCHMARK_RECONNECTS];
+	size_t itr, count = 0, detectCount = 0;
+	double start;
+	IoT_Error_t rc;
+
+	/* The client notices the drop when a PINGREQ goes unanswered */
+	connectParams.keepAliveIntervalInSec = BENCHMARK_RECONNECT_KEEP_ALIVE_SEC;
+	connectParams.pClientID = "benchmark";
+	connectParams.clientIDLen = (uint16_t) strlen(connectParams.pClientID);
+
+	rc = client_init(&client, port);
+	if(SUCCESS != rc) {
+		return;
+	}
+	rc = aws_iot_mqtt_connect(&client, &connectParams);
+	if(SUCCESS == rc) {
+		rc = aws_iot_mqtt_subscribe(&client, BENCHMARK_TOPIC, (uint16_t) strlen(BENCHMARK_TOPIC), QOS1,
+									message_handler, NULL);
+	}
+
+	for(itr = 0; SUCCESS == rc && itr < BENCHMARK_RECONNECTS; itr++) {
+		start = now_ms();
+		local_broker_disconnect_all(pBroker);
+		do {
+			rc = aws_iot_mqtt_yield(&client, 10);
+		} while(SUCCESS == rc && now_ms() - start < 4000.0 * BENCHMARK_RECONNECT_KEEP_ALIVE_SEC);
+		if(SUCCESS == rc) {
+			break;
+		}
+		detectSamples[detectCount++] = now_ms() - start;
+
+		start = now_ms();
+		do {
+			rc = aws_iot_mqtt_attempt_reconnect(&client);
+		} while(NETWORK_RECONNECTED != rc && now_ms() - start < BENCHMARK_TIMEOUT_MS);
+		if(NETWORK_RECONNECTED == rc) {
+			pSamples[count++] = now_ms() - start;
+			rc = SUCCESS;
+		}
+	}
+
+	aws_iot_mqtt_disconnect(&client);
+	aws_iot_mqtt_free(&client);
+
+	summarize(detectSamples, detectCount, &summary);
+	print_summary("detect", &summary, BENCHMARK_RECONNECTS);
+	summarize(pSamples, count, &summary);
+	print_summary("reconnect", &summary, BENCHMARK_RECONNECTS);
+}
+
+static void run_publish(uint16_t port, size_t messageCount, double *pSamples) {
+	AWS_IoT_Client client;
+	IoT_Publish_Message_Params params;
+	LatencySummary summary;
+	char payload[] = "{\"temperature\":21.5,\"humidity\":40}";
+	size_t itr, count = 0;
+	double start;
+	IoT_Error_t rc;
+
+	params.qos = QOS0;
+	params.isRetained = 0;
+	params.payload = payload;
+	params.payloadLen = strlen(payload);
+
+	rc = client_init(&client, port);
+	if(SUCCESS != rc) {
+		return;
+	}
+	rc = client_connect(&client);
+
+	start = now_ms();
+	for(itr = 0; SUCCESS == rc && itr < messageCount; itr++) {
+		rc = aws_iot_mqtt_publish(&client, BENCHMARK_TOPIC, (uint16_t) strlen(BENCHMARK_TOPIC), &params);
+	}
+	/* Retried until one gets through the loss, its PUBACK arrives after the broker has read every message */
+	params.qos = QOS1;
+	while(SUCCESS == rc) {
+		rc = aws_iot_mqtt_publish(&client, BENCHMARK_TOPIC, (uint16_t) strlen(BENCHMARK_TOPIC), &params);
+		if(MQTT_REQUEST_TIMEOUT_ERROR != rc) {
+			break;
+		}
+		rc = SUCCESS;
+	}
+	if(SUCCESS == rc) {
+		printf("%-10s %8zu msgs %12.0f msgs/sec\n", "qos0", messageCount,
+			   (double) messageCount * 1000.0 / (now_ms() - start));
+	} else {
+		printf("%-10s failed: %d\n", "qos0", rc);
+	}
+
+	for(itr = 0; SUCCESS == rc && itr < messageCount; itr++) {
+		start = now_ms();
+		rc = aws_iot_mqtt_publish(&client, BENCHMARK_TOPIC, (uint16_t) strlen(BENCHMARK_TOPIC), &params);
+		if(SUCCESS == rc) {
+			pSamples[count++] = now_ms() - start;
+		} else if(MQTT_REQUEST_TIMEOUT_ERROR == rc) {
+			rc = SUCCESS;
+		}
+	}
+
+	aws_iot_mqtt_disconnect(&client);
+	aws_iot_mqtt_free(&client);
+
+	summarize(pSamples, count, &summary);
+	print_summary("qos1", &summary, messageCount);
+}
+
+static void run_shadow(uint16_t port, double *pSamples) {
+	AWS_IoT_Client client;
+	ShadowInitParameters_t initParams = ShadowInitParametersDefault;
+	ShadowConnectParameters_t connectParams = ShadowConnectParametersDefault;
+	ShadowAck ack;
+	LatencySummary summary;
+	char document[256];
+	int32_t temperature = 0;
+	jsonStruct_t temperatureHandler;
+	size_t itr, count = 0;
+	double start;
+	IoT_Error_t rc;
+
+	initParams.pHost = "127.0.0.1";
+	initParams.port = port;
+	initParams.pTransportName = "tcp";
+	connectParams.pMyThingName = BENCHMARK_THING_NAME;
+	connectParams.pMqttClientId = "benchmark";
+	connectParams.mqttClientIdLen = (uint16_t) strlen(connectParams.pMqttClientId);
+
+	temperatureHandler.pKey = "temperature";
+	temperatureHandler.pData = &temperature;
+	temperatureHandler.type = SHADOW_JSON_INT32;
+	temperatureHandler.cb = NULL;
+
+	rc = aws_iot_shadow_init(&client, &initParams);
+	if(SUCCESS != rc) {
+		return;
+	}
+	rc = aws_iot_shadow_connect(&client, &connectParams);
+
+	/* The first update subscribes to the acks and waits for the subscription to settle, it is not counted */
+	for(itr = 0; SUCCESS == rc && itr <= BENCHMARK_SHADOW_UPDATES; itr++) {
+		temperature = (int32_t) itr;
+		rc = aws_iot_shadow_init_json_document(document, sizeof(document));
+		if(SUCCESS == rc) {
+			rc = aws_iot_shadow_add_reported(document, sizeof(document), 1, &temperatureHandler);
+		}
+		if(SUCCESS == rc) {
+			rc = aws_iot_finalize_json_document(document, sizeof(document));
+		}
+
+		ack.status = SHADOW_ACK_TIMEOUT;
+		ack.isDone = false;
+		start = now_ms();
+		if(SUCCESS == rc) {
+			rc = aws_iot_shadow_update(&client, BENCHMARK_THING_NAME, document, shadow_update_handler, &ack,
+									   BENCHMARK_SHADOW_TIMEOUT_SEC, true);
+		}
+		/* A dropped update is answered by the timeout of its ack */
+		while(SUCCESS == rc && !ack.isDone) {
+			rc = aws_iot_shadow_yield(&client, 1);
+		}
+		if(0 < itr && SHADOW_ACK_ACCEPTED == ack.status) {
+			pSamples[count++] = now_ms() - start;
+		}
+	}
+
+	aws_iot_shadow_disconnect(&client);
+	aws_iot_mqtt_free(&client);
+
+	summarize(pSamples, count, &summary);
+	print_summary("shadow", &summary, BENCHMARK_SHADOW_UPDATES);
+}
+
+int main(int argc, char **argv) {
+	LocalBrokerParams brokerParams;
+	LocalBroker *pBroker;
+	LocalBrokerStats stats;
+	size_t messageCount = BENCHMARK_DEFAULT_MESSAGES;
+	uint16_t port = BENCHMARK_DEFAULT_PORT;
+	double *pSamples;
+	IoT_Error_t rc;
+
+	memset(&brokerParams, 0, sizeof(brokerParams));
+	brokerParams.isShadowEnabled = true;
+	brokerParams.seed = BENCHMARK_SEED;
+
+	if(1 < argc) {
+		messageCount = (size_t) strtoul(argv[1], NULL, 10);
+	}
+	if(2 < argc) {
+		port = (uint16_t) atoi(argv[2]);
+	}
+	if(3 < argc) {
+		brokerParams.latencyMs = (uint32_t) strtoul(argv[3], NULL, 10);
+	}
+	if(4 < argc) {
+		brokerParams.lossPercent = (uint32_t) strtoul(argv[4], NULL, 10);
+	}
+	brokerParams.port = port;
+
+	pBroker = (LocalBroker *) malloc(sizeof(LocalBroker));
+	pSamples = (double *) malloc((messageCount + BENCHMARK_CONNECTS + BENCHMARK_SHADOW_UPDATES) * sizeof(double));
+	if(NULL == pBroker || NULL == pSamples) {
+		printf("benchmark setup failed\n");
+		return -1;
+	}
+
+	rc = local_broker_start(pBroker, &brokerParams);
+	if(SUCCESS != rc) {
+		printf("broker start failed: %d\n", rc);
+		return -1;
+	}
+
+	printf("local broker on port %u, latency %u ms, loss %u%%\n\n", (unsigned) port,
+		   (unsigned) brokerParams.latencyMs, (unsigned) brokerParams.lossPercent);
+	printf("%-10s %17s %10s %10s %10s\n", "run", "ok/attempts", "p50 ms", "p99 ms", "max ms");
+
+	run_connect(port, pSamples);
+	run_reconnect(pBroker, port, pSamples);
+	run_publish(port, messageCount, pSamples);
+	run_shadow(port, pSamples);
+
+	local_broker_get_stats(pBroker, &stats, false);
+	printf("\nbroker: %u connects, %u publishes, %u dropped, %u delivered, %u shadow responses, %u disconnects\n",
+		   stats.connectCount, stats.publishCount, stats.droppedCount, stats.deliveryCount,
+		   stats.shadowResponseCount, stats.disconnectCount);
+
+	local_broker_stop(pBroker);
+	free(pBroker);
+	free(pSamples);
+
+	return 0;
+}
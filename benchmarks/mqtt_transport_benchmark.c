@@ -0,0 +1,392 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file mqtt_transport_benchmark.c
+ * @brief Compares the MQTT client over the memory, TCP and TLS transports
+ *
+ * A minimal MQTT broker runs on a thread of this process. It is reached in three ways:
+ *  - memory: a pipe in the process, through iot_memory_listen
+ *  - tcp:    plain TCP on localhost
+ *  - tls:    TLS on localhost with the mbedTLS test certificates
+ *
+ * For each payload size the client publishes the messages at QoS0 and a QoS1 publish whose PUBACK stops the
+ * clock, then publishes the same number of messages one by one at QoS1 and records the time each took until
+ * its PUBACK. The memory transport shows what the MQTT client itself costs, the gap to tcp what the kernel
+ * network stack costs and the gap to tls what the encryption costs.
+ *
+ * The payloads above 512 bytes are written as more than one buffer, and the largest as more than one TLS
+ * record. A run fails when its median QoS1 latency shows that a write was held back by the socket.
+ *
+ * Usage: mqtt_transport_benchmark [message count] [port]
+ * The TCP broker listens on the port and the TLS broker on the port after it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "mbedtls/net.h"
+#include "mbedtls/ssl.h"
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_client_interface.h"
+#include "tls_test_server.h"
+
+#define BENCHMARK_DEFAULT_MESSAGES 5000
+#define BENCHMARK_DEFAULT_PORT 18897
+#define BENCHMARK_BUF_LEN 16384
+#define BENCHMARK_MAX_PAYLOAD_LEN 8192
+/* A QoS1 publish on loopback answered in more than this waited on Nagle and the delayed ACK of the peer */
+#define BENCHMARK_MAX_QOS1_P50_US 10000.0
+#define BENCHMARK_TOPIC "sensors/benchmark"
+#define BENCHMARK_MEMORY_NAME "benchmark-broker"
+
+typedef enum {
+	TRANSPORT_MEMORY = 0,
+	TRANSPORT_TCP = 1,
+	TRANSPORT_TLS = 2
+} BenchmarkTransport;
+
+static const char *transportNames[] = {"memory", "tcp", "tls"};
+
+typedef struct {
+	mbedtls_net_context tcpListenFd;
+	TlsTestServer tls;
+	BenchmarkTransport transport;
+	mbedtls_net_context fd;		///< Socket of the connection being served
+	pthread_t thread;
+	int isThreadStarted;
+	size_t publishCount;
+} Broker;
+
+typedef struct {
+	double msgsPerSec;
+	double cpuUsPerMsg;
+	double p50Us;
+	double p99Us;
+} BenchmarkResult;
+
+static TlsTestCredentials credentials;
+
+static double now_us(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (double) ts.tv_sec * 1000000.0 + (double) ts.tv_nsec / 1000.0;
+}
+
+static int compare_double(const void *pA, const void *pB) {
+	double a = *(const double *) pA, b = *(const double *) pB;
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+/* The plain transports are read and written on the socket, TLS through the SSL context */
+static int broker_recv(mbedtls_ssl_context *pSsl, mbedtls_net_context *pFd, unsigned char *buf, size_t len) {
+	int ret;
+
+	if(NULL != pSsl) {
+		return mbedtls_ssl_read(pSsl, buf, len);
+	}
+	do {
+		ret = (int) recv(pFd->fd, buf, len, 0);
+	} while(0 > ret && EINTR == errno);
+	return ret;
+}
+
+static void broker_send(mbedtls_ssl_context *pSsl, mbedtls_net_context *pFd, const unsigned char *buf, size_t len) {
+	if(NULL != pSsl) {
+		mbedtls_ssl_write(pSsl, buf, len);
+	} else {
+		send(pFd->fd, buf, len, MSG_NOSIGNAL);
+	}
+}
+
+/* Answers CONNECT, QoS1 PUBLISH and PINGREQ until the client sends DISCONNECT or closes the connection */
+static void *broker_thread(void *pArg) {
+	Broker *pBroker = (Broker *) pArg;
+	mbedtls_ssl_context ssl;
+	mbedtls_ssl_context *pSsl = NULL;
+	static unsigned char buf[1 << 16];
+	size_t len = 0, pos, remLen, hdrLen, mul;
+	unsigned char connack[] = {0x20, 0x02, 0x00, 0x00};
+	unsigned char puback[] = {0x40, 0x02, 0x00, 0x00};
+	unsigned char pingresp[] = {0xD0, 0x00};
+	unsigned char type;
+	size_t topicLen;
+	int ret, isRunning = 1;
+
+	mbedtls_ssl_init(&ssl);
+
+	if(TRANSPORT_TCP == pBroker->transport) {
+		if(0 != mbedtls_net_accept(&pBroker->tcpListenFd, &pBroker->fd, NULL, 0, NULL)) {
+			isRunning = 0;
+		}
+	} else if(TRANSPORT_TLS == pBroker->transport) {
+		if(0 != tls_test_server_accept(&pBroker->tls, &pBroker->fd, -1, NULL)
+		   || 0 != mbedtls_ssl_setup(&ssl, &pBroker->tls.conf)) {
+			isRunning = 0;
+		}
+		mbedtls_ssl_set_bio(&ssl, &pBroker->fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+		pSsl = &ssl;
+	}
+
+	while(isRunning) {
+		ret = broker_recv(pSsl, &pBroker->fd, buf + len, sizeof(buf) - len);
+		if(MBEDTLS_ERR_SSL_WANT_READ == ret || MBEDTLS_ERR_SSL_WANT_WRITE == ret) {
+			continue;
+		}
+		if(0 >= ret) {
+			break;
+		}
+		len += (size_t) ret;
+
+		pos = 0;
+		while(isRunning && 2 <= len - pos) {
+			remLen = 0;
+			mul = 1;
+			hdrLen = 1;
+			do {
+				if(pos + hdrLen >= len) {
+					break;
+				}
+				remLen += (buf[pos + hdrLen] & 127) * mul;
+				mul *= 128;
+			} while(0 != (buf[pos + hdrLen++] & 128));
+			if(pos + hdrLen > len || 0 != (buf[pos + hdrLen - 1] & 128) || pos + hdrLen + remLen > len) {
+				break;
+			}
+
+			type = (unsigned char) (buf[pos] >> 4);
+			if(1 == type) {
+				broker_send(pSsl, &pBroker->fd, connack, sizeof(connack));
+			} else if(3 == type) {
+				pBroker->publishCount++;
+				if(0 != (buf[pos] & 0x06)) {
+					topicLen = ((size_t) buf[pos + hdrLen] << 8) | buf[pos + hdrLen + 1];
+					puback[2] = buf[pos + hdrLen + 2 + topicLen];
+					puback[3] = buf[pos + hdrLen + 3 + topicLen];
+					broker_send(pSsl, &pBroker->fd, puback, sizeof(puback));
+				}
+			} else if(12 == type) {
+				broker_send(pSsl, &pBroker->fd, pingresp, sizeof(pingresp));
+			} else if(14 == type) {
+				isRunning = 0;
+			}
+			pos += hdrLen + remLen;
+		}
+		memmove(buf, buf + pos, len - pos);
+		len -= pos;
+	}
+
+	if(NULL != pSsl) {
+		mbedtls_ssl_close_notify(pSsl);
+	}
+	mbedtls_net_free(&pBroker->fd);
+	mbedtls_ssl_free(&ssl);
+	return NULL;
+}
+
+/* Called on the connecting thread by the memory transport with the broker end of the pipe */
+static IoT_Error_t broker_memory_accept(int peerFd, void *pContext) {
+	Broker *pBroker = (Broker *) pContext;
+
+	pBroker->fd.fd = peerFd;
+	if(0 != pthread_create(&pBroker->thread, NULL, broker_thread, pBroker)) {
+		close(peerFd);
+		return FAILURE;
+	}
+	pBroker->isThreadStarted = 1;
+
+	return SUCCESS;
+}
+
+static int broker_init(Broker *pBroker, uint16_t port) {
+	char portStr[8];
+
+	mbedtls_net_init(&pBroker->tcpListenFd);
+	mbedtls_net_init(&pBroker->fd);
+
+	if(0 != tls_test_server_init(&pBroker->tls, "mqtt_transport_benchmark")
+	   || 0 != tls_test_server_configure(&pBroker->tls, TLS_TEST_KEY_RSA)) {
+		return -1;
+	}
+
+	snprintf(portStr, sizeof(portStr), "%u", (unsigned) port);
+	if(0 != mbedtls_net_bind(&pBroker->tcpListenFd, "127.0.0.1", portStr, MBEDTLS_NET_PROTO_TCP)) {
+		return -1;
+	}
+	snprintf(portStr, sizeof(portStr), "%u", (unsigned) (port + 1));
+	if(0 != tls_test_server_listen(&pBroker->tls, portStr, false)) {
+		return -1;
+	}
+
+	return SUCCESS == iot_memory_listen(BENCHMARK_MEMORY_NAME, broker_memory_accept, pBroker) ? 0 : -1;
+}
+
+static void broker_free(Broker *pBroker) {
+	iot_memory_unlisten(BENCHMARK_MEMORY_NAME);
+	mbedtls_net_free(&pBroker->tcpListenFd);
+	tls_test_server_free(&pBroker->tls);
+}
+
+static IoT_Error_t run_transport(Broker *pBroker, uint16_t port, BenchmarkTransport transport, size_t payloadLen,
+								 size_t messageCount, double *pLatencies, BenchmarkResult *pResult) {
+	AWS_IoT_Client client;
+	IoT_Client_Init_Params initParams = iotClientInitParamsDefault;
+	IoT_Client_Connect_Params connectParams = iotClientConnectParamsDefault;
+	IoT_Publish_Message_Params params;
+	static unsigned char payload[BENCHMARK_MAX_PAYLOAD_LEN];
+	double start, cpuStart;
+	size_t i;
+	IoT_Error_t rc;
+
+	memset(payload, 'x', sizeof(payload));
+	params.qos = QOS0;
+	params.isRetained = 0;
+	params.payload = payload;
+	params.payloadLen = payloadLen;
+
+	initParams.enableAutoReconnect = false;
+	initParams.pTransportName = transportNames[transport];
+	initParams.pHostURL = TRANSPORT_MEMORY == transport ? BENCHMARK_MEMORY_NAME : "127.0.0.1";
+	initParams.port = TRANSPORT_TLS == transport ? (uint16_t) (port + 1) : port;
+	initParams.pRootCALocation = credentials.caPath;
+	initParams.pDeviceCertLocation = credentials.certPath;
+	initParams.pDevicePrivateKeyLocation = credentials.keyPath;
+	/* The mbedTLS test certificates are past their validity dates */
+	initParams.isSSLHostnameVerify = false;
+	initParams.writeBufSize = BENCHMARK_BUF_LEN;
+
+	connectParams.keepAliveIntervalInSec = 60;
+	connectParams.pClientID = "benchmark";
+	connectParams.clientIDLen = (uint16_t) strlen(connectParams.pClientID);
+
+	pBroker->transport = transport;
+	pBroker->publishCount = 0;
+	pBroker->isThreadStarted = 0;
+	if(TRANSPORT_MEMORY != transport) {
+		pthread_create(&pBroker->thread, NULL, broker_thread, pBroker);
+		pBroker->isThreadStarted = 1;
+	}
+
+	rc = aws_iot_mqtt_init(&client, &initParams);
+	if(SUCCESS == rc) {
+		rc = aws_iot_mqtt_connect(&client, &connectParams);
+	}
+
+	/* Throughput: the PUBACK of the last publish arrives after the broker has read every earlier message */
+	start = now_us(CLOCK_MONOTONIC);
+	cpuStart = now_us(CLOCK_THREAD_CPUTIME_ID);
+	for(i = 0; SUCCESS == rc && i < messageCount; i++) {
+		rc = aws_iot_mqtt_publish(&client, BENCHMARK_TOPIC, (uint16_t) strlen(BENCHMARK_TOPIC), &params);
+	}
+	if(SUCCESS == rc) {
+		params.qos = QOS1;
+		rc = aws_iot_mqtt_publish(&client, BENCHMARK_TOPIC, (uint16_t) strlen(BENCHMARK_TOPIC), &params);
+	}
+	pResult->msgsPerSec = (double) messageCount * 1000000.0 / (now_us(CLOCK_MONOTONIC) - start);
+	pResult->cpuUsPerMsg = (now_us(CLOCK_THREAD_CPUTIME_ID) - cpuStart) / (double) messageCount;
+
+	/* Latency: each QoS1 publish returns with its PUBACK */
+	for(i = 0; SUCCESS == rc && i < messageCount; i++) {
+		start = now_us(CLOCK_MONOTONIC);
+		rc = aws_iot_mqtt_publish(&client, BENCHMARK_TOPIC, (uint16_t) strlen(BENCHMARK_TOPIC), &params);
+		pLatencies[i] = now_us(CLOCK_MONOTONIC) - start;
+	}
+	if(SUCCESS == rc) {
+		qsort(pLatencies, messageCount, sizeof(double), compare_double);
+		pResult->p50Us = pLatencies[messageCount / 2];
+		pResult->p99Us = pLatencies[messageCount * 99 / 100];
+	}
+
+	aws_iot_mqtt_disconnect(&client);
+	if(pBroker->isThreadStarted) {
+		pthread_join(pBroker->thread, NULL);
+	}
+	aws_iot_mqtt_free(&client);
+
+	return rc;
+}
+
+int main(int argc, char **argv) {
+	static const size_t payloadLens[] = {16, 256, 1024, 8192};
+	size_t messageCount = BENCHMARK_DEFAULT_MESSAGES;
+	uint16_t port = BENCHMARK_DEFAULT_PORT;
+	Broker broker;
+	BenchmarkResult result;
+	double *pLatencies;
+	size_t p;
+	int transport;
+	IoT_Error_t rc = SUCCESS;
+
+	if(1 < argc) {
+		messageCount = (size_t) strtoul(argv[1], NULL, 10);
+	}
+	if(2 < argc) {
+		port = (uint16_t) atoi(argv[2]);
+	}
+	if(0 == messageCount) {
+		messageCount = 1;
+	}
+
+	pLatencies = (double *) malloc(messageCount * sizeof(double));
+	if(NULL == pLatencies
+	   || 0 != tls_test_write_credentials(&credentials, TLS_TEST_KEY_RSA)
+	   || 0 != broker_init(&broker, port)) {
+		printf("benchmark setup failed\n");
+		return -1;
+	}
+
+	printf("%zu QoS0 messages for throughput and %zu QoS1 messages for latency per run\n\n", messageCount,
+		   messageCount);
+	printf("%-8s %-9s %12s %12s %12s %12s\n", "payload", "transport", "msgs/sec", "cpu us/msg", "qos1 p50 us",
+		   "qos1 p99 us");
+
+	for(p = 0; SUCCESS == rc && p < sizeof(payloadLens) / sizeof(payloadLens[0]); p++) {
+		for(transport = TRANSPORT_MEMORY; SUCCESS == rc && transport <= TRANSPORT_TLS; transport++) {
+			rc = run_transport(&broker, port, (BenchmarkTransport) transport, payloadLens[p], messageCount,
+							   pLatencies, &result);
+			if(SUCCESS != rc) {
+				printf("%s run failed: %d\n", transportNames[transport], rc);
+				break;
+			}
+			if(2 * messageCount + 1 != broker.publishCount) {
+				printf("%s run lost messages: broker read %zu of %zu\n", transportNames[transport],
+					   broker.publishCount, 2 * messageCount + 1);
+				rc = FAILURE;
+				break;
+			}
+			printf("%-8zu %-9s %12.0f %12.2f %12.1f %12.1f\n", payloadLens[p], transportNames[transport],
+				   result.msgsPerSec, result.cpuUsPerMsg, result.p50Us, result.p99Us);
+			if(BENCHMARK_MAX_QOS1_P50_US < result.p50Us) {
+				printf("%s run stalled: qos1 p50 over %.0f us\n", transportNames[transport], BENCHMARK_MAX_QOS1_P50_US);
+				rc = FAILURE;
+				break;
+			}
+		}
+	}
+
+	broker_free(&broker);
+	free(pLatencies);
+	tls_test_remove_credentials(&credentials);
+
+	return SUCCESS == rc ? 0 : -1;
+}
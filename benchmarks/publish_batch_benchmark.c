@@ -0,0 +1,332 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file publish_batch_benchmark.c
+ * @brief Compares single, batched and coalesced QoS0 publishes over TLS
+ *
+ * A minimal MQTT broker runs on a thread of this process and listens on localhost using the mbedTLS test
+ * certificates. For each payload size the client publishes the same number of messages in three modes:
+ *  - single:   one aws_iot_mqtt_publish per message, each sent in its own TLS record
+ *  - batch:    aws_iot_mqtt_publish_batch with BENCHMARK_BATCH_SIZE messages per call
+ *  - coalesce: aws_iot_mqtt_publish with publishCoalesceBufSize set in the init params
+ *
+ * A QoS1 publish is sent after the messages and its PUBACK stops the clock, so every message has been read by
+ * the broker. The broker counts the TLS application data records and bytes it receives on the socket.
+ *
+ * Usage: publish_batch_benchmark [message count] [port]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_client_interface.h"
+#include "tls_test_server.h"
+
+#define BENCHMARK_DEFAULT_MESSAGES 5000
+#define BENCHMARK_DEFAULT_PORT "18883"
+#define BENCHMARK_BATCH_SIZE 32
+#define BENCHMARK_BUF_LEN 4096
+#define BENCHMARK_COALESCE_DELAY_MS 5
+#define BENCHMARK_TOPIC "sensors/benchmark"
+
+#define TLS_RECORD_HEADER_LEN 5
+#define TLS_CONTENT_TYPE_APPLICATION_DATA 23
+
+typedef enum {
+	MODE_SINGLE = 0,
+	MODE_BATCH = 1,
+	MODE_COALESCE = 2
+} BenchmarkMode;
+
+static const char *modeNames[] = {"single", "batch", "coalesce"};
+
+/* Counts the TLS records read from the socket without decrypting them */
+typedef struct {
+	mbedtls_net_context fd;
+	unsigned char header[TLS_RECORD_HEADER_LEN];
+	size_t headerLen;
+	size_t bodyLeft;
+	unsigned char contentType;
+	size_t appRecords;
+	size_t appBytes;
+} RecordCounter;
+
+typedef struct {
+	TlsTestServer tls;
+	RecordCounter counter;
+	size_t publishCount;
+} Broker;
+
+static TlsTestCredentials credentials;
+
+static double now_sec(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double) tv.tv_sec + (double) tv.tv_usec / 1000000.0;
+}
+
+static int counting_recv(void *ctx, unsigned char *buf, size_t len) {
+	RecordCounter *pCounter = (RecordCounter *) ctx;
+	int ret = mbedtls_net_recv(&pCounter->fd, buf, len);
+	int i = 0;
+	size_t skip;
+
+	while(i < ret) {
+		if(0 < pCounter->bodyLeft) {
+			skip = (size_t) (ret - i) < pCounter->bodyLeft ? (size_t) (ret - i) : pCounter->bodyLeft;
+			pCounter->bodyLeft -= skip;
+			i += (int) skip;
+			continue;
+		}
+		pCounter->header[pCounter->headerLen++] = buf[i++];
+		if(TLS_RECORD_HEADER_LEN == pCounter->headerLen) {
+			pCounter->headerLen = 0;
+			pCounter->contentType = pCounter->header[0];
+			pCounter->bodyLeft = ((size_t) pCounter->header[3] << 8) | pCounter->header[4];
+			if(TLS_CONTENT_TYPE_APPLICATION_DATA == pCounter->contentType) {
+				pCounter->appRecords++;
+				pCounter->appBytes += TLS_RECORD_HEADER_LEN + pCounter->bodyLeft;
+			}
+		}
+	}
+
+	return ret;
+}
+
+static int counting_send(void *ctx, const unsigned char *buf, size_t len) {
+	return mbedtls_net_send(&((RecordCounter *) ctx)->fd, buf, len);
+}
+
+/* Answers CONNECT, QoS1 PUBLISH and PINGREQ until the client sends DISCONNECT or closes the connection */
+static void *broker_thread(void *pArg) {
+	Broker *pBroker = (Broker *) pArg;
+	mbedtls_ssl_context ssl;
+	static unsigned char buf[1 << 16];
+	size_t len = 0, pos, remLen, hdrLen, mul;
+	unsigned char connack[] = {0x20, 0x02, 0x00, 0x00};
+	unsigned char puback[] = {0x40, 0x02, 0x00, 0x00};
+	unsigned char pingresp[] = {0xD0, 0x00};
+	unsigned char type;
+	size_t topicLen;
+	int ret, isRunning = 1;
+
+	memset(&pBroker->counter, 0, sizeof(pBroker->counter));
+	pBroker->publishCount = 0;
+	mbedtls_net_init(&pBroker->counter.fd);
+	mbedtls_ssl_init(&ssl);
+
+	if(0 != tls_test_server_accept(&pBroker->tls, &pBroker->counter.fd, -1, NULL)
+	   || 0 != mbedtls_ssl_setup(&ssl, &pBroker->tls.conf)) {
+		isRunning = 0;
+	}
+	mbedtls_ssl_set_bio(&ssl, &pBroker->counter, counting_send, counting_recv, NULL);
+
+	while(isRunning) {
+		ret = mbedtls_ssl_read(&ssl, buf + len, sizeof(buf) - len);
+		if(MBEDTLS_ERR_SSL_WANT_READ == ret || MBEDTLS_ERR_SSL_WANT_WRITE == ret) {
+			continue;
+		}
+		if(0 >= ret) {
+			break;
+		}
+		len += (size_t) ret;
+
+		pos = 0;
+		while(isRunning && 2 <= len - pos) {
+			remLen = 0;
+			mul = 1;
+			hdrLen = 1;
+			do {
+				if(pos + hdrLen >= len) {
+					break;
+				}
+				remLen += (buf[pos + hdrLen] & 127) * mul;
+				mul *= 128;
+			} while(0 != (buf[pos + hdrLen++] & 128));
+			if(pos + hdrLen > len || 0 != (buf[pos + hdrLen - 1] & 128) || pos + hdrLen + remLen > len) {
+				break;
+			}
+
+			type = (unsigned char) (buf[pos] >> 4);
+			if(1 == type) {
+				mbedtls_ssl_write(&ssl, connack, sizeof(connack));
+			} else if(3 == type) {
+				pBroker->publishCount++;
+				if(0 != (buf[pos] & 0x06)) {
+					topicLen = ((size_t) buf[pos + hdrLen] << 8) | buf[pos + hdrLen + 1];
+					puback[2] = buf[pos + hdrLen + 2 + topicLen];
+					puback[3] = buf[pos + hdrLen + 3 + topicLen];
+					mbedtls_ssl_write(&ssl, puback, sizeof(puback));
+				}
+			} else if(12 == type) {
+				mbedtls_ssl_write(&ssl, pingresp, sizeof(pingresp));
+			} else if(14 == type) {
+				isRunning = 0;
+			}
+			pos += hdrLen + remLen;
+		}
+		memmove(buf, buf + pos, len - pos);
+		len -= pos;
+	}
+
+	mbedtls_ssl_close_notify(&ssl);
+	mbedtls_net_free(&pBroker->counter.fd);
+	mbedtls_ssl_free(&ssl);
+	return NULL;
+}
+
+static int broker_init(Broker *pBroker, const char *pPort) {
+	if(0 != tls_test_server_init(&pBroker->tls, "publish_batch_benchmark")
+	   || 0 != tls_test_server_configure(&pBroker->tls, TLS_TEST_KEY_RSA)) {
+		return -1;
+	}
+
+	return tls_test_server_listen(&pBroker->tls, pPort, false);
+}
+
+static IoT_Error_t run_mode(Broker *pBroker, uint16_t port, BenchmarkMode mode, size_t payloadLen,
+							size_t messageCount, double *pElapsed) {
+	AWS_IoT_Client client;
+	IoT_Client_Init_Params initParams = iotClientInitParamsDefault;
+	IoT_Client_Connect_Params connectParams = iotClientConnectParamsDefault;
+	IoT_Publish_Message_Params params;
+	IoT_Publish_Batch_Entry entries[BENCHMARK_BATCH_SIZE];
+	unsigned char payload[256];
+	pthread_t brokerThread;
+	double start;
+	size_t sent, count, i;
+	IoT_Error_t rc;
+
+	memset(payload, 'x', sizeof(payload));
+	params.qos = QOS0;
+	params.isRetained = 0;
+	params.payload = payload;
+	params.payloadLen = payloadLen;
+
+	initParams.enableAutoReconnect = false;
+	initParams.pHostURL = "localhost";
+	initParams.port = port;
+	initParams.pRootCALocation = credentials.caPath;
+	initParams.pDeviceCertLocation = credentials.certPath;
+	initParams.pDevicePrivateKeyLocation = credentials.keyPath;
+	/* The mbedTLS test certificates are past their validity dates */
+	initParams.isSSLHostnameVerify = false;
+	initParams.writeBufSize = BENCHMARK_BUF_LEN;
+	if(MODE_COALESCE == mode) {
+		initParams.publishCoalesceBufSize = BENCHMARK_BUF_LEN;
+		initParams.publishCoalesceDelay_ms = BENCHMARK_COALESCE_DELAY_MS;
+	}
+
+	connectParams.keepAliveIntervalInSec = 60;
+	connectParams.pClientID = "benchmark";
+	connectParams.clientIDLen = (uint16_t) strlen(connectParams.pClientID);
+
+	pthread_create(&brokerThread, NULL, broker_thread, pBroker);
+
+	rc = aws_iot_mqtt_init(&client, &initParams);
+	if(SUCCESS == rc) {
+		rc = aws_iot_mqtt_connect(&client, &connectParams);
+	}
+
+	start = now_sec();
+	for(sent = 0; SUCCESS == rc && sent < messageCount; sent += count) {
+		count = 1;
+		if(MODE_BATCH == mode) {
+			count = messageCount - sent < BENCHMARK_BATCH_SIZE ? messageCount - sent : BENCHMARK_BATCH_SIZE;
+			for(i = 0; i < count; i++) {
+				entries[i].pTopicName = BENCHMARK_TOPIC;
+				entries[i].topicNameLen = (uint16_t) strlen(BENCHMARK_TOPIC);
+				entries[i].params = params;
+			}
+			rc = aws_iot_mqtt_publish_batch(&client, entries, count, NULL, NULL);
+		} else {
+			rc = aws_iot_mqtt_publish(&client, BENCHMARK_TOPIC, (uint16_t) strlen(BENCHMARK_TOPIC), &params);
+		}
+	}
+
+	/* The PUBACK of this publish arrives after the broker has read every earlier message */
+	if(SUCCESS == rc) {
+		params.qos = QOS1;
+		rc = aws_iot_mqtt_publish(&client, BENCHMARK_TOPIC, (uint16_t) strlen(BENCHMARK_TOPIC), &params);
+	}
+	*pElapsed = now_sec() - start;
+
+	aws_iot_mqtt_disconnect(&client);
+	pthread_join(brokerThread, NULL);
+	aws_iot_mqtt_free(&client);
+
+	return rc;
+}
+
+int main(int argc, char **argv) {
+	static const size_t payloadLens[] = {16, 64, 256};
+	size_t messageCount = BENCHMARK_DEFAULT_MESSAGES;
+	const char *pPort = BENCHMARK_DEFAULT_PORT;
+	Broker broker;
+	double elapsed;
+	size_t p;
+	int mode;
+	IoT_Error_t rc = SUCCESS;
+
+	if(1 < argc) {
+		messageCount = (size_t) strtoul(argv[1], NULL, 10);
+	}
+	if(2 < argc) {
+		pPort = argv[2];
+	}
+
+	if(0 != tls_test_write_credentials(&credentials, TLS_TEST_KEY_RSA)
+	   || 0 != broker_init(&broker, pPort)) {
+		printf("benchmark setup failed\n");
+		return -1;
+	}
+
+	printf("%zu QoS0 messages per run, batch size %d, coalesce buffer %d bytes\n\n", messageCount,
+		   BENCHMARK_BATCH_SIZE, BENCHMARK_BUF_LEN);
+	printf("%-8s %-9s %12s %12s %14s %14s\n", "payload", "mode", "msgs/sec", "records", "wire bytes",
+		   "bytes/msg");
+
+	for(p = 0; SUCCESS == rc && p < sizeof(payloadLens) / sizeof(payloadLens[0]); p++) {
+		for(mode = MODE_SINGLE; SUCCESS == rc && mode <= MODE_COALESCE; mode++) {
+			rc = run_mode(&broker, (uint16_t) atoi(pPort), (BenchmarkMode) mode, payloadLens[p], messageCount,
+						  &elapsed);
+			if(SUCCESS != rc) {
+				printf("%s run failed: %d\n", modeNames[mode], rc);
+				break;
+			}
+			if(messageCount + 1 != broker.publishCount) {
+				printf("%s run lost messages: broker read %zu of %zu\n", modeNames[mode], broker.publishCount,
+					   messageCount + 1);
+				rc = FAILURE;
+				break;
+			}
+			printf("%-8zu %-9s %12.0f %12zu %14zu %14.1f\n", payloadLens[p], modeNames[mode],
+				   (double) messageCount / elapsed, broker.counter.appRecords, broker.counter.appBytes,
+				   (double) broker.counter.appBytes / (double) messageCount);
+		}
+	}
+
+	tls_test_server_free(&broker.tls);
+	tls_test_remove_credentials(&credentials);
+
+	return SUCCESS == rc ? 0 : -1;
+}
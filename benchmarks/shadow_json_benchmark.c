@@ -0,0 +1,273 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file shadow_json_benchmark.c
+ * @brief Measures the CPU time the Thing Shadow spends on the JSON of each message
+ *
+ * No network is used, the documents are handled the way the shadow callbacks handle them:
+ *  - tokenize: jsmn_parse alone, the least any handling of a document costs
+ *  - ack:      what AckStatusCallback does with an update/accepted document, parse it and read its
+ *              version and clientToken
+ *  - reparse:  the same with the ack path AckStatusCallback had before the document was parsed once,
+ *              kept here as the baseline
+ *  - baseline: build a reported document of BENCHMARK_ATTRIBUTES attributes with the snprintf and strlen
+ *              add/finalize API of benchmarks/baseline, as it was before it was built on jsonBuilder_t
+ *  - api:      build the same document of BENCHMARK_ATTRIBUTES attributes with aws_iot_shadow_init_json_document,
+ *              aws_iot_shadow_add_reported and aws_iot_finalize_json_document
+ *  - builder:  build the same document with a jsonBuilder_t
+ *
+ * Usage: shadow_json_benchmark [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_shadow_json.h"
+#include "aws_iot_shadow_key.h"
+#include "shadow_json_baseline.h"
+
+#define BENCHMARK_DEFAULT_ITERATIONS 200000
+#define BENCHMARK_ATTRIBUTES 10
+#define BENCHMARK_DOCUMENT_LEN 512
+
+static const char ackDocument[] = "{\"state\":{\"desired\":{\"temperature\":22,\"mode\":\"eco\",\"fan\":true},"
+		"\"reported\":{\"temperature\":21.5,\"humidity\":40,\"mode\":\"eco\",\"fan\":false,\"battery\":87}},"
+		"\"metadata\":{\"desired\":{\"temperature\":{\"timestamp\":1500000000},\"mode\":{\"timestamp\":1500000000},"
+		"\"fan\":{\"timestamp\":1500000000}}},\"version\":1234,\"timestamp\":1500000001,"
+		"\"clientToken\":\"benchmark-client-12345\"}";
+
+static ShadowJsonDocument_t document;
+static char rxBuffer[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+
+static int32_t temperature = -42;
+static uint32_t uptime = 123456;
+static double humidity = 41.25;
+static float voltage = 3.3f;
+static bool isOn = true;
+static char mode[] = "eco";
+static int16_t rssi = -71;
+static uint8_t battery = 87;
+static double latitude = 47.606209;
+static double longitude = -122.332069;
+
+static jsonStruct_t attributes[BENCHMARK_ATTRIBUTES] = {
+		{"temperature", &temperature, SHADOW_JSON_INT32, NULL},
+		{"uptime", &uptime, SHADOW_JSON_UINT32, NULL},
+		{"humidity", &humidity, SHADOW_JSON_DOUBLE, NULL},
+		{"voltage", &voltage, SHADOW_JSON_FLOAT, NULL},
+		{"on", &isOn, SHADOW_JSON_BOOL, NULL},
+		{"mode", mode, SHADOW_JSON_STRING, NULL},
+		{"rssi", &rssi, SHADOW_JSON_INT16, NULL},
+		{"battery", &battery, SHADOW_JSON_UINT8, NULL},
+		{"latitude", &latitude, SHADOW_JSON_DOUBLE, NULL},
+		{"longitude", &longitude, SHADOW_JSON_DOUBLE, NULL}
+};
+
+/* The ack path before the document was parsed once: the payload is copied to be null terminated and
+ * parsed, every token is compared with the version key, then the document is parsed again and every
+ * token is compared with the clientToken key */
+static bool reparseAck(const char *pPayload, size_t payloadLen, uint32_t *pVersion, char *pClientToken) {
+	jsmn_parser parser;
+	jsmntok_t *pTokens = document.tokens;
+	int32_t tokenCount, i;
+	uint8_t length;
+	bool isVersionFound = false;
+
+	memcpy(rxBuffer, pPayload, payloadLen);
+	rxBuffer[payloadLen] = '\0';
+
+	jsmn_init(&parser);
+	tokenCount = jsmn_parse(&parser, rxBuffer, strlen(rxBuffer), pTokens, MAX_JSON_TOKEN_EXPECTED);
+	if(tokenCount < 1 || pTokens[0].type != JSMN_OBJECT) {
+		return false;
+	}
+	for(i = 1; i < tokenCount && !isVersionFound; i++) {
+		if(jsoneq(rxBuffer, &(pTokens[i]), SHADOW_VERSION_STRING) == 0) {
+			isVersionFound = SUCCESS == parseUnsignedInteger32Value(pVersion, rxBuffer, &(pTokens[i + 1]));
+		}
+	}
+
+	jsmn_init(&parser);
+	tokenCount = jsmn_parse(&parser, rxBuffer, strlen(rxBuffer), pTokens, MAX_JSON_TOKEN_EXPECTED);
+	if(tokenCount < 1 || pTokens[0].type != JSMN_OBJECT) {
+		return false;
+	}
+	for(i = 1; i < tokenCount; i++) {
+		if(jsoneq(rxBuffer, &(pTokens[i]), SHADOW_CLIENT_TOKEN_STRING) == 0) {
+			length = (uint8_t) (pTokens[i + 1].end - pTokens[i + 1].start);
+			strncpy(pClientToken, rxBuffer + pTokens[i + 1].start, length);
+			pClientToken[length] = '\0';
+			return isVersionFound;
+		}
+	}
+
+	return false;
+}
+
+static IoT_Error_t buildWithBaseline(char *pJsonDocument) {
+	IoT_Error_t rc = baseline_aws_iot_shadow_init_json_document(pJsonDocument, BENCHMARK_DOCUMENT_LEN);
+
+	if(SUCCESS == rc) {
+		rc = baseline_aws_iot_shadow_add_reported(pJsonDocument, BENCHMARK_DOCUMENT_LEN, BENCHMARK_ATTRIBUTES,
+												  &attributes[0], &attributes[1], &attributes[2], &attributes[3],
+												  &attributes[4], &attributes[5], &attributes[6], &attributes[7],
+												  &attributes[8], &attributes[9]);
+	}
+	if(SUCCESS == rc) {
+		rc = baseline_aws_iot_finalize_json_document(pJsonDocument, BENCHMARK_DOCUMENT_LEN);
+	}
+
+	return rc;
+}
+
+static IoT_Error_t buildWithApi(char *pJsonDocument) {
+	IoT_Error_t rc = aws_iot_shadow_init_json_document(pJsonDocument, BENCHMARK_DOCUMENT_LEN);
+
+	if(SUCCESS == rc) {
+		rc = aws_iot_shadow_add_reported(pJsonDocument, BENCHMARK_DOCUMENT_LEN, BENCHMARK_ATTRIBUTES, &attributes[0],
+										 &attributes[1], &attributes[2], &attributes[3], &attributes[4],
+										 &attributes[5], &attributes[6], &attributes[7], &attributes[8],
+										 &attributes[9]);
+	}
+	if(SUCCESS == rc) {
+		rc = aws_iot_finalize_json_document(pJsonDocument, BENCHMARK_DOCUMENT_LEN);
+	}
+
+	return rc;
+}
+
+static IoT_Error_t buildWithBuilder(char *pJsonDocument) {
+	jsonBuilder_t builder;
+	uint8_t i;
+
+	aws_iot_shadow_json_builder_init(&builder, pJsonDocument, BENCHMARK_DOCUMENT_LEN);
+	aws_iot_shadow_json_builder_begin_object(&builder, "reported");
+	for(i = 0; i < BENCHMARK_ATTRIBUTES; i++) {
+		aws_iot_shadow_json_builder_add(&builder, &attributes[i]);
+	}
+	aws_iot_shadow_json_builder_end_object(&builder);
+
+	return aws_iot_shadow_json_builder_finalize(&builder);
+}
+
+static double elapsedNs(struct timeval *pStart) {
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+	return (double) (end.tv_sec - pStart->tv_sec) * 1e9 + (double) (end.tv_usec - pStart->tv_usec) * 1e3;
+}
+
+int main(int argc, char **argv) {
+	uint32_t iterations = BENCHMARK_DEFAULT_ITERATIONS;
+	uint32_t i, version = 0, reparseVersion = 0;
+	size_t docLen = strlen(ackDocument);
+	char clientToken[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
+	char reparseClientToken[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
+	jsmn_parser parser;
+	char baselineDocument[BENCHMARK_DOCUMENT_LEN];
+	char apiDocument[BENCHMARK_DOCUMENT_LEN];
+	char builderDocument[BENCHMARK_DOCUMENT_LEN];
+	struct timeval start;
+
+	if(argc >= 2) {
+		iterations = (uint32_t) atoi(argv[1]);
+	}
+	if(0 == iterations) {
+		iterations = 1;
+	}
+
+	printf("%u iterations, %u byte ack document\n\n", iterations, (unsigned) docLen);
+	printf("%-10s %12s\n", "path", "ns/document");
+
+	gettimeofday(&start, NULL);
+	for(i = 0; i < iterations; i++) {
+		jsmn_init(&parser);
+		if(jsmn_parse(&parser, ackDocument, docLen, document.tokens, MAX_JSON_TOKEN_EXPECTED) < 0) {
+			printf("Document does not parse\n");
+			return -1;
+		}
+	}
+	printf("%-10s %12.0f\n", "tokenize", elapsedNs(&start) / iterations);
+
+	gettimeofday(&start, NULL);
+	for(i = 0; i < iterations; i++) {
+		if(!parseJsonDocument(&document, ackDocument, docLen) || !extractDocumentVersionNumber(&document, &version)
+		   || !extractDocumentClientToken(&document, clientToken, sizeof(clientToken))) {
+			printf("Ack document not recognized\n");
+			return -1;
+		}
+	}
+	printf("%-10s %12.0f\n", "ack", elapsedNs(&start) / iterations);
+
+	gettimeofday(&start, NULL);
+	for(i = 0; i < iterations; i++) {
+		if(!reparseAck(ackDocument, docLen, &reparseVersion, reparseClientToken)) {
+			printf("Ack document not recognized by the baseline\n");
+			return -1;
+		}
+	}
+	printf("%-10s %12.0f\n", "reparse", elapsedNs(&start) / iterations);
+
+	if(version != reparseVersion || 0 != strcmp(clientToken, reparseClientToken)) {
+		printf("Ack paths differ: version %u and %s, baseline %u and %s\n", version, clientToken, reparseVersion,
+			   reparseClientToken);
+		return -1;
+	}
+
+	/* The three documents get the same client token, tests/shadow_json_builder_test compares many more */
+	resetClientTokenSequenceNum();
+	buildWithBaseline(baselineDocument);
+	resetClientTokenSequenceNum();
+	buildWithApi(apiDocument);
+	resetClientTokenSequenceNum();
+	buildWithBuilder(builderDocument);
+	if(0 != strcmp(baselineDocument, apiDocument) || 0 != strcmp(apiDocument, builderDocument)) {
+		printf("Documents differ:\n%s\n%s\n%s\n", baselineDocument, apiDocument, builderDocument);
+		return -1;
+	}
+
+	gettimeofday(&start, NULL);
+	for(i = 0; i < iterations; i++) {
+		if(SUCCESS != buildWithBaseline(baselineDocument)) {
+			printf("Document does not fit\n");
+			return -1;
+		}
+	}
+	printf("%-10s %12.0f\n", "baseline", elapsedNs(&start) / iterations);
+
+	gettimeofday(&start, NULL);
+	for(i = 0; i < iterations; i++) {
+		if(SUCCESS != buildWithApi(apiDocument)) {
+			printf("Document does not fit\n");
+			return -1;
+		}
+	}
+	printf("%-10s %12.0f\n", "api", elapsedNs(&start) / iterations);
+
+	gettimeofday(&start, NULL);
+	for(i = 0; i < iterations; i++) {
+		if(SUCCESS != buildWithBuilder(builderDocument)) {
+			printf("Document does not fit\n");
+			return -1;
+		}
+	}
+	printf("%-10s %12.0f\n", "builder", elapsedNs(&start) / iterations);
+
+	return 0;
+}
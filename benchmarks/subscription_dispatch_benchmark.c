@@ -0,0 +1,213 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file subscription_dispatch_benchmark.c
+ * @brief Measures the cost of matching an incoming publish against the subscriptions of a client
+ *
+ * No network is used, the messages are handed to the dispatch the way cycle read hands them over.
+ * For each handler count, half of the topic filters are exact topics and half have wildcards:
+ *  - index:  aws_iot_mqtt_internal_dispatch_message, the topic hash table and the wildcard trie
+ *  - linear: the scan of every handler with strncmp and the wildcard matcher that the client used
+ *            before the subscription index, kept here as the baseline
+ *
+ * Half of the messages match an exact filter and half a wildcard filter. Both paths count the handler
+ * calls and the counts are compared.
+ *
+ * Usage: subscription_dispatch_benchmark [messages]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_mqtt_client_interface.h"
+#include "aws_iot_mqtt_client_common_internal.h"
+
+#define BENCHMARK_DEFAULT_MESSAGES 200000
+#define BENCHMARK_TOPICS 64
+#define BENCHMARK_MAX_FILTER_LEN 48
+
+static const uint32_t handlerCounts[] = {4, 16, 64, 256, 1024, 2048};
+
+static char filters[2048][BENCHMARK_MAX_FILTER_LEN];
+static uint16_t filterLens[2048];
+static char topics[BENCHMARK_TOPICS][BENCHMARK_MAX_FILTER_LEN];
+static uint16_t topicLens[BENCHMARK_TOPICS];
+static uint32_t callCount;
+
+static void countingHandler(AWS_IoT_Client *pClient, char *pTopicName, uint16_t topicNameLen,
+							IoT_Publish_Message_Params *pParams, void *pData) {
+	IOT_UNUSED(pClient);
+	IOT_UNUSED(pTopicName);
+	IOT_UNUSED(topicNameLen);
+	IOT_UNUSED(pParams);
+	IOT_UNUSED(pData);
+	callCount++;
+}
+
+/* The matcher of the client before the subscription index */
+static char linearIsTopicMatched(char *pTopicFilter, char *pTopicName, uint16_t topicNameLen) {
+	char *curf, *curn, *curn_end;
+
+	curf = pTopicFilter;
+	curn = pTopicName;
+	curn_end = curn + topicNameLen;
+
+	while(*curf && (curn < curn_end)) {
+		if(*curn == '/' && *curf != '/') {
+			break;
+		}
+		if(*curf != '+' && *curf != '#' && *curf != *curn) {
+			break;
+		}
+		if(*curf == '+') {
+			char *nextpos = curn + 1;
+			while(nextpos < curn_end && *nextpos != '/')
+				nextpos = ++curn + 1;
+		} else if(*curf == '#') {
+			curn = curn_end - 1;
+		}
+
+		curf++;
+		curn++;
+	};
+
+	return (curn == curn_end) && (*curf == '\0');
+}
+
+static void linearDispatch(uint32_t handlerCount, char *pTopicName, uint16_t topicNameLen,
+						   IoT_Publish_Message_Params *pParams) {
+	uint32_t itr;
+
+	for(itr = 0; itr < handlerCount; ++itr) {
+		if(((topicNameLen == filterLens[itr]) && (strncmp(pTopicName, filters[itr], topicNameLen) == 0))
+		   || linearIsTopicMatched(filters[itr], pTopicName, topicNameLen)) {
+			countingHandler(NULL, pTopicName, topicNameLen, pParams, NULL);
+		}
+	}
+}
+
+/* Even filters are exact device topics, odd ones are wildcards over fleets */
+static void makeFilters(uint32_t handlerCount) {
+	uint32_t i;
+
+	for(i = 0; i < handlerCount; i++) {
+		if(0 == i % 2) {
+			snprintf(filters[i], BENCHMARK_MAX_FILTER_LEN, "devices/dev%u/shadow/update", i / 2);
+		} else if(1 == i % 4) {
+			snprintf(filters[i], BENCHMARK_MAX_FILTER_LEN, "fleet/%u/+/telemetry", i / 4);
+		} else {
+			snprintf(filters[i], BENCHMARK_MAX_FILTER_LEN, "alerts/%u/#", i / 4);
+		}
+		filterLens[i] = (uint16_t) strlen(filters[i]);
+	}
+}
+
+/* Even topics match the exact filter of a device, odd ones the '+' filter of a fleet */
+static void makeTopics(uint32_t handlerCount) {
+	uint32_t i;
+
+	for(i = 0; i < BENCHMARK_TOPICS; i++) {
+		if(0 == i % 2) {
+			snprintf(topics[i], BENCHMARK_MAX_FILTER_LEN, "devices/dev%u/shadow/update", (i * 7) % (handlerCount / 2));
+		} else {
+			snprintf(topics[i], BENCHMARK_MAX_FILTER_LEN, "fleet/%u/sensor%u/telemetry", (i * 5) % (handlerCount / 4), i);
+		}
+		topicLens[i] = (uint16_t) strlen(topics[i]);
+	}
+}
+
+static double elapsedNs(struct timeval *pStart) {
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+	return (double) (end.tv_sec - pStart->tv_sec) * 1e9 + (double) (end.tv_usec - pStart->tv_usec) * 1e3;
+}
+
+int main(int argc, char **argv) {
+	uint32_t messages = BENCHMARK_DEFAULT_MESSAGES;
+	uint32_t i, j, handlerCount, indexCalls, linearCalls;
+	IoT_Client_Init_Params initParams = iotClientInitParamsDefault;
+	IoT_Publish_Message_Params params;
+	AWS_IoT_Client client;
+	double indexNs, linearNs;
+	struct timeval start;
+
+	if(argc >= 2) {
+		messages = (uint32_t) atoi(argv[1]);
+	}
+	if(0 == messages) {
+		messages = 1;
+	}
+
+	memset(&params, 0, sizeof(params));
+	params.payload = "{}";
+	params.payloadLen = 2;
+
+	printf("%u messages per row\n\n", messages);
+	printf("%8s %12s %12s\n", "handlers", "index ns", "linear ns");
+
+	for(i = 0; i < sizeof(handlerCounts) / sizeof(handlerCounts[0]); i++) {
+		handlerCount = handlerCounts[i];
+		makeFilters(handlerCount);
+		makeTopics(handlerCount);
+
+		initParams.pTransportName = "memory";
+		initParams.pHostURL = "subscription_dispatch_benchmark";
+		initParams.port = 1;
+		initParams.maxSubscriptions = handlerCount;
+		if(SUCCESS != aws_iot_mqtt_init(&client, &initParams)) {
+			printf("Client init failed\n");
+			return -1;
+		}
+		for(j = 0; j < handlerCount; j++) {
+			if(SUCCESS != aws_iot_mqtt_internal_add_subscription(&client, filters[j], filterLens[j], QOS0,
+																 countingHandler, NULL, NULL, NULL, NULL)) {
+				printf("Subscription %s refused\n", filters[j]);
+				return -1;
+			}
+		}
+
+		callCount = 0;
+		gettimeofday(&start, NULL);
+		for(j = 0; j < messages; j++) {
+			aws_iot_mqtt_internal_dispatch_message(&client, topics[j % BENCHMARK_TOPICS],
+												   topicLens[j % BENCHMARK_TOPICS], &params);
+		}
+		indexNs = elapsedNs(&start) / messages;
+		indexCalls = callCount;
+
+		callCount = 0;
+		gettimeofday(&start, NULL);
+		for(j = 0; j < messages; j++) {
+			linearDispatch(handlerCount, topics[j % BENCHMARK_TOPICS], topicLens[j % BENCHMARK_TOPICS], &params);
+		}
+		linearNs = elapsedNs(&start) / messages;
+		linearCalls = callCount;
+
+		aws_iot_mqtt_free(&client);
+
+		if(indexCalls != linearCalls) {
+			printf("Handler calls differ: %u indexed, %u linear\n", indexCalls, linearCalls);
+			return -1;
+		}
+		printf("%8u %12.0f %12.0f\n", handlerCount, indexNs, linearNs);
+	}
+
+	return 0;
+}
@@ -0,0 +1,483 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file tls_handshake_benchmark.c
+ * @brief Measures the TLS wrapper across cipher suites, ECDHE curves and client key types
+ *
+ * A TLS server runs on a thread of this process and listens on localhost using the mbedTLS test
+ * certificates. It is set up the way programs/ssl/ssl_server2 is with force_ciphersuite, curves,
+ * auth_mode and cache_max, so that each configuration negotiates exactly one cipher suite and curve
+ * and asks for a client certificate. For each configuration the client measures with the iot_tls API:
+ *  - full:     iot_tls_connect with no session to resume
+ *  - resumed:  iot_tls_connect offering the session of the previous connect from the server cache
+ *  - upload:   iot_tls_write of the bulk data, the server reads it and acknowledges the end
+ *  - download: iot_tls_read of the bulk data written by the server
+ *  - heap:     heap held by mbedTLS for the download connection, and the most it held at once
+ *
+ * Times are wall clock, CPU is the time the client thread spent on the CPU, so the server does not
+ * count. The credentials are loaded once per configuration, connects only do the handshake. Results
+ * are printed as a table and written as JSON to the report file.
+ *
+ * Usage: tls_handshake_benchmark [handshakes] [megabytes] [report file] [port]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/ecp.h"
+#include "mbedtls/aesni.h"
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "timer_interface.h"
+#include "network_interface.h"
+#include "tls_test_server.h"
+
+#define BENCHMARK_DEFAULT_HANDSHAKES 50
+#define BENCHMARK_DEFAULT_MEGABYTES 32
+#define BENCHMARK_DEFAULT_REPORT "tls_handshake_benchmark.json"
+#define BENCHMARK_DEFAULT_PORT "18884"
+#define BENCHMARK_CHUNK_LEN 4096
+#define BENCHMARK_TIMEOUT_MS 10000
+
+/* Bulk transfer commands, one byte followed by the length as 8 bytes big endian */
+#define BENCHMARK_CMD_UPLOAD 'U'
+#define BENCHMARK_CMD_DOWNLOAD 'D'
+#define BENCHMARK_CMD_LEN 9
+
+static const char *keyTypeNames[] = {"rsa", "ec"};
+
+typedef struct {
+	int ciphersuites[2];
+	mbedtls_ecp_group_id curves[3];
+	TlsTestKeyType serverKeyType;
+	TlsTestKeyType clientKeyType;
+} BenchmarkConfig;
+
+/* ECDSA suites need an EC server certificate, RSA suites an RSA one. The first curve is the one used for ECDHE */
+static const BenchmarkConfig configs[] = {
+	{{MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256, 0},
+			{MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_SECP384R1, MBEDTLS_ECP_DP_NONE}, TLS_TEST_KEY_EC, TLS_TEST_KEY_EC},
+	{{MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256, 0},
+			{MBEDTLS_ECP_DP_SECP384R1, MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_NONE}, TLS_TEST_KEY_EC, TLS_TEST_KEY_EC},
+	{{MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256, 0},
+			{MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_SECP384R1, MBEDTLS_ECP_DP_NONE}, TLS_TEST_KEY_EC, TLS_TEST_KEY_EC},
+	{{MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256, 0},
+			{MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_SECP384R1, MBEDTLS_ECP_DP_NONE}, TLS_TEST_KEY_RSA, TLS_TEST_KEY_RSA},
+	{{MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256, 0},
+			{MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_SECP384R1, MBEDTLS_ECP_DP_NONE}, TLS_TEST_KEY_RSA, TLS_TEST_KEY_EC},
+	{{MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384, 0},
+			{MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_SECP384R1, MBEDTLS_ECP_DP_NONE}, TLS_TEST_KEY_RSA, TLS_TEST_KEY_RSA},
+	{{MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256, 0},
+			{MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_SECP384R1, MBEDTLS_ECP_DP_NONE}, TLS_TEST_KEY_RSA, TLS_TEST_KEY_RSA},
+};
+
+typedef struct {
+	double wall_ms;
+	double cpu_ms;
+} Sample;
+
+typedef struct {
+	Sample full;
+	Sample resumed;
+	double uploadMBps;
+	double uploadCpuMsPerMB;
+	double downloadMBps;
+	double downloadCpuMsPerMB;
+	uint32_t resumedCount;
+	TLSMemoryReport memory;
+} BenchmarkResult;
+
+typedef struct {
+	TlsTestServer tls;
+	mbedtls_ssl_cache_context cache;
+	size_t connectionCount;
+	int isFailed;
+} Server;
+
+/* Client credentials of each key type */
+static TlsTestCredentials credentialFiles[2];
+
+static double now_ms(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * The server acknowledges every segment at once. Otherwise the delayed ACK of the server and
+ * Nagle on the client socket add 40ms to handshakes whose client flight is several writes
+ */
+static int quickack_recv(void *ctx, unsigned char *buf, size_t len) {
+	int one = 1;
+	setsockopt(((mbedtls_net_context *) ctx)->fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+	return mbedtls_net_recv(ctx, buf, len);
+}
+
+/* Serves one bulk command after the handshake, or none if the client just closes the connection */
+static void server_serve(mbedtls_ssl_context *pSsl) {
+	static unsigned char buf[BENCHMARK_CHUNK_LEN];
+	unsigned char cmd[BENCHMARK_CMD_LEN];
+	unsigned char ack = 1;
+	uint64_t len = 0, chunk;
+	int i;
+
+	if(0 != tls_test_read_all(pSsl, cmd, sizeof(cmd))) {
+		return;
+	}
+	for(i = 1; i < BENCHMARK_CMD_LEN; i++) {
+		len = (len << 8) | cmd[i];
+	}
+
+	memset(buf, 'x', sizeof(buf));
+	for(; 0 < len; len -= chunk) {
+		chunk = len < sizeof(buf) ? len : sizeof(buf);
+		if(BENCHMARK_CMD_UPLOAD == cmd[0] ? 0 != tls_test_read_all(pSsl, buf, (size_t) chunk)
+										  : 0 != tls_test_write_all(pSsl, buf, (size_t) chunk)) {
+			return;
+		}
+	}
+	if(BENCHMARK_CMD_UPLOAD == cmd[0]) {
+		tls_test_write_all(pSsl, &ack, 1);
+	}
+}
+
+/* Accepts connectionCount connections one after the other */
+static void *server_thread(void *pArg) {
+	Server *pServer = (Server *) pArg;
+	mbedtls_net_context fd;
+	mbedtls_ssl_context ssl;
+	size_t itr;
+	int one = 1;
+
+	for(itr = 0; itr < pServer->connectionCount; itr++) {
+		mbedtls_net_init(&fd);
+		mbedtls_ssl_init(&ssl);
+
+		if(0 != tls_test_server_accept(&pServer->tls, &fd, -1, NULL)
+		   || 0 != mbedtls_ssl_setup(&ssl, &pServer->tls.conf)) {
+			pServer->isFailed = 1;
+			mbedtls_ssl_free(&ssl);
+			mbedtls_net_free(&fd);
+			break;
+		}
+		setsockopt(fd.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		mbedtls_ssl_set_bio(&ssl, &fd, mbedtls_net_send, quickack_recv, NULL);
+
+		if(0 == tls_test_server_handshake(&ssl)) {
+			server_serve(&ssl);
+			mbedtls_ssl_close_notify(&ssl);
+		} else {
+			pServer->isFailed = 1;
+		}
+
+		mbedtls_ssl_free(&ssl);
+		mbedtls_net_free(&fd);
+	}
+
+	return NULL;
+}
+
+/* Sets the server up for one configuration. Sessions are cached so that clients can resume them */
+static int server_configure(Server *pServer, const BenchmarkConfig *pConfig) {
+	mbedtls_ssl_cache_init(&pServer->cache);
+	pServer->isFailed = 0;
+
+	if(0 != tls_test_server_configure(&pServer->tls, pConfig->serverKeyType)) {
+		return -1;
+	}
+
+	mbedtls_ssl_conf_ciphersuites(&pServer->tls.conf, pConfig->ciphersuites);
+	mbedtls_ssl_conf_curves(&pServer->tls.conf, pConfig->curves);
+	/* Asks for the client certificate so that the client signs, the test certificates are past their dates */
+	mbedtls_ssl_conf_authmode(&pServer->tls.conf, MBEDTLS_SSL_VERIFY_OPTIONAL);
+	mbedtls_ssl_conf_session_cache(&pServer->tls.conf, &pServer->cache, mbedtls_ssl_cache_get,
+								   mbedtls_ssl_cache_set);
+
+	return 0;
+}
+
+static void server_unconfigure(Server *pServer) {
+	tls_test_server_unconfigure(&pServer->tls);
+	mbedtls_ssl_cache_free(&pServer->cache);
+}
+
+/* Times handshakeCount connects. A full connect forgets the session first, a resumed one offers it */
+static IoT_Error_t run_handshakes(Network *pNetwork, const BenchmarkConfig *pConfig, size_t handshakeCount,
+								  bool isResumed, Sample *pSample) {
+	double wallStart, cpuStart;
+	size_t itr;
+	IoT_Error_t rc = SUCCESS;
+
+	pSample->wall_ms = 0;
+	pSample->cpu_ms = 0;
+
+	for(itr = 0; SUCCESS == rc && itr < handshakeCount; itr++) {
+		if(!isResumed) {
+			iot_tls_free_session(pNetwork);
+		}
+
+		wallStart = now_ms(CLOCK_MONOTONIC);
+		cpuStart = now_ms(CLOCK_THREAD_CPUTIME_ID);
+		rc = iot_tls_connect(pNetwork, NULL);
+		pSample->cpu_ms += now_ms(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+		pSample->wall_ms += now_ms(CLOCK_MONOTONIC) - wallStart;
+
+		if(SUCCESS == rc && pConfig->ciphersuites[0] !=
+							mbedtls_ssl_get_ciphersuite_id(mbedtls_ssl_get_ciphersuite(&(pNetwork->tlsDataParams.ssl)))) {
+			rc = SSL_CONNECTION_ERROR;
+		}
+
+		iot_tls_disconnect(pNetwork);
+		iot_tls_destroy(pNetwork);
+	}
+
+	pSample->wall_ms /= (double) handshakeCount;
+	pSample->cpu_ms /= (double) handshakeCount;
+
+	return rc;
+}
+
+/* Moves byteCount bytes over one connection in the given direction, and reports its heap if asked */
+static IoT_Error_t run_bulk(Network *pNetwork, unsigned char command, size_t byteCount, double *pMBps,
+							double *pCpuMsPerMB, TLSMemoryReport *pMemory) {
+	static unsigned char buf[BENCHMARK_CHUNK_LEN];
+	unsigned char cmd[BENCHMARK_CMD_LEN];
+	double wallStart, cpuStart, megabytes = (double) byteCount / (1024.0 * 1024.0);
+	size_t left, chunk, len;
+	Timer timer;
+	int i;
+	IoT_Error_t rc;
+
+	rc = iot_tls_connect(pNetwork, NULL);
+	if(SUCCESS != rc) {
+		return rc;
+	}
+
+	cmd[0] = command;
+	for(i = 1; i < BENCHMARK_CMD_LEN; i++) {
+		cmd[i] = (unsigned char) ((uint64_t) byteCount >> (8 * (BENCHMARK_CMD_LEN - 1 - i)));
+	}
+	memset(buf, 'x', sizeof(buf));
+
+	init_timer(&timer);
+	countdown_ms(&timer, BENCHMARK_TIMEOUT_MS);
+	rc = iot_tls_write(pNetwork, cmd, sizeof(cmd), &timer, &len);
+
+	wallStart = now_ms(CLOCK_MONOTONIC);
+	cpuStart = now_ms(CLOCK_THREAD_CPUTIME_ID);
+	for(left = byteCount; SUCCESS == rc && 0 < left; left -= chunk) {
+		chunk = left < sizeof(buf) ? left : sizeof(buf);
+		countdown_ms(&timer, BENCHMARK_TIMEOUT_MS);
+		if(BENCHMARK_CMD_UPLOAD == command) {
+			rc = iot_tls_write(pNetwork, buf, chunk, &timer, &len);
+		} else {
+			rc = iot_tls_read(pNetwork, buf, chunk, &timer, &len);
+		}
+	}
+	/* The upload is done once the server has read all of it */
+	if(SUCCESS == rc && BENCHMARK_CMD_UPLOAD == command) {
+		countdown_ms(&timer, BENCHMARK_TIMEOUT_MS);
+		rc = iot_tls_read(pNetwork, buf, 1, &timer, &len);
+	}
+	*pCpuMsPerMB = (now_ms(CLOCK_THREAD_CPUTIME_ID) - cpuStart) / megabytes;
+	*pMBps = megabytes * 1000.0 / (now_ms(CLOCK_MONOTONIC) - wallStart);
+	if(NULL != pMemory) {
+		iot_tls_get_memory_report(pNetwork, pMemory);
+	}
+
+	iot_tls_disconnect(pNetwork);
+	iot_tls_destroy(pNetwork);
+
+	return rc;
+}
+
+static IoT_Error_t run_config(Server *pServer, const char *pPort, const BenchmarkConfig *pConfig,
+							  size_t handshakeCount, size_t byteCount, BenchmarkResult *pResult) {
+	TlsTestCredentials *pFiles = &credentialFiles[pConfig->clientKeyType];
+	TLSCredentials credentials;
+	Network network;
+	pthread_t thread;
+	uint32_t fullCount;
+	IoT_Error_t rc;
+
+	if(0 != server_configure(pServer, pConfig)) {
+		server_unconfigure(pServer);
+		return NETWORK_SSL_INIT_ERROR;
+	}
+
+	rc = iot_tls_credentials_init(&credentials, pFiles->caPath, pFiles->certPath, pFiles->keyPath);
+	if(SUCCESS != rc) {
+		server_unconfigure(pServer);
+		return rc;
+	}
+
+	pServer->connectionCount = 2 * handshakeCount + 2;
+	pthread_create(&thread, NULL, server_thread, pServer);
+
+	iot_tls_init(&network, pFiles->caPath, pFiles->certPath, pFiles->keyPath, "localhost", (uint16_t) atoi(pPort),
+				 BENCHMARK_TIMEOUT_MS, false);
+	iot_tls_set_credentials(&network, &credentials);
+
+	rc = run_handshakes(&network, pConfig, handshakeCount, false, &pResult->full);
+	if(SUCCESS == rc) {
+		rc = run_handshakes(&network, pConfig, handshakeCount, true, &pResult->resumed);
+	}
+	iot_tls_get_handshake_counts(&network, &fullCount, &pResult->resumedCount);
+	if(SUCCESS == rc) {
+		rc = run_bulk(&network, BENCHMARK_CMD_UPLOAD, byteCount, &pResult->uploadMBps, &pResult->uploadCpuMsPerMB,
+					  NULL);
+	}
+	if(SUCCESS == rc) {
+		rc = run_bulk(&network, BENCHMARK_CMD_DOWNLOAD, byteCount, &pResult->downloadMBps,
+					  &pResult->downloadCpuMsPerMB, &pResult->memory);
+	}
+
+	/* A failed run leaves the server waiting for connections that will not come */
+	if(SUCCESS == rc) {
+		pthread_join(thread, NULL);
+	} else {
+		pthread_cancel(thread);
+		pthread_join(thread, NULL);
+	}
+	if(pServer->isFailed && SUCCESS == rc) {
+		rc = SSL_CONNECTION_ERROR;
+	}
+
+	iot_tls_free_session(&network);
+	iot_tls_credentials_free(&credentials);
+	server_unconfigure(pServer);
+
+	return rc;
+}
+
+static const char *curve_name(mbedtls_ecp_group_id id) {
+	const mbedtls_ecp_curve_info *pInfo = mbedtls_ecp_curve_info_from_grp_id(id);
+	return (NULL != pInfo) ? pInfo->name : "unknown";
+}
+
+static void write_report_entry(FILE *pFile, const BenchmarkConfig *pConfig, const BenchmarkResult *pResult,
+							   bool isLast) {
+	fprintf(pFile, "    {\"ciphersuite\": \"%s\", \"curve\": \"%s\", \"server_key\": \"%s\", \"client_key\": \"%s\",\n",
+			mbedtls_ssl_get_ciphersuite_name(pConfig->ciphersuites[0]), curve_name(pConfig->curves[0]),
+			keyTypeNames[pConfig->serverKeyType], keyTypeNames[pConfig->clientKeyType]);
+	fprintf(pFile, "     \"full_handshake_ms\": %.3f, \"full_handshake_cpu_ms\": %.3f,\n", pResult->full.wall_ms,
+			pResult->full.cpu_ms);
+	fprintf(pFile, "     \"resumed_handshake_ms\": %.3f, \"resumed_handshake_cpu_ms\": %.3f, \"resumed_count\": %u,\n",
+			pResult->resumed.wall_ms, pResult->resumed.cpu_ms, pResult->resumedCount);
+	fprintf(pFile, "     \"upload_mb_per_sec\": %.1f, \"upload_cpu_ms_per_mb\": %.2f,\n", pResult->uploadMBps,
+			pResult->uploadCpuMsPerMB);
+	fprintf(pFile, "     \"download_mb_per_sec\": %.1f, \"download_cpu_ms_per_mb\": %.2f,\n", pResult->downloadMBps,
+			pResult->downloadCpuMsPerMB);
+	fprintf(pFile, "     \"heap_bytes\": %zu, \"peak_heap_bytes\": %zu, \"record_buffer_bytes\": %zu}%s\n",
+			pResult->memory.heapBytes, pResult->memory.peakHeapBytes, pResult->memory.recordBufferBytes,
+			isLast ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+	const size_t configCount = sizeof(configs) / sizeof(configs[0]);
+	BenchmarkResult results[sizeof(configs) / sizeof(configs[0])];
+	size_t handshakeCount = BENCHMARK_DEFAULT_HANDSHAKES;
+	size_t megabytes = BENCHMARK_DEFAULT_MEGABYTES;
+	const char *pReportPath = BENCHMARK_DEFAULT_REPORT;
+	const char *pPort = BENCHMARK_DEFAULT_PORT;
+	bool hasAesni = false;
+	bool hasClmul = false;
+	Server server;
+	FILE *pReport;
+	size_t itr, completed = 0;
+	IoT_Error_t rc = SUCCESS;
+
+	if(1 < argc) {
+		handshakeCount = (size_t) strtoul(argv[1], NULL, 10);
+	}
+	if(2 < argc) {
+		megabytes = (size_t) strtoul(argv[2], NULL, 10);
+	}
+	if(3 < argc) {
+		pReportPath = argv[3];
+	}
+	if(4 < argc) {
+		pPort = argv[4];
+	}
+#if defined(MBEDTLS_AESNI_C)
+	hasAesni = (0 != mbedtls_aesni_has_support(MBEDTLS_AESNI_AES));
+	hasClmul = (0 != mbedtls_aesni_has_support(MBEDTLS_AESNI_CLMUL));
+#endif
+
+	if(0 == handshakeCount || 0 == megabytes) {
+		printf("Usage: %s [handshakes] [megabytes] [report file] [port]\n", argv[0]);
+		return -1;
+	}
+
+	if(0 != tls_test_write_credentials(&credentialFiles[TLS_TEST_KEY_RSA], TLS_TEST_KEY_RSA)
+	   || 0 != tls_test_write_credentials(&credentialFiles[TLS_TEST_KEY_EC], TLS_TEST_KEY_EC)
+	   || 0 != tls_test_server_init(&server.tls, "tls_handshake_benchmark")
+	   || 0 != tls_test_server_listen(&server.tls, pPort, false)) {
+		printf("benchmark setup failed\n");
+		return -1;
+	}
+
+	printf("%zu handshakes of each kind, %zu MB each way, AES-NI %s, PCLMULQDQ %s\n\n", handshakeCount, megabytes,
+		   hasAesni ? "yes" : "no", hasClmul ? "yes" : "no");
+	printf("%-40s %-10s %-6s %9s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n", "ciphersuite", "curve", "keys", "full ms",
+		   "cpu ms", "resum ms", "cpu ms", "up MB/s", "cpu/MB", "down MB/s", "cpu/MB", "heap KB", "peak KB");
+
+	for(itr = 0; SUCCESS == rc && itr < configCount; itr++) {
+		rc = run_config(&server, pPort, &configs[itr], handshakeCount, megabytes * 1024 * 1024, &results[itr]);
+		if(SUCCESS != rc) {
+			printf("%s run failed: %d\n", mbedtls_ssl_get_ciphersuite_name(configs[itr].ciphersuites[0]), rc);
+			break;
+		}
+		printf("%-40s %-10s %-2s/%-3s %9.2f %9.2f %9.2f %9.2f %9.1f %9.2f %9.1f %9.2f %9.1f %9.1f\n",
+			   mbedtls_ssl_get_ciphersuite_name(configs[itr].ciphersuites[0]), curve_name(configs[itr].curves[0]),
+			   keyTypeNames[configs[itr].serverKeyType], keyTypeNames[configs[itr].clientKeyType],
+			   results[itr].full.wall_ms, results[itr].full.cpu_ms, results[itr].resumed.wall_ms,
+			   results[itr].resumed.cpu_ms, results[itr].uploadMBps, results[itr].uploadCpuMsPerMB,
+			   results[itr].downloadMBps, results[itr].downloadCpuMsPerMB, results[itr].memory.heapBytes / 1024.0,
+			   results[itr].memory.peakHeapBytes / 1024.0);
+		completed++;
+	}
+
+	pReport = fopen(pReportPath, "w");
+	if(NULL != pReport) {
+		fprintf(pReport, "{\n  \"handshakes\": %zu,\n  \"megabytes\": %zu,\n  \"aesni\": %s,\n  \"pclmulqdq\": %s,\n",
+				handshakeCount, megabytes, hasAesni ? "true" : "false", hasClmul ? "true" : "false");
+		fprintf(pReport, "  \"results\": [\n");
+		for(itr = 0; itr < completed; itr++) {
+			write_report_entry(pReport, &configs[itr], &results[itr], itr + 1 == completed);
+		}
+		fprintf(pReport, "  ]\n}\n");
+		fclose(pReport);
+		printf("\nReport written to %s\n", pReportPath);
+	} else {
+		printf("\nUnable to write report to %s\n", pReportPath);
+	}
+
+	tls_test_server_free(&server.tls);
+	tls_test_remove_credentials(&credentialFiles[TLS_TEST_KEY_RSA]);
+	tls_test_remove_credentials(&credentialFiles[TLS_TEST_KEY_EC]);
+
+	return SUCCESS == rc ? 0 : -1;
+}
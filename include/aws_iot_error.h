@@ -38,6 +38,10 @@ extern "C" {
  * Values greater than 0 are specific non-error return codes
  */
 typedef enum {
+	/** Returned by aws_iot_shadow_update_reported when no registered attribute changed, nothing is published */
+			SHADOW_NOTHING_TO_REPORT = 8,
+	/** Returned by a non-blocking connect that is waiting for the socket */
+			NETWORK_CONNECT_IN_PROGRESS = 7,
 	/** Returned when the Network physical layer is connected */
 			NETWORK_PHYSICAL_LAYER_CONNECTED = 6,
 	/** Returned when the Network is manually disconnected */
@@ -151,6 +155,29 @@ typedef enum {
 			MUTEX_UNLOCK_ERROR = -48,
 	/** Mutex destroy failed */
 			MUTEX_DESTROY_ERROR = -49,
+	/** The in-flight window for asynchronous QoS1 publishes is full. Yield to receive PUBACKs and try again */
+			MQTT_MAX_INFLIGHT_PUBLISHES_REACHED_ERROR = -50,
+	/** Memory for a client resource could not be allocated */
+			MQTT_MEMORY_ALLOCATION_ERROR = -51,
+	/** Thread creation failed */
+			THREAD_CREATE_ERROR = -52,
+	/** Waiting for a thread to finish failed */
+			THREAD_JOIN_ERROR = -53,
+	/** Creating, changing or waiting on a network event set failed */
+			NETWORK_EVENT_SET_ERROR = -54,
+	/** The client manager already drives as many clients as it was sized for */
+			MQTT_MAX_MANAGED_CLIENTS_REACHED_ERROR = -55,
+	/** Creating, waiting on or signalling a condition variable failed */
+			THREAD_CONDITION_ERROR = -56,
+	/** The TLS max fragment length is not one TLS can negotiate or does not fit the record buffers */
+			NETWORK_SSL_MAX_FRAGMENT_LENGTH_ERROR = -57,
+	/** No network transport, or no memory transport listener, is registered under the name */
+			NETWORK_TRANSPORT_NOT_FOUND_ERROR = -58,
+	/** As many network transports, or memory transport listeners, are registered as there is room for */
+			NETWORK_MAX_TRANSPORTS_REACHED_ERROR = -59,
+	/** A blocking QoS1 publish was called on the RX thread of the full duplex mode, the thread that reads its PUBACK,
+	 *  or on a dispatch worker while the RX thread waits for the workers */
+			MQTT_BLOCKING_PUBLISH_ON_RX_THREAD_ERROR = -60,
 } IoT_Error_t;
 
 #ifdef __cplusplus
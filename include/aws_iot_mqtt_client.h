@@ -155,6 +155,33 @@ extern const IoT_Client_Connect_Params iotClientConnectParamsDefault;
  */
 typedef void (*iot_disconnect_handler)(AWS_IoT_Client *, void *);
 
+/**
+ * @brief Memory Allocator
+ *
+ * Defining a type for the allocator used for memory owned by a client.
+ * pRealloc is called with a NULL pointer to allocate and must behave like realloc.
+ * Can be backed by the heap, or by an arena carved out by the application
+ *
+ */
+typedef struct {
+	void *(*pRealloc)(void *ptr, size_t size, void *pContext);	///< Allocate, grow or shrink a block. Returns NULL on failure, leaving the block untouched
+	void (*pFree)(void *ptr, void *pContext);			///< Release a block allocated by pRealloc
+	void *pContext;							///< Passed as argument to pRealloc and pFree
+} IoT_Allocator_t;
+
+/**
+ * @brief MQTT Publish Batch Entry
+ *
+ * Defining a type for one message of a publish batch.
+ * Passed to aws_iot_mqtt_publish_batch
+ *
+ */
+typedef struct {
+	const char *pTopicName;				///< Topic to publish to
+	uint16_t topicNameLen;				///< Length of the topic name
+	IoT_Publish_Message_Params params;		///< Message parameters, id is set for QoS1 messages
+} IoT_Publish_Batch_Entry;
+
 /**
  * @brief MQTT Initialization Parameters
  *
@@ -166,7 +193,7 @@ typedef struct {
 	bool enableAutoReconnect;			///< Set to true to enable auto reconnect
 	char *pHostURL;					///< Pointer to a string defining the endpoint for the MQTT service
 	uint16_t port;					///< MQTT service listening port
-	char *pRootCALocation;				///< Pointer to a string defining the Root CA file (full file, not path)
+	char *pRootCALocation;				///< Pointer to a string defining the Root CA file (full file, not path). Not needed by the "tcp" and "memory" transports
 	char *pDeviceCertLocation;			///< Pointer to a string defining the device identity certificate file (full file, not path)
 	char *pDevicePrivateKeyLocation;        	///< Pointer to a string defining the device private key file (full file, not path)
 	uint32_t mqttCommandTimeout_ms;			///< Timeout for MQTT blocking calls. In milliseconds
@@ -174,6 +201,20 @@ typedef struct {
 	bool isSSLHostnameVerify;			///< Client should perform server certificate hostname validation
 	iot_disconnect_handler disconnectHandler;	///< Callback to be invoked upon connection loss
 	void *disconnectHandlerData;			///< Data to pass as argument when disconnect handler is called
+	uint32_t maxSubscriptions;			///< Maximum number of topic filters. Set to 0 to use AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS
+	unsigned char *pWriteBuf;			///< Caller supplied TX buffer of writeBufSize bytes. Set to NULL to allocate it
+	size_t writeBufSize;				///< Size of the TX buffer. Set to 0 to use AWS_IOT_MQTT_TX_BUF_LEN
+	unsigned char *pReadBuf;			///< Caller supplied RX buffer of readBufSize bytes. Set to NULL to allocate it
+	size_t readBufSize;				///< Initial size of the RX buffer. Set to 0 to use AWS_IOT_MQTT_RX_BUF_LEN
+	size_t maxReadBufSize;				///< An allocated RX buffer grows up to this size to receive bigger packets. Set to 0 to keep it at readBufSize
+	IoT_Allocator_t *pAllocator;			///< Allocator for the memory owned by the client. Set to NULL to use malloc and free
+	size_t publishCoalesceBufSize;			///< Publishes are packed into a buffer of this size and sent together. Set to 0 to send each publish on its own. Packed publishes a dropped connection did not send go out after the next connect
+	uint32_t publishCoalesceDelay_ms;		///< Longest time a packed publish waits for more before the buffer is sent. In milliseconds
+	char *pTLSSessionLocation;			///< File the TLS session is kept in so that connects after a restart can resume it. Set to NULL to keep it in memory only
+	TLSCredentials *pTLSCredentials;		///< Credentials parsed once and shared with other clients, see iot_tls_credentials_init. Set to NULL to parse the three files above on every connect
+	NetworkAddressCache *pAddressCache;		///< Cache the host is looked up in, can be shared with other clients, see iot_tls_address_cache_init. Set to NULL to resolve the host on every connect
+	uint16_t tlsMaxFragmentLength;			///< Largest TLS record payload asked of the server: 512, 1024, 2048 or 4096. Set to 0 for the largest the record buffers hold, see iot_tls_set_max_fragment_length
+	const char *pTransportName;			///< Network transport the client connects over: "tls", "tcp", "memory" or one registered with iot_network_register_transport. Set to NULL for TLS
 #ifdef _ENABLE_THREAD_SUPPORT_
 	bool isBlockOnThreadLockEnabled;		///< Timeout for Thread blocking calls. Set to 0 to block until lock is obtained. In milliseconds
 #endif
@@ -181,9 +222,11 @@ typedef struct {
 extern const IoT_Client_Init_Params iotClientInitParamsDefault;
 
 #ifdef _ENABLE_THREAD_SUPPORT_
-#define IoT_Client_Init_Params_initializer { true, NULL, 0, NULL, NULL, NULL, 20000, 5000, true, NULL, NULL, false }
+#define IoT_Client_Init_Params_initializer { true, NULL, 0, NULL, NULL, NULL, 20000, 5000, true, NULL, NULL, 0, \
+        NULL, 0, NULL, 0, 0, NULL, 0, 0, NULL, NULL, NULL, 0, NULL, false }
 #else
-#define IoT_Client_Init_Params_initializer { true, NULL, 0, NULL, NULL, NULL, 20000, 5000, true, NULL, NULL }
+#define IoT_Client_Init_Params_initializer { true, NULL, 0, NULL, NULL, NULL, 20000, 5000, true, NULL, NULL, 0, \
+        NULL, 0, NULL, 0, 0, NULL, 0, 0, NULL, NULL, NULL, 0, NULL }
 #endif
 
 /**
@@ -219,6 +262,30 @@ typedef enum _ClientState {
 typedef void (*pApplicationHandler_t)(AWS_IoT_Client *pClient, char *pTopicName, uint16_t topicNameLen,
 									  IoT_Publish_Message_Params *pParams, void *pClientData);
 
+/**
+ * @brief Streaming Chunk Callback Handler Type
+ *
+ * Defining a TYPE for definition of streaming subscription chunk function pointers.
+ * Called once for each part of the payload as it is read from the network. pParams->payload
+ * points into the client read buffer and is only valid for the duration of the call
+ *
+ */
+typedef void (*pStreamChunkHandler_t)(AWS_IoT_Client *pClient, char *pTopicName, uint16_t topicNameLen,
+									  IoT_Publish_Message_Params *pParams, size_t payloadOffset,
+									  size_t payloadTotalLen, void *pClientData);
+
+/**
+ * @brief Streaming Completion Callback Handler Type
+ *
+ * Defining a TYPE for definition of streaming subscription completion function pointers.
+ * Called once the last chunk of a message was delivered, or with an error status if the
+ * message could not be received completely. pParams->payloadLen holds the bytes delivered
+ *
+ */
+typedef void (*pStreamCompleteHandler_t)(AWS_IoT_Client *pClient, char *pTopicName, uint16_t topicNameLen,
+										 IoT_Publish_Message_Params *pParams, IoT_Error_t status,
+										 void *pClientData);
+
 /**
  * @brief MQTT Message Handler
  *
@@ -231,9 +298,216 @@ typedef struct _MessageHandlers {
 	uint16_t topicNameLen;
 	QoS qos;
 	pApplicationHandler_t pApplicationHandler;
+	pStreamChunkHandler_t pStreamChunkHandler;	/* Set instead of pApplicationHandler for streaming subscriptions */
+	pStreamCompleteHandler_t pStreamCompleteHandler;
 	void *pApplicationHandlerData;
+	uint32_t nextIndex;		/* Next handler in the same hash bucket, trie node or free list */
+	bool isPendingRemoval;		/* Unsubscribed during dispatch, removed once dispatch returns */
 } MessageHandlers;   /* Message handlers are indexed by subscription topic */
 
+/**
+ * @brief Wildcard Subscription Trie Node
+ *
+ * One topic level of a subscribed topic filter containing '+' or '#'. Defined in
+ * aws_iot_mqtt_client_subscription_index.c
+ *
+ */
+typedef struct _SubscriptionTrieNode SubscriptionTrieNode;
+
+/**
+ * @brief MQTT Subscription Index
+ *
+ * Defining a type for the runtime-sized subscription table of a client.
+ * Topic filters without wildcards are found through a hash table, filters with
+ * '+' or '#' through a trie with one node per topic level
+ *
+ */
+typedef struct _SubscriptionIndex {
+	MessageHandlers *pHandlers;		///< Handler slots, maxSubscriptions entries
+	uint32_t maxSubscriptions;		///< Number of handler slots
+	uint32_t *pBuckets;			///< Head handler index of each hash bucket for exact topic filters
+	uint32_t bucketMask;			///< Number of buckets minus one, the bucket count is a power of two
+	uint32_t freeIndex;			///< Head of the free handler slot list
+	SubscriptionTrieNode *pWildcardRoot;	///< Root of the trie for wildcard topic filters
+	SubscriptionTrieNode **pNodeBuckets;	///< Trie nodes hashed by parent node and topic level, same bucket count
+	uint32_t dispatchDepth;			///< Number of message dispatches in progress, removals are deferred while non zero
+	uint32_t streamingCount;		///< Number of streaming subscriptions, oversized messages are only streamed if non zero
+	bool isRemovalPending;			///< At least one handler is waiting for removal
+} SubscriptionIndex;
+
+/**
+ * @brief Publish Completion Callback Handler Type
+ *
+ * Defining a TYPE for definition of asynchronous publish completion function pointers.
+ * Called with SUCCESS once the PUBACK for an asynchronous QoS1 publish is received, or with
+ * NETWORK_DISCONNECTED_ERROR if the client is disconnected or freed before that. It is called
+ * exactly once for each QoS1 publish accepted by the client
+ *
+ */
+typedef void (*pPublishCompleteHandler_t)(AWS_IoT_Client *pClient, uint16_t packetId, IoT_Error_t status,
+										  void *pCompleteHandlerData);
+
+/**
+ * @brief MQTT In-flight Publish
+ *
+ * Defining a type for asynchronous QoS1 publishes waiting for a PUBACK.
+ * Records are indexed by packet id modulo AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES.
+ * Topic and payload are referenced, not copied, so they must stay valid until the
+ * completion handler is called
+ *
+ */
+typedef struct _InflightPublish {
+	const char *pTopicName;
+	uint16_t topicNameLen;
+	IoT_Publish_Message_Params params;
+	pPublishCompleteHandler_t pCompleteHandler;
+	void *pCompleteHandlerData;
+	Timer retryTimer;
+	bool isInUse;
+} InflightPublish;
+
+/**
+ * @brief MQTT Incoming Message Stream
+ *
+ * Defining a type for a PUBLISH too large for the read buffer, which is handed to the
+ * streaming subscriptions in chunks. Its fixed and variable header stay at the front of
+ * the read buffer while the payload is read behind them, one chunk at a time
+ *
+ */
+typedef struct _MessageStream {
+	IoT_Publish_Message_Params params;	///< Header fields of the message, payload points at the current chunk
+	char *pTopicName;			///< Topic name, inside the read buffer
+	uint16_t topicNameLen;
+	size_t headerLen;			///< Bytes of the fixed and variable header at the front of the read buffer
+	size_t payloadTotalLen;
+	size_t payloadOffset;			///< Payload bytes delivered so far
+	bool isInProgress;
+	bool isBeingRead;			///< A cycle read is delivering chunks, other readers have to wait
+	bool isDiscarding;			///< The handlers were told the message failed, the rest of it is read and dropped
+} MessageStream;
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+/**
+ * @brief MQTT Outgoing Packet
+ *
+ * Defining a type for a serialized packet handed to the TX thread. The packet bytes
+ * follow the struct in the same allocation
+ *
+ */
+typedef struct _TxPacket {
+	struct _TxPacket *pNext;		///< Next packet in the queue, written once by the producer that queued it
+	size_t len;				///< Number of packet bytes behind the struct
+} TxPacket;
+
+/**
+ * @brief MQTT I/O Threads
+ *
+ * Defining a type for the state of the full duplex mode. The RX thread reads and
+ * dispatches, publishers queue serialized packets for the TX thread on a lock free
+ * queue with many producers and a single consumer
+ *
+ */
+typedef struct _IoThreads {
+	IoT_Thread_t rxThread;
+	IoT_Thread_t txThread;
+	TxPacket *pQueueHead;			///< Last packet queued, producers swap their packet in here
+	TxPacket *pQueueTail;			///< Next packet to send, only touched by the TX thread
+	TxPacket queueStub;			///< Keeps the queue non empty so producers never touch pQueueTail
+	IoT_Mutex_t mutex;			///< Guards the flags and counts below and the condition variables. Lives as long as the client
+	IoT_Cond_t txCond;			///< Signalled when a packet is queued while the TX thread sleeps
+	IoT_Cond_t ackCond;			///< Signalled when a blocking QoS1 publish is complete
+	bool isTxWaiting;			///< The TX thread found the queue empty and is about to sleep
+	bool isRunning;				///< Publishes go through the queue
+	bool isStopping;			///< Set by aws_iot_mqtt_stop_io_threads to end the threads
+	uint32_t publisherCount;		///< Publishes in progress on the queue, stopping waits for them to leave
+	bool isRxWaitingForDispatch;		///< The RX thread waits for room in the dispatch pool, blocking publishes of its workers fail
+	bool wasBlockOnThreadLockEnabled;	///< isBlockOnThreadLockEnabled before the threads started
+} IoThreads;
+
+/**
+ * @brief MQTT Dispatched Message
+ *
+ * Defining a type for the copy of a received message that is handed to the dispatch
+ * workers. Topic name and payload follow the struct in the same allocation
+ *
+ */
+typedef struct _DispatchMessage {
+	struct _DispatchMessage *pNextFree;	///< Next buffer in the pool of free buffers
+	IoT_Publish_Message_Params params;	///< Header fields of the message, payload points into the copy
+	char *pTopicName;			///< Topic name, points into the copy
+	uint16_t topicNameLen;
+	uint32_t laneIndex;			///< Lane of the topic
+	uint32_t refCount;			///< Jobs not yet run, plus one while the message is being dispatched
+	bool isAckPending;			///< QoS1 message, the last holder sends the PUBACK once every handler has returned
+	uint32_t closedNetworkCount;		///< closedNetworkCount of the client when received, the PUBACK is only sent on that connection
+	size_t bufSize;				///< Bytes behind the struct
+} DispatchMessage;
+
+/**
+ * @brief MQTT Dispatch Job
+ *
+ * Defining a type for one handler to be called with one message
+ *
+ */
+typedef struct _DispatchJob {
+	struct _DispatchJob *pNext;		///< Next job in the lane, or in the pool of free jobs
+	DispatchMessage *pMessage;
+	pApplicationHandler_t pApplicationHandler;
+	void *pApplicationHandlerData;
+} DispatchJob;
+
+/**
+ * @brief MQTT Dispatch Lane
+ *
+ * Defining a type for the jobs of the topics that hash to the same lane. A lane is run
+ * by one worker at a time, so the handlers of a topic are called in the order the
+ * messages arrived
+ *
+ */
+typedef struct _DispatchLane {
+	DispatchJob *pHead;
+	DispatchJob *pTail;
+	struct _DispatchLane *pNextReady;	///< Next lane in the ready list of a worker
+	bool isScheduled;			///< The lane is in a ready list or one of its jobs is running
+} DispatchLane;
+
+/**
+ * @brief MQTT Dispatch Worker
+ *
+ * Defining a type for a thread of the dispatch pool. Lanes are made ready on the worker
+ * their index maps to, idle workers take ready lanes from the others
+ *
+ */
+typedef struct _DispatchWorker {
+	IoT_Thread_t thread;
+	AWS_IoT_Client *pClient;
+	DispatchLane *pReadyHead;		///< Lanes with jobs waiting for this worker
+	DispatchLane *pReadyTail;
+} DispatchWorker;
+
+/**
+ * @brief MQTT Dispatch Pool
+ *
+ * Defining a type for the worker threads that call the message handlers when
+ * dispatch is decoupled from reading
+ *
+ */
+typedef struct _DispatchPool {
+	DispatchLane lanes[AWS_IOT_MQTT_DISPATCH_LANES];
+	DispatchWorker *pWorkers;
+	uint32_t workerCount;
+	IoT_Mutex_t mutex;			///< Guards the lanes, the ready lists and the free buffers and jobs
+	IoT_Cond_t workCond;			///< Signalled when a lane becomes ready or the pool stops
+	IoT_Cond_t spaceCond;			///< Signalled when a job has run while the reader waits for room
+	DispatchMessage *pFreeMessages;		///< Free buffers of AWS_IOT_MQTT_DISPATCH_BUFFER_SIZE bytes
+	uint32_t freeMessageCount;
+	DispatchJob *pFreeJobs;
+	uint32_t queuedJobCount;		///< Jobs in the lanes, at most AWS_IOT_MQTT_DISPATCH_MAX_QUEUED_JOBS
+	uint32_t idleWorkerCount;		///< Workers waiting on workCond
+	bool isStopping;			///< Set by aws_iot_mqtt_stop_dispatch_pool, workers finish the queued jobs and exit
+} DispatchPool;
+#endif
+
 /**
  * @brief MQTT Client Status
  *
@@ -245,6 +519,7 @@ typedef struct _ClientStatus {
 	ClientState clientState;
 	bool isPingOutstanding;
 	bool isAutoReconnectEnabled;
+	bool isNetworkConnecting;	///< A reconnect by the client manager waits for the network connect it started
 } ClientStatus;
 
 /**
@@ -263,26 +538,55 @@ typedef struct _ClientData {
 	uint32_t counterNetworkDisconnected;
 
 	/* The below values are initialized with the
-	 * lengths of the TX/RX buffers and never modified
-	 * afterwards */
+	 * lengths of the TX/RX buffers. Only readBufSize
+	 * is modified afterwards, when the RX buffer grows
+	 * towards maxReadBufSize */
 	size_t writeBufSize;
 	size_t readBufSize;
-
-	unsigned char writeBuf[AWS_IOT_MQTT_TX_BUF_LEN];
-	unsigned char readBuf[AWS_IOT_MQTT_RX_BUF_LEN];
+	size_t maxReadBufSize;
+
+	unsigned char *writeBuf;
+	unsigned char *readBuf;
+	bool isWriteBufOwned;
+	bool isReadBufOwned;
+	IoT_Allocator_t allocator;
+
+	/* Serialized publishes waiting to be sent together, flushed when the
+	 * buffer is full, its delay ran out or any other packet is sent. Those
+	 * the connection dropped before are held back while connecting and sent
+	 * once the broker accepts the next connection */
+	unsigned char *pCoalesceBuf;
+	size_t coalesceBufSize;
+	size_t coalesceLen;
+	size_t coalesceHeldLen;
+	uint32_t coalesceDelayMs;
+	Timer coalesceTimer;
+
+	/* Bytes received into readBuf, and the length of the packet at
+	 * its start which is dropped when the next packet is read */
+	size_t readBufValidLen;
+	size_t readBufPacketLen;
+	MessageStream stream;
 
 #ifdef _ENABLE_THREAD_SUPPORT_
 	bool isBlockOnThreadLockEnabled;
 	IoT_Mutex_t state_change_mutex;
 	IoT_Mutex_t tls_read_mutex;
 	IoT_Mutex_t tls_write_mutex;
+	IoT_Mutex_t inflight_mutex;
+	IoThreads ioThreads;
+	DispatchPool *pDispatchPool;
+	uint32_t closedNetworkCount;	///< Connections closed so far, changed under tls_write_mutex
 #endif
 
 	IoT_Client_Connect_Params options;
 
-	MessageHandlers messageHandlers[AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS];
+	SubscriptionIndex subscriptions;
 	iot_disconnect_handler disconnectHandler;
 
+	InflightPublish inflightPublishes[AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES];
+	uint16_t inflightPublishCount;
+
 	void *disconnectHandlerData;
 } ClientData;
 
@@ -114,7 +114,15 @@ void aws_iot_mqtt_internal_write_char(unsigned char **pptr, unsigned char c);
 void aws_iot_mqtt_internal_write_utf8_string(unsigned char **pptr, const char *string, uint16_t stringLen);
 
 IoT_Error_t aws_iot_mqtt_internal_send_packet(AWS_IoT_Client *pClient, size_t length, Timer *pTimer);
+IoT_Error_t aws_iot_mqtt_internal_send_vectors(AWS_IoT_Client *pClient, const IoT_IoVec_t *pVectors, size_t count,
+											   Timer *pTimer);
+IoT_Error_t aws_iot_mqtt_internal_coalesce_vectors(AWS_IoT_Client *pClient, const IoT_IoVec_t *pVectors,
+												   size_t count, Timer *pTimer);
+IoT_Error_t aws_iot_mqtt_internal_flush_coalesced(AWS_IoT_Client *pClient, Timer *pTimer, bool isForced);
+IoT_Error_t aws_iot_mqtt_internal_close_network(AWS_IoT_Client *pClient);
 IoT_Error_t aws_iot_mqtt_internal_cycle_read(AWS_IoT_Client *pClient, Timer *pTimer, uint8_t *pPacketType);
+bool aws_iot_mqtt_internal_is_read_pending(AWS_IoT_Client *pClient);
+IoT_Error_t aws_iot_mqtt_internal_service(AWS_IoT_Client *pClient, uint32_t maxWait_ms, uint32_t *pWait_ms);
 IoT_Error_t aws_iot_mqtt_internal_wait_for_read(AWS_IoT_Client *pClient, uint8_t packetType, Timer *pTimer);
 IoT_Error_t aws_iot_mqtt_internal_serialize_zero(unsigned char *pTxBuf, size_t txBufLen,
 												 MessageTypes packetType, size_t *pSerializedLength);
@@ -123,6 +131,35 @@ IoT_Error_t aws_iot_mqtt_internal_deserialize_publish(uint8_t *dup, QoS *qos,
 													  char **pTopicName, uint16_t *topicNameLen,
 													  unsigned char **payload, size_t *payloadLen,
 													  unsigned char *pRxBuf, size_t rxBufLen);
+IoT_Error_t aws_iot_mqtt_internal_handle_inflight_puback(AWS_IoT_Client *pClient, bool *pIsConsumed);
+IoT_Error_t aws_iot_mqtt_internal_resend_inflight_publishes(AWS_IoT_Client *pClient, bool isForced);
+uint32_t aws_iot_mqtt_internal_next_inflight_retry_ms(AWS_IoT_Client *pClient, uint32_t maxWait_ms);
+void aws_iot_mqtt_internal_abort_inflight_publishes(AWS_IoT_Client *pClient, IoT_Error_t status);
+IoT_Error_t aws_iot_mqtt_internal_disconnect_keep_inflight(AWS_IoT_Client *pClient);
+IoT_Error_t aws_iot_mqtt_internal_complete_reconnect(AWS_IoT_Client *pClient);
+
+void *aws_iot_mqtt_internal_malloc(AWS_IoT_Client *pClient, size_t size);
+void *aws_iot_mqtt_internal_realloc(AWS_IoT_Client *pClient, void *ptr, size_t size);
+void aws_iot_mqtt_internal_free(AWS_IoT_Client *pClient, void *ptr);
+
+IoT_Error_t aws_iot_mqtt_internal_init_subscriptions(AWS_IoT_Client *pClient, uint32_t maxSubscriptions);
+void aws_iot_mqtt_internal_free_subscriptions(AWS_IoT_Client *pClient);
+IoT_Error_t aws_iot_mqtt_internal_add_subscription(AWS_IoT_Client *pClient, const char *pTopicFilter,
+												   uint16_t topicFilterLen, QoS qos,
+												   pApplicationHandler_t pApplicationHandler,
+												   pStreamChunkHandler_t pStreamChunkHandler,
+												   pStreamCompleteHandler_t pStreamCompleteHandler,
+												   void *pApplicationHandlerData, uint32_t *pHandlerIndex);
+bool aws_iot_mqtt_internal_has_subscription(AWS_IoT_Client *pClient, const char *pTopicFilter,
+											uint16_t topicFilterLen);
+IoT_Error_t aws_iot_mqtt_internal_remove_subscription(AWS_IoT_Client *pClient, const char *pTopicFilter,
+													  uint16_t topicFilterLen);
+IoT_Error_t aws_iot_mqtt_internal_remove_subscription_handler(AWS_IoT_Client *pClient, uint32_t handlerIndex);
+void aws_iot_mqtt_internal_dispatch_message(AWS_IoT_Client *pClient, char *pTopicName, uint16_t topicNameLen,
+											IoT_Publish_Message_Params *pMessageParams);
+void aws_iot_mqtt_internal_dispatch_stream(AWS_IoT_Client *pClient, MessageStream *pStream, bool isComplete,
+										   IoT_Error_t status);
+void aws_iot_mqtt_internal_abort_stream(AWS_IoT_Client *pClient, IoT_Error_t status);
 
 IoT_Error_t aws_iot_mqtt_set_client_state(AWS_IoT_Client *pClient, ClientState expectedCurrentState,
 										  ClientState newState);
@@ -133,6 +170,25 @@ IoT_Error_t aws_iot_mqtt_client_lock_mutex(AWS_IoT_Client *pClient, IoT_Mutex_t
 
 IoT_Error_t aws_iot_mqtt_client_unlock_mutex(AWS_IoT_Client *pClient, IoT_Mutex_t *pMutex);
 
+IoT_Error_t aws_iot_mqtt_internal_send_vectors_if_connected(AWS_IoT_Client *pClient, const IoT_IoVec_t *pVectors,
+															size_t count, Timer *pTimer);
+IoT_Error_t aws_iot_mqtt_internal_send_dispatched_puback(AWS_IoT_Client *pClient, uint16_t packetId,
+														 uint32_t closedNetworkCount);
+
+IoT_Error_t aws_iot_mqtt_internal_queue_vectors(AWS_IoT_Client *pClient, const IoT_IoVec_t *pVectors, size_t count);
+bool aws_iot_mqtt_internal_io_enter(AWS_IoT_Client *pClient);
+void aws_iot_mqtt_internal_io_leave(AWS_IoT_Client *pClient);
+bool aws_iot_mqtt_internal_is_rx_thread(AWS_IoT_Client *pClient);
+void aws_iot_mqtt_internal_io_set_rx_waiting(AWS_IoT_Client *pClient, bool isWaiting);
+
+IoT_Error_t aws_iot_mqtt_internal_dispatch_to_pool(AWS_IoT_Client *pClient, char *pTopicName, uint16_t topicNameLen,
+												   IoT_Publish_Message_Params *pMessageParams);
+void aws_iot_mqtt_internal_dispatch_pooled_message(AWS_IoT_Client *pClient, DispatchMessage *pMessage);
+bool aws_iot_mqtt_internal_is_dispatch_worker(AWS_IoT_Client *pClient);
+void aws_iot_mqtt_internal_queue_dispatch_job(AWS_IoT_Client *pClient, DispatchMessage *pMessage,
+											  pApplicationHandler_t pApplicationHandler,
+											  void *pApplicationHandlerData);
+
 #endif
 
 #ifdef __cplusplus
@@ -70,6 +70,20 @@ extern "C" {
  */
 IoT_Error_t aws_iot_mqtt_init(AWS_IoT_Client *pClient, IoT_Client_Init_Params *pInitParams);
 
+/**
+ * @brief MQTT Client Free Function
+ *
+ * Called to release the memory allocated by aws_iot_mqtt_init.
+ * The client must be disconnected. It can be initialized again afterwards.
+ * Asynchronous QoS1 publishes still waiting for their PUBACK are completed with
+ * NETWORK_DISCONNECTED_ERROR
+ *
+ * @param pClient Reference to the IoT Client
+ *
+ * @return IoT_Error_t Type defining successful/failed API call
+ */
+IoT_Error_t aws_iot_mqtt_free(AWS_IoT_Client *pClient);
+
 /**
  * @brief MQTT Connection Function
  *
@@ -87,7 +101,8 @@ IoT_Error_t aws_iot_mqtt_connect(AWS_IoT_Client *pClient, IoT_Client_Connect_Par
  *
  * Called to publish an MQTT message on a topic.
  * @note Call is blocking.  In the case of a QoS 0 message the function returns
- * after the message was successfully passed to the TLS layer.  In the case of QoS 1
+ * after the message was successfully passed to the TLS layer, or packed with other
+ * messages if publishCoalesceBufSize was set at init.  In the case of QoS 1
  * the function returns after the receipt of the PUBACK control packet.
  *
  * @param pClient Reference to the IoT Client
@@ -100,6 +115,57 @@ IoT_Error_t aws_iot_mqtt_connect(AWS_IoT_Client *pClient, IoT_Client_Connect_Par
 IoT_Error_t aws_iot_mqtt_publish(AWS_IoT_Client *pClient, const char *pTopicName, uint16_t topicNameLen,
 								 IoT_Publish_Message_Params *pParams);
 
+/**
+ * @brief Publish an MQTT message on a topic without waiting for the PUBACK
+ *
+ * Called to publish an MQTT message on a topic.
+ * @note Call is non-blocking.  The message is passed to the TLS layer and the function returns.
+ * In the case of QoS 1 the message is tracked in the in-flight window until the PUBACK is
+ * received during yield, at which point the completion handler is called.  Unacknowledged
+ * messages are sent again with the DUP flag set after AWS_IOT_MQTT_PUBLISH_RETRY_INTERVAL_MS
+ * and after an automatic reconnect.  Topic and payload are not copied and must remain valid
+ * until the completion handler is called, also when no handler is given.  If the client is
+ * disconnected, loses the connection without auto-reconnect, or is freed first, the handler
+ * is called with NETWORK_DISCONNECTED_ERROR.  In the case of QoS 0 the completion handler
+ * is called before the function returns.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pTopicName Topic Name to publish to
+ * @param topicNameLen Length of the topic name
+ * @param pParams Pointer to Publish Message parameters. The packet id is returned in the id field
+ * @param pCompleteHandler Handler called once the publish is complete, can be NULL
+ * @param pCompleteHandlerData Data to be passed as argument to the completion handler
+ *
+ * @return An IoT Error Type defining successful/failed publish
+ */
+IoT_Error_t aws_iot_mqtt_publish_async(AWS_IoT_Client *pClient, const char *pTopicName, uint16_t topicNameLen,
+									   IoT_Publish_Message_Params *pParams,
+									   pPublishCompleteHandler_t pCompleteHandler, void *pCompleteHandlerData);
+
+/**
+ * @brief Publish several MQTT messages together
+ *
+ * Called to publish a batch of MQTT messages. The messages are serialized back to back
+ * into the write buffer and sent in a single write, so that many small messages share
+ * TLS records instead of paying the record overhead and a system call each. Messages
+ * too large for the write buffer are sent on their own.
+ * @note Call is non-blocking. QoS 1 messages are added to the in-flight window and
+ * completed from yield when the PUBACK arrives, QoS 0 messages are completed once sent.
+ * The whole batch is refused if the window cannot take all of its QoS 1 messages.
+ * As for aws_iot_mqtt_publish_async, topics and payloads of QoS 1 messages must remain
+ * valid until their completion handler is called.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pEntries Messages to publish, the id of QoS 1 messages is set by the call
+ * @param entryCount Number of messages
+ * @param pCompleteHandler Handler called once each publish is complete, can be NULL
+ * @param pCompleteHandlerData Data to be passed as argument to the completion handler
+ *
+ * @return An IoT Error Type defining successful/failed publish
+ */
+IoT_Error_t aws_iot_mqtt_publish_batch(AWS_IoT_Client *pClient, IoT_Publish_Batch_Entry *pEntries, size_t entryCount,
+									   pPublishCompleteHandler_t pCompleteHandler, void *pCompleteHandlerData);
+
 /**
  * @brief Subscribe to an MQTT topic.
  *
@@ -118,6 +184,30 @@ IoT_Error_t aws_iot_mqtt_publish(AWS_IoT_Client *pClient, const char *pTopicName
 IoT_Error_t aws_iot_mqtt_subscribe(AWS_IoT_Client *pClient, const char *pTopicName, uint16_t topicNameLen,
 								   QoS qos, pApplicationHandler_t pApplicationHandler, void *pApplicationHandlerData);
 
+/**
+ * @brief Subscribe to an MQTT topic and receive its messages in chunks.
+ *
+ * Called to send a subscribe message to the broker requesting a subscription
+ * to an MQTT topic. Messages too large for the read buffer are not dropped, their
+ * payload is handed to pChunkHandler part by part as it is read from the network,
+ * in constant memory and without copying it out of the read buffer. Messages that
+ * fit are delivered as a single chunk. pCompleteHandler is called after the last
+ * chunk, or with an error if the connection failed before the message was complete
+ * @note Call is blocking.  The call returns after the receipt of the SUBACK control packet.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pTopicName Topic Name to publish to
+ * @param topicNameLen Length of the topic name
+ * @param pChunkHandler Reference to the function handling each payload chunk
+ * @param pCompleteHandler Reference to the function called once a message is complete, can be NULL
+ * @param pHandlerData Data to be passed as argument to both callbacks
+ *
+ * @return An IoT Error Type defining successful/failed subscription
+ */
+IoT_Error_t aws_iot_mqtt_subscribe_streaming(AWS_IoT_Client *pClient, const char *pTopicName, uint16_t topicNameLen,
+											 QoS qos, pStreamChunkHandler_t pChunkHandler,
+											 pStreamCompleteHandler_t pCompleteHandler, void *pHandlerData);
+
 /**
  * @brief Subscribe to an MQTT topic.
  *
@@ -151,6 +241,8 @@ IoT_Error_t aws_iot_mqtt_unsubscribe(AWS_IoT_Client *pClient, const char *pTopic
  * @brief Disconnect an MQTT Connection
  *
  * Called to send a disconnect message to the broker.
+ * Asynchronous QoS1 publishes still waiting for their PUBACK are completed with
+ * NETWORK_DISCONNECTED_ERROR, also if the connection was already lost.
  *
  * @param pClient Reference to the IoT Client
  *
@@ -192,6 +284,82 @@ IoT_Error_t aws_iot_mqtt_yield(AWS_IoT_Client *pClient, uint32_t timeout_ms);
  */
 IoT_Error_t aws_iot_mqtt_attempt_reconnect(AWS_IoT_Client *pClient);
 
+#ifdef _ENABLE_THREAD_SUPPORT_
+/**
+ * @brief Start the full duplex mode
+ *
+ * Starts an RX thread that yields the client in a loop and a TX thread that sends
+ * publishes. From then on publish, publish async and publish batch may be called from
+ * any number of threads at the same time. They serialize the message and queue it for
+ * the TX thread without waiting for the RX thread. A blocking QoS 1 publish returns when
+ * the RX thread has received its PUBACK. Called from a handler on the RX thread it fails
+ * at once with MQTT_BLOCKING_PUBLISH_ON_RX_THREAD_ERROR, handlers publish asynchronously.
+ * Published messages are copied, memory comes from the allocator of the client which
+ * must be thread safe.
+ *
+ * The application must not yield the client while the threads run. Subscribe,
+ * unsubscribe and disconnect are called before the threads are started or after
+ * they are stopped.
+ *
+ * @param pClient Reference to the IoT Client
+ *
+ * @return An IoT Error Type defining successful/failed start
+ */
+IoT_Error_t aws_iot_mqtt_start_io_threads(AWS_IoT_Client *pClient);
+
+/**
+ * @brief Stop the full duplex mode
+ *
+ * Sends what is queued and returns once both threads have finished and every publish
+ * in progress on them has returned. Blocking QoS 1 publishes still waiting for their
+ * PUBACK give up at once with MQTT_REQUEST_TIMEOUT_ERROR.
+ *
+ * @param pClient Reference to the IoT Client
+ *
+ * @return An IoT Error Type defining successful/failed stop
+ */
+IoT_Error_t aws_iot_mqtt_stop_io_threads(AWS_IoT_Client *pClient);
+
+/**
+ * @brief Start calling message handlers from a pool of worker threads
+ *
+ * From then on a received message is copied and handed to the workers, so that a slow
+ * handler no longer holds up reading, keep alive and the other subscriptions. Topics are
+ * hashed onto AWS_IOT_MQTT_DISPATCH_LANES lanes, the handlers of one lane are called one
+ * at a time in the order the messages arrived. Handlers of different lanes run in parallel
+ * and must be thread safe. Streaming subscriptions are still called by the reading thread.
+ *
+ * The PUBACK of a QoS 1 message is sent once every handler of the message has returned,
+ * so QoS 1 stays at least once: a message whose handlers did not all run, because the
+ * process ended or the connection was replaced meanwhile, is delivered again by the broker.
+ *
+ * A handler may run after its topic was unsubscribed, for a message received before.
+ * Handlers that publish should do so in full duplex mode, see aws_iot_mqtt_start_io_threads.
+ * While the workers are AWS_IOT_MQTT_DISPATCH_MAX_QUEUED_JOBS jobs behind, the RX thread
+ * waits for them and reads no PUBACK, so a blocking QoS 1 publish from a handler then fails
+ * at once with MQTT_BLOCKING_PUBLISH_ON_RX_THREAD_ERROR. Handlers publish asynchronously.
+ * The pool is started and stopped while the client is not being yielded.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param workerCount Number of worker threads
+ *
+ * @return An IoT Error Type defining successful/failed start
+ */
+IoT_Error_t aws_iot_mqtt_start_dispatch_pool(AWS_IoT_Client *pClient, uint32_t workerCount);
+
+/**
+ * @brief Stop the dispatch pool
+ *
+ * Returns once the queued handler calls have been made and the workers have finished.
+ * Handlers are called by the reading thread again afterwards.
+ *
+ * @param pClient Reference to the IoT Client
+ *
+ * @return An IoT Error Type defining successful/failed stop
+ */
+IoT_Error_t aws_iot_mqtt_stop_dispatch_pool(AWS_IoT_Client *pClient);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,197 @@
+/*
+* Copyright 2015-2016 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License").
+* You may not use this file except in compliance with the License.
+* A copy of the License is located at
+*
+* http://aws.amazon.com/apache2.0
+*
+* or in the "license" file accompanying this file. This file is distributed
+* on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+* express or implied. See the License for the specific language governing
+* permissions and limitations under the License.
+*/
+
+/**
+ * @file aws_iot_mqtt_client_manager.h
+ * @brief Drive many MQTT clients from a few threads
+ *
+ * Instead of one thread blocked in aws_iot_mqtt_yield per client, the sockets of all
+ * managed clients are waited on together in one network event set. A client is only
+ * serviced when its socket is readable or one of its timers is due: keep alive,
+ * reconnect backoff, packed publishes or in-flight retries. The clients are kept in a
+ * heap ordered by their next deadline, so a wakeup only touches the clients that are
+ * ready, not every managed client.
+ *
+ * A managed client that reconnects does the TCP connect and the TLS handshake without
+ * blocking, see iot_tls_connect_start. Its connect is taken forward each time its socket
+ * is ready, so one reconnect does not hold up the other clients of the thread. Once the
+ * handshake is done, the CONNACK and the SUBACKs of the subscriptions made again are
+ * waited for as before.
+ *
+ * Managed clients are initialized and connected as usual. They must not be yielded by
+ * the application while they are managed, everything else is called as before.
+ */
+
+#ifndef AWS_IOT_SDK_SRC_IOT_MQTT_CLIENT_MANAGER_H
+#define AWS_IOT_SDK_SRC_IOT_MQTT_CLIENT_MANAGER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "aws_iot_error.h"
+#include "aws_iot_config.h"
+#include "aws_iot_mqtt_client.h"
+
+#include "network_interface.h"
+#include "timer_interface.h"
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+#include "threads_interface.h"
+#endif
+
+/**
+ * @brief Client Manager Initialization Parameters
+ *
+ * Defining a type for client manager initialization parameters.
+ * Passed to aws_iot_mqtt_manager_init
+ *
+ */
+typedef struct {
+	uint32_t maxClients;		///< Most clients the manager drives at the same time
+	uint32_t workerCount;		///< Threads started by aws_iot_mqtt_manager_start. Only used with thread support
+} IoT_Client_Manager_Init_Params;
+extern const IoT_Client_Manager_Init_Params iotClientManagerInitParamsDefault;
+
+#define IoT_Client_Manager_Init_Params_initializer { 64, 1 }
+
+/**
+ * @brief Managed Client
+ *
+ * Defining a type for the record the manager keeps for each client.
+ *
+ */
+typedef struct {
+	AWS_IoT_Client *pClient;	///< The client, NULL if the record is free
+	Timer serviceTimer;		///< Expires when the client has timer work to do
+	bool isBusy;			///< A worker is servicing the client
+	bool isEventPending;		///< The socket became readable while the client was busy
+	uint32_t heapIndex;		///< Position in the timer heap of the manager. Only valid while the client is not busy
+} IoT_Managed_Client;
+
+/**
+ * @brief Client Manager
+ *
+ * Defining a type for a client manager. All members are private.
+ *
+ */
+typedef struct {
+	IoT_Managed_Client *pClients;	///< Records of the managed clients
+	uint32_t maxClients;		///< Number of records
+	uint32_t clientCount;		///< Number of records in use
+	IoT_Managed_Client **pTimerHeap;	///< Managed clients that are not busy, the one whose service timer expires first at the top
+	uint32_t timerHeapCount;	///< Number of clients in the timer heap
+	NetworkEventSet eventSet;	///< Sockets of the managed clients
+#ifdef _ENABLE_THREAD_SUPPORT_
+	IoT_Mutex_t lock;		///< Protects the records
+	IoT_Thread_t *pWorkers;		///< Threads started by aws_iot_mqtt_manager_start
+	uint32_t workerCount;		///< Number of worker threads
+	uint32_t runningWorkerCount;	///< Number of worker threads currently started
+	bool isStopping;		///< Set by aws_iot_mqtt_manager_stop to end the worker threads
+#endif
+} AWS_IoT_Client_Manager;
+
+/**
+ * @brief Client Manager Initialization Function
+ *
+ * @param pManager Reference to the manager
+ * @param pParams Sizes of the manager. NULL to use iotClientManagerInitParamsDefault
+ *
+ * @return IoT_Error_t Type defining successful/failed API call
+ */
+IoT_Error_t aws_iot_mqtt_manager_init(AWS_IoT_Client_Manager *pManager, const IoT_Client_Manager_Init_Params *pParams);
+
+/**
+ * @brief Start driving a client
+ *
+ * The client can be added before or after it is connected. Its sockets are added to the
+ * event set of the manager after every connect from then on. A running manager picks the
+ * client up within AWS_IOT_MQTT_MANAGER_IDLE_CHECK_INTERVAL_MS.
+ *
+ * @param pManager Reference to the manager
+ * @param pClient Reference to an initialized IoT Client
+ *
+ * @return SUCCESS, or MQTT_MAX_MANAGED_CLIENTS_REACHED_ERROR if the manager is full
+ */
+IoT_Error_t aws_iot_mqtt_manager_add_client(AWS_IoT_Client_Manager *pManager, AWS_IoT_Client *pClient);
+
+/**
+ * @brief Stop driving a client
+ *
+ * @param pManager Reference to the manager
+ * @param pClient Reference to a managed IoT Client
+ *
+ * @return SUCCESS, or MQTT_CLIENT_NOT_IDLE_ERROR if a worker is servicing the client. Try again then
+ */
+IoT_Error_t aws_iot_mqtt_manager_remove_client(AWS_IoT_Client_Manager *pManager, AWS_IoT_Client *pClient);
+
+/**
+ * @brief Drive the managed clients on the calling thread
+ *
+ * Services clients as their sockets become readable and their timers expire until the
+ * timeout passes or the manager is stopped. Several threads may run the same manager,
+ * a client is only serviced by one of them at a time.
+ *
+ * @param pManager Reference to the manager
+ * @param timeout_ms Time to drive the clients for, in milliseconds
+ *
+ * @return SUCCESS, or NETWORK_EVENT_SET_ERROR if waiting on the sockets failed
+ */
+IoT_Error_t aws_iot_mqtt_manager_run(AWS_IoT_Client_Manager *pManager, uint32_t timeout_ms);
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+/**
+ * @brief Start the worker threads
+ *
+ * Starts workerCount threads that run the manager until aws_iot_mqtt_manager_stop.
+ *
+ * @param pManager Reference to the manager
+ *
+ * @return IoT_Error_t Type defining successful/failed API call
+ */
+IoT_Error_t aws_iot_mqtt_manager_start(AWS_IoT_Client_Manager *pManager);
+
+/**
+ * @brief Stop the worker threads
+ *
+ * Returns once every worker thread has finished.
+ *
+ * @param pManager Reference to the manager
+ *
+ * @return IoT_Error_t Type defining successful/failed API call
+ */
+IoT_Error_t aws_iot_mqtt_manager_stop(AWS_IoT_Client_Manager *pManager);
+#endif
+
+/**
+ * @brief Client Manager Free Function
+ *
+ * Releases the resources of the manager. The worker threads must be stopped. Clients
+ * still managed are removed, they stay connected.
+ *
+ * @param pManager Reference to the manager
+ *
+ * @return IoT_Error_t Type defining successful/failed API call
+ */
+IoT_Error_t aws_iot_mqtt_manager_free(AWS_IoT_Client_Manager *pManager);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AWS_IOT_SDK_SRC_IOT_MQTT_CLIENT_MANAGER_H */
@@ -57,6 +57,7 @@ typedef struct {
 	char *pClientKey; ///< Location of Device private key
 	bool enableAutoReconnect;        ///< Set to true to enable auto reconnect
 	iot_disconnect_handler disconnectHandler;    ///< Callback to be invoked upon connection loss.
+	const char *pTransportName; ///< Network transport the MQTT client connects over, see IoT_Client_Init_Params. Set to NULL for TLS
 } ShadowInitParameters_t;
 
 /*!
@@ -240,12 +241,53 @@ IoT_Error_t aws_iot_shadow_delete(AWS_IoT_Client *pClient, const char *pThingNam
  *
  * Any time a delta is published the Json document will be delivered to the pStruct->cb. If you don't want the parsing done by the SDK then use the jsonStruct_t key set to "state". A good example of this is displayed in the sample_apps/shadow_console_echo.c
  *
+ * A key matches the first member of that name in the delta, at any depth and inside arrays as well. A key with the names of nested members joined with '.', such as "motor.left.speed", only matches that member of the state object.
+ * A path of MAX_JSON_DEPTH_EXPECTED names or more, or a SHADOW_JSON_STRUCT whose jsonObject_t nests more than MAX_JSON_DEPTH_EXPECTED objects, could never be matched or decoded and is refused with FAILURE.
+ * The callbacks of a delta are called in the order of the keys in the delta, not in the order of registration. Keys that are only found inside an array, or in objects nested deeper than MAX_JSON_DEPTH_EXPECTED, are matched after the others, in the order of registration.
+ * A SHADOW_JSON_STRUCT whose pData is a jsonObject_t is decoded into the members of the jsonObject_t, nested objects included, before pStruct->cb is called. A SHADOW_JSON_OBJECT is only handed to pStruct->cb.
+ *
  * @param pClient MQTT Client used as the protocol layer
  * @param pStruct The struct used to parse JSON value
  * @return An IoT Error Type defining successful/failed delta registering
  */
 IoT_Error_t aws_iot_shadow_register_delta(AWS_IoT_Client *pClient, jsonStruct_t *pStruct);
 
+/**
+ * @brief Register an attribute to be reported with aws_iot_shadow_update_reported
+ *
+ * The SDK keeps the value of the attribute last accepted by the Shadow service, and an update of the reported attributes only carries those that changed since.
+ * Numbers are compared by value, strings and objects by their JSON. A string or object whose JSON is MAX_SIZE_OF_REPORTED_ATTRIBUTE_JSON bytes or longer is reported on every update. Registering the same pStruct again changes its deadband and reports it on the next update.
+ *
+ * @param pClient MQTT Client used as the protocol layer
+ * @param pStruct The attribute, read on every update. pKey and pData have to stay valid
+ * @param deadband For the number types, the smallest change from the accepted value that is reported. 0 to report every change
+ * @return SUCCESS, NULL_VALUE_ERROR, or FAILURE if MAX_REPORTED_ATTRIBUTES_REGISTERED attributes are registered already
+ */
+IoT_Error_t aws_iot_shadow_register_reported(AWS_IoT_Client *pClient, jsonStruct_t *pStruct, double deadband);
+
+/**
+ * @brief Update the shadow with the registered attributes that changed since the last accepted update
+ *
+ * Builds a reported document of the attributes registered with aws_iot_shadow_register_reported whose value differs from the one last accepted by the Shadow service,
+ * by more than the deadband for numbers, and sends it like aws_iot_shadow_update. The first update reports every attribute.
+ * The values sent become the accepted ones when the update/accepted response with the client token of the document is received, so the response is always waited for and
+ * the attributes of an update that is rejected or times out are sent again by the next one.
+ * Only the response to the last update is waited for. An update made before that response arrived sends the attributes of the previous update again, until an update of them is accepted. The registered attributes describe one shadow, always update the same Thing Name.
+ *
+ * @param pClient MQTT Client used as the protocol layer
+ * @param pThingName Thing Name of the shadow that needs to be Updated
+ * @param pJsonString Buffer the document is built in, it holds the document sent on return
+ * @param maxSizeOfJsonString Size of pJsonString
+ * @param callback Called with the response like for aws_iot_shadow_update, NULL if the response is not important
+ * @param pContextData This is an extra parameter that could be passed along with the callback. It should be set to NULL if not used
+ * @param timeout_seconds It is the time the SDK will wait for the response on either accepted/rejected before declaring timeout on the action
+ * @param isPersistentSubscribe Keep the subscription to the response topics, as for aws_iot_shadow_update. Reports are usually made often so this should be set to true
+ * @return SHADOW_NOTHING_TO_REPORT if no attribute changed and nothing was sent, otherwise an IoT Error Type defining successful/failed update action
+ */
+IoT_Error_t aws_iot_shadow_update_reported(AWS_IoT_Client *pClient, const char *pThingName, char *pJsonString,
+										   size_t maxSizeOfJsonString, fpActionCallback_t callback,
+										   void *pContextData, uint8_t timeout_seconds, bool isPersistentSubscribe);
+
 /**
  * @brief Reset the last received version number to zero.
  * This will be useful if the Thing Shadow is deleted and would like to to reset the local version
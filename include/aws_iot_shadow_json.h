@@ -25,11 +25,152 @@ extern "C" {
 
 #include "aws_iot_error.h"
 #include "aws_iot_shadow_json_data.h"
+#include "aws_iot_json_utils.h"
+#include "aws_iot_config.h"
 
-bool isJsonValidAndParse(const char *pJsonDocument, void *pJsonHandler, int32_t *pTokenCount);
+/**
+ * @brief Parsed Shadow JSON Document
+ *
+ * A received shadow document tokenized once. The tokens of the keys every consumer needs
+ * are found in the same pass, so the version, the clientToken and the state subtrees are read
+ * without scanning or parsing the document again.
+ */
+typedef struct {
+	const char *pJson;		///< Document the tokens point into
+	size_t jsonLen;			///< Length of the document, it does not need to be null terminated
+	jsmntok_t tokens[MAX_JSON_TOKEN_EXPECTED];
+	int32_t tokenCount;
+	int32_t versionIndex;		///< Token of the top level version value, -1 if absent
+	int32_t clientTokenIndex;	///< Token of the top level clientToken value, -1 if absent
+	int32_t stateIndex;			///< Token of the state object, -1 if absent
+	int32_t desiredIndex;		///< Token of the state.desired object, -1 if absent
+	int32_t reportedIndex;		///< Token of the state.reported object, -1 if absent
+	int32_t deltaIndex;			///< Token of the state.delta object, -1 if absent
+} ShadowJsonDocument_t;
+
+/**
+ * @brief Tokenize a shadow document
+ *
+ * @param pDocument - Set to the tokens of the document and the indexes of its well known keys
+ * @param pJson - Document to parse, referenced by pDocument until it is parsed again
+ * @param jsonLen - Length of the document
+ * @return true if the document is valid JSON with an object at the top level
+ */
+bool parseJsonDocument(ShadowJsonDocument_t *pDocument, const char *pJson, size_t jsonLen);
+
+/**
+ * @brief Find a key of an object of a parsed document
+ *
+ * Only the direct members of the object are compared, nested objects are skipped.
+ *
+ * @param pDocument - Document parsed with parseJsonDocument
+ * @param objectIndex - Token of the object to search
+ * @param pKey - Key to find
+ * @return Token of the value of the key, -1 if the object has no such key
+ */
+int32_t findJsonDocumentKey(const ShadowJsonDocument_t *pDocument, int32_t objectIndex, const char *pKey);
+
+/**
+ * @brief Find the first key of a name in a parsed document, in any object and any array
+ *
+ * Unlike walkJsonDocumentKeys, this looks into arrays and has no depth limit, but it goes over the
+ * members of every object of the document for each key looked for.
+ *
+ * @param pDocument - Document parsed with parseJsonDocument
+ * @param pKey - Key to find
+ * @param keyLen - Length of the key
+ * @return Token of the key, -1 if the document has no such key
+ */
+int32_t findJsonDocumentKeyAtAnyDepth(const ShadowJsonDocument_t *pDocument, const char *pKey, size_t keyLen);
+
+/**
+ * @brief Path of a key in a parsed document
+ *
+ * The keys leading from the walked object down to the current key.
+ */
+typedef struct {
+	int32_t keyIndexes[MAX_JSON_DEPTH_EXPECTED];	///< Tokens of the keys, the last one is the current key
+	uint8_t keyCount;		///< Number of keys in keyIndexes, 1 for a key of the walked object itself
+	uint32_t keyHash;		///< hashJsonKey of the current key
+	uint32_t pathHash;		///< hashJsonKey of all the keys joined with '.'
+} JsonDocumentKeyPath_t;
+
+/**
+ * @brief Handler of the keys of a parsed document
+ *
+ * @param pDocument - Document being walked
+ * @param pPath - Path of the key, the token of its value follows the last key
+ * @param pContext - Context given to walkJsonDocumentKeys
+ */
+typedef void (*JsonDocumentKeyHandler_t)(const ShadowJsonDocument_t *pDocument, const JsonDocumentKeyPath_t *pPath,
+										 void *pContext);
+
+/**
+ * @brief Call a handler on every key of an object and of the objects nested in it
+ *
+ * The keys are visited once each in the order of the document. Arrays and objects nested
+ * deeper than MAX_JSON_DEPTH_EXPECTED are not looked into, the return value tells whether
+ * that left keys out.
+ *
+ * @param pDocument - Document parsed with parseJsonDocument
+ * @param objectIndex - Token of the object to walk
+ * @param handler - Called for each key
+ * @param pContext - Passed to the handler
+ * @return false if keys inside arrays or deeper objects were skipped
+ */
+bool walkJsonDocumentKeys(const ShadowJsonDocument_t *pDocument, int32_t objectIndex,
+						  JsonDocumentKeyHandler_t handler, void *pContext);
+
+/**
+ * @brief Compare the keys of a path with a path given as keys joined with '.'
+ *
+ * @param pDocument - Document the path was walked in
+ * @param pPath - Path given to a JsonDocumentKeyHandler_t
+ * @param firstKey - Number of keys at the start of pPath left out of the comparison
+ * @param pKeyPath - Path to compare with, "motor.left.speed" for example
+ * @param keyPathLen - Length of pKeyPath
+ * @return true if the keys of pPath from firstKey on are the keys of pKeyPath
+ */
+bool isJsonDocumentPath(const ShadowJsonDocument_t *pDocument, const JsonDocumentKeyPath_t *pPath, uint8_t firstKey,
+						const char *pKeyPath, size_t keyPathLen);
+
+/**
+ * @brief Hash of a JSON key, the same for a key of a document and a key given by the application
+ */
+uint32_t hashJsonKey(const char *pKey, size_t keyLen);
+
+/**
+ * @brief Hash of the characters of pKey appended to those a hash was computed from
+ *
+ * hashJsonKey of "motor.left" is extendJsonKeyHash of hashJsonKey of "motor." with "left".
+ */
+uint32_t extendJsonKeyHash(uint32_t hash, const char *pKey, size_t keyLen);
+
+/**
+ * @brief Decode a value of a parsed document into the data of a jsonStruct_t
+ *
+ * Strings and SHADOW_JSON_OBJECT values are left to the callback of the jsonStruct_t and are not
+ * decoded. A SHADOW_JSON_STRUCT is decoded into the members of the jsonObject_t its pData points to,
+ * the callbacks of the members are called once they are decoded. Members missing from the object
+ * are left unchanged.
+ *
+ * @param pDocument - Document parsed with parseJsonDocument
+ * @param valueIndex - Token of the value
+ * @param pDataStruct - Its pData is updated according to its type
+ * @return SUCCESS, or the error of the parse function of the type
+ */
+IoT_Error_t updateJsonStructValue(const ShadowJsonDocument_t *pDocument, int32_t valueIndex,
+								  jsonStruct_t *pDataStruct);
 
-bool isJsonKeyMatchingAndUpdateValue(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount,
-									 jsonStruct_t *pDataStruct, uint32_t *pDataLength, int32_t *pDataPosition);
+/**
+ * @brief Check that updateJsonStructValue can decode every object a jsonStruct_t nests
+ *
+ * A SHADOW_JSON_STRUCT is decoded up to MAX_JSON_DEPTH_EXPECTED objects deep, counting its own.
+ *
+ * @param pDataStruct - jsonStruct_t to check, of any type
+ * @return false if its jsonObject_t members nest objects deeper than that
+ */
+bool isJsonStructDecodable(const jsonStruct_t *pDataStruct);
 
 void aws_iot_shadow_internal_get_request_json(char *pJsonDocument);
 
@@ -37,13 +178,46 @@ void aws_iot_shadow_internal_delete_request_json(char *pJsonDocument);
 
 void resetClientTokenSequenceNum(void);
 
-
-bool isReceivedJsonValid(const char *pJsonDocument);
-
 void FillWithClientToken(char *pStringToUpdateClientToken);
 
 bool extractClientToken(const char *pJsonDocumentToBeSent, char *pExtractedClientToken);
 
+bool extractDocumentClientToken(const ShadowJsonDocument_t *pDocument, char *pExtractedClientToken,
+								size_t maxSizeOfClientToken);
+
+bool extractDocumentVersionNumber(const ShadowJsonDocument_t *pDocument, uint32_t *pVersionNumber);
+
+/**
+ * @brief Check and tokenize a received document
+ *
+ * @deprecated Use parseJsonDocument, which does not need a null terminated document and
+ * keeps the tokens with the document.
+ *
+ * @param pJsonDocument - Null terminated document
+ * @param pJsonHandler - Unused
+ * @param pTokenCount - Set to the number of tokens of the document
+ * @return true if the document is valid JSON with an object at the top level
+ */
+bool isJsonValidAndParse(const char *pJsonDocument, void *pJsonHandler, int32_t *pTokenCount);
+
+/**
+ * @brief Check that a received document is valid JSON with an object at the top level
+ *
+ * @deprecated Use parseJsonDocument.
+ */
+bool isReceivedJsonValid(const char *pJsonDocument);
+
+/**
+ * @brief Read the version of a document checked with isJsonValidAndParse
+ *
+ * @deprecated Use extractDocumentVersionNumber on a document parsed with parseJsonDocument.
+ *
+ * @param pJsonDocument - Null terminated document, parsed again if it is not the one checked last
+ * @param pJsonHandler - Unused
+ * @param tokenCount - Unused, the tokens are those of the document checked last
+ * @param pVersionNumber - Set to the top level version of the document
+ * @return true if the document has a version
+ */
 bool extractVersionNumber(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount, uint32_t *pVersionNumber);
 
 #ifdef __cplusplus
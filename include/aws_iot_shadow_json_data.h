@@ -54,19 +54,31 @@ typedef enum {
 	SHADOW_JSON_DOUBLE,
 	SHADOW_JSON_BOOL,
 	SHADOW_JSON_STRING,
-	SHADOW_JSON_OBJECT
+	SHADOW_JSON_OBJECT,
+	SHADOW_JSON_STRUCT
 } JsonPrimitiveType;
 
 /**
  * @brief This is the struct form of a JSON Key value pair
  */
 struct jsonStruct {
-	const char *pKey; ///< JSON key
-	void *pData; ///< pointer to the data (JSON value)
+	const char *pKey; ///< JSON key. When registered on the delta, keys joined with '.' such as "motor.left.speed" are a path from the state object
+	void *pData; ///< pointer to the data (JSON value). For SHADOW_JSON_OBJECT the JSON text of the object, which is not decoded. For SHADOW_JSON_STRUCT a jsonObject_t to decode the object into, or NULL to only get the callback
 	JsonPrimitiveType type; ///< type of JSON
 	jsonStructCallback_t cb; ///< callback to be executed on receiving the Key value pair
 };
 
+/**
+ * @brief The members of a JSON object, to decode the object into the data of each member
+ *
+ * The pKey of each member is its name in the object. Members of type SHADOW_JSON_STRUCT with their
+ * own jsonObject_t decode nested objects, so a whole tree of C structs is filled from one object.
+ */
+typedef struct {
+	jsonStruct_t *pMembers; ///< Array of the members
+	uint8_t memberCount; ///< Number of members in pMembers
+} jsonObject_t;
+
 /**
  * @brief Initialize the JSON document with Shadow expected name/value
  *
@@ -142,6 +154,98 @@ IoT_Error_t aws_iot_finalize_json_document(char *pJsonDocument, size_t maxSizeOf
 
 IoT_Error_t aws_iot_fill_with_client_token(char *pBufferToBeUpdatedWithClientToken, size_t maxSizeOfJsonDocument);
 
+/**
+ * @brief Cursor over a JSON document being built
+ *
+ * Keeps the write position and the nesting of the document, so values are appended in place without
+ * measuring or reformatting what was already written. The documents are the same, byte for byte, as
+ * those of aws_iot_shadow_init_json_document, aws_iot_shadow_add_reported, aws_iot_shadow_add_desired and
+ * aws_iot_finalize_json_document.
+ *
+ * The first error is kept in rc and every later call returns it without writing, so the calls can be made
+ * one after the other and the result checked once. The document is null terminated after every call.
+ */
+typedef struct {
+	char *pBuffer; ///< Buffer the document is written to
+	size_t bufferSize; ///< Size of pBuffer, the null terminator included
+	size_t length; ///< Length of the document written so far
+	IoT_Error_t rc; ///< First error met while building, SUCCESS if none
+	uint8_t depth; ///< Number of objects and arrays opened and not closed yet
+	uint32_t hasMembersMask; ///< Bit n is set once the object or array at depth n has a member
+	uint32_t isArrayMask; ///< Bit n is set if depth n is an array
+} jsonBuilder_t;
+
+#define JSON_BUILDER_MAX_DEPTH 32 ///< Deepest nesting of objects and arrays a jsonBuilder_t can build, the document and its state object included
+
+/**
+ * @brief Start a Shadow JSON document
+ *
+ * Writes {"state":{ and leaves the cursor in the state object, to add the desired and reported objects to.
+ *
+ * @param pBuilder The builder to start
+ * @param pJsonDocument The JSON Document filled in this char buffer
+ * @param maxSizeOfJsonDocument maximum size of the pJsonDocument that can be used to fill the JSON document
+ * @return SUCCESS, NULL_VALUE_ERROR or SHADOW_JSON_BUFFER_TRUNCATED
+ */
+IoT_Error_t aws_iot_shadow_json_builder_init(jsonBuilder_t *pBuilder, char *pJsonDocument, size_t maxSizeOfJsonDocument);
+
+/**
+ * @brief Open an object, such as "desired" or "reported" in the state object
+ *
+ * @param pBuilder The builder started with aws_iot_shadow_json_builder_init
+ * @param pKey Name of the object, ignored when the object is an element of an array
+ * @return SUCCESS, or the first error of the builder. SHADOW_JSON_ERROR when nested deeper than JSON_BUILDER_MAX_DEPTH
+ */
+IoT_Error_t aws_iot_shadow_json_builder_begin_object(jsonBuilder_t *pBuilder, const char *pKey);
+
+/**
+ * @brief Close the object opened last
+ *
+ * @param pBuilder The builder started with aws_iot_shadow_json_builder_init
+ * @return SUCCESS, or the first error of the builder. SHADOW_JSON_ERROR if the innermost open value is not an object
+ */
+IoT_Error_t aws_iot_shadow_json_builder_end_object(jsonBuilder_t *pBuilder);
+
+/**
+ * @brief Open an array
+ *
+ * @param pBuilder The builder started with aws_iot_shadow_json_builder_init
+ * @param pKey Name of the array, ignored when the array is an element of an array
+ * @return SUCCESS, or the first error of the builder. SHADOW_JSON_ERROR when nested deeper than JSON_BUILDER_MAX_DEPTH
+ */
+IoT_Error_t aws_iot_shadow_json_builder_begin_array(jsonBuilder_t *pBuilder, const char *pKey);
+
+/**
+ * @brief Close the array opened last
+ *
+ * @param pBuilder The builder started with aws_iot_shadow_json_builder_init
+ * @return SUCCESS, or the first error of the builder. SHADOW_JSON_ERROR if the innermost open value is not an array
+ */
+IoT_Error_t aws_iot_shadow_json_builder_end_array(jsonBuilder_t *pBuilder);
+
+/**
+ * @brief Add a value to the object or array opened last
+ *
+ * The value is formatted as aws_iot_shadow_add_reported does. A SHADOW_JSON_STRUCT is added as an object of all the
+ * members of its jsonObject_t. Strings and the JSON text of a SHADOW_JSON_OBJECT are written as they are, without
+ * escaping.
+ *
+ * @param pBuilder The builder started with aws_iot_shadow_json_builder_init
+ * @param pStruct The key and value to add, the key is ignored in an array
+ * @return SUCCESS, or the first error of the builder. NULL_VALUE_ERROR if the value or the key in an object is NULL
+ */
+IoT_Error_t aws_iot_shadow_json_builder_add(jsonBuilder_t *pBuilder, const jsonStruct_t *pStruct);
+
+/**
+ * @brief Close the state object and end the document with a client token
+ *
+ * Like aws_iot_finalize_json_document, the client token sequence number is incremented.
+ *
+ * @param pBuilder The builder started with aws_iot_shadow_json_builder_init, with every object and array it opened closed
+ * @return SUCCESS, or the first error of the builder. SHADOW_JSON_ERROR if an object or an array is still open
+ */
+IoT_Error_t aws_iot_shadow_json_builder_finalize(jsonBuilder_t *pBuilder);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,5 +18,7 @@
 
 #define SHADOW_CLIENT_TOKEN_STRING "clientToken"
 #define SHADOW_VERSION_STRING "version"
+#define SHADOW_STATE_STRING "state"
+#define SHADOW_REPORTED_STRING "reported"
 
 #endif /* SRC_SHADOW_AWS_IOT_SHADOW_KEY_H_ */
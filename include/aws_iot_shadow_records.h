@@ -45,8 +45,12 @@ void addToAckWaitList(uint8_t indexAckWaitList, const char *pThingName, ShadowAc
 					  uint32_t timeout_seconds);
 bool getNextFreeIndexOfAckWaitList(uint8_t *pIndex);
 void HandleExpiredResponseCallbacks(void);
+uint32_t getTimeToNextAckExpiryMs(uint32_t maxWait_ms);
 void initDeltaTokens(void);
 IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct);
+void initReportedAttributes(void);
+IoT_Error_t registerReportedAttribute(jsonStruct_t *pStruct, double deadband);
+IoT_Error_t buildReportedDiff(char *pJsonDocument, size_t maxSizeOfJsonDocument);
 
 #ifdef __cplusplus
 }
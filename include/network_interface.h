@@ -41,6 +41,42 @@ extern "C" {
  */
 typedef struct Network Network;
 
+/**
+ * @brief I/O Vector Type
+ *
+ * Defines one buffer of a scatter-gather write. The buffers of a list are sent
+ * back to back as one contiguous stream of bytes.
+ */
+typedef struct {
+	const unsigned char *pBase;            ///< Pointer to the first byte of the buffer
+	size_t len;                            ///< Number of bytes in the buffer
+} IoT_IoVec_t;
+
+/**
+ * @brief Network Event Set Type
+ *
+ * A set of network connections that are waited on together, so one thread can
+ * serve many connections. The definition is platform specific and lives in
+ * "network_platform.h".
+ */
+typedef struct NetworkEventSet NetworkEventSet;
+
+/**
+ * @brief TLS Credentials Type
+ *
+ * Root CA, device certificate and private key parsed once and shared by many network
+ * connections. The definition is platform specific and lives in "network_platform.h".
+ */
+typedef struct TLSCredentials TLSCredentials;
+
+/**
+ * @brief Network Address Cache Type
+ *
+ * Resolved addresses of the hosts connected to, shared by many network connections. The
+ * definition is platform specific and lives in "network_platform.h".
+ */
+typedef struct NetworkAddressCache NetworkAddressCache;
+
 /**
  * @brief TLS Connection Parameters
  *
@@ -55,8 +91,21 @@ typedef struct {
 	uint16_t DestinationPort;            ///< Integer defining the connection port of the MQTT service.
 	uint32_t timeout_ms;                ///< Unsigned integer defining the TLS handshake timeout value in milliseconds.
 	bool ServerVerificationFlag;        ///< Boolean.  True = perform server certificate hostname validation.  False = skip validation \b NOT recommended.
+	uint16_t maxFragmentLength;            ///< Largest record payload asked of the server: 512, 1024, 2048 or 4096. 0 = the largest the record buffers hold.
 } TLSConnectParams;
 
+/**
+ * @brief TLS Memory Report
+ *
+ * Heap held by the TLS library for one connection, to size the record buffers by.
+ */
+typedef struct {
+	size_t heapBytes;                    ///< Heap held for the connection now, parsed credentials included unless they are shared
+	size_t peakHeapBytes;                ///< Most heap held at once since the connection was initialized, handshakes included
+	size_t recordBufferBytes;            ///< Part of heapBytes taken by the incoming and outgoing record buffers
+	size_t maxFragmentLength;            ///< Largest record payload sent on the connection, and asked of the server
+} TLSMemoryReport;
+
 /**
  * @brief Network Structure
  *
@@ -64,9 +113,15 @@ typedef struct {
  */
 struct Network {
 	IoT_Error_t (*connect)(Network *, TLSConnectParams *);
+	IoT_Error_t (*connectStart)(Network *, TLSConnectParams *);    ///< Function pointer pointing to the network function to start a connect without blocking, see iot_tls_connect_start. Optional, can be NULL
+	IoT_Error_t (*connectContinue)(Network *);    ///< Function pointer pointing to the network function to take a connect started by connectStart forward. Set along with connectStart
+	IoT_Error_t (*connectLeftMs)(Network *, uint32_t *);    ///< Function pointer pointing to the network function to get the time until the connect in progress has to be taken forward. Set along with connectStart
 
 	IoT_Error_t (*read)(Network *, unsigned char *, size_t, Timer *, size_t *);    ///< Function pointer pointing to the network function to read from the network
+	IoT_Error_t (*readAvailable)(Network *, unsigned char *, size_t, Timer *, size_t *);    ///< Function pointer pointing to the network function to read whatever is available from the network, up to the given length. Optional, can be NULL
 	IoT_Error_t (*write)(Network *, unsigned char *, size_t, Timer *, size_t *);    ///< Function pointer pointing to the network function to write to the network
+	IoT_Error_t (*writev)(Network *, const IoT_IoVec_t *, size_t, Timer *, size_t *);    ///< Function pointer pointing to the network function to write a list of buffers to the network. Optional, can be NULL
+	IoT_Error_t (*waitReadable)(Network *, uint32_t);    ///< Function pointer pointing to the network function to block until data can be read or the timeout in milliseconds passes. Optional, can be NULL
 	IoT_Error_t (*disconnect)(Network *);    ///< Function pointer pointing to the network function to disconnect from the network
 	IoT_Error_t (*isConnected)(Network *);    ///< Function pointer pointing to the network function to check if physical layer is connected
 	IoT_Error_t (*destroy)(Network *);        ///< Function pointer pointing to the network function to destroy the network object
@@ -75,6 +130,97 @@ struct Network {
 	TLSDataParams tlsDataParams;            ///< TLSData params structure containing the connection data parameters that are specific to the library being used
 };
 
+/**
+ * @brief Network Transport Init Function
+ *
+ * Sets up the function pointers of a Network for one transport, with the parameters of
+ * iot_tls_init. Transports that do not use TLS ignore the credential files and the
+ * server verification flag.
+ */
+typedef IoT_Error_t (*NetworkTransportInit)(Network *, char *, char *, char *, char *, uint16_t, uint32_t, bool);
+
+/**
+ * @brief Register a network transport under a name
+ *
+ * The built in transports are "tls", "tcp" and "memory". Transports are registered once at
+ * startup, before any client is initialized over them.
+ *
+ * @param pName - Name the transport is selected by, kept by reference
+ * @param init - Function that sets up a Network for the transport
+ * @return IoT_Error_t - SUCCESS, or NETWORK_MAX_TRANSPORTS_REACHED_ERROR if there is no room
+ *                       for another transport, see AWS_IOT_NETWORK_MAX_TRANSPORTS
+ */
+IoT_Error_t iot_network_register_transport(const char *pName, NetworkTransportInit init);
+
+/**
+ * @brief Initialize a Network over a transport selected by name
+ *
+ * @param pNetwork - Pointer to a Network struct defining the network interface.
+ * @param pTransportName - Name of the transport, NULL for "tls"
+ * @param pRootCALocation - Path of the location of the Root CA
+ * @param pDeviceCertLocation - Path to the location of the Device Cert
+ * @param pDevicyPrivateKeyLocation - Path to the location of the device private key file
+ * @param pDestinationURL - The target endpoint to connect to
+ * @param DestinationPort - The port on the target to connect to
+ * @param timeout_ms - The value to use for timeout of operation
+ * @param ServerVerificationFlag - used to decide whether server verification is needed or not
+ *
+ * @return IoT_Error_t - the result of the init function of the transport, or
+ *                       NETWORK_TRANSPORT_NOT_FOUND_ERROR if no transport has the name
+ */
+IoT_Error_t iot_network_init(Network *pNetwork, const char *pTransportName, char *pRootCALocation,
+							 char *pDeviceCertLocation, char *pDevicePrivateKeyLocation, char *pDestinationURL,
+							 uint16_t DestinationPort, uint32_t timeout_ms, bool ServerVerificationFlag);
+
+/**
+ * @brief Initialize the plain TCP transport
+ *
+ * Same as iot_tls_init, but the connection is a plain TCP socket without TLS, for brokers
+ * on a trusted local network and for measuring the MQTT client without the cost of TLS.
+ * The socket is kept in the TLS data of the Network, so event sets work with it as well.
+ *
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tcp_init(Network *pNetwork, char *pRootCALocation, char *pDeviceCertLocation,
+						 char *pDevicePrivateKeyLocation, char *pDestinationURL,
+						 uint16_t DestinationPort, uint32_t timeout_ms, bool ServerVerificationFlag);
+
+/**
+ * @brief Initialize the in-process memory transport
+ *
+ * Same as iot_tcp_init, but a connect goes to the listener registered with iot_memory_listen
+ * under the destination URL, in the same process. The port is ignored.
+ *
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_memory_init(Network *pNetwork, char *pRootCALocation, char *pDeviceCertLocation,
+							char *pDevicePrivateKeyLocation, char *pDestinationURL,
+							uint16_t DestinationPort, uint32_t timeout_ms, bool ServerVerificationFlag);
+
+/**
+ * @brief Accept connects of the memory transport under a name
+ *
+ * Each connect to the name creates a pipe and hands its peer end to the accept function,
+ * on the thread of the connect. Listeners are registered before anything connects to them.
+ *
+ * @param pName - Name connects give as destination URL, kept by reference
+ * @param accept - Function called with the peer end of each new pipe
+ * @param pContext - Passed to the accept function
+ * @return IoT_Error_t - SUCCESS, or NETWORK_MAX_TRANSPORTS_REACHED_ERROR if there is no room
+ *                       for another listener, see AWS_IOT_NETWORK_MEMORY_MAX_LISTENERS
+ */
+IoT_Error_t iot_memory_listen(const char *pName, NetworkMemoryAcceptFunction accept, void *pContext);
+
+/**
+ * @brief Stop accepting connects of the memory transport under a name
+ *
+ * Pipes created before are not affected.
+ *
+ * @param pName - Name given to iot_memory_listen
+ * @return IoT_Error_t - SUCCESS, or NETWORK_TRANSPORT_NOT_FOUND_ERROR if nothing listens under the name
+ */
+IoT_Error_t iot_memory_unlisten(const char *pName);
+
 /**
  * @brief Initialize the TLS implementation
  *
@@ -108,6 +254,67 @@ IoT_Error_t iot_tls_init(Network *pNetwork, char *pRootCALocation, char *pDevice
  */
 IoT_Error_t iot_tls_connect(Network *pNetwork, TLSConnectParams *TLSParams);
 
+/**
+ * @brief Start a TLS connection without blocking
+ *
+ * Sets up the TLS context and starts the TCP connect to the server. The connect and the
+ * TLS handshake are then taken forward by iot_tls_connect_continue each time a socket
+ * is ready, so one thread can keep many connects in flight. Resolving the host name
+ * blocks unless its addresses are cached, see iot_tls_set_address_cache. The timeout
+ * of the connection parameters bounds the whole connect.
+ *
+ * The addresses of the server are raced. IPv6 and IPv4 addresses take turns, and a TCP
+ * connect to the next address starts whenever one fails or has not got through within
+ * AWS_IOT_NETWORK_CONNECT_ATTEMPT_DELAY_MS. The first connect to get through is used.
+ *
+ * If the connection was added to an event set, its sockets are registered for the event
+ * the connect waits for, and iot_tls_event_set_wait returns the connection when it is
+ * time to call iot_tls_connect_continue. It has to be called as well once the time given
+ * by iot_tls_connect_left_ms passes. Otherwise iot_tls_connect_wait waits for all of it.
+ *
+ * @param pNetwork - Pointer to a Network struct defining the network interface.
+ * @param TLSParams - TLSConnectParams defines the properties of the TLS connection, NULL to keep those set before
+ * @return IoT_Error_t - NETWORK_CONNECT_IN_PROGRESS, or the error that ended the connect
+ */
+IoT_Error_t iot_tls_connect_start(Network *pNetwork, TLSConnectParams *TLSParams);
+
+/**
+ * @brief Take a TLS connection started by iot_tls_connect_start forward
+ *
+ * Does as much of the connect as can be done without blocking. A call before the socket
+ * is ready does nothing. A connect that fails on one address of the server goes on with
+ * the next one.
+ *
+ * @param pNetwork - Pointer to a Network struct defining the network interface.
+ * @return IoT_Error_t - SUCCESS once connected, NETWORK_CONNECT_IN_PROGRESS while waiting for
+ * the socket, NETWORK_SSL_CONNECT_TIMEOUT_ERROR if the timeout passed, or another TLS error
+ */
+IoT_Error_t iot_tls_connect_continue(Network *pNetwork);
+
+/**
+ * @brief Wait until a TLS connection in progress can be taken forward
+ *
+ * Waits for the socket to be ready for the connect, no longer than the connect has left.
+ *
+ * @param pNetwork - Pointer to a Network struct defining the network interface.
+ * @param uint32_t - maximum time to wait in milliseconds
+ * @return IoT_Error_t - SUCCESS if the socket is ready or no connect is in progress,
+ * NETWORK_CONNECT_IN_PROGRESS if the wait timed out
+ */
+IoT_Error_t iot_tls_connect_wait(Network *pNetwork, uint32_t timeout_ms);
+
+/**
+ * @brief Get the time until a TLS connection in progress has to be taken forward
+ *
+ * iot_tls_connect_continue has to be called by then even if no socket is ready, to start
+ * a TCP connect to the next address of the server or to end a connect that timed out.
+ *
+ * @param pNetwork - Pointer to a Network struct defining the network interface.
+ * @param uint32_t - pointer to store the time in milliseconds, 0 if no connect is in progress
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tls_connect_left_ms(Network *pNetwork, uint32_t *pLeft_ms);
+
 /**
  * @brief Write bytes to the network socket
  *
@@ -120,6 +327,22 @@ IoT_Error_t iot_tls_connect(Network *pNetwork, TLSConnectParams *TLSParams);
  */
 IoT_Error_t iot_tls_write(Network *, unsigned char *, size_t, Timer *, size_t *);
 
+/**
+ * @brief Write a list of buffers to the network socket
+ *
+ * Sends the buffers in order as if they were one. Large buffers are passed to the
+ * TLS layer in place, small ones are gathered first so that they do not each end
+ * up in a TLS record of their own.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ * @param IoT_IoVec_t pointer - list of buffers to write to socket
+ * @param size_t - number of buffers in the list
+ * @param Timer * - operation timer
+ * @param size_t - pointer to store number of bytes written
+ * @return IoT_Error_t - successful write or TLS error code
+ */
+IoT_Error_t iot_tls_writev(Network *, const IoT_IoVec_t *, size_t, Timer *, size_t *);
+
 /**
  * @brief Read bytes from the network socket
  *
@@ -132,6 +355,268 @@ IoT_Error_t iot_tls_write(Network *, unsigned char *, size_t, Timer *, size_t *)
  */
 IoT_Error_t iot_tls_read(Network *, unsigned char *, size_t, Timer *, size_t *);
 
+/**
+ * @brief Read available bytes from the network socket
+ *
+ * Unlike iot_tls_read this returns as soon as any bytes are received, so a single call
+ * can return a whole TLS record holding several MQTT packets.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ * @param unsigned char pointer - pointer to buffer where read bytes should be copied
+ * @param size_t - maximum number of bytes to read
+ * @param Timer * - operation timer
+ * @param size_t - pointer to store number of bytes read
+ * @return IoT_Error_t - successful read or TLS error code
+ */
+IoT_Error_t iot_tls_read_available(Network *, unsigned char *, size_t, Timer *, size_t *);
+
+/**
+ * @brief Wait until data can be read from the network socket
+ *
+ * Blocks on the socket until it is readable or the timeout passes, without reading.
+ * Data the TLS layer has already decrypted and buffered counts as readable, since
+ * the socket will not signal it again. Without an open socket this waits out the
+ * timeout.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ * @param uint32_t - maximum time to wait in milliseconds
+ * @return IoT_Error_t - SUCCESS if data can be read, NETWORK_SSL_READ_TIMEOUT_ERROR if the timeout passed
+ */
+IoT_Error_t iot_tls_wait_readable(Network *, uint32_t);
+
+/**
+ * @brief Initialize a network event set
+ *
+ * @param NetworkEventSet - Pointer to the event set to be initialized
+ * @return IoT_Error_t - SUCCESS or NETWORK_EVENT_SET_ERROR
+ */
+IoT_Error_t iot_tls_event_set_init(NetworkEventSet *);
+
+/**
+ * @brief Register a network connection with an event set
+ *
+ * The connection stays registered across reconnects, each new socket is added to the
+ * set once its TLS handshake is done, or as soon as it is created by iot_tls_connect_start. A readable socket is reported once and has to
+ * be rearmed with iot_tls_event_set_rearm to be reported again.
+ *
+ * @param NetworkEventSet - Pointer to the event set
+ * @param Network - Pointer to a Network struct defining the network interface
+ * @param void - pointer returned by iot_tls_event_set_wait when the connection is readable
+ * @return IoT_Error_t - SUCCESS or NETWORK_EVENT_SET_ERROR
+ */
+IoT_Error_t iot_tls_event_set_add(NetworkEventSet *, Network *, void *);
+
+/**
+ * @brief Remove a network connection from its event set
+ *
+ * @param Network - Pointer to a Network struct defining the network interface
+ * @return IoT_Error_t - SUCCESS or NETWORK_EVENT_SET_ERROR
+ */
+IoT_Error_t iot_tls_event_set_remove(Network *);
+
+/**
+ * @brief Report a network connection again once it is readable
+ *
+ * @param Network - Pointer to a Network struct defining the network interface
+ * @return IoT_Error_t - SUCCESS or NETWORK_EVENT_SET_ERROR
+ */
+IoT_Error_t iot_tls_event_set_rearm(Network *);
+
+/**
+ * @brief Wait until connections of an event set are readable
+ *
+ * @param NetworkEventSet - Pointer to the event set
+ * @param void ** - array receiving the pointers registered with the readable connections
+ * @param size_t - number of entries in the array
+ * @param uint32_t - maximum time to wait in milliseconds
+ * @param size_t - pointer to store the number of readable connections
+ * @param bool - pointer to store whether the set was interrupted
+ * @return IoT_Error_t - SUCCESS or NETWORK_EVENT_SET_ERROR
+ */
+IoT_Error_t iot_tls_event_set_wait(NetworkEventSet *, void **, size_t, uint32_t, size_t *, bool *);
+
+/**
+ * @brief Interrupt an event set, or clear the interruption
+ *
+ * While the set is interrupted every wait on it, including those already blocked,
+ * returns at once with the interrupted flag set.
+ *
+ * @param NetworkEventSet - Pointer to the event set
+ * @param bool - true to interrupt the set, false to clear the interruption
+ * @return IoT_Error_t - SUCCESS or NETWORK_EVENT_SET_ERROR
+ */
+IoT_Error_t iot_tls_event_set_interrupt(NetworkEventSet *, bool);
+
+/**
+ * @brief Free the resources of an event set
+ *
+ * @param NetworkEventSet - Pointer to the event set
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tls_event_set_free(NetworkEventSet *);
+
+/**
+ * @brief Load TLS credentials to be shared by network connections
+ *
+ * Parses the files and seeds a random number generator once. Connections using the
+ * credentials only do the TLS handshake on connect. The file locations are kept and
+ * must stay valid.
+ *
+ * @param TLSCredentials - Pointer to the credentials to be initialized
+ * @param char - path of the root CA file
+ * @param char - path of the device certificate file
+ * @param char - path of the device private key file
+ * @return IoT_Error_t - SUCCESS, or the TLS error of the file that failed to parse
+ */
+IoT_Error_t iot_tls_credentials_init(TLSCredentials *, char *, char *, char *);
+
+/**
+ * @brief Parse the credential files again if they changed
+ *
+ * Connects check the files as well and pick up changes on their own. Connections made
+ * before a reload keep the credentials they were made with. If the new files fail to
+ * parse the credentials loaded before stay in use.
+ *
+ * @param TLSCredentials - Pointer to the credentials
+ * @return IoT_Error_t - SUCCESS, or the TLS error of the file that failed to parse
+ */
+IoT_Error_t iot_tls_credentials_reload(TLSCredentials *);
+
+/**
+ * @brief Free TLS credentials
+ *
+ * Every network connection using the credentials must be destroyed first.
+ *
+ * @param TLSCredentials - Pointer to the credentials
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tls_credentials_free(TLSCredentials *);
+
+/**
+ * @brief Make a network connection use shared TLS credentials
+ *
+ * Takes effect on the next connect. The file locations passed at init are not used
+ * while credentials are set.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface
+ * @param TLSCredentials - Pointer to the credentials, NULL to parse the files on each connect again
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tls_set_credentials(Network *, TLSCredentials *);
+
+/**
+ * @brief Initialize a network address cache
+ *
+ * Connections using the cache resolve a host once and then use its addresses until they
+ * expire, after the TTL given by the resolver or AWS_IOT_NETWORK_ADDRESS_CACHE_TTL_SEC.
+ * Expired addresses are still used if the host cannot be resolved again. The host is
+ * resolved again as well when no address of it could be connected to.
+ *
+ * @param NetworkAddressCache - Pointer to the cache to be initialized
+ * @param NetworkResolveFunction - resolver to call on a miss, NULL for the system resolver
+ * @return IoT_Error_t - SUCCESS, or the error of creating the lock of the cache
+ */
+IoT_Error_t iot_tls_address_cache_init(NetworkAddressCache *, NetworkResolveFunction);
+
+/**
+ * @brief Drop every address held by a network address cache
+ *
+ * The next connect to each host resolves it again.
+ *
+ * @param NetworkAddressCache - Pointer to the cache
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tls_address_cache_flush(NetworkAddressCache *);
+
+/**
+ * @brief Free a network address cache
+ *
+ * Every network connection using the cache must be destroyed first.
+ *
+ * @param NetworkAddressCache - Pointer to the cache
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tls_address_cache_free(NetworkAddressCache *);
+
+/**
+ * @brief Make a network connection look the server up in an address cache
+ *
+ * @param Network - Pointer to a Network struct defining the network interface
+ * @param NetworkAddressCache - Pointer to the cache, NULL to resolve the server on each connect
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tls_set_address_cache(Network *, NetworkAddressCache *);
+
+/**
+ * @brief Keep the TLS session in a file across restarts
+ *
+ * The session of each handshake is written to the file, and a session found in it is
+ * offered to the server on the next connect, so the first connect after a restart can
+ * be resumed too. The file holds the master secret of the session and is created
+ * readable by the owner only. A file written for another server is ignored.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface
+ * @param char - path of the session file, NULL to keep the session in memory only
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tls_set_session_location(Network *, char *);
+
+/**
+ * @brief Get the number of full and resumed TLS handshakes
+ *
+ * A connect resumes the session of the previous one when the server accepts the session
+ * ticket or session ID offered to it, skipping the certificate exchange and key agreement.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface
+ * @param uint32_t - pointer to store the number of connects that negotiated a new session
+ * @param uint32_t - pointer to store the number of connects that resumed a session
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tls_get_handshake_counts(Network *, uint32_t *, uint32_t *);
+
+/**
+ * @brief Set the largest TLS record payload asked of the server
+ *
+ * Each connection holds an incoming and an outgoing record buffer sized for
+ * MBEDTLS_SSL_MAX_CONTENT_LEN, 16 KB unless the mbed TLS configuration makes it smaller.
+ * A server that accepts the max fragment length extension sends no larger records than
+ * asked for, so the buffers can be made smaller without failing on large records. A
+ * handshake with a server that answers the extension with another length fails. One that
+ * ignores it may still send records too large for small buffers. Records sent to the
+ * server are kept to the same length either way.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface
+ * @param uint16_t - 512, 1024, 2048 or 4096, or 0 to ask for the largest the record buffers hold,
+ *                   which asks for nothing when they hold 16 KB
+ * @return IoT_Error_t - SUCCESS, or NETWORK_SSL_MAX_FRAGMENT_LENGTH_ERROR if TLS cannot
+ *                       negotiate the length or it does not fit the record buffers
+ */
+IoT_Error_t iot_tls_set_max_fragment_length(Network *, uint16_t);
+
+/**
+ * @brief Report the heap the TLS library holds for a connection
+ *
+ * Counts what the library allocated while connecting, handshakes and session included,
+ * and what it has not freed since. Heap is only counted if mbed TLS is built with
+ * MBEDTLS_PLATFORM_MEMORY, otherwise only the record buffers are reported.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface
+ * @param TLSMemoryReport - pointer to store the report
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tls_get_memory_report(Network *, TLSMemoryReport *);
+
+/**
+ * @brief Release the saved TLS session
+ *
+ * The session survives disconnect and destroy so that reconnects can resume it. The next
+ * connect does a full handshake. The session file, if any, is kept.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface
+ * @return IoT_Error_t - SUCCESS
+ */
+IoT_Error_t iot_tls_free_session(Network *);
+
 /**
  * @brief Disconnect from network socket
  *
@@ -36,6 +36,8 @@ extern "C" {
  */
 #include "threads_platform.h"
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <aws_iot_error.h>
 
 /**
@@ -48,6 +50,33 @@ extern "C" {
  */
 typedef struct _IoT_Mutex_t IoT_Mutex_t;
 
+/**
+ * @brief Thread Type
+ *
+ * Forward declaration of a thread struct.  The definition of this struct is
+ * platform dependent.  When porting to a new platform add this definition
+ * in "threads_platform.h".
+ *
+ */
+typedef struct _IoT_Thread_t IoT_Thread_t;
+
+/**
+ * @brief Condition Variable Type
+ *
+ * Forward declaration of a condition variable struct.  The definition of this struct is
+ * platform dependent.  When porting to a new platform add this definition
+ * in "threads_platform.h".
+ *
+ */
+typedef struct _IoT_Cond_t IoT_Cond_t;
+
+/**
+ * @brief Thread Routine Type
+ *
+ * Function run by a thread started with aws_iot_thread_create.
+ */
+typedef void *(*IoT_Thread_Routine_t)(void *);
+
 /**
  * @brief Initialize the provided mutex
  *
@@ -100,6 +129,74 @@ IoT_Error_t aws_iot_thread_mutex_unlock(IoT_Mutex_t *);
  */
 IoT_Error_t aws_iot_thread_mutex_destroy(IoT_Mutex_t *);
 
+/**
+ * @brief Start a thread
+ *
+ * Call this function to run the routine on a new thread
+ *
+ * @param IoT_Thread_t - pointer to the thread to be started
+ * @param IoT_Thread_Routine_t - routine the thread runs
+ * @param void - pointer passed to the routine
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_create(IoT_Thread_t *, IoT_Thread_Routine_t, void *);
+
+/**
+ * @brief Wait for a thread to finish
+ *
+ * Call this function to block until the routine of the thread has returned
+ *
+ * @param IoT_Thread_t - pointer to the thread to be waited for
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_join(IoT_Thread_t *);
+
+/**
+ * @brief Check if the calling thread is the given thread
+ *
+ * @param IoT_Thread_t - pointer to a started thread
+ * @return bool - true if the caller runs on that thread
+ */
+bool aws_iot_thread_is_current(IoT_Thread_t *);
+
+/**
+ * @brief Initialize the provided condition variable
+ *
+ * @param IoT_Cond_t - pointer to the condition variable to be initialized
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_cond_init(IoT_Cond_t *);
+
+/**
+ * @brief Wait on the provided condition variable
+ *
+ * Call this function with the mutex locked. The mutex is released while waiting and
+ * locked again before returning. Returns SUCCESS when signalled, when the timeout
+ * passed and on spurious wake ups, so the caller has to check its condition again
+ *
+ * @param IoT_Cond_t - pointer to the condition variable to wait on
+ * @param IoT_Mutex_t - pointer to the locked mutex protecting the condition
+ * @param uint32_t - maximum time to wait in milliseconds
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_cond_wait(IoT_Cond_t *, IoT_Mutex_t *, uint32_t);
+
+/**
+ * @brief Wake up all threads waiting on the provided condition variable
+ *
+ * @param IoT_Cond_t - pointer to the condition variable to be signalled
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_cond_broadcast(IoT_Cond_t *);
+
+/**
+ * @brief Destroy the provided condition variable
+ *
+ * @param IoT_Cond_t - pointer to the condition variable to be destroyed
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_cond_destroy(IoT_Cond_t *);
+
 #ifdef __cplusplus
 }
 #endif
@@ -89,6 +89,17 @@ void countdown_sec(Timer *, uint32_t);
  */
 uint32_t left_ms(Timer *);
 
+/**
+ * @brief Compare two timers
+ *
+ * Used to order timers, for example in a heap of deadlines.
+ *
+ * @param Timer - pointer to the first timer
+ * @param Timer - pointer to the second timer
+ * @return bool - true if the first timer expires before the second one
+ */
+bool is_timer_before(Timer *, Timer *);
+
 /**
  * @brief Initialize a timer
  *
@@ -98,6 +109,24 @@ uint32_t left_ms(Timer *);
  */
 void init_timer(Timer *);
 
+/**
+ * @brief Cache the current time for the calling thread
+ *
+ * Reads the clock once. Until timer_release_now is called, the timer functions called
+ * on this thread use that time instead of reading the clock again. Used to check many
+ * timers in one pass without a clock read per timer. The time must be released before
+ * waiting on anything, or timers waited on will never expire.
+ */
+void timer_cache_now(void);
+
+/**
+ * @brief Stop using the cached time
+ *
+ * The timer functions called on this thread read the clock again. Does nothing if
+ * no time is cached.
+ */
+void timer_release_now(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file network_transport.c
+ * @brief Registry of the network transports a Network can be initialized over.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <string.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_error.h"
+#include "network_interface.h"
+
+#define NETWORK_DEFAULT_TRANSPORT "tls"
+
+typedef struct {
+	const char *pName;
+	NetworkTransportInit init;
+} NetworkTransport;
+
+static const NetworkTransport builtinTransports[] = {
+	{NETWORK_DEFAULT_TRANSPORT, iot_tls_init},
+	{"tcp", iot_tcp_init},
+	{"memory", iot_memory_init},
+};
+
+/* Transports registered by the application, checked before the built in ones */
+static NetworkTransport registeredTransports[AWS_IOT_NETWORK_MAX_TRANSPORTS];
+static size_t registeredTransportCount = 0;
+
+IoT_Error_t iot_network_register_transport(const char *pName, NetworkTransportInit init) {
+	if(NULL == pName || NULL == init) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if(AWS_IOT_NETWORK_MAX_TRANSPORTS <= registeredTransportCount) {
+		return NETWORK_MAX_TRANSPORTS_REACHED_ERROR;
+	}
+
+	registeredTransports[registeredTransportCount].pName = pName;
+	registeredTransports[registeredTransportCount].init = init;
+	registeredTransportCount++;
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_network_init(Network *pNetwork, const char *pTransportName, char *pRootCALocation,
+							 char *pDeviceCertLocation, char *pDevicePrivateKeyLocation, char *pDestinationURL,
+							 uint16_t DestinationPort, uint32_t timeout_ms, bool ServerVerificationFlag) {
+	NetworkTransportInit init = NULL;
+	size_t itr;
+
+	if(NULL == pNetwork) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if(NULL == pTransportName) {
+		pTransportName = NETWORK_DEFAULT_TRANSPORT;
+	}
+
+	for(itr = 0; NULL == init && itr < registeredTransportCount; itr++) {
+		if(0 == strcmp(registeredTransports[itr].pName, pTransportName)) {
+			init = registeredTransports[itr].init;
+		}
+	}
+	for(itr = 0; NULL == init && itr < sizeof(builtinTransports) / sizeof(builtinTransports[0]); itr++) {
+		if(0 == strcmp(builtinTransports[itr].pName, pTransportName)) {
+			init = builtinTransports[itr].init;
+		}
+	}
+
+	if(NULL == init) {
+		return NETWORK_TRANSPORT_NOT_FOUND_ERROR;
+	}
+
+	return init(pNetwork, pRootCALocation, pDeviceCertLocation, pDevicePrivateKeyLocation, pDestinationURL,
+				DestinationPort, timeout_ms, ServerVerificationFlag);
+}
+
+#ifdef __cplusplus
+}
+#endif
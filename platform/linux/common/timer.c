@@ -26,47 +26,65 @@ extern "C" {
 #include <sys/types.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include "timer_platform.h"
 
+#define TIMER_NSEC_PER_MSEC 1000000ULL
+#define TIMER_NSEC_PER_SEC 1000000000ULL
+
+/* Time cached by timer_cache_now for the calling thread */
+static __thread bool isNowCached = false;
+static __thread uint64_t cachedNow_ns = 0;
+
+static uint64_t _timer_now_ns(void) {
+	struct timespec now;
+
+	if(isNowCached) {
+		return cachedNow_ns;
+	}
+
+	clock_gettime(IOT_TIMER_CLOCK_ID, &now);
+	return (uint64_t) now.tv_sec * TIMER_NSEC_PER_SEC + (uint64_t) now.tv_nsec;
+}
+
 bool has_timer_expired(Timer *timer) {
-	struct timeval now, res;
-	gettimeofday(&now, NULL);
-	timersub(&timer->end_time, &now, &res);
-	return res.tv_sec < 0 || (res.tv_sec == 0 && res.tv_usec <= 0);
+	return timer->end_time_ns <= _timer_now_ns();
 }
 
 void countdown_ms(Timer *timer, uint32_t timeout) {
-	struct timeval now;
-	gettimeofday(&now, NULL);
-#ifdef __cplusplus
-	struct timeval interval = {timeout / 1000, static_cast<int>((timeout % 1000) * 1000)};
-#else
-	struct timeval interval = {timeout / 1000, (int)((timeout % 1000) * 1000)};
-#endif
-	timeradd(&now, &interval, &timer->end_time);
+	timer->end_time_ns = _timer_now_ns() + (uint64_t) timeout * TIMER_NSEC_PER_MSEC;
 }
 
 uint32_t left_ms(Timer *timer) {
-	struct timeval now, res;
-	gettimeofday(&now, NULL);
-	timersub(&timer->end_time, &now, &res);
+	uint64_t now_ns = _timer_now_ns();
 	uint32_t result_ms = 0;
-	if(res.tv_sec >= 0) {
-		result_ms = (uint32_t) (res.tv_sec * 1000 + res.tv_usec / 1000);
+	if(timer->end_time_ns > now_ns) {
+		result_ms = (uint32_t) ((timer->end_time_ns - now_ns) / TIMER_NSEC_PER_MSEC);
 	}
 	return result_ms;
 }
 
 void countdown_sec(Timer *timer, uint32_t timeout) {
-	struct timeval now;
-	gettimeofday(&now, NULL);
-	struct timeval interval = {timeout, 0};
-	timeradd(&now, &interval, &timer->end_time);
+	timer->end_time_ns = _timer_now_ns() + (uint64_t) timeout * TIMER_NSEC_PER_SEC;
+}
+
+bool is_timer_before(Timer *timer, Timer *other) {
+	return timer->end_time_ns < other->end_time_ns;
 }
 
 void init_timer(Timer *timer) {
-	timer->end_time = (struct timeval) {0, 0};
+	timer->end_time_ns = 0;
+}
+
+void timer_cache_now(void) {
+	isNowCached = false;
+	cachedNow_ns = _timer_now_ns();
+	isNowCached = true;
+}
+
+void timer_release_now(void) {
+	isNowCached = false;
 }
 
 #ifdef __cplusplus
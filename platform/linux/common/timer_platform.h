@@ -25,13 +25,28 @@ extern "C" {
  */
 #include <sys/time.h>
 #include <sys/select.h>
+#include <time.h>
+#include <stdint.h>
 #include "timer_interface.h"
 
+/**
+ * Clock the timers are read from. It must not jump when the wall clock is set, so NTP steps
+ * do not expire or stretch running timers. Define IOT_TIMER_USE_COARSE_CLOCK to use
+ * CLOCK_MONOTONIC_COARSE, which is cheaper to read but only advances once per scheduler tick
+ */
+#ifndef IOT_TIMER_CLOCK_ID
+#ifdef IOT_TIMER_USE_COARSE_CLOCK
+#define IOT_TIMER_CLOCK_ID CLOCK_MONOTONIC_COARSE
+#else
+#define IOT_TIMER_CLOCK_ID CLOCK_MONOTONIC
+#endif
+#endif
+
 /**
  * definition of the Timer struct. Platform specific
  */
 struct Timer {
-	struct timeval end_time;
+	uint64_t end_time_ns;	///< Deadline on IOT_TIMER_CLOCK_ID in nanoseconds
 };
 
 #ifdef __cplusplus
@@ -18,7 +18,22 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <malloc.h>
 #include <timer_platform.h>
 #include <network_interface.h>
 
@@ -27,9 +42,132 @@ extern "C" {
 #include "network_interface.h"
 #include "network_platform.h"
 
+#include "mbedtls/ssl_internal.h"
+
 /* This is the value used for ssl read timeout */
 #define IOT_SSL_READ_TIMEOUT 10
 
+/* Buffers of a scatter-gather write smaller than this are gathered into one TLS record, so that the
+ * header and the payload of a publish up to this size go out as one record */
+#define TLS_WRITEV_GATHER_LEN 4096
+
+/* Largest record payload TLS allows, what the record buffers hold unless mbed TLS is configured otherwise */
+#define TLS_MAX_RECORD_PAYLOAD_LEN 16384
+
+/* First bytes of a session file, changed whenever its layout changes */
+#define TLS_SESSION_FILE_MAGIC 0x53544931
+
+/* Longest host name, certificate or ticket accepted from a session file */
+#define TLS_SESSION_FILE_MAX_HOST_LEN 255
+#define TLS_SESSION_FILE_MAX_BLOB_LEN 16384
+
+/*
+ * Fixed part of a session file. It is followed by the host name, the DER of the server
+ * certificate and the session ticket. The file is only read back by the device that
+ * wrote it, so the fields are kept in host byte order
+ */
+typedef struct {
+	uint32_t magic;
+	uint16_t port;
+	uint16_t hostLen;
+	int64_t start;
+	int32_t ciphersuite;
+	int32_t compression;
+	uint32_t idLen;
+	uint32_t verifyResult;
+	uint32_t peerCertLen;
+	uint32_t ticketLen;
+	uint32_t ticketLifetime;
+	uint8_t mflCode;
+	uint8_t truncHmac;
+	uint8_t encryptThenMac;
+	uint8_t reserved;
+	unsigned char id[32];
+	unsigned char master[48];
+} TLSSessionFileHeader;
+
+#if defined(MBEDTLS_PLATFORM_MEMORY)
+/*
+ * Connection that heap allocated by mbed TLS on this thread is charged to, NULL if none.
+ * A connection is only connected and torn down by one thread at a time
+ */
+static __thread TLSDataParams *_pHeapOwner = NULL;
+
+/*
+ * Put in front of each block mbed TLS allocates. A block is freed back to the connection
+ * it was charged to, whichever connection is charged when it is freed. The long double
+ * keeps the block behind it aligned as calloc would have
+ */
+typedef union {
+	struct {
+		TLSDataParams *pOwner;
+		size_t chargedBytes;
+	} charge;
+	long double alignment;
+} TLSHeapHeader;
+
+static void *_iot_tls_heap_calloc(size_t count, size_t size) {
+	TLSHeapHeader *pHeader;
+
+	if(0 != size && (SIZE_MAX - sizeof(TLSHeapHeader)) / size < count) {
+		return NULL;
+	}
+
+	pHeader = (TLSHeapHeader *) calloc(1, sizeof(TLSHeapHeader) + count * size);
+	if(NULL == pHeader) {
+		return NULL;
+	}
+
+	pHeader->charge.pOwner = _pHeapOwner;
+	pHeader->charge.chargedBytes = 0;
+	if(NULL != _pHeapOwner) {
+		pHeader->charge.chargedBytes = malloc_usable_size(pHeader);
+		_pHeapOwner->heapBytes += pHeader->charge.chargedBytes;
+		if(_pHeapOwner->peakHeapBytes < _pHeapOwner->heapBytes) {
+			_pHeapOwner->peakHeapBytes = _pHeapOwner->heapBytes;
+		}
+	}
+
+	return pHeader + 1;
+}
+
+static void _iot_tls_heap_free(void *pBlock) {
+	TLSHeapHeader *pHeader;
+
+	if(NULL == pBlock) {
+		return;
+	}
+
+	pHeader = (TLSHeapHeader *) pBlock - 1;
+	if(NULL != pHeader->charge.pOwner) {
+		pHeader->charge.pOwner->heapBytes -= pHeader->charge.chargedBytes;
+	}
+
+	free(pHeader);
+}
+
+/*
+ * Counts the heap of each connection, see iot_tls_get_memory_report. Set before main runs,
+ * since a block mbed TLS allocated before would be freed without its header
+ */
+__attribute__((constructor)) static void _iot_tls_heap_install(void) {
+	mbedtls_platform_set_calloc_free(_iot_tls_heap_calloc, _iot_tls_heap_free);
+}
+#endif
+
+/* Charges the heap mbed TLS allocates from now on to a connection, returns the one charged before */
+static TLSDataParams *_iot_tls_heap_charge(TLSDataParams *tlsDataParams) {
+#if defined(MBEDTLS_PLATFORM_MEMORY)
+	TLSDataParams *pPrevious = _pHeapOwner;
+
+	_pHeapOwner = tlsDataParams;
+	return pPrevious;
+#else
+	((void) tlsDataParams);
+	return NULL;
+#endif
+}
+
 /*
  * This is a function to do further verification if needed on the cert received
  */
@@ -52,6 +190,531 @@ static int _iot_tls_verify_cert(void *data, mbedtls_x509_crt *crt, int depth, ui
 	return 0;
 }
 
+/*
+ * Registers a socket of the connection for one event, readable or, while a connect
+ * waits for it, writable. A socket registered while connecting is modified rather than
+ * added again. Closing the socket removes it from the set, so only live sockets are
+ * ever registered
+ */
+static IoT_Error_t _iot_tls_event_set_ctl(TLSDataParams *tlsDataParams, int fd, int op) {
+	struct epoll_event event;
+	int ret;
+
+	event.events = EPOLLONESHOT;
+	if(TLS_CONNECT_IDLE != tlsDataParams->connectState && tlsDataParams->isConnectWantWrite) {
+		event.events |= EPOLLOUT;
+	} else {
+		event.events |= EPOLLIN;
+	}
+	event.data.ptr = tlsDataParams->pEventData;
+
+	ret = epoll_ctl(tlsDataParams->pEventSet->epollFd, op, fd, &event);
+	if(0 != ret && EPOLL_CTL_ADD == op && EEXIST == errno) {
+		ret = epoll_ctl(tlsDataParams->pEventSet->epollFd, EPOLL_CTL_MOD, fd, &event);
+	}
+	if(0 != ret) {
+		return NETWORK_EVENT_SET_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+static void _iot_tls_drop_session(TLSDataParams *tlsDataParams) {
+	mbedtls_ssl_session_free(&(tlsDataParams->savedSession));
+	mbedtls_ssl_session_init(&(tlsDataParams->savedSession));
+	tlsDataParams->isSessionSaved = false;
+}
+
+static bool _iot_tls_file_put(FILE *pFile, const void *pData, size_t len) {
+	return 0 == len || 1 == fwrite(pData, len, 1, pFile);
+}
+
+static bool _iot_tls_file_get(FILE *pFile, void *pData, size_t len) {
+	return 0 == len || 1 == fread(pData, len, 1, pFile);
+}
+
+/*
+ * Writes the saved session to the session file. A session that cannot be written is
+ * only kept in memory
+ */
+static void _iot_tls_write_session_file(Network *pNetwork) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	const mbedtls_ssl_session *pSession = &(tlsDataParams->savedSession);
+	TLSSessionFileHeader header;
+	const unsigned char *pPeerCert = NULL;
+	const unsigned char *pTicket = NULL;
+	FILE *pFile;
+	bool isOk;
+	int fd;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = TLS_SESSION_FILE_MAGIC;
+	header.port = pNetwork->tlsConnectParams.DestinationPort;
+	header.hostLen = (uint16_t) strlen(pNetwork->tlsConnectParams.pDestinationURL);
+	header.ciphersuite = pSession->ciphersuite;
+	header.compression = pSession->compression;
+	header.idLen = (uint32_t) pSession->id_len;
+	header.verifyResult = pSession->verify_result;
+	memcpy(header.id, pSession->id, sizeof(header.id));
+	memcpy(header.master, pSession->master, sizeof(header.master));
+#if defined(MBEDTLS_HAVE_TIME)
+	header.start = (int64_t) pSession->start;
+#endif
+	if(NULL != pSession->peer_cert) {
+		pPeerCert = pSession->peer_cert->raw.p;
+		header.peerCertLen = (uint32_t) pSession->peer_cert->raw.len;
+	}
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+	pTicket = pSession->ticket;
+	header.ticketLen = (uint32_t) pSession->ticket_len;
+	header.ticketLifetime = pSession->ticket_lifetime;
+#endif
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+	header.mflCode = pSession->mfl_code;
+#endif
+#if defined(MBEDTLS_SSL_TRUNCATED_HMAC)
+	header.truncHmac = (uint8_t) pSession->trunc_hmac;
+#endif
+#if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
+	header.encryptThenMac = (uint8_t) pSession->encrypt_then_mac;
+#endif
+
+	/* The file holds the master secret, only the owner may read it */
+	fd = open(tlsDataParams->pSessionLocation, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if(0 > fd) {
+		IOT_WARN("Unable to write TLS session file %s\n", tlsDataParams->pSessionLocation);
+		return;
+	}
+	pFile = fdopen(fd, "wb");
+	if(NULL == pFile) {
+		close(fd);
+		return;
+	}
+
+	isOk = _iot_tls_file_put(pFile, &header, sizeof(header));
+	isOk = isOk && _iot_tls_file_put(pFile, pNetwork->tlsConnectParams.pDestinationURL, header.hostLen);
+	isOk = isOk && _iot_tls_file_put(pFile, pPeerCert, header.peerCertLen);
+	isOk = isOk && _iot_tls_file_put(pFile, pTicket, header.ticketLen);
+	if(0 != fclose(pFile) || !isOk) {
+		IOT_WARN("Unable to write TLS session file %s\n", tlsDataParams->pSessionLocation);
+		unlink(tlsDataParams->pSessionLocation);
+	}
+}
+
+/*
+ * Reads the session file into the saved session. Missing files, files of another server
+ * and damaged files are ignored, the connect then does a full handshake
+ */
+static void _iot_tls_read_session_file(Network *pNetwork) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	TLSSessionFileHeader header;
+	mbedtls_ssl_session session;
+	char host[TLS_SESSION_FILE_MAX_HOST_LEN];
+	unsigned char *pPeerCert = NULL;
+	FILE *pFile;
+	bool isOk;
+
+	pFile = fopen(tlsDataParams->pSessionLocation, "rb");
+	if(NULL == pFile) {
+		return;
+	}
+
+	mbedtls_ssl_session_init(&session);
+
+	isOk = _iot_tls_file_get(pFile, &header, sizeof(header)) && TLS_SESSION_FILE_MAGIC == header.magic
+		   && pNetwork->tlsConnectParams.DestinationPort == header.port
+		   && strlen(pNetwork->tlsConnectParams.pDestinationURL) == header.hostLen
+		   && TLS_SESSION_FILE_MAX_HOST_LEN >= header.hostLen && sizeof(session.id) >= header.idLen
+		   && TLS_SESSION_FILE_MAX_BLOB_LEN >= header.peerCertLen && TLS_SESSION_FILE_MAX_BLOB_LEN >= header.ticketLen;
+	isOk = isOk && _iot_tls_file_get(pFile, host, header.hostLen)
+		   && 0 == memcmp(host, pNetwork->tlsConnectParams.pDestinationURL, header.hostLen);
+
+	if(isOk) {
+		session.ciphersuite = header.ciphersuite;
+		session.compression = header.compression;
+		session.id_len = header.idLen;
+		session.verify_result = header.verifyResult;
+		memcpy(session.id, header.id, sizeof(session.id));
+		memcpy(session.master, header.master, sizeof(session.master));
+#if defined(MBEDTLS_HAVE_TIME)
+		session.start = (time_t) header.start;
+#endif
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+		session.mfl_code = header.mflCode;
+#endif
+#if defined(MBEDTLS_SSL_TRUNCATED_HMAC)
+		session.trunc_hmac = header.truncHmac;
+#endif
+#if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
+		session.encrypt_then_mac = header.encryptThenMac;
+#endif
+	}
+
+	if(isOk && 0 < header.peerCertLen) {
+		pPeerCert = mbedtls_calloc(1, header.peerCertLen);
+		session.peer_cert = mbedtls_calloc(1, sizeof(mbedtls_x509_crt));
+		isOk = NULL != pPeerCert && NULL != session.peer_cert;
+		if(NULL != session.peer_cert) {
+			mbedtls_x509_crt_init(session.peer_cert);
+		}
+		isOk = isOk && _iot_tls_file_get(pFile, pPeerCert, header.peerCertLen)
+			   && 0 == mbedtls_x509_crt_parse_der(session.peer_cert, pPeerCert, header.peerCertLen);
+		mbedtls_free(pPeerCert);
+	}
+
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+	if(isOk && 0 < header.ticketLen) {
+		session.ticket = mbedtls_calloc(1, header.ticketLen);
+		session.ticket_len = header.ticketLen;
+		session.ticket_lifetime = header.ticketLifetime;
+		isOk = NULL != session.ticket && _iot_tls_file_get(pFile, session.ticket, header.ticketLen);
+	}
+#endif
+
+	fclose(pFile);
+
+	if(!isOk) {
+		IOT_WARN("Ignoring TLS session file %s\n", tlsDataParams->pSessionLocation);
+		mbedtls_ssl_session_free(&session);
+		return;
+	}
+
+	/* The saved session takes over the certificate and ticket */
+	_iot_tls_drop_session(tlsDataParams);
+	tlsDataParams->savedSession = session;
+	tlsDataParams->isSessionSaved = true;
+}
+
+/*
+ * Counts the handshake that just completed and saves its session for the next connect.
+ * A resumed session keeps the master secret of the session that was offered
+ */
+static void _iot_tls_save_session(Network *pNetwork) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+
+	if(tlsDataParams->isSessionSaved && 0 == memcmp(tlsDataParams->ssl.session->master,
+													tlsDataParams->savedSession.master,
+													sizeof(tlsDataParams->savedSession.master))) {
+		tlsDataParams->resumedHandshakeCount++;
+	} else {
+		tlsDataParams->fullHandshakeCount++;
+	}
+
+	_iot_tls_drop_session(tlsDataParams);
+	if(0 != mbedtls_ssl_get_session(&(tlsDataParams->ssl), &(tlsDataParams->savedSession))) {
+		_iot_tls_drop_session(tlsDataParams);
+		return;
+	}
+	tlsDataParams->isSessionSaved = true;
+
+	if(NULL != tlsDataParams->pSessionLocation) {
+		_iot_tls_write_session_file(pNetwork);
+	}
+}
+
+static IoT_Error_t _iot_tls_parse_credentials(char *pRootCALocation, char *pDeviceCertLocation,
+											  char *pDevicePrivateKeyLocation, mbedtls_x509_crt *pCACert,
+											  mbedtls_x509_crt *pCliCert, mbedtls_pk_context *pKey) {
+	int ret;
+
+	IOT_DEBUG("  . Loading the CA root certificate ...");
+	ret = mbedtls_x509_crt_parse_file(pCACert, pRootCALocation);
+	if(ret < 0) {
+		IOT_ERROR(" failed\n  !  mbedtls_x509_crt_parse returned -0x%x while parsing root cert\n\n", -ret);
+		return NETWORK_X509_ROOT_CRT_PARSE_ERROR;
+	}
+	IOT_DEBUG(" ok (%d skipped)\n", ret);
+
+	IOT_DEBUG("  . Loading the client cert. and key...");
+	ret = mbedtls_x509_crt_parse_file(pCliCert, pDeviceCertLocation);
+	if(ret != 0) {
+		IOT_ERROR(" failed\n  !  mbedtls_x509_crt_parse returned -0x%x while parsing device cert\n\n", -ret);
+		return NETWORK_X509_DEVICE_CRT_PARSE_ERROR;
+	}
+
+	ret = mbedtls_pk_parse_keyfile(pKey, pDevicePrivateKeyLocation, "");
+	if(ret != 0) {
+		IOT_ERROR(" failed\n  !  mbedtls_pk_parse_key returned -0x%x while parsing private key\n\n", -ret);
+		IOT_DEBUG(" path : %s ", pDevicePrivateKeyLocation);
+		return NETWORK_PK_PRIVATE_KEY_PARSE_ERROR;
+	}
+	IOT_DEBUG(" ok\n");
+
+	return SUCCESS;
+}
+
+static void _iot_tls_credentials_lock(TLSCredentials *pCredentials) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_lock(&(pCredentials->lock));
+#else
+	((void) pCredentials);
+#endif
+}
+
+static void _iot_tls_credentials_unlock(TLSCredentials *pCredentials) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_unlock(&(pCredentials->lock));
+#else
+	((void) pCredentials);
+#endif
+}
+
+/* Random number generator of the connections using shared credentials */
+static int _iot_tls_credentials_random(void *pContext, unsigned char *pOutput, size_t len) {
+	TLSCredentials *pCredentials = (TLSCredentials *) pContext;
+	int ret;
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_lock(&(pCredentials->rngLock));
+#endif
+	ret = mbedtls_ctr_drbg_random(&(pCredentials->ctr_drbg), pOutput, len);
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_unlock(&(pCredentials->rngLock));
+#endif
+
+	return ret;
+}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+static int _iot_tls_locked_key_decrypt(void *pContext, int mode, size_t *pOutputLen, const unsigned char *pInput,
+									   unsigned char *pOutput, size_t outputMaxLen) {
+	struct TLSCredentialSet *pSet = (struct TLSCredentialSet *) pContext;
+	int ret;
+
+	aws_iot_thread_mutex_lock(&(pSet->pCredentials->keyLock));
+	ret = mbedtls_rsa_pkcs1_decrypt(mbedtls_pk_rsa(pSet->pkey), _iot_tls_credentials_random, pSet->pCredentials,
+									mode, pOutputLen, pInput, pOutput, outputMaxLen);
+	aws_iot_thread_mutex_unlock(&(pSet->pCredentials->keyLock));
+
+	return ret;
+}
+
+static int _iot_tls_locked_key_sign(void *pContext, int (*pRandom)(void *, unsigned char *, size_t),
+									void *pRandomContext, int mode, mbedtls_md_type_t mdAlg, unsigned int hashLen,
+									const unsigned char *pHash, unsigned char *pSig) {
+	struct TLSCredentialSet *pSet = (struct TLSCredentialSet *) pContext;
+	int ret;
+
+	aws_iot_thread_mutex_lock(&(pSet->pCredentials->keyLock));
+	ret = mbedtls_rsa_pkcs1_sign(mbedtls_pk_rsa(pSet->pkey), pRandom, pRandomContext, mode, mdAlg, hashLen, pHash,
+								 pSig);
+	aws_iot_thread_mutex_unlock(&(pSet->pCredentials->keyLock));
+
+	return ret;
+}
+
+static size_t _iot_tls_locked_key_len(void *pContext) {
+	return mbedtls_pk_rsa(((struct TLSCredentialSet *) pContext)->pkey)->len;
+}
+
+/*
+ * Makes the first public key operation of a key, which caches a value in the key: the
+ * Montgomery constant of an RSA key or the comb table of an EC group
+ */
+static IoT_Error_t _iot_tls_warm_up_key(mbedtls_pk_context *pKey, TLSCredentials *pCredentials) {
+	unsigned char input[MBEDTLS_MPI_MAX_SIZE];
+	unsigned char output[MBEDTLS_MPI_MAX_SIZE];
+	mbedtls_rsa_context *pRsa;
+	mbedtls_ecp_keypair *pEc;
+	mbedtls_ecp_point point;
+	mbedtls_mpi one;
+	int ret = 0;
+
+	if(mbedtls_pk_can_do(pKey, MBEDTLS_PK_RSA) && MBEDTLS_PK_RSA_ALT != mbedtls_pk_get_type(pKey)) {
+		pRsa = mbedtls_pk_rsa(*pKey);
+		memset(input, 0, pRsa->len);
+		input[pRsa->len - 1] = 1;
+		ret = mbedtls_rsa_public(pRsa, input, output);
+	} else if(mbedtls_pk_can_do(pKey, MBEDTLS_PK_ECKEY)) {
+		pEc = mbedtls_pk_ec(*pKey);
+		mbedtls_ecp_point_init(&point);
+		mbedtls_mpi_init(&one);
+		ret = mbedtls_mpi_lset(&one, 1);
+		if(0 == ret) {
+			ret = mbedtls_ecp_mul(&(pEc->grp), &point, &one, &(pEc->grp.G), _iot_tls_credentials_random, pCredentials);
+		}
+		mbedtls_mpi_free(&one);
+		mbedtls_ecp_point_free(&point);
+	}
+
+	return (0 == ret) ? SUCCESS : NETWORK_SSL_INIT_ERROR;
+}
+
+/*
+ * mbedTLS is built without MBEDTLS_THREADING_C, so keys must not be written to by two
+ * handshakes at once. The values the first use of a key caches in it are computed before
+ * the set is shared. RSA private key operations update the blinding values on every use,
+ * they go through a wrapper that takes the key lock
+ */
+static IoT_Error_t _iot_tls_credential_set_prepare_sharing(TLSCredentials *pCredentials,
+															struct TLSCredentialSet *pSet) {
+	mbedtls_x509_crt *pCert;
+	IoT_Error_t rc = SUCCESS;
+
+	pSet->pCredentials = pCredentials;
+
+	for(pCert = &(pSet->cacert); SUCCESS == rc && NULL != pCert && NULL != pCert->raw.p; pCert = pCert->next) {
+		rc = _iot_tls_warm_up_key(&(pCert->pk), pCredentials);
+	}
+	if(SUCCESS != rc) {
+		return rc;
+	}
+
+	if(MBEDTLS_PK_RSA == mbedtls_pk_get_type(&(pSet->pkey))) {
+		if(0 != mbedtls_pk_setup_rsa_alt(&(pSet->lockedKey), pSet, _iot_tls_locked_key_decrypt,
+										 _iot_tls_locked_key_sign, _iot_tls_locked_key_len)) {
+			return NETWORK_SSL_INIT_ERROR;
+		}
+		pSet->pOwnKey = &(pSet->lockedKey);
+		return SUCCESS;
+	}
+
+	return _iot_tls_warm_up_key(&(pSet->pkey), pCredentials);
+}
+#endif
+
+/* Drops a reference to a credential set, the last one frees it. Called with the lock held */
+static void _iot_tls_credential_set_release(struct TLSCredentialSet *pSet) {
+	if(0 < --(pSet->refCount)) {
+		return;
+	}
+
+	mbedtls_x509_crt_free(&(pSet->cacert));
+	mbedtls_x509_crt_free(&(pSet->clicert));
+#ifdef _ENABLE_THREAD_SUPPORT_
+	mbedtls_pk_free(&(pSet->lockedKey));
+#endif
+	mbedtls_pk_free(&(pSet->pkey));
+	mbedtls_free(pSet);
+}
+
+/*
+ * Parses the credential files into a new current set, unless they are unchanged since
+ * the current set was parsed. Called with the lock held
+ */
+static IoT_Error_t _iot_tls_credentials_load(TLSCredentials *pCredentials) {
+	char *pLocations[3] = {pCredentials->pRootCALocation, pCredentials->pDeviceCertLocation,
+						   pCredentials->pDevicePrivateKeyLocation};
+	struct stat fileStats[3];
+	struct TLSCredentialSet *pSet;
+	bool isChanged = (NULL == pCredentials->pCurrentSet);
+	IoT_Error_t rc;
+	int itr;
+
+	memset(fileStats, 0, sizeof(fileStats));
+	for(itr = 0; itr < 3; itr++) {
+		/* A file that cannot be checked is parsed again, which reports the error */
+		if(0 != stat(pLocations[itr], &(fileStats[itr])) ||
+		   fileStats[itr].st_ino != pCredentials->fileStats[itr].st_ino ||
+		   fileStats[itr].st_size != pCredentials->fileStats[itr].st_size ||
+		   fileStats[itr].st_mtim.tv_sec != pCredentials->fileStats[itr].st_mtim.tv_sec ||
+		   fileStats[itr].st_mtim.tv_nsec != pCredentials->fileStats[itr].st_mtim.tv_nsec) {
+			isChanged = true;
+		}
+	}
+	if(!isChanged) {
+		return SUCCESS;
+	}
+
+	pSet = mbedtls_calloc(1, sizeof(struct TLSCredentialSet));
+	if(NULL == pSet) {
+		return NETWORK_SSL_INIT_ERROR;
+	}
+	mbedtls_x509_crt_init(&(pSet->cacert));
+	mbedtls_x509_crt_init(&(pSet->clicert));
+	mbedtls_pk_init(&(pSet->pkey));
+	pSet->pOwnKey = &(pSet->pkey);
+#ifdef _ENABLE_THREAD_SUPPORT_
+	mbedtls_pk_init(&(pSet->lockedKey));
+#endif
+	pSet->refCount = 1;
+
+	rc = _iot_tls_parse_credentials(pCredentials->pRootCALocation, pCredentials->pDeviceCertLocation,
+									pCredentials->pDevicePrivateKeyLocation, &(pSet->cacert), &(pSet->clicert),
+									&(pSet->pkey));
+	/* Files replaced one after the other can be caught with a certificate that does not match the key */
+	if(SUCCESS == rc && 0 != mbedtls_pk_check_pair(&(pSet->clicert.pk), &(pSet->pkey))) {
+		IOT_ERROR("Device certificate and private key do not match\n");
+		rc = NETWORK_PK_PRIVATE_KEY_PARSE_ERROR;
+	}
+#ifdef _ENABLE_THREAD_SUPPORT_
+	if(SUCCESS == rc) {
+		rc = _iot_tls_credential_set_prepare_sharing(pCredentials, pSet);
+	}
+#endif
+	if(SUCCESS != rc) {
+		_iot_tls_credential_set_release(pSet);
+		return rc;
+	}
+
+	if(NULL != pCredentials->pCurrentSet) {
+		_iot_tls_credential_set_release(pCredentials->pCurrentSet);
+	}
+	pCredentials->pCurrentSet = pSet;
+	memcpy(pCredentials->fileStats, fileStats, sizeof(fileStats));
+	pCredentials->loadCount++;
+
+	return SUCCESS;
+}
+
+/* Takes a reference to the current credential set for a new connection */
+static IoT_Error_t _iot_tls_credentials_acquire(TLSDataParams *tlsDataParams) {
+	TLSCredentials *pCredentials = tlsDataParams->pCredentials;
+	IoT_Error_t rc;
+
+	_iot_tls_credentials_lock(pCredentials);
+
+	if(NULL != tlsDataParams->pCredentialSet) {
+		_iot_tls_credential_set_release(tlsDataParams->pCredentialSet);
+		tlsDataParams->pCredentialSet = NULL;
+	}
+
+	rc = _iot_tls_credentials_load(pCredentials);
+	if(SUCCESS != rc && NULL != pCredentials->pCurrentSet) {
+		IOT_WARN("Credential files failed to parse, connecting with the ones loaded before\n");
+		rc = SUCCESS;
+	}
+	if(SUCCESS == rc) {
+		tlsDataParams->pCredentialSet = pCredentials->pCurrentSet;
+		tlsDataParams->pCredentialSet->refCount++;
+	}
+
+	_iot_tls_credentials_unlock(pCredentials);
+
+	return rc;
+}
+
+/*
+ * Maps a max fragment length to its TLS code. 0 picks the largest length the record buffers
+ * hold, and no code at all when they hold the largest records TLS allows anyway
+ */
+static IoT_Error_t _iot_tls_max_fragment_length_code(uint16_t length, unsigned char *pCode) {
+	/* Indexed by the MBEDTLS_SSL_MAX_FRAG_LEN_ codes */
+	static const uint16_t codeLengths[] = {TLS_MAX_RECORD_PAYLOAD_LEN, 512, 1024, 2048, 4096};
+	unsigned char code;
+
+	*pCode = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+
+	if(0 == length) {
+		if(TLS_MAX_RECORD_PAYLOAD_LEN <= MBEDTLS_SSL_MAX_CONTENT_LEN) {
+			return SUCCESS;
+		}
+		for(code = MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+			MBEDTLS_SSL_MAX_FRAG_LEN_NONE != code && MBEDTLS_SSL_MAX_CONTENT_LEN < codeLengths[code]; code--);
+		*pCode = code;
+		return (MBEDTLS_SSL_MAX_FRAG_LEN_NONE != code) ? SUCCESS : NETWORK_SSL_MAX_FRAGMENT_LENGTH_ERROR;
+	}
+
+	for(code = MBEDTLS_SSL_MAX_FRAG_LEN_512; code <= MBEDTLS_SSL_MAX_FRAG_LEN_4096; code++) {
+		if(length == codeLengths[code] && MBEDTLS_SSL_MAX_CONTENT_LEN >= length) {
+			*pCode = code;
+			return SUCCESS;
+		}
+	}
+
+	return NETWORK_SSL_MAX_FRAGMENT_LENGTH_ERROR;
+}
+
 void _iot_tls_set_connect_params(Network *pNetwork, char *pRootCALocation, char *pDeviceCertLocation,
 								 char *pDevicePrivateKeyLocation, char *pDestinationURL,
 								 uint16_t destinationPort, uint32_t timeout_ms, bool ServerVerificationFlag) {
@@ -69,15 +732,41 @@ IoT_Error_t iot_tls_init(Network *pNetwork, char *pRootCALocation, char *pDevice
 						 uint16_t destinationPort, uint32_t timeout_ms, bool ServerVerificationFlag) {
 	_iot_tls_set_connect_params(pNetwork, pRootCALocation, pDeviceCertLocation, pDevicePrivateKeyLocation,
 								pDestinationURL, destinationPort, timeout_ms, ServerVerificationFlag);
+	pNetwork->tlsConnectParams.maxFragmentLength = 0;
 
 	pNetwork->connect = iot_tls_connect;
+	pNetwork->connectStart = iot_tls_connect_start;
+	pNetwork->connectContinue = iot_tls_connect_continue;
+	pNetwork->connectLeftMs = iot_tls_connect_left_ms;
 	pNetwork->read = iot_tls_read;
+	pNetwork->readAvailable = iot_tls_read_available;
 	pNetwork->write = iot_tls_write;
+	pNetwork->writev = iot_tls_writev;
+	pNetwork->waitReadable = iot_tls_wait_readable;
 	pNetwork->disconnect = iot_tls_disconnect;
 	pNetwork->isConnected = iot_tls_is_connected;
 	pNetwork->destroy = iot_tls_destroy;
 
 	pNetwork->tlsDataParams.flags = 0;
+	/* No socket until connect, waiting on the network just sleeps */
+	mbedtls_net_init(&(pNetwork->tlsDataParams.server_fd));
+	mbedtls_ssl_init(&(pNetwork->tlsDataParams.ssl));
+	pNetwork->tlsDataParams.pEventSet = NULL;
+	pNetwork->tlsDataParams.pEventData = NULL;
+	mbedtls_ssl_session_init(&(pNetwork->tlsDataParams.savedSession));
+	pNetwork->tlsDataParams.isSessionSaved = false;
+	pNetwork->tlsDataParams.pSessionLocation = NULL;
+	pNetwork->tlsDataParams.fullHandshakeCount = 0;
+	pNetwork->tlsDataParams.resumedHandshakeCount = 0;
+	pNetwork->tlsDataParams.pCredentials = NULL;
+	pNetwork->tlsDataParams.pCredentialSet = NULL;
+	pNetwork->tlsDataParams.connectState = TLS_CONNECT_IDLE;
+	pNetwork->tlsDataParams.isConnectWantWrite = false;
+	pNetwork->tlsDataParams.pAddressCache = NULL;
+	pNetwork->tlsDataParams.addressCount = 0;
+	pNetwork->tlsDataParams.nextAddress = 0;
+	pNetwork->tlsDataParams.heapBytes = 0;
+	pNetwork->tlsDataParams.peakHeapBytes = 0;
 
 	return SUCCESS;
 }
@@ -87,176 +776,814 @@ IoT_Error_t iot_tls_is_connected(Network *pNetwork) {
 	return NETWORK_PHYSICAL_LAYER_CONNECTED;
 }
 
-IoT_Error_t iot_tls_connect(Network *pNetwork, TLSConnectParams *params) {
-	if(NULL == pNetwork) {
-		return NULL_VALUE_ERROR;
-	}
-
-	if(NULL != params) {
-		_iot_tls_set_connect_params(pNetwork, params->pRootCALocation, params->pDeviceCertLocation,
-									params->pDevicePrivateKeyLocation, params->pDestinationURL,
-									params->DestinationPort, params->timeout_ms, params->ServerVerificationFlag);
-	}
+static void _iot_tls_address_cache_lock(NetworkAddressCache *pCache) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_lock(&(pCache->lock));
+#else
+	((void) pCache);
+#endif
+}
 
-	int ret = 0;
-	const char *pers = "aws_iot_tls_wrapper";
-#ifdef IOT_DEBUG
-	unsigned char buf[MBEDTLS_SSL_MAX_CONTENT_LEN + 1];
+static void _iot_tls_address_cache_unlock(NetworkAddressCache *pCache) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_unlock(&(pCache->lock));
+#else
+	((void) pCache);
 #endif
-	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+}
 
-	mbedtls_net_init(&(tlsDataParams->server_fd));
-	mbedtls_ssl_init(&(tlsDataParams->ssl));
-	mbedtls_ssl_config_init(&(tlsDataParams->conf));
-	mbedtls_ctr_drbg_init(&(tlsDataParams->ctr_drbg));
-	mbedtls_x509_crt_init(&(tlsDataParams->cacert));
-	mbedtls_x509_crt_init(&(tlsDataParams->clicert));
-	mbedtls_pk_init(&(tlsDataParams->pkey));
+/* Default resolver. getaddrinfo does not tell how long the addresses are good for */
+static IoT_Error_t _iot_tls_resolve_getaddrinfo(const char *pHost, NetworkAddress *pAddresses, size_t maxCount,
+												size_t *pCount, uint32_t *pTtlSec) {
+	struct addrinfo hints, *pList, *pAddr;
 
-	IOT_DEBUG("\n  . Seeding the random number generator...");
-	mbedtls_entropy_init(&(tlsDataParams->entropy));
-	if((ret = mbedtls_ctr_drbg_seed(&(tlsDataParams->ctr_drbg), mbedtls_entropy_func, &(tlsDataParams->entropy),
-									(const unsigned char *) pers, strlen(pers))) != 0) {
-		IOT_ERROR(" failed\n  ! mbedtls_ctr_drbg_seed returned -0x%x\n", -ret);
-		return NETWORK_MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	*pCount = 0;
+	*pTtlSec = 0;
+
+	/* Asks for IPv4 and IPv6 addresses at once, the resolver sends both queries in parallel */
+	if(0 != getaddrinfo(pHost, NULL, &hints, &pList)) {
+		return NETWORK_ERR_NET_UNKNOWN_HOST;
 	}
 
-	IOT_DEBUG("  . Loading the CA root certificate ...");
-	ret = mbedtls_x509_crt_parse_file(&(tlsDataParams->cacert), pNetwork->tlsConnectParams.pRootCALocation);
-	if(ret < 0) {
-		IOT_ERROR(" failed\n  !  mbedtls_x509_crt_parse returned -0x%x while parsing root cert\n\n", -ret);
-		return NETWORK_X509_ROOT_CRT_PARSE_ERROR;
+	for(pAddr = pList; NULL != pAddr && *pCount < maxCount; pAddr = pAddr->ai_next) {
+		if(sizeof(pAddresses[*pCount].addr) >= pAddr->ai_addrlen) {
+			memcpy(&(pAddresses[*pCount].addr), pAddr->ai_addr, pAddr->ai_addrlen);
+			pAddresses[*pCount].addrLen = pAddr->ai_addrlen;
+			(*pCount)++;
+		}
 	}
-	IOT_DEBUG(" ok (%d skipped)\n", ret);
+	freeaddrinfo(pList);
 
-	IOT_DEBUG("  . Loading the client cert. and key...");
-	ret = mbedtls_x509_crt_parse_file(&(tlsDataParams->clicert), pNetwork->tlsConnectParams.pDeviceCertLocation);
-	if(ret != 0) {
-		IOT_ERROR(" failed\n  !  mbedtls_x509_crt_parse returned -0x%x while parsing device cert\n\n", -ret);
-		return NETWORK_X509_DEVICE_CRT_PARSE_ERROR;
+	return (0 < *pCount) ? SUCCESS : NETWORK_ERR_NET_UNKNOWN_HOST;
+}
+
+/*
+ * Orders the addresses so that the families take turns, starting with the family of the
+ * first one. A connect that races them then does not wait for every address of a broken
+ * family before it tries the other
+ */
+static void _iot_tls_interleave_addresses(NetworkAddress *pAddresses, size_t count) {
+	NetworkAddress sorted[AWS_IOT_NETWORK_MAX_ADDRESSES];
+	bool isTaken[AWS_IOT_NETWORK_MAX_ADDRESSES];
+	sa_family_t family;
+	size_t itr, sortedCount;
+
+	if(0 == count) {
+		return;
+	}
+
+	memset(isTaken, 0, sizeof(isTaken));
+	family = pAddresses[0].addr.ss_family;
+
+	for(sortedCount = 0; sortedCount < count; sortedCount++) {
+		/* The first address left of the family whose turn it is, or of any family once that one ran out */
+		for(itr = 0; itr < count && (isTaken[itr] || family != pAddresses[itr].addr.ss_family); itr++);
+		if(itr == count) {
+			for(itr = 0; isTaken[itr]; itr++);
+		}
+
+		isTaken[itr] = true;
+		sorted[sortedCount] = pAddresses[itr];
+		family = (AF_INET6 == pAddresses[itr].addr.ss_family) ? AF_INET : AF_INET6;
+	}
+
+	memcpy(pAddresses, sorted, count * sizeof(NetworkAddress));
+}
+
+static bool _iot_tls_address_equal(const NetworkAddress *pA, const NetworkAddress *pB) {
+	if(pA->addr.ss_family != pB->addr.ss_family) {
+		return false;
+	}
+
+	if(AF_INET == pA->addr.ss_family) {
+		return 0 == memcmp(&(((const struct sockaddr_in *) &(pA->addr))->sin_addr),
+						   &(((const struct sockaddr_in *) &(pB->addr))->sin_addr), sizeof(struct in_addr));
+	}
+	if(AF_INET6 == pA->addr.ss_family) {
+		return 0 == memcmp(&(((const struct sockaddr_in6 *) &(pA->addr))->sin6_addr),
+						   &(((const struct sockaddr_in6 *) &(pB->addr))->sin6_addr), sizeof(struct in6_addr));
+	}
+
+	return false;
+}
+
+static void _iot_tls_address_set_port(NetworkAddress *pAddress, uint16_t port) {
+	if(AF_INET == pAddress->addr.ss_family) {
+		((struct sockaddr_in *) &(pAddress->addr))->sin_port = htons(port);
+	} else if(AF_INET6 == pAddress->addr.ss_family) {
+		((struct sockaddr_in6 *) &(pAddress->addr))->sin6_port = htons(port);
+	}
+}
+
+/* Returns the entry of the host, NULL if it has none. Called with the cache locked */
+static NetworkAddressCacheEntry *_iot_tls_address_cache_find(NetworkAddressCache *pCache, const char *pHost) {
+	size_t itr;
+
+	for(itr = 0; itr < AWS_IOT_NETWORK_ADDRESS_CACHE_ENTRIES; itr++) {
+		if('\0' != pCache->entries[itr].host[0] && 0 == strcmp(pCache->entries[itr].host, pHost)) {
+			return &(pCache->entries[itr]);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Stores the addresses a connect resolved. If resolving failed, the expired addresses of
+ * the host are handed to the connect instead, they may well still work
+ */
+static IoT_Error_t _iot_tls_address_cache_store(NetworkAddressCache *pCache, const char *pHost,
+												TLSDataParams *tlsDataParams, IoT_Error_t rc, uint32_t ttl_sec) {
+	NetworkAddressCacheEntry *pEntry;
+	size_t itr;
+
+	if(NETWORK_ADDRESS_CACHE_MAX_HOST_LEN < strlen(pHost)) {
+		return rc;
+	}
+
+	_iot_tls_address_cache_lock(pCache);
+
+	pEntry = _iot_tls_address_cache_find(pCache, pHost);
+	if(SUCCESS != rc) {
+		if(NULL != pEntry) {
+			IOT_WARN("  ! unable to resolve %s, using the addresses resolved before\n", pHost);
+			memcpy(tlsDataParams->addresses, pEntry->addresses, pEntry->addressCount * sizeof(NetworkAddress));
+			tlsDataParams->addressCount = pEntry->addressCount;
+			pEntry->lastUse = ++(pCache->useCount);
+			rc = SUCCESS;
+		}
+	} else {
+		if(NULL == pEntry) {
+			/* A free entry, or else the one used least recently */
+			for(itr = 0; itr < AWS_IOT_NETWORK_ADDRESS_CACHE_ENTRIES; itr++) {
+				if('\0' == pCache->entries[itr].host[0]) {
+					pEntry = &(pCache->entries[itr]);
+					break;
+				}
+				if(NULL == pEntry || pCache->entries[itr].lastUse < pEntry->lastUse) {
+					pEntry = &(pCache->entries[itr]);
+				}
+			}
+			strcpy(pEntry->host, pHost);
+		}
+
+		memcpy(pEntry->addresses, tlsDataParams->addresses, tlsDataParams->addressCount * sizeof(NetworkAddress));
+		pEntry->addressCount = tlsDataParams->addressCount;
+		pEntry->lastUse = ++(pCache->useCount);
+		init_timer(&(pEntry->expiryTimer));
+		countdown_sec(&(pEntry->expiryTimer), (0 < ttl_sec) ? ttl_sec : AWS_IOT_NETWORK_ADDRESS_CACHE_TTL_SEC);
+	}
+
+	_iot_tls_address_cache_unlock(pCache);
+
+	return rc;
+}
+
+/*
+ * Tells the address cache how the TCP connects went. The address that got through is tried
+ * first from then on. If none did, the host is resolved again on the next connect
+ */
+static void _iot_tls_address_cache_report(Network *pNetwork, const NetworkAddress *pWinner) {
+	NetworkAddressCache *pCache = pNetwork->tlsDataParams.pAddressCache;
+	NetworkAddressCacheEntry *pEntry;
+	NetworkAddress address;
+	size_t itr;
+
+	if(NULL == pCache) {
+		return;
+	}
+
+	_iot_tls_address_cache_lock(pCache);
+
+	pEntry = _iot_tls_address_cache_find(pCache, pNetwork->tlsConnectParams.pDestinationURL);
+	if(NULL != pEntry && NULL == pWinner) {
+		countdown_ms(&(pEntry->expiryTimer), 0);
+	} else if(NULL != pEntry) {
+		for(itr = 0; itr < pEntry->addressCount && !_iot_tls_address_equal(&(pEntry->addresses[itr]), pWinner); itr++);
+		if(itr < pEntry->addressCount) {
+			address = pEntry->addresses[itr];
+			memmove(&(pEntry->addresses[1]), &(pEntry->addresses[0]), itr * sizeof(NetworkAddress));
+			pEntry->addresses[0] = address;
+		}
+	}
+
+	_iot_tls_address_cache_unlock(pCache);
+}
+
+/*
+ * Looks the server up in the address cache of the connection and resolves it if its
+ * addresses expired or were never cached. Without a cache the server is resolved each time
+ */
+static IoT_Error_t _iot_tls_resolve(Network *pNetwork) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	NetworkAddressCache *pCache = tlsDataParams->pAddressCache;
+	const char *pHost = pNetwork->tlsConnectParams.pDestinationURL;
+	NetworkResolveFunction resolve = _iot_tls_resolve_getaddrinfo;
+	NetworkAddressCacheEntry *pEntry;
+	uint32_t ttl_sec = 0;
+	size_t itr;
+	IoT_Error_t rc = SUCCESS;
+
+	tlsDataParams->addressCount = 0;
+
+	if(NULL != pCache) {
+		resolve = pCache->resolve;
+
+		_iot_tls_address_cache_lock(pCache);
+		pEntry = _iot_tls_address_cache_find(pCache, pHost);
+		if(NULL != pEntry && !has_timer_expired(&(pEntry->expiryTimer))) {
+			memcpy(tlsDataParams->addresses, pEntry->addresses, pEntry->addressCount * sizeof(NetworkAddress));
+			tlsDataParams->addressCount = pEntry->addressCount;
+			pEntry->lastUse = ++(pCache->useCount);
+		} else {
+			pCache->resolveCount++;
+		}
+		_iot_tls_address_cache_unlock(pCache);
+	}
+
+	if(0 == tlsDataParams->addressCount) {
+		/* The cache is not locked while resolving, which can take seconds */
+		rc = resolve(pHost, tlsDataParams->addresses, AWS_IOT_NETWORK_MAX_ADDRESSES, &(tlsDataParams->addressCount),
+					 &ttl_sec);
+		if(SUCCESS == rc && 0 == tlsDataParams->addressCount) {
+			rc = NETWORK_ERR_NET_UNKNOWN_HOST;
+		}
+		if(SUCCESS == rc) {
+			_iot_tls_interleave_addresses(tlsDataParams->addresses, tlsDataParams->addressCount);
+		} else {
+			tlsDataParams->addressCount = 0;
+		}
+		if(NULL != pCache) {
+			rc = _iot_tls_address_cache_store(pCache, pHost, tlsDataParams, rc, ttl_sec);
+		}
+	}
+
+	for(itr = 0; itr < tlsDataParams->addressCount; itr++) {
+		_iot_tls_address_set_port(&(tlsDataParams->addresses[itr]), pNetwork->tlsConnectParams.DestinationPort);
+	}
+
+	return rc;
+}
+
+/* Closes the sockets of the TCP connects still in progress */
+static void _iot_tls_connect_close_attempts(TLSDataParams *tlsDataParams) {
+	size_t itr;
+
+	for(itr = 0; itr < tlsDataParams->nextAddress; itr++) {
+		if(0 <= tlsDataParams->attemptFds[itr]) {
+			close(tlsDataParams->attemptFds[itr]);
+			tlsDataParams->attemptFds[itr] = -1;
+		}
+	}
+}
+
+/* Ends the connect in progress, the socket of the connection is kept */
+static void _iot_tls_connect_end(TLSDataParams *tlsDataParams) {
+	_iot_tls_connect_close_attempts(tlsDataParams);
+	tlsDataParams->nextAddress = 0;
+	tlsDataParams->connectState = TLS_CONNECT_IDLE;
+}
+
+/* Gives up on the connect in progress. Closing the sockets takes them out of the event set */
+static void _iot_tls_connect_abort(TLSDataParams *tlsDataParams) {
+	mbedtls_net_free(&(tlsDataParams->server_fd));
+	_iot_tls_connect_end(tlsDataParams);
+}
+
+/*
+ * Starts a non-blocking TCP connect to the next address of the server that takes one,
+ * alongside the connects already in progress. The address after it is raced against
+ * them once the attempt timer expires
+ */
+static IoT_Error_t _iot_tls_connect_next_address(TLSDataParams *tlsDataParams) {
+	IoT_Error_t rc = NETWORK_ERR_NET_CONNECT_FAILED;
+	NetworkAddress *pAddress;
+	mbedtls_net_context attempt;
+	size_t index;
+	int one = 1;
+
+	while(tlsDataParams->nextAddress < tlsDataParams->addressCount) {
+		index = tlsDataParams->nextAddress++;
+		pAddress = &(tlsDataParams->addresses[index]);
+
+		attempt.fd = socket(pAddress->addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+		if(0 > attempt.fd) {
+			rc = NETWORK_ERR_NET_SOCKET_FAILED;
+			continue;
+		}
+
+		/* MQTT packets are small, each record is sent as soon as it is written rather than held back by Nagle */
+		setsockopt(attempt.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		if(0 == mbedtls_net_set_nonblock(&attempt) &&
+		   (0 == connect(attempt.fd, (struct sockaddr *) &(pAddress->addr), pAddress->addrLen) || EINPROGRESS == errno)) {
+			/* The socket turns writable once the connect is done, whether it succeeded or not */
+			tlsDataParams->attemptFds[index] = attempt.fd;
+			init_timer(&(tlsDataParams->attemptTimer));
+			countdown_ms(&(tlsDataParams->attemptTimer), AWS_IOT_NETWORK_CONNECT_ATTEMPT_DELAY_MS);
+			return SUCCESS;
+		}
+
+		rc = NETWORK_ERR_NET_CONNECT_FAILED;
+		mbedtls_net_free(&attempt);
+	}
+
+	return rc;
+}
+
+/*
+ * Checks the TCP connects in progress. The first one to get through becomes the socket of
+ * the connection and the others are closed. The next address is tried as soon as a connect
+ * fails, or alongside the others once the attempt timer expires
+ */
+static IoT_Error_t _iot_tls_connect_race(Network *pNetwork) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	struct pollfd pfds[AWS_IOT_NETWORK_MAX_ADDRESSES];
+	size_t indexes[AWS_IOT_NETWORK_MAX_ADDRESSES];
+	size_t itr, pollCount = 0, pendingCount, index;
+	bool isFailed = false;
+	socklen_t errorLen;
+	int error;
+	IoT_Error_t rc = NETWORK_ERR_NET_CONNECT_FAILED;
+
+	for(itr = 0; itr < tlsDataParams->nextAddress; itr++) {
+		if(0 <= tlsDataParams->attemptFds[itr]) {
+			pfds[pollCount].fd = tlsDataParams->attemptFds[itr];
+			pfds[pollCount].events = POLLOUT;
+			pfds[pollCount].revents = 0;
+			indexes[pollCount++] = itr;
+		}
+	}
+
+	pendingCount = pollCount;
+	if(0 < pollCount && 0 < poll(pfds, pollCount, 0)) {
+		for(itr = 0; itr < pollCount; itr++) {
+			if(0 == pfds[itr].revents) {
+				continue;
+			}
+			index = indexes[itr];
+
+			error = 0;
+			errorLen = sizeof(error);
+			if(0 == getsockopt(pfds[itr].fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) && 0 == error) {
+				tlsDataParams->server_fd.fd = pfds[itr].fd;
+				tlsDataParams->attemptFds[index] = -1;
+				_iot_tls_connect_close_attempts(tlsDataParams);
+				_iot_tls_address_cache_report(pNetwork, &(tlsDataParams->addresses[index]));
+				return SUCCESS;
+			}
+
+			IOT_WARN("  ! connect to address %u of %s failed with error %d\n", (unsigned int) index,
+					 pNetwork->tlsConnectParams.pDestinationURL, error);
+			close(pfds[itr].fd);
+			tlsDataParams->attemptFds[index] = -1;
+			isFailed = true;
+			pendingCount--;
+		}
+	}
+
+	if((isFailed || 0 == pendingCount || has_timer_expired(&(tlsDataParams->attemptTimer))) &&
+	   tlsDataParams->nextAddress < tlsDataParams->addressCount) {
+		rc = _iot_tls_connect_next_address(tlsDataParams);
+		if(SUCCESS == rc) {
+			pendingCount++;
+		}
+	}
+
+	if(0 == pendingCount) {
+		IOT_ERROR(" failed\n  ! unable to connect to any address of %s\n\n", pNetwork->tlsConnectParams.pDestinationURL);
+		_iot_tls_address_cache_report(pNetwork, NULL);
+		return rc;
+	}
+
+	return NETWORK_CONNECT_IN_PROGRESS;
+}
+
+/* Time until the connect in progress has to be taken forward even if no socket is ready */
+static uint32_t _iot_tls_connect_left_ms(TLSDataParams *tlsDataParams) {
+	uint32_t left = left_ms(&(tlsDataParams->connectTimer));
+
+	if(TLS_CONNECT_TCP == tlsDataParams->connectState && tlsDataParams->nextAddress < tlsDataParams->addressCount &&
+	   left_ms(&(tlsDataParams->attemptTimer)) < left) {
+		left = left_ms(&(tlsDataParams->attemptTimer));
+	}
+
+	return left;
+}
+
+/*
+ * Sets up the TLS context for a connect, resolves the server and starts the TCP connect
+ * to its first address
+ */
+static IoT_Error_t _iot_tls_connect_begin(Network *pNetwork, TLSConnectParams *params) {
+	if(NULL != params) {
+		/* A session is only offered to the server it was negotiated with */
+		if(pNetwork->tlsConnectParams.DestinationPort != params->DestinationPort ||
+		   0 != strcmp(pNetwork->tlsConnectParams.pDestinationURL, params->pDestinationURL)) {
+			_iot_tls_drop_session(&(pNetwork->tlsDataParams));
+		}
+		_iot_tls_set_connect_params(pNetwork, params->pRootCALocation, params->pDeviceCertLocation,
+									params->pDevicePrivateKeyLocation, params->pDestinationURL,
+									params->DestinationPort, params->timeout_ms, params->ServerVerificationFlag);
+		pNetwork->tlsConnectParams.maxFragmentLength = params->maxFragmentLength;
+	}
+
+	int ret = 0;
+	const char *pers = "aws_iot_tls_wrapper";
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	mbedtls_x509_crt *pCACert = &(tlsDataParams->cacert);
+	mbedtls_x509_crt *pCliCert = &(tlsDataParams->clicert);
+	mbedtls_pk_context *pKey = &(tlsDataParams->pkey);
+	int (*pRandom)(void *, unsigned char *, size_t) = mbedtls_ctr_drbg_random;
+	void *pRandomContext = &(tlsDataParams->ctr_drbg);
+	TLSDataParams *pPreviousOwner;
+	unsigned char mflCode;
+	size_t itr;
+	IoT_Error_t rc;
+
+	/* A connect started again replaces the one in progress */
+	if(TLS_CONNECT_IDLE != tlsDataParams->connectState) {
+		_iot_tls_connect_abort(tlsDataParams);
+	}
+
+	mbedtls_net_init(&(tlsDataParams->server_fd));
+	mbedtls_ssl_init(&(tlsDataParams->ssl));
+	mbedtls_ssl_config_init(&(tlsDataParams->conf));
+	mbedtls_ctr_drbg_init(&(tlsDataParams->ctr_drbg));
+	mbedtls_x509_crt_init(&(tlsDataParams->cacert));
+	mbedtls_x509_crt_init(&(tlsDataParams->clicert));
+	mbedtls_pk_init(&(tlsDataParams->pkey));
+	mbedtls_entropy_init(&(tlsDataParams->entropy));
+
+	if(NULL != tlsDataParams->pCredentials) {
+		/* Parsed and seeded already, only the handshake is left to do */
+		pPreviousOwner = _iot_tls_heap_charge(NULL);
+		ret = _iot_tls_credentials_acquire(tlsDataParams);
+		_iot_tls_heap_charge(pPreviousOwner);
+		if(SUCCESS != ret) {
+			return (IoT_Error_t) ret;
+		}
+		pCACert = &(tlsDataParams->pCredentialSet->cacert);
+		pCliCert = &(tlsDataParams->pCredentialSet->clicert);
+		pKey = tlsDataParams->pCredentialSet->pOwnKey;
+		pRandom = _iot_tls_credentials_random;
+		pRandomContext = tlsDataParams->pCredentials;
+	} else {
+		IOT_DEBUG("\n  . Seeding the random number generator...");
+		if((ret = mbedtls_ctr_drbg_seed(&(tlsDataParams->ctr_drbg), mbedtls_entropy_func, &(tlsDataParams->entropy),
+										(const unsigned char *) pers, strlen(pers))) != 0) {
+			IOT_ERROR(" failed\n  ! mbedtls_ctr_drbg_seed returned -0x%x\n", -ret);
+			return NETWORK_MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+		}
+
+		ret = _iot_tls_parse_credentials(pNetwork->tlsConnectParams.pRootCALocation,
+										 pNetwork->tlsConnectParams.pDeviceCertLocation,
+										 pNetwork->tlsConnectParams.pDevicePrivateKeyLocation, pCACert, pCliCert, pKey);
+		if(SUCCESS != ret) {
+			return (IoT_Error_t) ret;
+		}
+	}
+
+	IOT_DEBUG("  . Setting up the SSL/TLS structure...");
+	if((ret = mbedtls_ssl_config_defaults(&(tlsDataParams->conf), MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+										  MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
+		IOT_ERROR(" failed\n  ! mbedtls_ssl_config_defaults returned -0x%x\n\n", -ret);
+		return SSL_CONNECTION_ERROR;
+	}
+
+	mbedtls_ssl_conf_verify(&(tlsDataParams->conf), _iot_tls_verify_cert, NULL);
+	if(pNetwork->tlsConnectParams.ServerVerificationFlag == true) {
+		mbedtls_ssl_conf_authmode(&(tlsDataParams->conf), MBEDTLS_SSL_VERIFY_REQUIRED);
+	} else {
+		mbedtls_ssl_conf_authmode(&(tlsDataParams->conf), MBEDTLS_SSL_VERIFY_OPTIONAL);
+	}
+	mbedtls_ssl_conf_rng(&(tlsDataParams->conf), pRandom, pRandomContext);
+
+	mbedtls_ssl_conf_ca_chain(&(tlsDataParams->conf), pCACert, NULL);
+	if((ret = mbedtls_ssl_conf_own_cert(&(tlsDataParams->conf), pCliCert, pKey)) != 0) {
+		IOT_ERROR(" failed\n  ! mbedtls_ssl_conf_own_cert returned %d\n\n", ret);
+		return SSL_CONNECTION_ERROR;
+	}
+
+	/* Only used by reads once the handshake is done, the handshake is bounded by timeout_ms as a whole */
+	mbedtls_ssl_conf_read_timeout(&(tlsDataParams->conf), IOT_SSL_READ_TIMEOUT);
+
+	if(SUCCESS != _iot_tls_max_fragment_length_code(pNetwork->tlsConnectParams.maxFragmentLength, &mflCode)) {
+		IOT_ERROR(" failed\n  ! max fragment length %u does not fit the record buffers of %u bytes\n\n",
+				  pNetwork->tlsConnectParams.maxFragmentLength, (unsigned int) MBEDTLS_SSL_MAX_CONTENT_LEN);
+		return NETWORK_SSL_MAX_FRAGMENT_LENGTH_ERROR;
+	}
+	if((ret = mbedtls_ssl_conf_max_frag_len(&(tlsDataParams->conf), mflCode)) != 0) {
+		IOT_ERROR(" failed\n  ! mbedtls_ssl_conf_max_frag_len returned -0x%x\n\n", -ret);
+		return NETWORK_SSL_MAX_FRAGMENT_LENGTH_ERROR;
+	}
+
+	if((ret = mbedtls_ssl_setup(&(tlsDataParams->ssl), &(tlsDataParams->conf))) != 0) {
+		IOT_ERROR(" failed\n  ! mbedtls_ssl_setup returned -0x%x\n\n", -ret);
+		return SSL_CONNECTION_ERROR;
+	}
+	if((ret = mbedtls_ssl_set_hostname(&(tlsDataParams->ssl), pNetwork->tlsConnectParams.pDestinationURL)) != 0) {
+		IOT_ERROR(" failed\n  ! mbedtls_ssl_set_hostname returned %d\n\n", ret);
+		return SSL_CONNECTION_ERROR;
+	}
+
+	if(!tlsDataParams->isSessionSaved && NULL != tlsDataParams->pSessionLocation) {
+		_iot_tls_read_session_file(pNetwork);
+	}
+	/* The server resumes the session if it still knows it, otherwise the handshake is a full one */
+	if(tlsDataParams->isSessionSaved && 0 != (ret = mbedtls_ssl_set_session(&(tlsDataParams->ssl),
+																			 &(tlsDataParams->savedSession)))) {
+		IOT_WARN("  ! mbedtls_ssl_set_session returned -0x%x, doing a full handshake\n", -ret);
+	}
+	/* The socket does not block during the handshake, a read that would block returns WANT_READ */
+	mbedtls_ssl_set_bio(&(tlsDataParams->ssl), &(tlsDataParams->server_fd), mbedtls_net_send, mbedtls_net_recv, NULL);
+	IOT_DEBUG(" ok\n");
+
+	char portBuffer[6];
+	snprintf(portBuffer, 6, "%d", pNetwork->tlsConnectParams.DestinationPort);
+	IOT_DEBUG("  . Connecting to %s/%s...", pNetwork->tlsConnectParams.pDestinationURL, portBuffer);
+
+	rc = _iot_tls_resolve(pNetwork);
+	if(SUCCESS != rc) {
+		IOT_ERROR(" failed\n  ! unable to resolve %s\n\n", pNetwork->tlsConnectParams.pDestinationURL);
+		return rc;
+	}
+
+	init_timer(&(tlsDataParams->connectTimer));
+	countdown_ms(&(tlsDataParams->connectTimer), pNetwork->tlsConnectParams.timeout_ms);
+	tlsDataParams->connectState = TLS_CONNECT_TCP;
+	tlsDataParams->isConnectWantWrite = true;
+	tlsDataParams->nextAddress = 0;
+	for(itr = 0; itr < AWS_IOT_NETWORK_MAX_ADDRESSES; itr++) {
+		tlsDataParams->attemptFds[itr] = -1;
+	}
+
+	rc = _iot_tls_connect_next_address(tlsDataParams);
+	if(SUCCESS != rc) {
+		IOT_ERROR(" failed\n  ! unable to connect to any address of %s\n\n", pNetwork->tlsConnectParams.pDestinationURL);
+		_iot_tls_address_cache_report(pNetwork, NULL);
+		_iot_tls_connect_abort(tlsDataParams);
+		return rc;
+	}
+
+	return NETWORK_CONNECT_IN_PROGRESS;
+}
+
+/* Checks the server certificate once the handshake is done and hands the connection over to blocking I/O */
+static IoT_Error_t _iot_tls_connect_finish(Network *pNetwork) {
+	int ret = 0;
+#ifdef IOT_DEBUG
+	unsigned char buf[MBEDTLS_SSL_MAX_CONTENT_LEN + 1];
+#endif
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+
+	IOT_DEBUG(" ok\n    [ Protocol is %s ]\n    [ Ciphersuite is %s ]\n", mbedtls_ssl_get_version(&(tlsDataParams->ssl)),
+		  mbedtls_ssl_get_ciphersuite(&(tlsDataParams->ssl)));
+	if((ret = mbedtls_ssl_get_record_expansion(&(tlsDataParams->ssl))) >= 0) {
+		IOT_DEBUG("    [ Record expansion is %d ]\n", ret);
+	} else {
+		IOT_DEBUG("    [ Record expansion is unknown (compression) ]\n");
+	}
+
+	IOT_DEBUG("  . Verifying peer X.509 certificate...");
+
+	if(pNetwork->tlsConnectParams.ServerVerificationFlag == true) {
+		if((tlsDataParams->flags = mbedtls_ssl_get_verify_result(&(tlsDataParams->ssl))) != 0) {
+			char vrfy_buf[512];
+			IOT_ERROR(" failed\n");
+			mbedtls_x509_crt_verify_info(vrfy_buf, sizeof(vrfy_buf), "  ! ", tlsDataParams->flags);
+			IOT_ERROR("%s\n", vrfy_buf);
+			ret = SSL_CONNECTION_ERROR;
+		} else {
+			IOT_DEBUG(" ok\n");
+			ret = SUCCESS;
+		}
+	} else {
+		IOT_DEBUG(" Server Verification skipped\n");
+		ret = SUCCESS;
+	}
+
+#ifdef IOT_DEBUG
+	if (mbedtls_ssl_get_peer_cert(&(tlsDataParams->ssl)) != NULL) {
+		IOT_DEBUG("  . Peer certificate information    ...\n");
+		mbedtls_x509_crt_info((char *) buf, sizeof(buf) - 1, "      ", mbedtls_ssl_get_peer_cert(&(tlsDataParams->ssl)));
+		IOT_DEBUG("%s\n", buf);
+	}
+#endif
+
+	_iot_tls_connect_end(tlsDataParams);
+
+	/* Reads and writes of the MQTT client block on the socket, reads up to the read timeout */
+	if(0 != mbedtls_net_set_block(&(tlsDataParams->server_fd))) {
+		IOT_ERROR(" failed\n  ! net_set_(non)block() failed\n\n");
+		ret = SSL_CONNECTION_ERROR;
+	}
+	mbedtls_ssl_set_bio(&(tlsDataParams->ssl), &(tlsDataParams->server_fd), mbedtls_net_send, NULL,
+						mbedtls_net_recv_timeout);
+
+	if(SUCCESS == ret) {
+		_iot_tls_save_session(pNetwork);
+	}
+
+	/* The socket of a new connection replaces the closed one in the event set */
+	if(SUCCESS == ret && NULL != tlsDataParams->pEventSet) {
+		ret = _iot_tls_event_set_ctl(tlsDataParams, tlsDataParams->server_fd.fd, EPOLL_CTL_ADD);
+	}
+
+	return (IoT_Error_t) ret;
+}
+
+/*
+ * Takes the connect in progress as far as it goes without blocking. Returns
+ * NETWORK_CONNECT_IN_PROGRESS when it has to wait for the socket again
+ */
+static IoT_Error_t _iot_tls_connect_advance(Network *pNetwork) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	IoT_Error_t rc;
+	int ret;
+
+	if(TLS_CONNECT_IDLE == tlsDataParams->connectState) {
+		return FAILURE;
+	}
+
+	if(has_timer_expired(&(tlsDataParams->connectTimer))) {
+		IOT_ERROR(" failed\n  ! connect timed out\n");
+		_iot_tls_connect_abort(tlsDataParams);
+		return NETWORK_SSL_CONNECT_TIMEOUT_ERROR;
+	}
+
+	if(TLS_CONNECT_TCP == tlsDataParams->connectState) {
+		rc = _iot_tls_connect_race(pNetwork);
+		if(NETWORK_CONNECT_IN_PROGRESS == rc) {
+			return rc;
+		}
+		if(SUCCESS != rc) {
+			_iot_tls_connect_abort(tlsDataParams);
+			return rc;
+		}
+
+		IOT_DEBUG(" ok\n");
+		IOT_DEBUG("  . Performing the SSL/TLS handshake...");
+		tlsDataParams->connectState = TLS_CONNECT_HANDSHAKE;
+	}
+
+	ret = mbedtls_ssl_handshake(&(tlsDataParams->ssl));
+	if(MBEDTLS_ERR_SSL_WANT_READ == ret || MBEDTLS_ERR_SSL_WANT_WRITE == ret) {
+		tlsDataParams->isConnectWantWrite = (MBEDTLS_ERR_SSL_WANT_WRITE == ret);
+		return NETWORK_CONNECT_IN_PROGRESS;
+	}
+	if(0 != ret) {
+		IOT_ERROR(" failed\n  ! mbedtls_ssl_handshake returned -0x%x\n", -ret);
+		if(ret == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) {
+			IOT_ERROR("    Unable to verify the server's certificate. "
+						  "Either it is invalid,\n"
+						  "    or you didn't set ca_file or ca_path "
+						  "to an appropriate value.\n"
+						  "    Alternatively, you may want to use "
+						  "auth_mode=optional for testing purposes.\n");
+		}
+		/* Do not offer the session again in case the server choked on it */
+		_iot_tls_drop_session(tlsDataParams);
+		_iot_tls_connect_abort(tlsDataParams);
+		return SSL_CONNECTION_ERROR;
+	}
+
+	return _iot_tls_connect_finish(pNetwork);
+}
+
+/* Registers the sockets of the connect in progress for the event they wait for */
+static IoT_Error_t _iot_tls_connect_register(TLSDataParams *tlsDataParams) {
+	IoT_Error_t rc = SUCCESS;
+	size_t itr;
+
+	if(NULL == tlsDataParams->pEventSet) {
+		return NETWORK_CONNECT_IN_PROGRESS;
+	}
+
+	if(TLS_CONNECT_TCP == tlsDataParams->connectState) {
+		for(itr = 0; SUCCESS == rc && itr < tlsDataParams->nextAddress; itr++) {
+			if(0 <= tlsDataParams->attemptFds[itr]) {
+				rc = _iot_tls_event_set_ctl(tlsDataParams, tlsDataParams->attemptFds[itr], EPOLL_CTL_ADD);
+			}
+		}
+	} else {
+		rc = _iot_tls_event_set_ctl(tlsDataParams, tlsDataParams->server_fd.fd, EPOLL_CTL_ADD);
+	}
+
+	if(SUCCESS != rc) {
+		_iot_tls_connect_abort(tlsDataParams);
+		return NETWORK_EVENT_SET_ERROR;
+	}
+
+	return NETWORK_CONNECT_IN_PROGRESS;
+}
+
+IoT_Error_t iot_tls_connect(Network *pNetwork, TLSConnectParams *params) {
+	TLSDataParams *pPreviousOwner;
+	IoT_Error_t rc;
+
+	if(NULL == pNetwork) {
+		return NULL_VALUE_ERROR;
+	}
+
+	pPreviousOwner = _iot_tls_heap_charge(&(pNetwork->tlsDataParams));
+	rc = _iot_tls_connect_begin(pNetwork, params);
+	while(NETWORK_CONNECT_IN_PROGRESS == rc) {
+		iot_tls_connect_wait(pNetwork, UINT32_MAX);
+		rc = _iot_tls_connect_advance(pNetwork);
+	}
+	_iot_tls_heap_charge(pPreviousOwner);
+
+	return rc;
+}
+
+IoT_Error_t iot_tls_connect_start(Network *pNetwork, TLSConnectParams *params) {
+	TLSDataParams *pPreviousOwner;
+	IoT_Error_t rc;
+
+	if(NULL == pNetwork) {
+		return NULL_VALUE_ERROR;
 	}
 
-	ret = mbedtls_pk_parse_keyfile(&(tlsDataParams->pkey), pNetwork->tlsConnectParams.pDevicePrivateKeyLocation, "");
-	if(ret != 0) {
-		IOT_ERROR(" failed\n  !  mbedtls_pk_parse_key returned -0x%x while parsing private key\n\n", -ret);
-		IOT_DEBUG(" path : %s ", pNetwork->tlsConnectParams.pDevicePrivateKeyLocation);
-		return NETWORK_PK_PRIVATE_KEY_PARSE_ERROR;
+	pPreviousOwner = _iot_tls_heap_charge(&(pNetwork->tlsDataParams));
+	rc = _iot_tls_connect_begin(pNetwork, params);
+	_iot_tls_heap_charge(pPreviousOwner);
+	if(NETWORK_CONNECT_IN_PROGRESS == rc) {
+		rc = _iot_tls_connect_register(&(pNetwork->tlsDataParams));
 	}
-	IOT_DEBUG(" ok\n");
-	char portBuffer[6];
-	snprintf(portBuffer, 6, "%d", pNetwork->tlsConnectParams.DestinationPort);
-	IOT_DEBUG("  . Connecting to %s/%s...", pNetwork->tlsConnectParams.pDestinationURL, portBuffer);
-	if((ret = mbedtls_net_connect(&(tlsDataParams->server_fd), pNetwork->tlsConnectParams.pDestinationURL,
-								  portBuffer, MBEDTLS_NET_PROTO_TCP)) != 0) {
-		IOT_ERROR(" failed\n  ! mbedtls_net_connect returned -0x%x\n\n", -ret);
-		switch(ret) {
-			case MBEDTLS_ERR_NET_SOCKET_FAILED:
-				return NETWORK_ERR_NET_SOCKET_FAILED;
-			case MBEDTLS_ERR_NET_UNKNOWN_HOST:
-				return NETWORK_ERR_NET_UNKNOWN_HOST;
-			case MBEDTLS_ERR_NET_CONNECT_FAILED:
-			default:
-				return NETWORK_ERR_NET_CONNECT_FAILED;
-		};
-	}
-
-	ret = mbedtls_net_set_block(&(tlsDataParams->server_fd));
-	if(ret != 0) {
-		IOT_ERROR(" failed\n  ! net_set_(non)block() returned -0x%x\n\n", -ret);
-		return SSL_CONNECTION_ERROR;
-	} IOT_DEBUG(" ok\n");
 
-	IOT_DEBUG("  . Setting up the SSL/TLS structure...");
-	if((ret = mbedtls_ssl_config_defaults(&(tlsDataParams->conf), MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
-										  MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
-		IOT_ERROR(" failed\n  ! mbedtls_ssl_config_defaults returned -0x%x\n\n", -ret);
-		return SSL_CONNECTION_ERROR;
-	}
+	return rc;
+}
 
-	mbedtls_ssl_conf_verify(&(tlsDataParams->conf), _iot_tls_verify_cert, NULL);
-	if(pNetwork->tlsConnectParams.ServerVerificationFlag == true) {
-		mbedtls_ssl_conf_authmode(&(tlsDataParams->conf), MBEDTLS_SSL_VERIFY_REQUIRED);
-	} else {
-		mbedtls_ssl_conf_authmode(&(tlsDataParams->conf), MBEDTLS_SSL_VERIFY_OPTIONAL);
+IoT_Error_t iot_tls_connect_continue(Network *pNetwork) {
+	TLSDataParams *pPreviousOwner;
+	IoT_Error_t rc;
+
+	if(NULL == pNetwork) {
+		return NULL_VALUE_ERROR;
 	}
-	mbedtls_ssl_conf_rng(&(tlsDataParams->conf), mbedtls_ctr_drbg_random, &(tlsDataParams->ctr_drbg));
 
-	mbedtls_ssl_conf_ca_chain(&(tlsDataParams->conf), &(tlsDataParams->cacert), NULL);
-	if((ret = mbedtls_ssl_conf_own_cert(&(tlsDataParams->conf), &(tlsDataParams->clicert), &(tlsDataParams->pkey))) !=
-	   0) {
-		IOT_ERROR(" failed\n  ! mbedtls_ssl_conf_own_cert returned %d\n\n", ret);
-		return SSL_CONNECTION_ERROR;
+	pPreviousOwner = _iot_tls_heap_charge(&(pNetwork->tlsDataParams));
+	rc = _iot_tls_connect_advance(pNetwork);
+	_iot_tls_heap_charge(pPreviousOwner);
+	if(NETWORK_CONNECT_IN_PROGRESS == rc) {
+		rc = _iot_tls_connect_register(&(pNetwork->tlsDataParams));
 	}
 
-	mbedtls_ssl_conf_read_timeout(&(tlsDataParams->conf), pNetwork->tlsConnectParams.timeout_ms);
+	return rc;
+}
 
-	if((ret = mbedtls_ssl_setup(&(tlsDataParams->ssl), &(tlsDataParams->conf))) != 0) {
-		IOT_ERROR(" failed\n  ! mbedtls_ssl_setup returned -0x%x\n\n", -ret);
-		return SSL_CONNECTION_ERROR;
+IoT_Error_t iot_tls_connect_wait(Network *pNetwork, uint32_t timeout_ms) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	struct pollfd pfds[AWS_IOT_NETWORK_MAX_ADDRESSES];
+	size_t itr, count = 0;
+	uint32_t left;
+
+	if(TLS_CONNECT_IDLE == tlsDataParams->connectState) {
+		return SUCCESS;
 	}
-	if((ret = mbedtls_ssl_set_hostname(&(tlsDataParams->ssl), pNetwork->tlsConnectParams.pDestinationURL)) != 0) {
-		IOT_ERROR(" failed\n  ! mbedtls_ssl_set_hostname returned %d\n\n", ret);
-		return SSL_CONNECTION_ERROR;
+
+	/* Waking up in time lets the next continue start the next address or report the timeout */
+	left = _iot_tls_connect_left_ms(tlsDataParams);
+	if(timeout_ms > left) {
+		timeout_ms = left;
 	}
-	IOT_DEBUG("\n\nSSL state connect : %d ", tlsDataParams->ssl.state);
-	mbedtls_ssl_set_bio(&(tlsDataParams->ssl), &(tlsDataParams->server_fd), mbedtls_net_send, NULL,
-						mbedtls_net_recv_timeout);
-	IOT_DEBUG(" ok\n");
 
-	IOT_DEBUG("\n\nSSL state connect : %d ", tlsDataParams->ssl.state);
-	IOT_DEBUG("  . Performing the SSL/TLS handshake...");
-	while((ret = mbedtls_ssl_handshake(&(tlsDataParams->ssl))) != 0) {
-		if(ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
-			IOT_ERROR(" failed\n  ! mbedtls_ssl_handshake returned -0x%x\n", -ret);
-			if(ret == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) {
-				IOT_ERROR("    Unable to verify the server's certificate. "
-							  "Either it is invalid,\n"
-							  "    or you didn't set ca_file or ca_path "
-							  "to an appropriate value.\n"
-							  "    Alternatively, you may want to use "
-							  "auth_mode=optional for testing purposes.\n");
+	if(TLS_CONNECT_TCP == tlsDataParams->connectState) {
+		for(itr = 0; itr < tlsDataParams->nextAddress; itr++) {
+			if(0 <= tlsDataParams->attemptFds[itr]) {
+				pfds[count].fd = tlsDataParams->attemptFds[itr];
+				pfds[count].events = POLLOUT;
+				pfds[count++].revents = 0;
 			}
-			return SSL_CONNECTION_ERROR;
 		}
+	} else {
+		pfds[0].fd = tlsDataParams->server_fd.fd;
+		pfds[0].events = tlsDataParams->isConnectWantWrite ? POLLOUT : POLLIN;
+		pfds[count++].revents = 0;
 	}
 
-	IOT_DEBUG(" ok\n    [ Protocol is %s ]\n    [ Ciphersuite is %s ]\n", mbedtls_ssl_get_version(&(tlsDataParams->ssl)),
-		  mbedtls_ssl_get_ciphersuite(&(tlsDataParams->ssl)));
-	if((ret = mbedtls_ssl_get_record_expansion(&(tlsDataParams->ssl))) >= 0) {
-		IOT_DEBUG("    [ Record expansion is %d ]\n", ret);
-	} else {
-		IOT_DEBUG("    [ Record expansion is unknown (compression) ]\n");
+	if(0 == poll(pfds, count, (INT_MAX < timeout_ms) ? INT_MAX : (int) timeout_ms)) {
+		return NETWORK_CONNECT_IN_PROGRESS;
 	}
 
-	IOT_DEBUG("  . Verifying peer X.509 certificate...");
+	return SUCCESS;
+}
 
-	if(pNetwork->tlsConnectParams.ServerVerificationFlag == true) {
-		if((tlsDataParams->flags = mbedtls_ssl_get_verify_result(&(tlsDataParams->ssl))) != 0) {
-			char vrfy_buf[512];
-			IOT_ERROR(" failed\n");
-			mbedtls_x509_crt_verify_info(vrfy_buf, sizeof(vrfy_buf), "  ! ", tlsDataParams->flags);
-			IOT_ERROR("%s\n", vrfy_buf);
-			ret = SSL_CONNECTION_ERROR;
-		} else {
-			IOT_DEBUG(" ok\n");
-			ret = SUCCESS;
-		}
-	} else {
-		IOT_DEBUG(" Server Verification skipped\n");
-		ret = SUCCESS;
-	}
+IoT_Error_t iot_tls_connect_left_ms(Network *pNetwork, uint32_t *pLeft_ms) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
 
-#ifdef IOT_DEBUG
-	if (mbedtls_ssl_get_peer_cert(&(tlsDataParams->ssl)) != NULL) {
-		IOT_DEBUG("  . Peer certificate information    ...\n");
-		mbedtls_x509_crt_info((char *) buf, sizeof(buf) - 1, "      ", mbedtls_ssl_get_peer_cert(&(tlsDataParams->ssl)));
-		IOT_DEBUG("%s\n", buf);
+	*pLeft_ms = 0;
+	if(TLS_CONNECT_IDLE != tlsDataParams->connectState) {
+		*pLeft_ms = _iot_tls_connect_left_ms(tlsDataParams);
 	}
-#endif
-
-	mbedtls_ssl_conf_read_timeout(&(tlsDataParams->conf), IOT_SSL_READ_TIMEOUT);
 
-	return (IoT_Error_t) ret;
+	return SUCCESS;
 }
 
 IoT_Error_t iot_tls_write(Network *pNetwork, unsigned char *pMsg, size_t len, Timer *timer, size_t *written_len) {
@@ -293,6 +1620,57 @@ IoT_Error_t iot_tls_write(Network *pNetwork, unsigned char *pMsg, size_t len, Ti
 	return SUCCESS;
 }
 
+IoT_Error_t iot_tls_writev(Network *pNetwork, const IoT_IoVec_t *pVectors, size_t count, Timer *timer,
+						   size_t *written_len) {
+	unsigned char gatherBuf[TLS_WRITEV_GATHER_LEN];
+	size_t itr, gatheredLen, copyLen, remainingLen, len;
+	const unsigned char *pData;
+	IoT_Error_t ret = SUCCESS;
+
+	*written_len = 0;
+	gatheredLen = 0;
+
+	for(itr = 0; itr < count && SUCCESS == ret; itr++) {
+		pData = pVectors[itr].pBase;
+		remainingLen = pVectors[itr].len;
+
+		while(0 < remainingLen && SUCCESS == ret) {
+			if(0 == gatheredLen && TLS_WRITEV_GATHER_LEN <= remainingLen) {
+				/* Large buffers go to the TLS layer straight from the caller's memory */
+				len = 0;
+				ret = iot_tls_write(pNetwork, (unsigned char *) pData, remainingLen, timer, &len);
+				*written_len += len;
+				break;
+			}
+
+			/* Small buffers are gathered, and the head of a large one tops them up to a full record */
+			copyLen = TLS_WRITEV_GATHER_LEN - gatheredLen;
+			if(remainingLen < copyLen) {
+				copyLen = remainingLen;
+			}
+			memcpy(gatherBuf + gatheredLen, pData, copyLen);
+			gatheredLen += copyLen;
+			pData += copyLen;
+			remainingLen -= copyLen;
+
+			if(TLS_WRITEV_GATHER_LEN == gatheredLen) {
+				len = 0;
+				ret = iot_tls_write(pNetwork, gatherBuf, gatheredLen, timer, &len);
+				*written_len += len;
+				gatheredLen = 0;
+			}
+		}
+	}
+
+	if(SUCCESS == ret && 0 < gatheredLen) {
+		len = 0;
+		ret = iot_tls_write(pNetwork, gatherBuf, gatheredLen, timer, &len);
+		*written_len += len;
+	}
+
+	return ret;
+}
+
 IoT_Error_t iot_tls_read(Network *pNetwork, unsigned char *pMsg, size_t len, Timer *timer, size_t *read_len) {
 	size_t rxLen = 0;
 	bool isErrorFlag = false;
@@ -303,7 +1681,7 @@ IoT_Error_t iot_tls_read(Network *pNetwork, unsigned char *pMsg, size_t len, Tim
 
 	do {
 		//mbedtls_ssl_conf_read_timeout(&(tlsDataParams->conf), timerLeftVal);
-		ret = mbedtls_ssl_read(&(tlsDataParams->ssl), pMsg, len);
+		ret = mbedtls_ssl_read(&(tlsDataParams->ssl), pMsg + rxLen, len - rxLen);
 		if(ret >= 0) { /* 0 is for EOF */
 			rxLen += ret;
 		} else if(ret != MBEDTLS_ERR_SSL_WANT_READ) {
@@ -330,6 +1708,350 @@ IoT_Error_t iot_tls_read(Network *pNetwork, unsigned char *pMsg, size_t len, Tim
 	return SUCCESS;
 }
 
+IoT_Error_t iot_tls_read_available(Network *pNetwork, unsigned char *pMsg, size_t len, Timer *timer,
+								   size_t *read_len) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	int ret = 0;
+
+	*read_len = 0;
+
+	do {
+		ret = mbedtls_ssl_read(&(tlsDataParams->ssl), pMsg, len);
+		if(ret > 0) {
+			*read_len = (size_t) ret;
+			return SUCCESS;
+		} else if(0 == ret || MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY == ret || MBEDTLS_ERR_SSL_CONN_EOF == ret) {
+			/* The server closed the connection, the socket stays readable from now on */
+			return NETWORK_SSL_READ_ERROR;
+		} else if(ret != MBEDTLS_ERR_SSL_WANT_READ) {
+			/* Includes the read timeout, connection errors will be caught in ping request */
+			return NETWORK_SSL_NOTHING_TO_READ;
+		}
+	} while(!has_timer_expired(timer));
+
+	return NETWORK_SSL_READ_TIMEOUT_ERROR;
+}
+
+IoT_Error_t iot_tls_wait_readable(Network *pNetwork, uint32_t timeout_ms) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	struct pollfd pfd;
+	int ret;
+
+	/* A record that was read whole may hold more than the last read asked for */
+	if(0 < mbedtls_ssl_get_bytes_avail(&(tlsDataParams->ssl))) {
+		return SUCCESS;
+	}
+
+	pfd.fd = tlsDataParams->server_fd.fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	/* poll ignores a negative descriptor and just sleeps */
+	ret = poll(&pfd, 1, (INT_MAX < timeout_ms) ? INT_MAX : (int) timeout_ms);
+	if(0 == ret) {
+		return NETWORK_SSL_READ_TIMEOUT_ERROR;
+	}
+
+	/* Errors and hang-ups are reported as readable, the read that follows picks them up.
+	 * An interrupted poll returns early and the caller waits again */
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_event_set_init(NetworkEventSet *pEventSet) {
+	struct epoll_event event;
+
+	pEventSet->epollFd = epoll_create1(EPOLL_CLOEXEC);
+	pEventSet->interruptFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(0 > pEventSet->epollFd || 0 > pEventSet->interruptFd) {
+		iot_tls_event_set_free(pEventSet);
+		return NETWORK_EVENT_SET_ERROR;
+	}
+
+	/* Level triggered and never read, once signalled every wait sees it */
+	event.events = EPOLLIN;
+	event.data.ptr = pEventSet;
+	if(0 != epoll_ctl(pEventSet->epollFd, EPOLL_CTL_ADD, pEventSet->interruptFd, &event)) {
+		iot_tls_event_set_free(pEventSet);
+		return NETWORK_EVENT_SET_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_event_set_add(NetworkEventSet *pEventSet, Network *pNetwork, void *pData) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+
+	tlsDataParams->pEventSet = pEventSet;
+	tlsDataParams->pEventData = pData;
+
+	if(0 > tlsDataParams->server_fd.fd) {
+		return SUCCESS;
+	}
+
+	return _iot_tls_event_set_ctl(tlsDataParams, tlsDataParams->server_fd.fd, EPOLL_CTL_ADD);
+}
+
+IoT_Error_t iot_tls_event_set_remove(Network *pNetwork) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	IoT_Error_t rc = SUCCESS;
+
+	if(NULL != tlsDataParams->pEventSet && 0 <= tlsDataParams->server_fd.fd) {
+		if(0 != epoll_ctl(tlsDataParams->pEventSet->epollFd, EPOLL_CTL_DEL, tlsDataParams->server_fd.fd, NULL)) {
+			rc = NETWORK_EVENT_SET_ERROR;
+		}
+	}
+
+	tlsDataParams->pEventSet = NULL;
+	tlsDataParams->pEventData = NULL;
+
+	return rc;
+}
+
+IoT_Error_t iot_tls_event_set_rearm(Network *pNetwork) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+
+	if(NULL == tlsDataParams->pEventSet || 0 > tlsDataParams->server_fd.fd) {
+		return SUCCESS;
+	}
+
+	return _iot_tls_event_set_ctl(tlsDataParams, tlsDataParams->server_fd.fd, EPOLL_CTL_MOD);
+}
+
+IoT_Error_t iot_tls_event_set_wait(NetworkEventSet *pEventSet, void **ppReady, size_t maxReady, uint32_t timeout_ms,
+								   size_t *pReadyCount, bool *pIsInterrupted) {
+	struct epoll_event events[NETWORK_EVENT_SET_MAX_EVENTS];
+	int ret, itr;
+
+	*pReadyCount = 0;
+	*pIsInterrupted = false;
+
+	if(NETWORK_EVENT_SET_MAX_EVENTS < maxReady) {
+		maxReady = NETWORK_EVENT_SET_MAX_EVENTS;
+	}
+
+	ret = epoll_wait(pEventSet->epollFd, events, (int) maxReady, (INT_MAX < timeout_ms) ? INT_MAX : (int) timeout_ms);
+	if(0 > ret) {
+		/* An interrupted wait returns early with nothing ready */
+		return (EINTR == errno) ? SUCCESS : NETWORK_EVENT_SET_ERROR;
+	}
+
+	for(itr = 0; itr < ret; itr++) {
+		if(pEventSet == events[itr].data.ptr) {
+			*pIsInterrupted = true;
+		} else {
+			ppReady[(*pReadyCount)++] = events[itr].data.ptr;
+		}
+	}
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_event_set_interrupt(NetworkEventSet *pEventSet, bool isInterrupted) {
+	uint64_t value = 1;
+
+	if(isInterrupted) {
+		if(sizeof(value) != write(pEventSet->interruptFd, &value, sizeof(value))) {
+			return NETWORK_EVENT_SET_ERROR;
+		}
+	} else if(sizeof(value) != read(pEventSet->interruptFd, &value, sizeof(value)) && EAGAIN != errno) {
+		/* Reading resets the counter, EAGAIN means it was not set */
+		return NETWORK_EVENT_SET_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_event_set_free(NetworkEventSet *pEventSet) {
+	if(0 <= pEventSet->epollFd) {
+		close(pEventSet->epollFd);
+		pEventSet->epollFd = -1;
+	}
+	if(0 <= pEventSet->interruptFd) {
+		close(pEventSet->interruptFd);
+		pEventSet->interruptFd = -1;
+	}
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_credentials_init(TLSCredentials *pCredentials, char *pRootCALocation, char *pDeviceCertLocation,
+									 char *pDevicePrivateKeyLocation) {
+	const char *pers = "aws_iot_tls_wrapper";
+	IoT_Error_t rc = SUCCESS;
+	int ret;
+
+	if(NULL == pCredentials || NULL == pRootCALocation || NULL == pDeviceCertLocation ||
+	   NULL == pDevicePrivateKeyLocation) {
+		return NULL_VALUE_ERROR;
+	}
+
+	pCredentials->pRootCALocation = pRootCALocation;
+	pCredentials->pDeviceCertLocation = pDeviceCertLocation;
+	pCredentials->pDevicePrivateKeyLocation = pDevicePrivateKeyLocation;
+	memset(pCredentials->fileStats, 0, sizeof(pCredentials->fileStats));
+	pCredentials->pCurrentSet = NULL;
+	pCredentials->loadCount = 0;
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	rc = aws_iot_thread_mutex_init(&(pCredentials->lock));
+	if(SUCCESS != rc) {
+		return rc;
+	}
+	rc = aws_iot_thread_mutex_init(&(pCredentials->rngLock));
+	if(SUCCESS != rc) {
+		aws_iot_thread_mutex_destroy(&(pCredentials->lock));
+		return rc;
+	}
+	rc = aws_iot_thread_mutex_init(&(pCredentials->keyLock));
+	if(SUCCESS != rc) {
+		aws_iot_thread_mutex_destroy(&(pCredentials->lock));
+		aws_iot_thread_mutex_destroy(&(pCredentials->rngLock));
+		return rc;
+	}
+#endif
+
+	mbedtls_entropy_init(&(pCredentials->entropy));
+	mbedtls_ctr_drbg_init(&(pCredentials->ctr_drbg));
+	if((ret = mbedtls_ctr_drbg_seed(&(pCredentials->ctr_drbg), mbedtls_entropy_func, &(pCredentials->entropy),
+									(const unsigned char *) pers, strlen(pers))) != 0) {
+		IOT_ERROR(" failed\n  ! mbedtls_ctr_drbg_seed returned -0x%x\n", -ret);
+		rc = NETWORK_MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+	}
+
+	if(SUCCESS == rc) {
+		rc = _iot_tls_credentials_load(pCredentials);
+	}
+
+	if(SUCCESS != rc) {
+		iot_tls_credentials_free(pCredentials);
+	}
+
+	return rc;
+}
+
+IoT_Error_t iot_tls_credentials_reload(TLSCredentials *pCredentials) {
+	IoT_Error_t rc;
+
+	_iot_tls_credentials_lock(pCredentials);
+	rc = _iot_tls_credentials_load(pCredentials);
+	_iot_tls_credentials_unlock(pCredentials);
+
+	return rc;
+}
+
+IoT_Error_t iot_tls_credentials_free(TLSCredentials *pCredentials) {
+	if(NULL != pCredentials->pCurrentSet) {
+		_iot_tls_credential_set_release(pCredentials->pCurrentSet);
+		pCredentials->pCurrentSet = NULL;
+	}
+
+	mbedtls_ctr_drbg_free(&(pCredentials->ctr_drbg));
+	mbedtls_entropy_free(&(pCredentials->entropy));
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_destroy(&(pCredentials->lock));
+	aws_iot_thread_mutex_destroy(&(pCredentials->rngLock));
+	aws_iot_thread_mutex_destroy(&(pCredentials->keyLock));
+#endif
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_set_credentials(Network *pNetwork, TLSCredentials *pCredentials) {
+	pNetwork->tlsDataParams.pCredentials = pCredentials;
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_address_cache_init(NetworkAddressCache *pCache, NetworkResolveFunction resolve) {
+	if(NULL == pCache) {
+		return NULL_VALUE_ERROR;
+	}
+
+	memset(pCache->entries, 0, sizeof(pCache->entries));
+	pCache->resolve = (NULL != resolve) ? resolve : _iot_tls_resolve_getaddrinfo;
+	pCache->useCount = 0;
+	pCache->resolveCount = 0;
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	return aws_iot_thread_mutex_init(&(pCache->lock));
+#else
+	return SUCCESS;
+#endif
+}
+
+IoT_Error_t iot_tls_address_cache_flush(NetworkAddressCache *pCache) {
+	_iot_tls_address_cache_lock(pCache);
+	memset(pCache->entries, 0, sizeof(pCache->entries));
+	_iot_tls_address_cache_unlock(pCache);
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_address_cache_free(NetworkAddressCache *pCache) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_destroy(&(pCache->lock));
+#else
+	((void) pCache);
+#endif
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_set_address_cache(Network *pNetwork, NetworkAddressCache *pCache) {
+	pNetwork->tlsDataParams.pAddressCache = pCache;
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_set_session_location(Network *pNetwork, char *pSessionLocation) {
+	pNetwork->tlsDataParams.pSessionLocation = pSessionLocation;
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_get_handshake_counts(Network *pNetwork, uint32_t *pFullCount, uint32_t *pResumedCount) {
+	*pFullCount = pNetwork->tlsDataParams.fullHandshakeCount;
+	*pResumedCount = pNetwork->tlsDataParams.resumedHandshakeCount;
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_set_max_fragment_length(Network *pNetwork, uint16_t maxFragmentLength) {
+	unsigned char mflCode;
+	IoT_Error_t rc;
+
+	rc = _iot_tls_max_fragment_length_code(maxFragmentLength, &mflCode);
+	if(SUCCESS == rc) {
+		pNetwork->tlsConnectParams.maxFragmentLength = maxFragmentLength;
+	}
+
+	return rc;
+}
+
+IoT_Error_t iot_tls_get_memory_report(Network *pNetwork, TLSMemoryReport *pReport) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+
+	pReport->heapBytes = tlsDataParams->heapBytes;
+	pReport->peakHeapBytes = tlsDataParams->peakHeapBytes;
+	pReport->recordBufferBytes = (NULL != tlsDataParams->ssl.out_buf) ? 2 * MBEDTLS_SSL_BUFFER_LEN : 0;
+	pReport->maxFragmentLength = TLS_MAX_RECORD_PAYLOAD_LEN;
+	if(NULL != tlsDataParams->ssl.conf) {
+		pReport->maxFragmentLength = mbedtls_ssl_get_max_frag_len(&(tlsDataParams->ssl));
+	}
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tls_free_session(Network *pNetwork) {
+	TLSDataParams *pPreviousOwner = _iot_tls_heap_charge(&(pNetwork->tlsDataParams));
+
+	_iot_tls_drop_session(&(pNetwork->tlsDataParams));
+	_iot_tls_heap_charge(pPreviousOwner);
+
+	return SUCCESS;
+}
+
 IoT_Error_t iot_tls_disconnect(Network *pNetwork) {
 	mbedtls_ssl_context *ssl = &(pNetwork->tlsDataParams.ssl);
 	int ret = 0;
@@ -345,8 +2067,10 @@ IoT_Error_t iot_tls_disconnect(Network *pNetwork) {
 
 IoT_Error_t iot_tls_destroy(Network *pNetwork) {
 	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	TLSDataParams *pPreviousOwner = _iot_tls_heap_charge(tlsDataParams);
 
-	mbedtls_net_free(&(tlsDataParams->server_fd));
+	/* Also gives up on a connect still in progress */
+	_iot_tls_connect_abort(tlsDataParams);
 
 	mbedtls_x509_crt_free(&(tlsDataParams->clicert));
 	mbedtls_x509_crt_free(&(tlsDataParams->cacert));
@@ -356,6 +2080,16 @@ IoT_Error_t iot_tls_destroy(Network *pNetwork) {
 	mbedtls_ctr_drbg_free(&(tlsDataParams->ctr_drbg));
 	mbedtls_entropy_free(&(tlsDataParams->entropy));
 
+	/* A credential set released last is freed, it was not charged to the connection */
+	_iot_tls_heap_charge(pPreviousOwner);
+
+	if(NULL != tlsDataParams->pCredentialSet) {
+		_iot_tls_credentials_lock(tlsDataParams->pCredentials);
+		_iot_tls_credential_set_release(tlsDataParams->pCredentialSet);
+		_iot_tls_credentials_unlock(tlsDataParams->pCredentials);
+		tlsDataParams->pCredentialSet = NULL;
+	}
+
 	return SUCCESS;
 }
 
@@ -15,6 +15,11 @@
 
 #ifndef IOTSDKC_NETWORK_MBEDTLS_PLATFORM_H_H
 
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
 #include "mbedtls/config.h"
 
 #include "mbedtls/platform.h"
@@ -28,10 +33,146 @@
 #include "mbedtls/debug.h"
 #include "mbedtls/timing.h"
 
+#include "aws_iot_config.h"
+#include "aws_iot_error.h"
+#include "timer_platform.h"
+#include "threads_interface.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Most ready connections returned by one wait on a network event set
+ */
+#define NETWORK_EVENT_SET_MAX_EVENTS 64
+
+/**
+ * @brief Network Event Set
+ *
+ * An epoll set of the sockets of many connections. Each socket is registered for one
+ * event at a time and has to be rearmed after it was handled, so two threads waiting
+ * on the same set never handle the same connection at once.
+ */
+struct NetworkEventSet {
+	int epollFd;		///< The epoll instance
+	int interruptFd;	///< eventfd that makes every wait on the set return once signalled
+};
+
+/**
+ * Longest host name an address cache holds
+ */
+#define NETWORK_ADDRESS_CACHE_MAX_HOST_LEN 255
+
+/**
+ * @brief Network Address
+ *
+ * One IPv4 or IPv6 address of a host. The port is set by the connect.
+ */
+typedef struct {
+	struct sockaddr_storage addr;
+	socklen_t addrLen;
+} NetworkAddress;
+
+/**
+ * @brief Network Resolve Function
+ *
+ * Resolves a host name to at most maxCount addresses, in the order they should be tried,
+ * and stores the time in seconds they may be used for, or 0 if the resolver does not know.
+ * The default resolves with getaddrinfo. A stub can take its place for tests.
+ */
+typedef IoT_Error_t (*NetworkResolveFunction)(const char *pHost, NetworkAddress *pAddresses, size_t maxCount,
+											  size_t *pCount, uint32_t *pTtlSec);
+
+/**
+ * @brief Network Address Cache Entry
+ */
+typedef struct {
+	char host[NETWORK_ADDRESS_CACHE_MAX_HOST_LEN + 1];	///< Host name, empty if the entry is free
+	NetworkAddress addresses[AWS_IOT_NETWORK_MAX_ADDRESSES];	///< Addresses of the host, the one the last connect got through to first
+	size_t addressCount;
+	struct Timer expiryTimer;		///< Expires when the host has to be resolved again
+	uint32_t lastUse;			///< Use count of the cache when the entry was last looked up
+} NetworkAddressCacheEntry;
+
+/**
+ * @brief Network Address Cache
+ *
+ * Addresses of the hosts connected to, shared by many connections so that a reconnect
+ * does not wait for the resolver. Expired addresses are still used when the host cannot
+ * be resolved again.
+ */
+struct NetworkAddressCache {
+	NetworkAddressCacheEntry entries[AWS_IOT_NETWORK_ADDRESS_CACHE_ENTRIES];
+	NetworkResolveFunction resolve;		///< Resolver called on a miss
+	uint32_t useCount;			///< Number of lookups, orders the entries by last use
+	uint32_t resolveCount;			///< Number of times the resolver was called
+#ifdef _ENABLE_THREAD_SUPPORT_
+	IoT_Mutex_t lock;			///< Protects the entries
+#endif
+};
+
+/**
+ * @brief Network Memory Accept Function
+ *
+ * Called by a connect of the memory transport to the name it was registered under. It is
+ * handed the peer end of the pipe, a connected local socket it reads and writes with
+ * plain socket calls. It owns the socket and closes it when done. An error fails the
+ * connect.
+ */
+typedef IoT_Error_t (*NetworkMemoryAcceptFunction)(int peerFd, void *pContext);
+
+/**
+ * @brief TLS Credential Set
+ *
+ * The certificates and key parsed from the credential files at one point in time.
+ * Connections hold a reference to the set they were made with, so a reload never
+ * frees a set a connection still uses.
+ */
+struct TLSCredentialSet {
+	mbedtls_x509_crt cacert;
+	mbedtls_x509_crt clicert;
+	mbedtls_pk_context pkey;
+	mbedtls_pk_context *pOwnKey;	///< Private key handed to the connections, pkey or lockedKey
+#ifdef _ENABLE_THREAD_SUPPORT_
+	mbedtls_pk_context lockedKey;	///< RSA key wrapper that uses pkey under the key lock of the credentials
+	struct TLSCredentials *pCredentials;	///< Credentials the set belongs to
+#endif
+	uint32_t refCount;	///< Connections using the set, plus one while it is the current set
+};
+
+/**
+ * @brief TLS Credentials
+ *
+ * Credentials parsed once and shared read-only by many connections. The files are
+ * parsed again when they change. The random number generator is seeded once and
+ * shared as well.
+ */
+struct TLSCredentials {
+	char *pRootCALocation;
+	char *pDeviceCertLocation;
+	char *pDevicePrivateKeyLocation;
+	struct stat fileStats[3];		///< State of the files when the current set was parsed
+	struct TLSCredentialSet *pCurrentSet;	///< Set new connections are made with
+	uint32_t loadCount;			///< Number of times the files were parsed
+	mbedtls_entropy_context entropy;
+	mbedtls_ctr_drbg_context ctr_drbg;
+#ifdef _ENABLE_THREAD_SUPPORT_
+	IoT_Mutex_t lock;			///< Protects the current set and the reference counts
+	IoT_Mutex_t rngLock;			///< Serializes the use of the random number generator
+	IoT_Mutex_t keyLock;			///< Serializes RSA private key operations, which update the blinding values of the key
+#endif
+};
+
+/**
+ * @brief Steps of a non-blocking connect
+ */
+typedef enum {
+	TLS_CONNECT_IDLE = 0,		///< No connect in progress
+	TLS_CONNECT_TCP = 1,		///< Waiting for a TCP connection to one of the addresses of the server
+	TLS_CONNECT_HANDSHAKE = 2	///< Waiting for the socket to go on with the TLS handshake
+} TLSConnectState;
+
 /**
  * @brief TLS Connection Parameters
  *
@@ -48,6 +189,26 @@ typedef struct _TLSDataParams {
 	mbedtls_x509_crt clicert;
 	mbedtls_pk_context pkey;
 	mbedtls_net_context server_fd;
+	struct NetworkEventSet *pEventSet;	///< Event set the socket is registered with after each connect, NULL if none
+	void *pEventData;			///< Returned by the event set when the socket is readable
+	mbedtls_ssl_session savedSession;	///< Session of the last handshake, offered to the server on the next connect
+	bool isSessionSaved;			///< savedSession holds a session
+	char *pSessionLocation;			///< File the session is kept in across restarts, NULL to keep it in memory only
+	uint32_t fullHandshakeCount;		///< Connects that negotiated a new session
+	uint32_t resumedHandshakeCount;		///< Connects that resumed the saved session
+	struct TLSCredentials *pCredentials;	///< Shared credentials used instead of parsing the files on each connect, NULL if none
+	struct TLSCredentialSet *pCredentialSet;	///< Set of the shared credentials the connection holds, NULL if none
+	TLSConnectState connectState;		///< Step of the connect in progress
+	bool isConnectWantWrite;		///< The connect in progress waits for the socket to be writable rather than readable
+	struct Timer connectTimer;		///< Expires when the connect in progress times out
+	struct NetworkAddressCache *pAddressCache;	///< Cache the server is looked up in, NULL to resolve it on each connect
+	NetworkAddress addresses[AWS_IOT_NETWORK_MAX_ADDRESSES];	///< Addresses of the server the connect in progress tries
+	size_t addressCount;
+	size_t nextAddress;			///< Index of the address the next TCP connect is started to
+	int attemptFds[AWS_IOT_NETWORK_MAX_ADDRESSES];	///< Sockets of the TCP connects in progress by address, -1 if none
+	struct Timer attemptTimer;		///< Expires when a TCP connect to the next address is started alongside the others
+	size_t heapBytes;			///< Heap mbed TLS holds for the connection
+	size_t peakHeapBytes;			///< Most heap mbed TLS held for the connection at once
 }TLSDataParams;
 
 #define IOTSDKC_NETWORK_MBEDTLS_PLATFORM_H_H
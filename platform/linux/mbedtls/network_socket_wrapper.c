@@ -0,0 +1,504 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file network_socket_wrapper.c
+ * @brief Network transports without TLS: plain TCP and an in-process memory pipe.
+ *
+ * Both keep their socket in the TLS data of the Network, where the event set functions
+ * look for it, and share the same non-blocking socket I/O.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_error.h"
+#include "aws_iot_log.h"
+#include "network_interface.h"
+#include "network_platform.h"
+
+/* Longest a read waits for its first byte before it reports nothing to read, as the TLS read timeout does */
+#define SOCKET_READ_WAIT_MS 10
+
+/* Most buffers handed to one sendmsg call */
+#define SOCKET_WRITEV_MAX_VECTORS 64
+
+typedef struct {
+	const char *pName;	///< Name connects give as destination URL, NULL if the entry is free
+	NetworkMemoryAcceptFunction accept;
+	void *pContext;
+} NetworkMemoryListener;
+
+static NetworkMemoryListener memoryListeners[AWS_IOT_NETWORK_MEMORY_MAX_LISTENERS];
+
+/* Waits for the socket to get ready for the events, returns false if the time runs out first */
+static bool _iot_socket_poll(int fd, short events, uint32_t timeout_ms) {
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+
+	/* Errors and hang-ups count as ready, the call that follows picks them up.
+	 * An interrupted poll counts as ready too, the caller just tries again */
+	return 0 != poll(&pfd, 1, (INT_MAX < timeout_ms) ? INT_MAX : (int) timeout_ms);
+}
+
+/* Takes over a connected socket as the socket of the Network */
+static IoT_Error_t _iot_socket_attach(Network *pNetwork, int fd) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+	int flags = fcntl(fd, F_GETFL);
+
+	if(0 > flags || 0 != fcntl(fd, F_SETFL, flags | O_NONBLOCK)) {
+		close(fd);
+		return TCP_SETUP_ERROR;
+	}
+
+	tlsDataParams->server_fd.fd = fd;
+
+	/* The socket of a new connection replaces the closed one in the event set */
+	if(NULL != tlsDataParams->pEventSet) {
+		return iot_tls_event_set_add(tlsDataParams->pEventSet, pNetwork, tlsDataParams->pEventData);
+	}
+
+	return SUCCESS;
+}
+
+static void _iot_socket_close(Network *pNetwork) {
+	TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
+
+	/* Closing the socket takes it out of the event set */
+	if(0 <= tlsDataParams->server_fd.fd) {
+		close(tlsDataParams->server_fd.fd);
+		tlsDataParams->server_fd.fd = -1;
+	}
+}
+
+/* Connects to one address within the time left on the timer, returns the socket or -1 */
+static int _iot_tcp_connect_address(const struct addrinfo *pAddress, Timer *pTimer, IoT_Error_t *pRc) {
+	socklen_t errorLen;
+	int fd, error;
+
+	fd = socket(pAddress->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+	if(0 > fd) {
+		*pRc = NETWORK_ERR_NET_SOCKET_FAILED;
+		return -1;
+	}
+
+	error = (0 == connect(fd, pAddress->ai_addr, pAddress->ai_addrlen)) ? 0 : errno;
+	if(EINPROGRESS == error) {
+		if(!_iot_socket_poll(fd, POLLOUT, left_ms(pTimer))) {
+			*pRc = NETWORK_SSL_CONNECT_TIMEOUT_ERROR;
+			close(fd);
+			return -1;
+		}
+		errorLen = sizeof(error);
+		if(0 != getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLen)) {
+			error = errno;
+		}
+	}
+
+	if(0 != error) {
+		*pRc = NETWORK_ERR_NET_CONNECT_FAILED;
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static IoT_Error_t _iot_tcp_connect(Network *pNetwork, TLSConnectParams *params) {
+	struct addrinfo hints, *pAddresses, *pAddress;
+	char portBuffer[6];
+	Timer timer;
+	IoT_Error_t rc = NETWORK_ERR_NET_CONNECT_FAILED;
+	int fd = -1, one = 1;
+
+	if(NULL == pNetwork) {
+		return NULL_VALUE_ERROR;
+	}
+	if(NULL != params) {
+		pNetwork->tlsConnectParams = *params;
+	}
+
+	_iot_socket_close(pNetwork);
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	snprintf(portBuffer, sizeof(portBuffer), "%d", pNetwork->tlsConnectParams.DestinationPort);
+
+	IOT_DEBUG("  . Connecting to %s/%s over TCP...", pNetwork->tlsConnectParams.pDestinationURL, portBuffer);
+	if(0 != getaddrinfo(pNetwork->tlsConnectParams.pDestinationURL, portBuffer, &hints, &pAddresses)) {
+		IOT_ERROR(" failed\n  ! unable to resolve %s\n\n", pNetwork->tlsConnectParams.pDestinationURL);
+		return NETWORK_ERR_NET_UNKNOWN_HOST;
+	}
+
+	init_timer(&timer);
+	countdown_ms(&timer, pNetwork->tlsConnectParams.timeout_ms);
+	for(pAddress = pAddresses; 0 > fd && NULL != pAddress && !has_timer_expired(&timer);
+		pAddress = pAddress->ai_next) {
+		fd = _iot_tcp_connect_address(pAddress, &timer, &rc);
+	}
+	freeaddrinfo(pAddresses);
+
+	if(0 > fd) {
+		IOT_ERROR(" failed\n  ! unable to connect to %s/%s\n\n", pNetwork->tlsConnectParams.pDestinationURL, portBuffer);
+		return rc;
+	}
+
+	/* MQTT packets are small, each is sent as soon as it is written */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	IOT_DEBUG(" ok\n");
+
+	return _iot_socket_attach(pNetwork, fd);
+}
+
+static IoT_Error_t _iot_memory_connect(Network *pNetwork, TLSConnectParams *params) {
+	NetworkMemoryListener *pListener = NULL;
+	IoT_Error_t rc;
+	size_t itr;
+	int fds[2];
+
+	if(NULL == pNetwork) {
+		return NULL_VALUE_ERROR;
+	}
+	if(NULL != params) {
+		pNetwork->tlsConnectParams = *params;
+	}
+
+	_iot_socket_close(pNetwork);
+
+	for(itr = 0; NULL == pListener && itr < AWS_IOT_NETWORK_MEMORY_MAX_LISTENERS; itr++) {
+		if(NULL != memoryListeners[itr].pName &&
+		   0 == strcmp(memoryListeners[itr].pName, pNetwork->tlsConnectParams.pDestinationURL)) {
+			pListener = &(memoryListeners[itr]);
+		}
+	}
+	if(NULL == pListener) {
+		IOT_ERROR("  ! nothing listens on the memory transport as %s\n", pNetwork->tlsConnectParams.pDestinationURL);
+		return NETWORK_ERR_NET_UNKNOWN_HOST;
+	}
+
+	if(0 != socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds)) {
+		return NETWORK_ERR_NET_SOCKET_FAILED;
+	}
+
+	/* The listener owns the peer end from here on, even if it fails */
+	rc = pListener->accept(fds[1], pListener->pContext);
+	if(SUCCESS != rc) {
+		IOT_ERROR("  ! the listener on the memory transport as %s refused the connect: %d\n",
+				  pNetwork->tlsConnectParams.pDestinationURL, rc);
+		close(fds[0]);
+		return NETWORK_ERR_NET_CONNECT_FAILED;
+	}
+
+	return _iot_socket_attach(pNetwork, fds[0]);
+}
+
+static IoT_Error_t _iot_socket_writev(Network *pNetwork, const IoT_IoVec_t *pVectors, size_t count, Timer *timer,
+									  size_t *written_len) {
+	int fd = pNetwork->tlsDataParams.server_fd.fd;
+	struct iovec iov[SOCKET_WRITEV_MAX_VECTORS];
+	struct msghdr msg;
+	size_t itr = 0, offset = 0, iovCount, sent;
+	ssize_t ret;
+
+	*written_len = 0;
+
+	while(itr < count) {
+		if(offset == pVectors[itr].len) {
+			itr++;
+			offset = 0;
+			continue;
+		}
+
+		/* The buffers left, the first one from where the last send stopped */
+		for(iovCount = 0; iovCount < SOCKET_WRITEV_MAX_VECTORS && itr + iovCount < count; iovCount++) {
+			iov[iovCount].iov_base = (void *) pVectors[itr + iovCount].pBase;
+			iov[iovCount].iov_len = pVectors[itr + iovCount].len;
+		}
+		iov[0].iov_base = (void *) (pVectors[itr].pBase + offset);
+		iov[0].iov_len -= offset;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iovCount;
+
+		ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if(0 > ret) {
+			if(EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+				IOT_ERROR("  ! sendmsg failed with error %d\n", errno);
+				return NETWORK_SSL_WRITE_ERROR;
+			}
+			if(has_timer_expired(timer) || !_iot_socket_poll(fd, POLLOUT, left_ms(timer))) {
+				return NETWORK_SSL_WRITE_TIMEOUT_ERROR;
+			}
+			continue;
+		}
+
+		*written_len += (size_t) ret;
+		for(sent = (size_t) ret; 0 < sent;) {
+			if(sent < pVectors[itr].len - offset) {
+				offset += sent;
+				sent = 0;
+			} else {
+				sent -= pVectors[itr].len - offset;
+				itr++;
+				offset = 0;
+			}
+		}
+	}
+
+	return SUCCESS;
+}
+
+static IoT_Error_t _iot_socket_write(Network *pNetwork, unsigned char *pMsg, size_t len, Timer *timer,
+									 size_t *written_len) {
+	IoT_IoVec_t vector;
+
+	vector.pBase = pMsg;
+	vector.len = len;
+
+	return _iot_socket_writev(pNetwork, &vector, 1, timer, written_len);
+}
+
+static IoT_Error_t _iot_socket_read(Network *pNetwork, unsigned char *pMsg, size_t len, Timer *timer,
+									size_t *read_len) {
+	int fd = pNetwork->tlsDataParams.server_fd.fd;
+	bool isErrorFlag = false;
+	size_t rxLen = 0;
+	uint32_t wait_ms;
+	ssize_t ret;
+
+	while(rxLen < len) {
+		ret = recv(fd, pMsg + rxLen, len - rxLen, 0);
+		if(0 < ret) {
+			rxLen += (size_t) ret;
+			continue;
+		}
+		if(0 == ret || (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)) {
+			/* Closed by the server or failed, caught in ping request when nothing was read */
+			isErrorFlag = true;
+			break;
+		}
+
+		wait_ms = left_ms(timer);
+		if(0 == rxLen && SOCKET_READ_WAIT_MS < wait_ms) {
+			wait_ms = SOCKET_READ_WAIT_MS;
+		}
+		if(0 == wait_ms || !_iot_socket_poll(fd, POLLIN, wait_ms)) {
+			break;
+		}
+	}
+
+	*read_len = rxLen;
+
+	if(rxLen == len) {
+		return SUCCESS;
+	} else if(0 == rxLen) {
+		return NETWORK_SSL_NOTHING_TO_READ;
+	} else if(isErrorFlag) {
+		return NETWORK_SSL_READ_ERROR;
+	}
+
+	return NETWORK_SSL_READ_TIMEOUT_ERROR;
+}
+
+static IoT_Error_t _iot_socket_read_available(Network *pNetwork, unsigned char *pMsg, size_t len, Timer *timer,
+											  size_t *read_len) {
+	int fd = pNetwork->tlsDataParams.server_fd.fd;
+	uint32_t wait_ms;
+	ssize_t ret;
+
+	*read_len = 0;
+
+	do {
+		ret = recv(fd, pMsg, len, 0);
+		if(0 < ret) {
+			*read_len = (size_t) ret;
+			return SUCCESS;
+		}
+		if(0 == ret || (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)) {
+			/* Closed by the server or failed, the socket stays readable from now on */
+			return NETWORK_SSL_READ_ERROR;
+		}
+
+		wait_ms = left_ms(timer);
+		if(SOCKET_READ_WAIT_MS < wait_ms) {
+			wait_ms = SOCKET_READ_WAIT_MS;
+		}
+		if(!_iot_socket_poll(fd, POLLIN, wait_ms)) {
+			return NETWORK_SSL_NOTHING_TO_READ;
+		}
+	} while(!has_timer_expired(timer));
+
+	return NETWORK_SSL_READ_TIMEOUT_ERROR;
+}
+
+static IoT_Error_t _iot_socket_wait_readable(Network *pNetwork, uint32_t timeout_ms) {
+	/* poll ignores a negative descriptor and just sleeps */
+	if(!_iot_socket_poll(pNetwork->tlsDataParams.server_fd.fd, POLLIN, timeout_ms)) {
+		return NETWORK_SSL_READ_TIMEOUT_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+static IoT_Error_t _iot_socket_is_connected(Network *pNetwork) {
+	IOT_UNUSED(pNetwork);
+
+	return NETWORK_PHYSICAL_LAYER_CONNECTED;
+}
+
+static IoT_Error_t _iot_socket_disconnect(Network *pNetwork) {
+	if(0 <= pNetwork->tlsDataParams.server_fd.fd) {
+		shutdown(pNetwork->tlsDataParams.server_fd.fd, SHUT_RDWR);
+	}
+
+	return SUCCESS;
+}
+
+static IoT_Error_t _iot_socket_destroy(Network *pNetwork) {
+	_iot_socket_close(pNetwork);
+
+	return SUCCESS;
+}
+
+/*
+ * Sets up the Network the way iot_tls_init does and swaps in the socket functions. The
+ * settings the MQTT client makes with the iot_tls functions are kept but not used
+ */
+static IoT_Error_t _iot_socket_init(Network *pNetwork, char *pRootCALocation, char *pDeviceCertLocation,
+									char *pDevicePrivateKeyLocation, char *pDestinationURL, uint16_t destinationPort,
+									uint32_t timeout_ms, bool ServerVerificationFlag) {
+	IoT_Error_t rc;
+
+	rc = iot_tls_init(pNetwork, pRootCALocation, pDeviceCertLocation, pDevicePrivateKeyLocation, pDestinationURL,
+					  destinationPort, timeout_ms, ServerVerificationFlag);
+	if(SUCCESS != rc) {
+		return rc;
+	}
+
+	/* Connects over the socket transports are done in one call */
+	pNetwork->connectStart = NULL;
+	pNetwork->connectContinue = NULL;
+	pNetwork->connectLeftMs = NULL;
+	pNetwork->read = _iot_socket_read;
+	pNetwork->readAvailable = _iot_socket_read_available;
+	pNetwork->write = _iot_socket_write;
+	pNetwork->writev = _iot_socket_writev;
+	pNetwork->waitReadable = _iot_socket_wait_readable;
+	pNetwork->disconnect = _iot_socket_disconnect;
+	pNetwork->isConnected = _iot_socket_is_connected;
+	pNetwork->destroy = _iot_socket_destroy;
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_tcp_init(Network *pNetwork, char *pRootCALocation, char *pDeviceCertLocation,
+						 char *pDevicePrivateKeyLocation, char *pDestinationURL, uint16_t destinationPort,
+						 uint32_t timeout_ms, bool ServerVerificationFlag) {
+	IoT_Error_t rc;
+
+	rc = _iot_socket_init(pNetwork, pRootCALocation, pDeviceCertLocation, pDevicePrivateKeyLocation,
+						  pDestinationURL, destinationPort, timeout_ms, ServerVerificationFlag);
+	if(SUCCESS == rc) {
+		pNetwork->connect = _iot_tcp_connect;
+	}
+
+	return rc;
+}
+
+IoT_Error_t iot_memory_init(Network *pNetwork, char *pRootCALocation, char *pDeviceCertLocation,
+							char *pDevicePrivateKeyLocation, char *pDestinationURL, uint16_t destinationPort,
+							uint32_t timeout_ms, bool ServerVerificationFlag) {
+	IoT_Error_t rc;
+
+	rc = _iot_socket_init(pNetwork, pRootCALocation, pDeviceCertLocation, pDevicePrivateKeyLocation,
+						  pDestinationURL, destinationPort, timeout_ms, ServerVerificationFlag);
+	if(SUCCESS == rc) {
+		pNetwork->connect = _iot_memory_connect;
+	}
+
+	return rc;
+}
+
+IoT_Error_t iot_memory_listen(const char *pName, NetworkMemoryAcceptFunction accept, void *pContext) {
+	NetworkMemoryListener *pListener = NULL;
+	size_t itr;
+
+	if(NULL == pName || NULL == accept) {
+		return NULL_VALUE_ERROR;
+	}
+
+	/* Listening again under a name replaces the listener */
+	for(itr = 0; itr < AWS_IOT_NETWORK_MEMORY_MAX_LISTENERS; itr++) {
+		if(NULL != memoryListeners[itr].pName && 0 == strcmp(memoryListeners[itr].pName, pName)) {
+			pListener = &(memoryListeners[itr]);
+			break;
+		}
+		if(NULL == pListener && NULL == memoryListeners[itr].pName) {
+			pListener = &(memoryListeners[itr]);
+		}
+	}
+	if(NULL == pListener) {
+		return NETWORK_MAX_TRANSPORTS_REACHED_ERROR;
+	}
+
+	pListener->pName = pName;
+	pListener->accept = accept;
+	pListener->pContext = pContext;
+
+	return SUCCESS;
+}
+
+IoT_Error_t iot_memory_unlisten(const char *pName) {
+	size_t itr;
+
+	if(NULL == pName) {
+		return NULL_VALUE_ERROR;
+	}
+
+	for(itr = 0; itr < AWS_IOT_NETWORK_MEMORY_MAX_LISTENERS; itr++) {
+		if(NULL != memoryListeners[itr].pName && 0 == strcmp(memoryListeners[itr].pName, pName)) {
+			memoryListeners[itr].pName = NULL;
+			return SUCCESS;
+		}
+	}
+
+	return NETWORK_TRANSPORT_NOT_FOUND_ERROR;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -34,6 +34,27 @@ struct _IoT_Mutex_t {
 	pthread_mutex_t lock;
 };
 
+/**
+ * @brief Thread Type
+ *
+ * definition of the Thread struct. Platform specific
+ *
+ */
+struct _IoT_Thread_t {
+	pthread_t thread;
+};
+
+/**
+ * @brief Condition Variable Type
+ *
+ * definition of the Condition Variable struct. Platform specific.
+ * Timed waits run on the monotonic clock
+ *
+ */
+struct _IoT_Cond_t {
+	pthread_cond_t cond;
+};
+
 #ifdef __cplusplus
 }
 #endif
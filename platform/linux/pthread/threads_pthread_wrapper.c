@@ -13,6 +13,9 @@
  * permissions and limitations under the License.
  */
 
+#include <errno.h>
+#include <time.h>
+
 #include "threads_platform.h"
 #ifdef _ENABLE_THREAD_SUPPORT_
 
@@ -104,6 +107,138 @@ IoT_Error_t aws_iot_thread_mutex_destroy(IoT_Mutex_t *pMutex) {
 	return SUCCESS;
 }
 
+/**
+ * @brief Start a thread
+ *
+ * Call this function to run the routine on a new thread
+ *
+ * @param IoT_Thread_t - pointer to the thread to be started
+ * @param IoT_Thread_Routine_t - routine the thread runs
+ * @param void - pointer passed to the routine
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_create(IoT_Thread_t *pThread, IoT_Thread_Routine_t routine, void *pArg) {
+	if(0 != pthread_create(&(pThread->thread), NULL, routine, pArg)) {
+		return THREAD_CREATE_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief Wait for a thread to finish
+ *
+ * Call this function to block until the routine of the thread has returned
+ *
+ * @param IoT_Thread_t - pointer to the thread to be waited for
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_join(IoT_Thread_t *pThread) {
+	if(0 != pthread_join(pThread->thread, NULL)) {
+		return THREAD_JOIN_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief Check if the calling thread is the given thread
+ *
+ * @param IoT_Thread_t - pointer to a started thread
+ * @return bool - true if the caller runs on that thread
+ */
+bool aws_iot_thread_is_current(IoT_Thread_t *pThread) {
+	return 0 != pthread_equal(pThread->thread, pthread_self());
+}
+
+/**
+ * @brief Initialize the provided condition variable
+ *
+ * Timed waits are measured on the monotonic clock, like the timers
+ *
+ * @param IoT_Cond_t - pointer to the condition variable to be initialized
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_cond_init(IoT_Cond_t *pCond) {
+	pthread_condattr_t attr;
+	int rc;
+
+	if(0 != pthread_condattr_init(&attr)) {
+		return THREAD_CONDITION_ERROR;
+	}
+
+	rc = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	if(0 == rc) {
+		rc = pthread_cond_init(&(pCond->cond), &attr);
+	}
+	pthread_condattr_destroy(&attr);
+
+	if(0 != rc) {
+		return THREAD_CONDITION_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief Wait on the provided condition variable
+ *
+ * Call this function with the mutex locked. Returns SUCCESS when signalled, when
+ * the timeout passed and on spurious wake ups
+ *
+ * @param IoT_Cond_t - pointer to the condition variable to wait on
+ * @param IoT_Mutex_t - pointer to the locked mutex protecting the condition
+ * @param uint32_t - maximum time to wait in milliseconds
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_cond_wait(IoT_Cond_t *pCond, IoT_Mutex_t *pMutex, uint32_t timeout_ms) {
+	struct timespec deadline;
+	int rc;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+	if(1000000000 <= deadline.tv_nsec) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	rc = pthread_cond_timedwait(&(pCond->cond), &(pMutex->lock), &deadline);
+	if(0 != rc && ETIMEDOUT != rc) {
+		return THREAD_CONDITION_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief Wake up all threads waiting on the provided condition variable
+ *
+ * @param IoT_Cond_t - pointer to the condition variable to be signalled
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_cond_broadcast(IoT_Cond_t *pCond) {
+	if(0 != pthread_cond_broadcast(&(pCond->cond))) {
+		return THREAD_CONDITION_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief Destroy the provided condition variable
+ *
+ * @param IoT_Cond_t - pointer to the condition variable to be destroyed
+ * @return IoT_Error_t - error code indicating result of operation
+ */
+IoT_Error_t aws_iot_thread_cond_destroy(IoT_Cond_t *pCond) {
+	if(0 != pthread_cond_destroy(&(pCond->cond))) {
+		return THREAD_CONDITION_ERROR;
+	}
+
+	return SUCCESS;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,8 +39,12 @@
 extern "C" {
 #endif
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "aws_iot_log.h"
 #include "aws_iot_mqtt_client_interface.h"
+#include "aws_iot_mqtt_client_common_internal.h"
 
 #ifdef _ENABLE_THREAD_SUPPORT_
 #include "threads_interface.h"
@@ -152,6 +156,90 @@ IoT_Error_t aws_iot_mqtt_set_connect_params(AWS_IoT_Client *pClient, IoT_Client_
 	FUNC_EXIT_RC(SUCCESS);
 }
 
+static void *_aws_iot_mqtt_default_realloc(void *ptr, size_t size, void *pContext) {
+	(void) pContext;
+	return realloc(ptr, size);
+}
+
+static void _aws_iot_mqtt_default_free(void *ptr, void *pContext) {
+	(void) pContext;
+	free(ptr);
+}
+
+static void _aws_iot_mqtt_free_buffers(AWS_IoT_Client *pClient) {
+	if(pClient->clientData.isWriteBufOwned) {
+		aws_iot_mqtt_internal_free(pClient, pClient->clientData.writeBuf);
+	}
+	if(pClient->clientData.isReadBufOwned) {
+		aws_iot_mqtt_internal_free(pClient, pClient->clientData.readBuf);
+	}
+	aws_iot_mqtt_internal_free(pClient, pClient->clientData.pCoalesceBuf);
+	pClient->clientData.writeBuf = NULL;
+	pClient->clientData.readBuf = NULL;
+	pClient->clientData.pCoalesceBuf = NULL;
+	pClient->clientData.isWriteBufOwned = false;
+	pClient->clientData.isReadBufOwned = false;
+	pClient->clientData.coalesceBufSize = 0;
+	pClient->clientData.coalesceLen = 0;
+	pClient->clientData.coalesceHeldLen = 0;
+}
+
+/**
+ * @brief Set up the TX and RX buffers of the client
+ *
+ * Caller supplied buffers are used as they are. Otherwise the buffers are allocated,
+ * and the RX buffer is allowed to grow up to maxReadBufSize. The buffer publishes are
+ * packed into is only allocated if publishCoalesceBufSize is set.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pInitParams Pointer to MQTT initialization parameters
+ *
+ * @return IoT_Error_t Type defining successful/failed call
+ */
+static IoT_Error_t _aws_iot_mqtt_init_buffers(AWS_IoT_Client *pClient, IoT_Client_Init_Params *pInitParams) {
+	pClient->clientData.writeBufSize = (0 != pInitParams->writeBufSize) ? pInitParams->writeBufSize
+																		: AWS_IOT_MQTT_TX_BUF_LEN;
+	pClient->clientData.readBufSize = (0 != pInitParams->readBufSize) ? pInitParams->readBufSize
+																	  : AWS_IOT_MQTT_RX_BUF_LEN;
+	pClient->clientData.maxReadBufSize = pClient->clientData.readBufSize;
+	if(NULL == pInitParams->pReadBuf && pInitParams->maxReadBufSize > pClient->clientData.readBufSize) {
+		pClient->clientData.maxReadBufSize = pInitParams->maxReadBufSize;
+	}
+
+	pClient->clientData.writeBuf = pInitParams->pWriteBuf;
+	pClient->clientData.isWriteBufOwned = (NULL == pInitParams->pWriteBuf);
+	if(pClient->clientData.isWriteBufOwned) {
+		pClient->clientData.writeBuf = (unsigned char *) aws_iot_mqtt_internal_malloc(pClient,
+																					  pClient->clientData.writeBufSize);
+	}
+
+	pClient->clientData.readBuf = pInitParams->pReadBuf;
+	pClient->clientData.isReadBufOwned = (NULL == pInitParams->pReadBuf);
+	if(pClient->clientData.isReadBufOwned) {
+		pClient->clientData.readBuf = (unsigned char *) aws_iot_mqtt_internal_malloc(pClient,
+																					 pClient->clientData.readBufSize);
+	}
+
+	pClient->clientData.pCoalesceBuf = NULL;
+	pClient->clientData.coalesceBufSize = pInitParams->publishCoalesceBufSize;
+	pClient->clientData.coalesceLen = 0;
+	pClient->clientData.coalesceHeldLen = 0;
+	pClient->clientData.coalesceDelayMs = pInitParams->publishCoalesceDelay_ms;
+	init_timer(&(pClient->clientData.coalesceTimer));
+	if(0 < pClient->clientData.coalesceBufSize) {
+		pClient->clientData.pCoalesceBuf = (unsigned char *) aws_iot_mqtt_internal_malloc(
+				pClient, pClient->clientData.coalesceBufSize);
+	}
+
+	if(NULL == pClient->clientData.writeBuf || NULL == pClient->clientData.readBuf
+	   || (0 < pClient->clientData.coalesceBufSize && NULL == pClient->clientData.pCoalesceBuf)) {
+		_aws_iot_mqtt_free_buffers(pClient);
+		return MQTT_MEMORY_ALLOCATION_ERROR;
+	}
+
+	return SUCCESS;
+}
+
 IoT_Error_t aws_iot_mqtt_init(AWS_IoT_Client *pClient, IoT_Client_Init_Params *pInitParams) {
 	uint32_t i;
 	IoT_Error_t rc;
@@ -159,22 +247,34 @@ IoT_Error_t aws_iot_mqtt_init(AWS_IoT_Client *pClient, IoT_Client_Init_Params *p
 
 	FUNC_ENTRY;
 
-	if(NULL == pClient || NULL == pInitParams || NULL == pInitParams->pHostURL || 0 == pInitParams->port ||
-	   NULL == pInitParams->pRootCALocation || NULL == pInitParams->pDevicePrivateKeyLocation ||
-	   NULL == pInitParams->pDeviceCertLocation) {
+	if(NULL == pClient || NULL == pInitParams || NULL == pInitParams->pHostURL || 0 == pInitParams->port) {
 		FUNC_EXIT_RC(NULL_VALUE_ERROR);
 	}
 
-	for(i = 0; i < AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS; ++i) {
-		pClient->clientData.messageHandlers[i].topicName = NULL;
-		pClient->clientData.messageHandlers[i].pApplicationHandler = NULL;
-		pClient->clientData.messageHandlers[i].pApplicationHandlerData = NULL;
-		pClient->clientData.messageHandlers[i].qos = QOS0;
+	/* Only TLS needs the credentials, the other transports ignore them */
+	if((NULL == pInitParams->pTransportName || 0 == strcmp(pInitParams->pTransportName, "tls"))
+	   && NULL == pInitParams->pTLSCredentials && (NULL == pInitParams->pRootCALocation ||
+												NULL == pInitParams->pDevicePrivateKeyLocation ||
+												NULL == pInitParams->pDeviceCertLocation)) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
 	}
 
+	for(i = 0; i < AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES; ++i) {
+		pClient->clientData.inflightPublishes[i].pTopicName = NULL;
+		pClient->clientData.inflightPublishes[i].topicNameLen = 0;
+		pClient->clientData.inflightPublishes[i].pCompleteHandler = NULL;
+		pClient->clientData.inflightPublishes[i].pCompleteHandlerData = NULL;
+		pClient->clientData.inflightPublishes[i].isInUse = false;
+		init_timer(&(pClient->clientData.inflightPublishes[i].retryTimer));
+	}
+	pClient->clientData.inflightPublishCount = 0;
+
 	pClient->clientData.commandTimeoutMs = pInitParams->mqttCommandTimeout_ms;
-	pClient->clientData.writeBufSize = AWS_IOT_MQTT_TX_BUF_LEN;
-	pClient->clientData.readBufSize = AWS_IOT_MQTT_RX_BUF_LEN;
+	pClient->clientData.readBufValidLen = 0;
+	pClient->clientData.readBufPacketLen = 0;
+	pClient->clientData.stream.isInProgress = false;
+	pClient->clientData.stream.isBeingRead = false;
+	pClient->clientData.stream.isDiscarding = false;
 	pClient->clientData.counterNetworkDisconnected = 0;
 	pClient->clientData.disconnectHandler = pInitParams->disconnectHandler;
 	pClient->clientData.disconnectHandlerData = pInitParams->disconnectHandlerData;
@@ -200,19 +300,66 @@ IoT_Error_t aws_iot_mqtt_init(AWS_IoT_Client *pClient, IoT_Client_Init_Params *p
 	if(SUCCESS != rc) {
 		FUNC_EXIT_RC(rc);
 	}
+	rc = aws_iot_thread_mutex_init(&(pClient->clientData.inflight_mutex));
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+	rc = aws_iot_thread_mutex_init(&(pClient->clientData.ioThreads.mutex));
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+	pClient->clientData.ioThreads.isRunning = false;
+	pClient->clientData.ioThreads.isStopping = false;
+	pClient->clientData.ioThreads.publisherCount = 0;
+	pClient->clientData.ioThreads.isRxWaitingForDispatch = false;
+	pClient->clientData.pDispatchPool = NULL;
+	pClient->clientData.closedNetworkCount = 0;
 #endif
 
 	pClient->clientStatus.isPingOutstanding = 0;
 	pClient->clientStatus.isAutoReconnectEnabled = pInitParams->enableAutoReconnect;
+	pClient->clientStatus.isNetworkConnecting = false;
 
-	rc = iot_tls_init(&(pClient->networkStack), pInitParams->pRootCALocation, pInitParams->pDeviceCertLocation,
-					  pInitParams->pDevicePrivateKeyLocation, pInitParams->pHostURL, pInitParams->port,
-					  pInitParams->tlsHandshakeTimeout_ms, pInitParams->isSSLHostnameVerify);
+	rc = iot_network_init(&(pClient->networkStack), pInitParams->pTransportName, pInitParams->pRootCALocation,
+						  pInitParams->pDeviceCertLocation, pInitParams->pDevicePrivateKeyLocation,
+						  pInitParams->pHostURL, pInitParams->port, pInitParams->tlsHandshakeTimeout_ms,
+						  pInitParams->isSSLHostnameVerify);
 
 	if(SUCCESS != rc) {
 		pClient->clientStatus.clientState = CLIENT_STATE_INVALID;
 		FUNC_EXIT_RC(rc);
 	}
+	iot_tls_set_session_location(&(pClient->networkStack), pInitParams->pTLSSessionLocation);
+	iot_tls_set_credentials(&(pClient->networkStack), pInitParams->pTLSCredentials);
+	iot_tls_set_address_cache(&(pClient->networkStack), pInitParams->pAddressCache);
+	rc = iot_tls_set_max_fragment_length(&(pClient->networkStack), pInitParams->tlsMaxFragmentLength);
+	if(SUCCESS != rc) {
+		pClient->clientStatus.clientState = CLIENT_STATE_INVALID;
+		FUNC_EXIT_RC(rc);
+	}
+
+	if(NULL != pInitParams->pAllocator) {
+		pClient->clientData.allocator = *(pInitParams->pAllocator);
+	} else {
+		pClient->clientData.allocator.pRealloc = _aws_iot_mqtt_default_realloc;
+		pClient->clientData.allocator.pFree = _aws_iot_mqtt_default_free;
+		pClient->clientData.allocator.pContext = NULL;
+	}
+
+	rc = _aws_iot_mqtt_init_buffers(pClient, pInitParams);
+	if(SUCCESS != rc) {
+		pClient->clientStatus.clientState = CLIENT_STATE_INVALID;
+		FUNC_EXIT_RC(rc);
+	}
+
+	rc = aws_iot_mqtt_internal_init_subscriptions(pClient, (0 != pInitParams->maxSubscriptions)
+														   ? pInitParams->maxSubscriptions
+														   : AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS);
+	if(SUCCESS != rc) {
+		_aws_iot_mqtt_free_buffers(pClient);
+		pClient->clientStatus.clientState = CLIENT_STATE_INVALID;
+		FUNC_EXIT_RC(rc);
+	}
 
 	init_timer(&(pClient->pingTimer));
 	init_timer(&(pClient->reconnectDelayTimer));
@@ -222,9 +369,65 @@ IoT_Error_t aws_iot_mqtt_init(AWS_IoT_Client *pClient, IoT_Client_Init_Params *p
 	FUNC_EXIT_RC(SUCCESS);
 }
 
+IoT_Error_t aws_iot_mqtt_free(AWS_IoT_Client *pClient) {
+	FUNC_ENTRY;
+
+	if(NULL == pClient) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	if(aws_iot_mqtt_is_client_connected(pClient)) {
+		FUNC_EXIT_RC(NETWORK_ALREADY_CONNECTED_ERROR);
+	}
+
+	aws_iot_mqtt_internal_abort_inflight_publishes(pClient, NETWORK_DISCONNECTED_ERROR);
+	aws_iot_mqtt_internal_free_subscriptions(pClient);
+	_aws_iot_mqtt_free_buffers(pClient);
+	iot_tls_free_session(&(pClient->networkStack));
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_destroy(&(pClient->clientData.state_change_mutex));
+	aws_iot_thread_mutex_destroy(&(pClient->clientData.tls_read_mutex));
+	aws_iot_thread_mutex_destroy(&(pClient->clientData.tls_write_mutex));
+	aws_iot_thread_mutex_destroy(&(pClient->clientData.inflight_mutex));
+	aws_iot_thread_mutex_destroy(&(pClient->clientData.ioThreads.mutex));
+#endif
+
+	pClient->clientStatus.clientState = CLIENT_STATE_INVALID;
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+void *aws_iot_mqtt_internal_malloc(AWS_IoT_Client *pClient, size_t size) {
+	return pClient->clientData.allocator.pRealloc(NULL, size, pClient->clientData.allocator.pContext);
+}
+
+void *aws_iot_mqtt_internal_realloc(AWS_IoT_Client *pClient, void *ptr, size_t size) {
+	return pClient->clientData.allocator.pRealloc(ptr, size, pClient->clientData.allocator.pContext);
+}
+
+void aws_iot_mqtt_internal_free(AWS_IoT_Client *pClient, void *ptr) {
+	if(NULL != ptr) {
+		pClient->clientData.allocator.pFree(ptr, pClient->clientData.allocator.pContext);
+	}
+}
+
 uint16_t aws_iot_mqtt_get_next_packet_id(AWS_IoT_Client *pClient) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+	/* Publishers and the RX thread of the full duplex mode draw ids at the same time */
+	uint16_t packetId, nextPacketId;
+
+	packetId = __atomic_load_n(&(pClient->clientData.nextPacketId), __ATOMIC_RELAXED);
+	do {
+		nextPacketId = (uint16_t) ((MAX_PACKET_ID == packetId) ? 1 : (packetId + 1));
+	} while(!__atomic_compare_exchange_n(&(pClient->clientData.nextPacketId), &packetId, nextPacketId, false,
+										 __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	return nextPacketId;
+#else
 	return pClient->clientData.nextPacketId = (uint16_t) ((MAX_PACKET_ID == pClient->clientData.nextPacketId) ? 1 : (
 			pClient->clientData.nextPacketId + 1));
+#endif
 }
 
 bool aws_iot_mqtt_is_client_connected(AWS_IoT_Client *pClient) {
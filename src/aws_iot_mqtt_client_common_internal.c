@@ -47,6 +47,9 @@ extern "C" {
 /* Max length of packet header */
 #define MAX_NO_OF_REMAINING_LENGTH_BYTES 4
 
+/* Fixed header, remaining length and packet id */
+#define MQTT_ACK_LENGTH 4
+
 /**
  * Encodes the message length according to the MQTT algorithm
  * @param buf the buffer into which the encoded data is written
@@ -264,9 +267,208 @@ IoT_Error_t aws_iot_mqtt_internal_init_header(MQTTHeader *pHeader, MessageTypes
 	FUNC_EXIT_RC(SUCCESS);
 }
 
-IoT_Error_t aws_iot_mqtt_internal_send_packet(AWS_IoT_Client *pClient, size_t length, Timer *pTimer) {
+/* Writes the buffers in order, the caller holds the write mutex */
+static IoT_Error_t _aws_iot_mqtt_internal_write_vectors(AWS_IoT_Client *pClient, const IoT_IoVec_t *pVectors,
+														size_t count, Timer *pTimer) {
+	size_t itr, length, vectorSent, sentLen, sent;
+	IoT_Error_t rc;
+
+	length = 0;
+	for(itr = 0; itr < count; itr++) {
+		length += pVectors[itr].len;
+	}
+
+	sent = 0;
+
+	/* Time passes while the write waits for the socket, so a time cached by yield is no longer valid */
+	timer_release_now();
+
+	if(NULL != pClient->networkStack.writev) {
+		sentLen = 0;
+		rc = pClient->networkStack.writev(&(pClient->networkStack), pVectors, count, pTimer, &sentLen);
+		sent = sentLen;
+	} else {
+		/* Network layers without writev get one write per buffer */
+		rc = SUCCESS;
+		for(itr = 0; itr < count && SUCCESS == rc; itr++) {
+			vectorSent = 0;
+			while(vectorSent < pVectors[itr].len && !has_timer_expired(pTimer)) {
+				sentLen = 0;
+				rc = pClient->networkStack.write(&(pClient->networkStack),
+												 (unsigned char *) pVectors[itr].pBase + vectorSent,
+												 pVectors[itr].len - vectorSent, pTimer, &sentLen);
+				if(SUCCESS != rc) {
+					/* there was an error writing the data */
+					break;
+				}
+				vectorSent += sentLen;
+			}
+			sent += vectorSent;
+			if(vectorSent != pVectors[itr].len) {
+				break;
+			}
+		}
+	}
+
+	if(sent == length) {
+		/* record the fact that we have successfully sent the packet */
+		//countdown_sec(&c->pingTimer, c->clientData.keepAliveInterval);
+		return SUCCESS;
+	}
+
+	return FAILURE;
+}
+
+/* Sends the packed publishes in a single write, the caller holds the write mutex.
+ * They are dropped if the write fails, the connection is gone at that point */
+static IoT_Error_t _aws_iot_mqtt_internal_write_coalesced(AWS_IoT_Client *pClient, Timer *pTimer) {
+	IoT_IoVec_t packed;
+
+	if(0 == pClient->clientData.coalesceLen) {
+		return SUCCESS;
+	}
+
+	packed.pBase = pClient->clientData.pCoalesceBuf;
+	packed.len = pClient->clientData.coalesceLen;
+	pClient->clientData.coalesceLen = 0;
+
+	return _aws_iot_mqtt_internal_write_vectors(pClient, &packed, 1, pTimer);
+}
+
+IoT_Error_t aws_iot_mqtt_internal_send_vectors(AWS_IoT_Client *pClient, const IoT_IoVec_t *pVectors, size_t count,
+											   Timer *pTimer) {
+	IoT_Error_t rc;
+#ifdef _ENABLE_THREAD_SUPPORT_
+	IoT_Error_t threadRc;
+#endif
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || NULL == pVectors || NULL == pTimer) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	threadRc = aws_iot_mqtt_client_lock_mutex(pClient, &(pClient->clientData.tls_write_mutex));
+	if(SUCCESS != threadRc) {
+		FUNC_EXIT_RC(threadRc);
+	}
+#endif
+
+	/* Packed publishes go out first, packets leave in the order they were sent */
+	rc = _aws_iot_mqtt_internal_write_coalesced(pClient, pTimer);
+	if(SUCCESS == rc) {
+		rc = _aws_iot_mqtt_internal_write_vectors(pClient, pVectors, count, pTimer);
+	}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	threadRc = aws_iot_mqtt_client_unlock_mutex(pClient, &(pClient->clientData.tls_write_mutex));
+	if(SUCCESS != threadRc) {
+		FUNC_EXIT_RC(threadRc);
+	}
+#endif
+
+	FUNC_EXIT_RC(rc);
+}
+
+IoT_Error_t aws_iot_mqtt_internal_coalesce_vectors(AWS_IoT_Client *pClient, const IoT_IoVec_t *pVectors,
+												   size_t count, Timer *pTimer) {
+	size_t itr, length;
+	IoT_Error_t rc;
+#ifdef _ENABLE_THREAD_SUPPORT_
+	IoT_Error_t threadRc;
+#endif
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || NULL == pVectors || NULL == pTimer) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	if(NULL == pClient->clientData.pCoalesceBuf) {
+		rc = aws_iot_mqtt_internal_send_vectors(pClient, pVectors, count, pTimer);
+		FUNC_EXIT_RC(rc);
+	}
+
+	length = 0;
+	for(itr = 0; itr < count; itr++) {
+		length += pVectors[itr].len;
+	}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	threadRc = aws_iot_mqtt_client_lock_mutex(pClient, &(pClient->clientData.tls_write_mutex));
+	if(SUCCESS != threadRc) {
+		FUNC_EXIT_RC(threadRc);
+	}
+#endif
+
+	rc = SUCCESS;
+	if(pClient->clientData.coalesceLen + length > pClient->clientData.coalesceBufSize) {
+		rc = _aws_iot_mqtt_internal_write_coalesced(pClient, pTimer);
+	}
+
+	if(SUCCESS == rc && length > pClient->clientData.coalesceBufSize) {
+		/* Too big to be packed, sent on its own */
+		rc = _aws_iot_mqtt_internal_write_vectors(pClient, pVectors, count, pTimer);
+	} else if(SUCCESS == rc) {
+		if(0 == pClient->clientData.coalesceLen) {
+			countdown_ms(&(pClient->clientData.coalesceTimer), pClient->clientData.coalesceDelayMs);
+		}
+		for(itr = 0; itr < count; itr++) {
+			memcpy(pClient->clientData.pCoalesceBuf + pClient->clientData.coalesceLen, pVectors[itr].pBase,
+				   pVectors[itr].len);
+			pClient->clientData.coalesceLen += pVectors[itr].len;
+		}
+	}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	threadRc = aws_iot_mqtt_client_unlock_mutex(pClient, &(pClient->clientData.tls_write_mutex));
+	if(SUCCESS != threadRc) {
+		FUNC_EXIT_RC(threadRc);
+	}
+#endif
+
+	FUNC_EXIT_RC(rc);
+}
+
+IoT_Error_t aws_iot_mqtt_internal_flush_coalesced(AWS_IoT_Client *pClient, Timer *pTimer, bool isForced) {
+	IoT_Error_t rc;
+#ifdef _ENABLE_THREAD_SUPPORT_
+	IoT_Error_t threadRc;
+#endif
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || NULL == pTimer) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	if(0 == pClient->clientData.coalesceLen
+	   || (!isForced && !has_timer_expired(&(pClient->clientData.coalesceTimer)))) {
+		FUNC_EXIT_RC(SUCCESS);
+	}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	threadRc = aws_iot_mqtt_client_lock_mutex(pClient, &(pClient->clientData.tls_write_mutex));
+	if(SUCCESS != threadRc) {
+		FUNC_EXIT_RC(threadRc);
+	}
+#endif
+
+	rc = _aws_iot_mqtt_internal_write_coalesced(pClient, pTimer);
 
-	size_t sentLen, sent;
+#ifdef _ENABLE_THREAD_SUPPORT_
+	threadRc = aws_iot_mqtt_client_unlock_mutex(pClient, &(pClient->clientData.tls_write_mutex));
+	if(SUCCESS != threadRc) {
+		FUNC_EXIT_RC(threadRc);
+	}
+#endif
+
+	FUNC_EXIT_RC(rc);
+}
+
+IoT_Error_t aws_iot_mqtt_internal_send_packet(AWS_IoT_Client *pClient, size_t length, Timer *pTimer) {
+	IoT_IoVec_t packet;
 	IoT_Error_t rc;
 
 	FUNC_ENTRY;
@@ -279,44 +481,252 @@ IoT_Error_t aws_iot_mqtt_internal_send_packet(AWS_IoT_Client *pClient, size_t le
 		FUNC_EXIT_RC(MQTT_TX_BUFFER_TOO_SHORT_ERROR);
 	}
 
+	packet.pBase = pClient->clientData.writeBuf;
+	packet.len = length;
+	rc = aws_iot_mqtt_internal_send_vectors(pClient, &packet, 1, pTimer);
+
+	FUNC_EXIT_RC(rc);
+}
+
 #ifdef _ENABLE_THREAD_SUPPORT_
-	rc = aws_iot_mqtt_client_lock_mutex(pClient, &(pClient->clientData.tls_write_mutex));
+/* Used by the TX thread of the full duplex mode. The connection may be torn down by the
+ * RX thread at any time, it is only checked and written while holding the write mutex */
+IoT_Error_t aws_iot_mqtt_internal_send_vectors_if_connected(AWS_IoT_Client *pClient, const IoT_IoVec_t *pVectors,
+															size_t count, Timer *pTimer) {
+	IoT_Error_t rc;
+	IoT_Error_t threadRc;
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || NULL == pVectors || NULL == pTimer) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	threadRc = aws_iot_thread_mutex_lock(&(pClient->clientData.tls_write_mutex));
+	if(SUCCESS != threadRc) {
+		FUNC_EXIT_RC(threadRc);
+	}
+
+	if(!aws_iot_mqtt_is_client_connected(pClient)) {
+		rc = NETWORK_DISCONNECTED_ERROR;
+	} else {
+		rc = _aws_iot_mqtt_internal_write_coalesced(pClient, pTimer);
+		if(SUCCESS == rc) {
+			rc = _aws_iot_mqtt_internal_write_vectors(pClient, pVectors, count, pTimer);
+		}
+	}
+
+	threadRc = aws_iot_thread_mutex_unlock(&(pClient->clientData.tls_write_mutex));
+	if(SUCCESS != threadRc) {
+		FUNC_EXIT_RC(threadRc);
+	}
+
+	FUNC_EXIT_RC(rc);
+}
+
+/**
+ * @brief Send the PUBACK of a message handled by the dispatch pool
+ *
+ * Called from a dispatch worker, or the reader, once every handler of the message has
+ * returned. The connection may have been replaced meanwhile, the PUBACK is only sent on
+ * the connection the message was received on since the broker redelivers it otherwise.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param packetId Packet id of the message
+ * @param closedNetworkCount closedNetworkCount of the client when the message was received
+ *
+ * @return SUCCESS, or NETWORK_DISCONNECTED_ERROR if the connection is no longer the same
+ */
+IoT_Error_t aws_iot_mqtt_internal_send_dispatched_puback(AWS_IoT_Client *pClient, uint16_t packetId,
+														 uint32_t closedNetworkCount) {
+	unsigned char ack[MQTT_ACK_LENGTH];
+	IoT_IoVec_t packet;
+	uint32_t len;
+	Timer timer;
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	len = 0;
+	rc = aws_iot_mqtt_internal_serialize_ack(ack, sizeof(ack), PUBACK, 0, packetId, &len);
 	if(SUCCESS != rc) {
 		FUNC_EXIT_RC(rc);
 	}
+
+	packet.pBase = ack;
+	packet.len = len;
+	init_timer(&timer);
+	countdown_ms(&timer, pClient->clientData.commandTimeoutMs);
+
+	aws_iot_thread_mutex_lock(&(pClient->clientData.tls_write_mutex));
+	if(closedNetworkCount != pClient->clientData.closedNetworkCount || !aws_iot_mqtt_is_client_connected(pClient)) {
+		rc = NETWORK_DISCONNECTED_ERROR;
+	} else {
+		rc = _aws_iot_mqtt_internal_write_coalesced(pClient, &timer);
+		if(SUCCESS == rc) {
+			rc = _aws_iot_mqtt_internal_write_vectors(pClient, &packet, 1, &timer);
+		}
+	}
+	aws_iot_thread_mutex_unlock(&(pClient->clientData.tls_write_mutex));
+
+	FUNC_EXIT_RC(rc);
+}
 #endif
 
-	sentLen = 0;
-	sent = 0;
+/**
+ * @brief Close and release the network connection
+ *
+ * With thread support the write mutex is held while the connection is released, so that
+ * a write from another thread never runs on a released connection. The client state
+ * must no longer be connected when this is called.
+ *
+ * @param pClient Reference to the IoT Client
+ *
+ * @return Return value of the destroy function of the network stack
+ */
+IoT_Error_t aws_iot_mqtt_internal_close_network(AWS_IoT_Client *pClient) {
+	IoT_Error_t rc;
 
-	while(sent < length && !has_timer_expired(pTimer)) {
-		rc = pClient->networkStack.write(&(pClient->networkStack), &pClient->clientData.writeBuf[sent], length, pTimer,
-										 &sentLen);
-		if(SUCCESS != rc) {
-			/* there was an error writing the data */
+	FUNC_ENTRY;
+
+	if(NULL == pClient) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_lock(&(pClient->clientData.tls_write_mutex));
+#endif
+
+	pClient->networkStack.disconnect(&(pClient->networkStack));
+	rc = pClient->networkStack.destroy(&(pClient->networkStack));
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	pClient->clientData.closedNetworkCount++;
+	aws_iot_thread_mutex_unlock(&(pClient->clientData.tls_write_mutex));
+#endif
+
+	FUNC_EXIT_RC(rc);
+}
+
+/**
+ * @brief Drop the last packet read from the front of the read buffer
+ *
+ * The packet is kept in place until the next read so that it can be deserialized
+ * directly from the read buffer. Any bytes received behind it are moved to the front.
+ *
+ * @param pClient Reference to the IoT Client
+ */
+static void _aws_iot_mqtt_internal_consume_read_buf(AWS_IoT_Client *pClient) {
+	size_t packetLen = pClient->clientData.readBufPacketLen;
+
+	if(0 == packetLen) {
+		return;
+	}
+
+	pClient->clientData.readBufValidLen -= packetLen;
+	if(0 < pClient->clientData.readBufValidLen) {
+		memmove(pClient->clientData.readBuf, pClient->clientData.readBuf + packetLen,
+				pClient->clientData.readBufValidLen);
+	}
+	pClient->clientData.readBufPacketLen = 0;
+}
+
+/**
+ * @brief Make sure the read buffer holds at least the required number of bytes
+ *
+ * When the network layer provides readAvailable, one call pulls in everything the
+ * TLS record holds, so the following packets are sliced out of the buffer without
+ * another network read. Otherwise exactly the missing bytes are read.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param requiredLen Number of bytes needed at the front of the read buffer
+ * @param pTimer Timer for the read operation
+ *
+ * @return SUCCESS once the bytes are available, MQTT_NOTHING_TO_READ if they did not arrive in time
+ */
+static IoT_Error_t _aws_iot_mqtt_internal_fill_read_buf(AWS_IoT_Client *pClient, size_t requiredLen, Timer *pTimer) {
+	size_t read_len;
+	IoT_Error_t rc;
+
+	/* Time passes while the read waits for data, so a time cached by yield is no longer valid */
+	timer_release_now();
+
+	while(pClient->clientData.readBufValidLen < requiredLen) {
+		read_len = 0;
+		if(NULL != pClient->networkStack.readAvailable) {
+			rc = pClient->networkStack.readAvailable(&(pClient->networkStack),
+													 pClient->clientData.readBuf + pClient->clientData.readBufValidLen,
+													 pClient->clientData.readBufSize - pClient->clientData.readBufValidLen,
+													 pTimer, &read_len);
+		} else {
+			rc = pClient->networkStack.read(&(pClient->networkStack),
+											pClient->clientData.readBuf + pClient->clientData.readBufValidLen,
+											requiredLen - pClient->clientData.readBufValidLen, pTimer, &read_len);
+		}
+		pClient->clientData.readBufValidLen += read_len;
+
+		if(pClient->clientData.readBufValidLen >= requiredLen) {
 			break;
 		}
-		sent += sentLen;
+
+		if(SUCCESS != rc && NETWORK_SSL_NOTHING_TO_READ != rc && NETWORK_SSL_READ_TIMEOUT_ERROR != rc) {
+			return rc;
+		}
+
+		/* A partially received packet stays in the buffer and is completed by the next read */
+		if(0 == pClient->clientData.readBufValidLen || has_timer_expired(pTimer)) {
+			return MQTT_NOTHING_TO_READ;
+		}
 	}
 
-#ifdef _ENABLE_THREAD_SUPPORT_
-	rc = aws_iot_mqtt_client_unlock_mutex(pClient, &(pClient->clientData.tls_write_mutex));
-	if(SUCCESS != rc) {
-		FUNC_EXIT_RC(rc);
+	return SUCCESS;
+}
+
+/**
+ * @brief Grow the read buffer so that it can hold a packet of the given length
+ *
+ * The size is doubled until the packet fits, without going over maxReadBufSize.
+ * Caller supplied buffers never grow.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param packetLen Total length of the packet to receive
+ *
+ * @return true if the packet fits in the read buffer
+ */
+static bool _aws_iot_mqtt_internal_grow_read_buf(AWS_IoT_Client *pClient, size_t packetLen) {
+	size_t newSize;
+	unsigned char *pNewBuf;
+
+	if(packetLen <= pClient->clientData.readBufSize) {
+		return true;
 	}
-#endif
 
-	if(sent == length) {
-		/* record the fact that we have successfully sent the packet */
-		//countdown_sec(&c->pingTimer, c->clientData.keepAliveInterval);
-		FUNC_EXIT_RC(SUCCESS);
+	if(!pClient->clientData.isReadBufOwned || packetLen > pClient->clientData.maxReadBufSize) {
+		return false;
+	}
+
+	newSize = pClient->clientData.readBufSize;
+	while(newSize < packetLen) {
+		newSize *= 2;
+	}
+	if(newSize > pClient->clientData.maxReadBufSize) {
+		newSize = pClient->clientData.maxReadBufSize;
+	}
+
+	pNewBuf = (unsigned char *) aws_iot_mqtt_internal_realloc(pClient, pClient->clientData.readBuf, newSize);
+	if(NULL == pNewBuf) {
+		IOT_WARN("Could not grow the read buffer to %u bytes", (unsigned int) newSize);
+		return false;
 	}
 
-	FUNC_EXIT_RC(FAILURE);
+	pClient->clientData.readBuf = pNewBuf;
+	pClient->clientData.readBufSize = newSize;
+
+	return true;
 }
 
-static IoT_Error_t _aws_iot_mqtt_internal_decode_packet_remaining_len(AWS_IoT_Client *pClient,
-																	  size_t *rem_len, Timer *pTimer) {
+static IoT_Error_t _aws_iot_mqtt_internal_decode_packet_remaining_len(AWS_IoT_Client *pClient, size_t *rem_len,
+																	  size_t *header_len, Timer *pTimer) {
 	unsigned char encodedByte;
 	size_t multiplier, len;
 	IoT_Error_t rc;
@@ -324,136 +734,179 @@ static IoT_Error_t _aws_iot_mqtt_internal_decode_packet_remaining_len(AWS_IoT_Cl
 	FUNC_ENTRY;
 
 	multiplier = 1;
-	len = 0;
+	len = 1; /* skip the header byte */
 	*rem_len = 0;
 
 	do {
-		if(++len > MAX_NO_OF_REMAINING_LENGTH_BYTES) {
+		if(len > MAX_NO_OF_REMAINING_LENGTH_BYTES) {
 			/* bad data */
+			pClient->clientData.readBufValidLen = 0;
 			FUNC_EXIT_RC(MQTT_DECODE_REMAINING_LENGTH_ERROR);
 		}
 
-		rc = pClient->networkStack.read(&(pClient->networkStack), &encodedByte, 1, pTimer, &len);
+		rc = _aws_iot_mqtt_internal_fill_read_buf(pClient, len + 1, pTimer);
 		if(SUCCESS != rc) {
 			FUNC_EXIT_RC(rc);
 		}
 
+		encodedByte = pClient->clientData.readBuf[len++];
 		*rem_len += ((encodedByte & 127) * multiplier);
 		multiplier *= 128;
 	} while((encodedByte & 128) != 0);
 
+	*header_len = len;
+
 	FUNC_EXIT_RC(rc);
 }
 
-static IoT_Error_t _aws_iot_mqtt_internal_read_packet(AWS_IoT_Client *pClient, Timer *pTimer, uint8_t *pPacketType) {
-	size_t len, rem_len, total_bytes_read, bytes_to_be_read, read_len;
+/**
+ * @brief Start streaming a PUBLISH that does not fit the read buffer
+ *
+ * Reads the variable header behind the fixed header so that the topic name and packet id
+ * stay at the front of the read buffer, the payload is then read behind them chunk by chunk.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param header_len Length of the fixed header
+ * @param rem_len Remaining length of the packet
+ * @param pTimer Timer for the read operation
+ *
+ * @return SUCCESS once the stream is set up, MQTT_RX_BUFFER_TOO_SHORT_ERROR if even the variable header does not fit
+ */
+static IoT_Error_t _aws_iot_mqtt_internal_start_stream(AWS_IoT_Client *pClient, size_t header_len, size_t rem_len,
+													   Timer *pTimer) {
+	MessageStream *pStream = &(pClient->clientData.stream);
+	unsigned char *pVarHeader;
+	size_t varHeaderLen;
+	uint16_t topicNameLen;
 	IoT_Error_t rc;
 	MQTTHeader header = {0};
 
-	len = 0;
-	rem_len = 0;
-	total_bytes_read = 0;
-	bytes_to_be_read = 0;
-	read_len = 0;
+	FUNC_ENTRY;
 
-	rc = pClient->networkStack.read(&(pClient->networkStack), pClient->clientData.readBuf, 1, pTimer, &read_len);
-	/* 1. read the header byte.  This has the packet type in it */
-	if(NETWORK_SSL_NOTHING_TO_READ == rc) {
-		return MQTT_NOTHING_TO_READ;
+	rc = _aws_iot_mqtt_internal_fill_read_buf(pClient, header_len + 2, pTimer);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
 	}
 
-	len = 1;
+	header.byte = pClient->clientData.readBuf[0];
+	pVarHeader = pClient->clientData.readBuf + header_len;
+	topicNameLen = aws_iot_mqtt_internal_read_uint16_t(&pVarHeader);
+	varHeaderLen = 2 + (size_t) topicNameLen + ((QOS0 != header.bits.qos) ? 2 : 0);
 
-	/* 2. read the remaining length.  This is variable in itself */
-	rc = _aws_iot_mqtt_internal_decode_packet_remaining_len(pClient, &rem_len, pTimer);
-	if(SUCCESS != rc) {
-		return rc;
+	/* At least one payload byte has to fit behind the header */
+	if(varHeaderLen > rem_len || header_len + varHeaderLen >= pClient->clientData.readBufSize) {
+		FUNC_EXIT_RC(MQTT_RX_BUFFER_TOO_SHORT_ERROR);
 	}
 
-	/* if the buffer is too short then the message will be dropped silently */
-	if(rem_len >= pClient->clientData.readBufSize) {
-		bytes_to_be_read = pClient->clientData.readBufSize;
-		do {
-			rc = pClient->networkStack.read(&(pClient->networkStack), pClient->clientData.readBuf, bytes_to_be_read,
-											pTimer, &read_len);
-			if(SUCCESS == rc) {
-				total_bytes_read += read_len;
-				if((rem_len - total_bytes_read) >= pClient->clientData.readBufSize) {
-					bytes_to_be_read = pClient->clientData.readBufSize;
-				} else {
-					bytes_to_be_read = rem_len - total_bytes_read;
-				}
-			}
-		} while(total_bytes_read < rem_len && SUCCESS == rc);
-		return MQTT_RX_BUFFER_TOO_SHORT_ERROR;
+	rc = _aws_iot_mqtt_internal_fill_read_buf(pClient, header_len + varHeaderLen, pTimer);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
 	}
 
-	/* put the original remaining length into the read buffer */
-	len += aws_iot_mqtt_internal_write_len_to_buffer(pClient->clientData.readBuf + 1, (uint32_t) rem_len);
+	pStream->pTopicName = (char *) pVarHeader;
+	pStream->topicNameLen = topicNameLen;
+	pVarHeader += topicNameLen;
 
-	/* 3. read the rest of the buffer using a callback to supply the rest of the data */
-	if(rem_len > 0) {
-		rc = pClient->networkStack.read(&(pClient->networkStack), pClient->clientData.readBuf + len, rem_len, pTimer,
-										&read_len);
-		if(SUCCESS != rc || read_len != rem_len) {
-			return FAILURE;
-		}
-	}
+	pStream->params.qos = (QoS) header.bits.qos;
+	pStream->params.isDup = header.bits.dup;
+	pStream->params.isRetained = header.bits.retain;
+	pStream->params.id = (QOS0 != pStream->params.qos) ? aws_iot_mqtt_internal_read_uint16_t(&pVarHeader) : 0;
+	pStream->params.payload = NULL;
+	pStream->params.payloadLen = 0;
 
-	header.byte = pClient->clientData.readBuf[0];
-	*pPacketType = header.bits.type;
+	pStream->headerLen = header_len + varHeaderLen;
+	pStream->payloadTotalLen = rem_len - varHeaderLen;
+	pStream->payloadOffset = 0;
+	pStream->isInProgress = true;
+	pStream->isBeingRead = true;
+	pStream->isDiscarding = false;
 
-	FUNC_EXIT_RC(rc);
+	FUNC_EXIT_RC(SUCCESS);
 }
 
-// assume topic filter and name is in correct format
-// # can only be at end
-// + and # can only be next to separator
-static char _aws_iot_mqtt_internal_is_topic_matched(char *pTopicFilter, char *pTopicName, uint16_t topicNameLen) {
+static IoT_Error_t _aws_iot_mqtt_internal_read_packet(AWS_IoT_Client *pClient, Timer *pTimer, uint8_t *pPacketType) {
+	size_t rem_len, header_len, packet_len, bytes_to_be_read, read_len;
+	IoT_Error_t rc;
+	MQTTHeader header = {0};
 
-	char *curf, *curn, *curn_end;
+	rem_len = 0;
+	header_len = 0;
 
-	if(NULL == pTopicFilter || NULL == pTopicName) {
-		return NULL_VALUE_ERROR;
+	/* 0. a message being streamed is finished before the next packet is read */
+	if(pClient->clientData.stream.isInProgress) {
+		if(pClient->clientData.stream.isBeingRead) {
+			return MQTT_NOTHING_TO_READ;
+		}
+		pClient->clientData.stream.isBeingRead = true;
+		*pPacketType = PUBLISH;
+		return SUCCESS;
 	}
 
-	curf = pTopicFilter;
-	curn = pTopicName;
-	curn_end = curn + topicNameLen;
+	/* 1. drop the previous packet, it is no longer referenced */
+	_aws_iot_mqtt_internal_consume_read_buf(pClient);
 
-	while(*curf && (curn < curn_end)) {
-		if(*curn == '/' && *curf != '/') {
-			break;
-		}
-		if(*curf != '+' && *curf != '#' && *curf != *curn) {
-			break;
+	/* 2. read the header byte and the remaining length.  This is variable in itself */
+	rc = _aws_iot_mqtt_internal_decode_packet_remaining_len(pClient, &rem_len, &header_len, pTimer);
+	if(SUCCESS != rc) {
+		return rc;
+	}
+
+	packet_len = header_len + rem_len;
+
+	/* if the buffer is too short and cannot grow then the message is streamed to the
+	 * streaming subscriptions if there are any, otherwise it will be dropped silently */
+	if(!_aws_iot_mqtt_internal_grow_read_buf(pClient, packet_len)) {
+		header.byte = pClient->clientData.readBuf[0];
+		if(PUBLISH == header.bits.type && 0 < pClient->clientData.subscriptions.streamingCount) {
+			rc = _aws_iot_mqtt_internal_start_stream(pClient, header_len, rem_len, pTimer);
+			if(SUCCESS == rc) {
+				*pPacketType = PUBLISH;
+				return SUCCESS;
+			}
+			if(MQTT_RX_BUFFER_TOO_SHORT_ERROR != rc) {
+				return rc;
+			}
 		}
-		if(*curf == '+') {
-			/* skip until we meet the next separator, or end of string */
-			char *nextpos = curn + 1;
-			while(nextpos < curn_end && *nextpos != '/')
-				nextpos = ++curn + 1;
-		} else if(*curf == '#') {
-			/* skip until end of string */
-			curn = curn_end - 1;
+
+		packet_len -= pClient->clientData.readBufValidLen;
+		pClient->clientData.readBufValidLen = 0;
+		rc = SUCCESS;
+		timer_release_now();
+		while(0 < packet_len && SUCCESS == rc) {
+			bytes_to_be_read = (packet_len < pClient->clientData.readBufSize) ? packet_len
+																			  : pClient->clientData.readBufSize;
+			read_len = 0;
+			rc = pClient->networkStack.read(&(pClient->networkStack), pClient->clientData.readBuf, bytes_to_be_read,
+											pTimer, &read_len);
+			packet_len -= read_len;
 		}
+		return MQTT_RX_BUFFER_TOO_SHORT_ERROR;
+	}
 
-		curf++;
-		curn++;
-	};
+	/* 3. make sure the rest of the packet is in the buffer */
+	rc = _aws_iot_mqtt_internal_fill_read_buf(pClient, packet_len, pTimer);
+	if(SUCCESS != rc) {
+		return rc;
+	}
+	pClient->clientData.readBufPacketLen = packet_len;
+
+	header.byte = pClient->clientData.readBuf[0];
+	*pPacketType = header.bits.type;
 
-	return (curn == curn_end) && (*curf == '\0');
+	FUNC_EXIT_RC(rc);
 }
 
 static IoT_Error_t _aws_iot_mqtt_internal_deliver_message(AWS_IoT_Client *pClient, char *pTopicName,
 														  uint16_t topicNameLen,
-														  IoT_Publish_Message_Params *pMessageParams) {
-	uint32_t itr;
+														  IoT_Publish_Message_Params *pMessageParams,
+														  bool *pIsAckDeferred) {
 	IoT_Error_t rc;
 	ClientState clientState;
 
 	FUNC_ENTRY;
 
+	*pIsAckDeferred = false;
+
 	if(NULL == pTopicName) {
 		FUNC_EXIT_RC(NULL_VALUE_ERROR);
 	}
@@ -464,23 +917,214 @@ static IoT_Error_t _aws_iot_mqtt_internal_deliver_message(AWS_IoT_Client *pClien
 	clientState = aws_iot_mqtt_get_client_state(pClient);
 	rc = aws_iot_mqtt_set_client_state(pClient, clientState, CLIENT_STATE_CONNECTED_WAIT_FOR_CB_RETURN);
 
-	/* Find the right message handler - indexed by topic */
-	for(itr = 0; itr < AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS; ++itr) {
-		if(NULL != pClient->clientData.messageHandlers[itr].topicName) {
-			if(((topicNameLen == pClient->clientData.messageHandlers[itr].topicNameLen)
-				&&
-				(strncmp(pTopicName, (char *) pClient->clientData.messageHandlers[itr].topicName, topicNameLen) == 0))
-			   || _aws_iot_mqtt_internal_is_topic_matched((char *) pClient->clientData.messageHandlers[itr].topicName,
-														  pTopicName, topicNameLen)) {
-				if(NULL != pClient->clientData.messageHandlers[itr].pApplicationHandler) {
-					pClient->clientData.messageHandlers[itr].pApplicationHandler(pClient, pTopicName, topicNameLen,
-																				 pMessageParams,
-																				 pClient->clientData.messageHandlers[itr].pApplicationHandlerData);
+	/* Find the right message handlers - indexed by topic */
+#ifdef _ENABLE_THREAD_SUPPORT_
+	/* With a dispatch pool the handlers run on its workers with a copy of the message,
+	 * and the pool sends the PUBACK once they have all returned */
+	if(NULL != pClient->clientData.pDispatchPool
+	   && SUCCESS == aws_iot_mqtt_internal_dispatch_to_pool(pClient, pTopicName, topicNameLen, pMessageParams)) {
+		*pIsAckDeferred = true;
+	} else {
+		aws_iot_mqtt_internal_dispatch_message(pClient, pTopicName, topicNameLen, pMessageParams);
+	}
+#else
+	aws_iot_mqtt_internal_dispatch_message(pClient, pTopicName, topicNameLen, pMessageParams);
+#endif
+
+	rc = aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_CONNECTED_WAIT_FOR_CB_RETURN, clientState);
+
+	FUNC_EXIT_RC(rc);
+}
+
+static IoT_Error_t _aws_iot_mqtt_internal_send_puback(AWS_IoT_Client *pClient, uint16_t packetId, Timer *pTimer) {
+	uint32_t len;
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	len = 0;
+	rc = aws_iot_mqtt_internal_serialize_ack(pClient->clientData.writeBuf, pClient->clientData.writeBufSize,
+											 PUBACK, 0, packetId, &len);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+
+	rc = aws_iot_mqtt_internal_send_packet(pClient, len, pTimer);
+
+	FUNC_EXIT_RC(rc);
+}
+
+/* Clears the stream, the read buffer no longer holds any part of it */
+static void _aws_iot_mqtt_internal_reset_stream(AWS_IoT_Client *pClient) {
+	pClient->clientData.stream.isInProgress = false;
+	pClient->clientData.stream.isBeingRead = false;
+	pClient->clientData.stream.isDiscarding = false;
+	pClient->clientData.readBufValidLen = 0;
+	pClient->clientData.readBufPacketLen = 0;
+}
+
+void aws_iot_mqtt_internal_abort_stream(AWS_IoT_Client *pClient, IoT_Error_t status) {
+	MessageStream *pStream = &(pClient->clientData.stream);
+
+	if(!pStream->isInProgress) {
+		return;
+	}
+
+	if(!pStream->isDiscarding) {
+		pStream->params.payload = NULL;
+		pStream->params.payloadLen = pStream->payloadOffset;
+		aws_iot_mqtt_internal_dispatch_stream(pClient, pStream, true, status);
+	}
+
+	_aws_iot_mqtt_internal_reset_stream(pClient);
+}
+
+/* Tells the handlers the message failed and drops the rest of its payload as it is read,
+ * so that the packet behind it is still framed correctly */
+static void _aws_iot_mqtt_internal_discard_stream(AWS_IoT_Client *pClient, IoT_Error_t status) {
+	MessageStream *pStream = &(pClient->clientData.stream);
+
+	if(pStream->isDiscarding) {
+		return;
+	}
+
+	pStream->params.payload = NULL;
+	pStream->params.payloadLen = pStream->payloadOffset;
+	aws_iot_mqtt_internal_dispatch_stream(pClient, pStream, true, status);
+	pStream->isDiscarding = true;
+}
+
+static IoT_Error_t _aws_iot_mqtt_internal_deliver_stream(AWS_IoT_Client *pClient, bool isComplete) {
+	IoT_Error_t rc;
+	ClientState clientState;
+
+	FUNC_ENTRY;
+
+	/* Same as for whole messages, yield cannot be called from the callbacks */
+	clientState = aws_iot_mqtt_get_client_state(pClient);
+	rc = aws_iot_mqtt_set_client_state(pClient, clientState, CLIENT_STATE_CONNECTED_WAIT_FOR_CB_RETURN);
+
+	aws_iot_mqtt_internal_dispatch_stream(pClient, &(pClient->clientData.stream), isComplete, SUCCESS);
+
+	rc = aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_CONNECTED_WAIT_FOR_CB_RETURN, clientState);
+
+	FUNC_EXIT_RC(rc);
+}
+
+/**
+ * @brief Hand the payload of a streamed PUBLISH to the streaming subscriptions
+ *
+ * Payload bytes are read into the read buffer behind the message header and passed on
+ * in place, so memory use does not depend on the message size. If the timer expires
+ * first, the next cycle read continues where this one stopped.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pTimer Timer for the read operation
+ *
+ * @return SUCCESS unless the network failed while the message was received
+ */
+static IoT_Error_t _aws_iot_mqtt_internal_handle_stream(AWS_IoT_Client *pClient, Timer *pTimer) {
+	MessageStream *pStream = &(pClient->clientData.stream);
+	size_t chunkLen, read_len;
+	IoT_Error_t rc, readRc, deliverRc;
+	Timer ackTimer;
+
+	FUNC_ENTRY;
+
+	readRc = SUCCESS;
+	deliverRc = SUCCESS;
+	for(;;) {
+		/* Bytes received behind the header are the next chunk */
+		chunkLen = pClient->clientData.readBufValidLen - pStream->headerLen;
+		if(pStream->payloadTotalLen - pStream->payloadOffset < chunkLen) {
+			chunkLen = pStream->payloadTotalLen - pStream->payloadOffset;
+		}
+		if(0 < chunkLen) {
+			if(!pStream->isDiscarding) {
+				pStream->params.payload = pClient->clientData.readBuf + pStream->headerLen;
+				pStream->params.payloadLen = chunkLen;
+				rc = _aws_iot_mqtt_internal_deliver_stream(pClient, false);
+				if(SUCCESS != rc) {
+					_aws_iot_mqtt_internal_discard_stream(pClient, rc);
+					deliverRc = rc;
 				}
 			}
+			pStream->payloadOffset += chunkLen;
+			pClient->clientData.readBufValidLen = pStream->headerLen;
+		}
+
+		if(pStream->payloadOffset == pStream->payloadTotalLen) {
+			break;
+		}
+
+		if(SUCCESS != readRc && NETWORK_SSL_NOTHING_TO_READ != readRc && NETWORK_SSL_READ_TIMEOUT_ERROR != readRc) {
+			/* The rest of the payload is dropped by the next reads, a reconnect ends the stream */
+			_aws_iot_mqtt_internal_discard_stream(pClient, readRc);
+			pStream->isBeingRead = false;
+			FUNC_EXIT_RC(readRc);
+		}
+
+		if(has_timer_expired(pTimer)) {
+			/* Continued by the next cycle read */
+			pStream->isBeingRead = false;
+			FUNC_EXIT_RC(deliverRc);
+		}
+
+		/* Never read past the end of the message, the next packet may follow it */
+		chunkLen = pStream->payloadTotalLen - pStream->payloadOffset;
+		if(pClient->clientData.readBufSize - pStream->headerLen < chunkLen) {
+			chunkLen = pClient->clientData.readBufSize - pStream->headerLen;
+		}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+		rc = aws_iot_mqtt_client_lock_mutex(pClient, &(pClient->clientData.tls_read_mutex));
+		if(SUCCESS != rc) {
+			pStream->isBeingRead = false;
+			FUNC_EXIT_RC(rc);
 		}
+#endif
+		timer_release_now();
+		read_len = 0;
+		if(NULL != pClient->networkStack.readAvailable) {
+			readRc = pClient->networkStack.readAvailable(&(pClient->networkStack),
+														 pClient->clientData.readBuf + pStream->headerLen, chunkLen,
+														 pTimer, &read_len);
+		} else {
+			readRc = pClient->networkStack.read(&(pClient->networkStack),
+												pClient->clientData.readBuf + pStream->headerLen, chunkLen, pTimer,
+												&read_len);
+		}
+		pClient->clientData.readBufValidLen += read_len;
+#ifdef _ENABLE_THREAD_SUPPORT_
+		rc = aws_iot_mqtt_client_unlock_mutex(pClient, &(pClient->clientData.tls_read_mutex));
+		if(SUCCESS != rc) {
+			FUNC_EXIT_RC(rc);
+		}
+#endif
+	}
+
+	/* A discarded message was not handled, so it is not acknowledged */
+	if(pStream->isDiscarding) {
+		_aws_iot_mqtt_internal_reset_stream(pClient);
+		FUNC_EXIT_RC(deliverRc);
+	}
+
+	pStream->params.payload = NULL;
+	pStream->params.payloadLen = pStream->payloadTotalLen;
+	rc = _aws_iot_mqtt_internal_deliver_stream(pClient, true);
+	_aws_iot_mqtt_internal_reset_stream(pClient);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+
+	if(QOS0 == pStream->params.qos) {
+		FUNC_EXIT_RC(SUCCESS);
 	}
-	rc = aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_CONNECTED_WAIT_FOR_CB_RETURN, clientState);
+
+	/* The read timer may have run out while the payload arrived */
+	init_timer(&ackTimer);
+	countdown_ms(&ackTimer, pClient->clientData.commandTimeoutMs);
+	rc = _aws_iot_mqtt_internal_send_puback(pClient, pStream->params.id, &ackTimer);
 
 	FUNC_EXIT_RC(rc);
 }
@@ -488,15 +1132,14 @@ static IoT_Error_t _aws_iot_mqtt_internal_deliver_message(AWS_IoT_Client *pClien
 static IoT_Error_t _aws_iot_mqtt_internal_handle_publish(AWS_IoT_Client *pClient, Timer *pTimer) {
 	char *topicName;
 	uint16_t topicNameLen;
-	uint32_t len;
 	IoT_Error_t rc;
 	IoT_Publish_Message_Params msg;
+	bool isAckDeferred;
 
 	FUNC_ENTRY;
 
 	topicName = NULL;
 	topicNameLen = 0;
-	len = 0;
 
 	rc = aws_iot_mqtt_internal_deserialize_publish(&msg.isDup, &msg.qos, &msg.isRetained,
 												   &msg.id, &topicName, &topicNameLen,
@@ -508,34 +1151,46 @@ static IoT_Error_t _aws_iot_mqtt_internal_handle_publish(AWS_IoT_Client *pClient
 		FUNC_EXIT_RC(rc);
 	}
 
-	rc = _aws_iot_mqtt_internal_deliver_message(pClient, topicName, topicNameLen, &msg);
+	rc = _aws_iot_mqtt_internal_deliver_message(pClient, topicName, topicNameLen, &msg, &isAckDeferred);
 	if(SUCCESS != rc) {
 		FUNC_EXIT_RC(rc);
 	}
 
-	if(QOS0 == msg.qos) {
-		/* No further processing required for QoS0 */
+	if(QOS0 == msg.qos || isAckDeferred) {
+		/* No further processing required for QoS0, the dispatch pool acknowledges its own messages */
 		FUNC_EXIT_RC(SUCCESS);
 	}
 
 	/* Message assumed to be QoS1 since we do not support QoS2 at this time */
-	rc = aws_iot_mqtt_internal_serialize_ack(pClient->clientData.writeBuf, pClient->clientData.writeBufSize,
-											 PUBACK, 0, msg.id, &len);
-
+	rc = _aws_iot_mqtt_internal_send_puback(pClient, msg.id, pTimer);
 	if(SUCCESS != rc) {
 		FUNC_EXIT_RC(rc);
 	}
 
-	rc = aws_iot_mqtt_internal_send_packet(pClient, len, pTimer);
-	if(SUCCESS != rc) {
-		FUNC_EXIT_RC(rc);
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+/**
+ * @brief Check if the client holds received data that has not been processed
+ *
+ * Bytes read ahead into the read buffer and the rest of a streamed message do not make
+ * the socket readable again, so they have to be processed without waiting on it.
+ *
+ * @param pClient Reference to the IoT Client
+ *
+ * @return true if the next cycle read has data to process without reading the network
+ */
+bool aws_iot_mqtt_internal_is_read_pending(AWS_IoT_Client *pClient) {
+	if(pClient->clientData.stream.isInProgress) {
+		return !pClient->clientData.stream.isBeingRead;
 	}
 
-	FUNC_EXIT_RC(SUCCESS);
+	return pClient->clientData.readBufValidLen > pClient->clientData.readBufPacketLen;
 }
 
 IoT_Error_t aws_iot_mqtt_internal_cycle_read(AWS_IoT_Client *pClient, Timer *pTimer, uint8_t *pPacketType) {
 	IoT_Error_t rc;
+	bool isPubackConsumed = false;
 
 #ifdef _ENABLE_THREAD_SUPPORT_
 	IoT_Error_t threadRc;
@@ -570,13 +1225,24 @@ IoT_Error_t aws_iot_mqtt_internal_cycle_read(AWS_IoT_Client *pClient, Timer *pTi
 	}
 
 	switch(*pPacketType) {
+		case PUBACK: {
+			/* PUBACKs for asynchronous publishes are completed here, the rest are forwarded */
+			rc = aws_iot_mqtt_internal_handle_inflight_puback(pClient, &isPubackConsumed);
+			if(isPubackConsumed) {
+				*pPacketType = 0;
+			}
+			break;
+		}
 		case CONNACK:
-		case PUBACK:
 		case SUBACK:
 		case UNSUBACK:
 			/* SDK is blocking, these responses will be forwarded to calling function to process */
 			break;
 		case PUBLISH: {
+			if(pClient->clientData.stream.isInProgress) {
+				rc = _aws_iot_mqtt_internal_handle_stream(pClient, pTimer);
+				break;
+			}
 			rc = _aws_iot_mqtt_internal_handle_publish(pClient, pTimer);
 			break;
 		}
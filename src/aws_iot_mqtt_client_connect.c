@@ -371,10 +371,12 @@ static bool _aws_iot_mqtt_is_client_state_valid_for_connect(ClientState clientSt
  *
  * @param pClient Reference to the IoT Client
  * @param pConnectParams Pointer to MQTT connection parameters
+ * @param isNetworkConnected The network connection was made already, without blocking
  *
  * @return An IoT Error Type defining successful/failed connection
  */
-static IoT_Error_t _aws_iot_mqtt_internal_connect(AWS_IoT_Client *pClient, IoT_Client_Connect_Params *pConnectParams) {
+static IoT_Error_t _aws_iot_mqtt_internal_connect(AWS_IoT_Client *pClient, IoT_Client_Connect_Params *pConnectParams,
+												  bool isNetworkConnected) {
 	Timer connect_timer;
 	IoT_Error_t connack_rc = FAILURE;
 	char sessionPresent = 0;
@@ -391,10 +393,26 @@ static IoT_Error_t _aws_iot_mqtt_internal_connect(AWS_IoT_Client *pClient, IoT_C
 		}
 	}
 
-	rc = pClient->networkStack.connect(&(pClient->networkStack), NULL);
-	if(SUCCESS != rc) {
-		/* TLS Connect failed, return error */
-		FUNC_EXIT_RC(rc);
+	/* Bytes left over from a previous connection are discarded, along with a message
+	 * that was being streamed when it dropped */
+	aws_iot_mqtt_internal_abort_stream(pClient, NETWORK_DISCONNECTED_ERROR);
+	pClient->clientData.readBufValidLen = 0;
+	pClient->clientData.readBufPacketLen = 0;
+
+	/* Packed publishes the previous connection did not send must not go out ahead of the CONNECT,
+	 * they are held back until the broker accepts the connection */
+	pClient->clientData.coalesceHeldLen += pClient->clientData.coalesceLen;
+	pClient->clientData.coalesceLen = 0;
+
+	timer_release_now();
+	if(!isNetworkConnected) {
+		/* Replaces a network connect the client manager left in progress */
+		pClient->clientStatus.isNetworkConnecting = false;
+		rc = pClient->networkStack.connect(&(pClient->networkStack), NULL);
+		if(SUCCESS != rc) {
+			/* TLS Connect failed, return error */
+			FUNC_EXIT_RC(rc);
+		}
 	}
 
 	init_timer(&connect_timer);
@@ -433,22 +451,32 @@ static IoT_Error_t _aws_iot_mqtt_internal_connect(AWS_IoT_Client *pClient, IoT_C
 	pClient->clientStatus.isPingOutstanding = false;
 	countdown_sec(&pClient->pingTimer, pClient->clientData.keepAliveInterval / (uint32_t) 2);
 
+	if(0 < pClient->clientData.coalesceHeldLen) {
+		pClient->clientData.coalesceLen = pClient->clientData.coalesceHeldLen;
+		pClient->clientData.coalesceHeldLen = 0;
+		rc = aws_iot_mqtt_internal_flush_coalesced(pClient, &connect_timer, true);
+		if(SUCCESS != rc) {
+			FUNC_EXIT_RC(rc);
+		}
+	}
+
 	FUNC_EXIT_RC(SUCCESS);
 }
 
 /**
  * @brief MQTT Connection Function
  *
- * Called to establish an MQTT connection with the AWS IoT Service
- * This is the outer function which does the validations and calls the internal connect above
- * to perform the actual operation. It is also responsible for client state changes
+ * Does the validations and client state changes of a connect, shared by the connect API
+ * and the reconnect of the client manager, which connects the network without blocking.
  *
  * @param pClient Reference to the IoT Client
  * @param pConnectParams Pointer to MQTT connection parameters
+ * @param isNetworkConnected The network connection was made already
  *
  * @return An IoT Error Type defining successful/failed connection
  */
-IoT_Error_t aws_iot_mqtt_connect(AWS_IoT_Client *pClient, IoT_Client_Connect_Params *pConnectParams) {
+static IoT_Error_t _aws_iot_mqtt_connect(AWS_IoT_Client *pClient, IoT_Client_Connect_Params *pConnectParams,
+										 bool isNetworkConnected) {
 	IoT_Error_t rc, disconRc;
 	ClientState clientState;
 
@@ -468,11 +496,10 @@ IoT_Error_t aws_iot_mqtt_connect(AWS_IoT_Client *pClient, IoT_Client_Connect_Par
 
 	aws_iot_mqtt_set_client_state(pClient, clientState, CLIENT_STATE_CONNECTING);
 
-	rc = _aws_iot_mqtt_internal_connect(pClient, pConnectParams);
+	rc = _aws_iot_mqtt_internal_connect(pClient, pConnectParams, isNetworkConnected);
 
 	if(SUCCESS != rc) {
-		pClient->networkStack.disconnect(&(pClient->networkStack));
-		disconRc = pClient->networkStack.destroy(&(pClient->networkStack));
+		disconRc = aws_iot_mqtt_internal_close_network(pClient);
 		aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_CONNECTING, CLIENT_STATE_DISCONNECTED_ERROR);
 	} else {
 		aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_CONNECTING, CLIENT_STATE_CONNECTED_IDLE);
@@ -481,6 +508,28 @@ IoT_Error_t aws_iot_mqtt_connect(AWS_IoT_Client *pClient, IoT_Client_Connect_Par
 	FUNC_EXIT_RC(rc);
 }
 
+/**
+ * @brief MQTT Connection Function
+ *
+ * Called to establish an MQTT connection with the AWS IoT Service
+ * This is the outer function which does the validations and calls the internal connect above
+ * to perform the actual operation. It is also responsible for client state changes
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pConnectParams Pointer to MQTT connection parameters
+ *
+ * @return An IoT Error Type defining successful/failed connection
+ */
+IoT_Error_t aws_iot_mqtt_connect(AWS_IoT_Client *pClient, IoT_Client_Connect_Params *pConnectParams) {
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	rc = _aws_iot_mqtt_connect(pClient, pConnectParams, false);
+
+	FUNC_EXIT_RC(rc);
+}
+
 /**
  * @brief Disconnect an MQTT Connection
  *
@@ -519,8 +568,7 @@ IoT_Error_t _aws_iot_mqtt_internal_disconnect(AWS_IoT_Client *pClient) {
 	}
 
 	/* Clean network stack */
-	pClient->networkStack.disconnect(&(pClient->networkStack));
-	rc = pClient->networkStack.destroy(&(pClient->networkStack));
+	rc = aws_iot_mqtt_internal_close_network(pClient);
 	if(0 != rc) {
 		/* TLS Destroy failed, return error */
 		FUNC_EXIT_RC(FAILURE);
@@ -532,15 +580,15 @@ IoT_Error_t _aws_iot_mqtt_internal_disconnect(AWS_IoT_Client *pClient) {
 /**
  * @brief Disconnect an MQTT Connection
  *
- * Called to send a disconnect message to the broker.
- * This is the outer function which does the validations and calls the internal disconnect above
- * to perform the actual operation. It is also responsible for client state changes
+ * Sends the disconnect message to the broker and closes the network connection.
+ * Validates and changes the client state, shared by the disconnect API and the
+ * disconnect on a lost connection
  *
  * @param pClient Reference to the IoT Client
  *
  * @return An IoT Error Type defining successful/failed send of the disconnect control packet.
  */
-IoT_Error_t aws_iot_mqtt_disconnect(AWS_IoT_Client *pClient) {
+static IoT_Error_t _aws_iot_mqtt_disconnect(AWS_IoT_Client *pClient) {
 	ClientState clientState;
 	IoT_Error_t rc;
 
@@ -574,19 +622,57 @@ IoT_Error_t aws_iot_mqtt_disconnect(AWS_IoT_Client *pClient) {
 }
 
 /**
- * @brief MQTT Manual Re-Connection Function
+ * @brief Disconnect an MQTT Connection after the connection was lost
  *
- * Called to establish an MQTT connection with the AWS IoT Service
- * using parameters from the last time a connection was attempted
- * Use after disconnect to start the reconnect process manually
- * Makes only one reconnect attempt. Sets the client state to
- * pending reconnect in case of failure
+ * Called from yield when the broker stopped answering. Publishes waiting for a PUBACK
+ * stay in the in-flight window, to be sent again once the client reconnects.
+ *
+ * @param pClient Reference to the IoT Client
+ *
+ * @return An IoT Error Type defining successful/failed send of the disconnect control packet.
+ */
+IoT_Error_t aws_iot_mqtt_internal_disconnect_keep_inflight(AWS_IoT_Client *pClient) {
+	return _aws_iot_mqtt_disconnect(pClient);
+}
+
+/**
+ * @brief Disconnect an MQTT Connection
+ *
+ * Called to send a disconnect message to the broker.
+ * This is the outer function which does the validations and calls the internal disconnect above
+ * to perform the actual operation. It is also responsible for client state changes.
+ * Publishes waiting for a PUBACK are completed with NETWORK_DISCONNECTED_ERROR, also
+ * when the connection was already lost
  *
  * @param pClient Reference to the IoT Client
  *
+ * @return An IoT Error Type defining successful/failed send of the disconnect control packet.
+ */
+IoT_Error_t aws_iot_mqtt_disconnect(AWS_IoT_Client *pClient) {
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	rc = _aws_iot_mqtt_disconnect(pClient);
+	if(NULL != pClient && !aws_iot_mqtt_is_client_connected(pClient)) {
+		aws_iot_mqtt_internal_abort_inflight_publishes(pClient, NETWORK_DISCONNECTED_ERROR);
+	}
+
+	FUNC_EXIT_RC(rc);
+}
+
+/**
+ * @brief Make one reconnect attempt
+ *
+ * Shared by the reconnect API and the reconnect of the client manager, which connects the
+ * network without blocking first.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param isNetworkConnected The network connection was made already
+ *
  * @return An IoT Error Type defining successful/failed connection
  */
-IoT_Error_t aws_iot_mqtt_attempt_reconnect(AWS_IoT_Client *pClient) {
+static IoT_Error_t _aws_iot_mqtt_attempt_reconnect(AWS_IoT_Client *pClient, bool isNetworkConnected) {
 	IoT_Error_t rc;
 
 	FUNC_ENTRY;
@@ -600,7 +686,7 @@ IoT_Error_t aws_iot_mqtt_attempt_reconnect(AWS_IoT_Client *pClient) {
 	}
 
 	/* Ignoring return code. failures expected if network is disconnected */
-	rc = aws_iot_mqtt_connect(pClient, NULL);
+	rc = _aws_iot_mqtt_connect(pClient, NULL, isNetworkConnected);
 
 	/* If still disconnected handle disconnect */
 	if(CLIENT_STATE_CONNECTED_IDLE != aws_iot_mqtt_get_client_state(pClient)) {
@@ -613,9 +699,59 @@ IoT_Error_t aws_iot_mqtt_attempt_reconnect(AWS_IoT_Client *pClient) {
 		FUNC_EXIT_RC(rc);
 	}
 
+	/* Publishes still waiting for a PUBACK are sent again with the DUP flag set */
+	rc = aws_iot_mqtt_internal_resend_inflight_publishes(pClient, true);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+
 	FUNC_EXIT_RC(NETWORK_RECONNECTED);
 }
 
+/**
+ * @brief MQTT Manual Re-Connection Function
+ *
+ * Called to establish an MQTT connection with the AWS IoT Service
+ * using parameters from the last time a connection was attempted
+ * Use after disconnect to start the reconnect process manually
+ * Makes only one reconnect attempt. Sets the client state to
+ * pending reconnect in case of failure
+ *
+ * @param pClient Reference to the IoT Client
+ *
+ * @return An IoT Error Type defining successful/failed connection
+ */
+IoT_Error_t aws_iot_mqtt_attempt_reconnect(AWS_IoT_Client *pClient) {
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	rc = _aws_iot_mqtt_attempt_reconnect(pClient, false);
+
+	FUNC_EXIT_RC(rc);
+}
+
+/**
+ * @brief Finish a reconnect whose network connection was made without blocking
+ *
+ * Sends the CONNECT over the connection the client manager made with the connectStart and
+ * connectContinue functions of the network, then subscribes again and resends the
+ * in-flight publishes like aws_iot_mqtt_attempt_reconnect.
+ *
+ * @param pClient Reference to the IoT Client
+ *
+ * @return NETWORK_RECONNECTED, or NETWORK_ATTEMPTING_RECONNECT if the broker did not accept the connection
+ */
+IoT_Error_t aws_iot_mqtt_internal_complete_reconnect(AWS_IoT_Client *pClient) {
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	rc = _aws_iot_mqtt_attempt_reconnect(pClient, true);
+
+	FUNC_EXIT_RC(rc);
+}
+
 #ifdef __cplusplus
 }
 #endif
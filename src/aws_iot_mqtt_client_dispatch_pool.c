@@ -0,0 +1,421 @@
+/*
+* Copyright 2015-2016 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License").
+* You may not use this file except in compliance with the License.
+* A copy of the License is located at
+*
+* http://aws.amazon.com/apache2.0
+*
+* or in the "license" file accompanying this file. This file is distributed
+* on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+* express or implied. See the License for the specific language governing
+* permissions and limitations under the License.
+*/
+
+/**
+ * @file aws_iot_mqtt_client_dispatch_pool.c
+ * @brief Message handlers called by worker threads instead of the reading thread
+ *
+ * The reader copies a received message into a pooled buffer and queues one job per
+ * matching handler, then goes back to reading. Jobs are kept in lanes chosen by a hash
+ * of the topic. A lane is run by one worker at a time, so the handlers of one topic are
+ * called in the order the messages arrived while different topics are handled in parallel.
+ *
+ * A lane that gets a job is made ready on the worker its index maps to, so a topic tends
+ * to stay on one worker. A worker without ready lanes takes them from the other workers.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+
+#include <string.h>
+
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_client_interface.h"
+#include "aws_iot_mqtt_client_common_internal.h"
+
+/* Idle workers and a reader waiting for room look at the pool again this often */
+#define AWS_IOT_MQTT_DISPATCH_IDLE_WAIT_MS 1000
+
+/* Returns a buffer for a message of len bytes, the caller holds the pool mutex */
+static DispatchMessage *_aws_iot_mqtt_dispatch_take_message(AWS_IoT_Client *pClient, DispatchPool *pPool,
+															  size_t len) {
+	DispatchMessage *pMessage;
+	size_t bufSize;
+
+	if(AWS_IOT_MQTT_DISPATCH_BUFFER_SIZE >= len && NULL != pPool->pFreeMessages) {
+		pMessage = pPool->pFreeMessages;
+		pPool->pFreeMessages = pMessage->pNextFree;
+		pPool->freeMessageCount--;
+		return pMessage;
+	}
+
+	bufSize = (AWS_IOT_MQTT_DISPATCH_BUFFER_SIZE >= len) ? AWS_IOT_MQTT_DISPATCH_BUFFER_SIZE : len;
+	pMessage = (DispatchMessage *) aws_iot_mqtt_internal_malloc(pClient, sizeof(DispatchMessage) + bufSize);
+	if(NULL != pMessage) {
+		pMessage->bufSize = bufSize;
+	}
+
+	return pMessage;
+}
+
+/* Drops a reference to a message, the caller holds the pool mutex. The last holder sends the
+ * PUBACK of a QoS1 message, nobody else can reach the message while the mutex is released */
+static void _aws_iot_mqtt_dispatch_release_message(AWS_IoT_Client *pClient, DispatchPool *pPool,
+												   DispatchMessage *pMessage) {
+	if(1 == pMessage->refCount && pMessage->isAckPending) {
+		pMessage->isAckPending = false;
+		aws_iot_thread_mutex_unlock(&(pPool->mutex));
+		if(SUCCESS != aws_iot_mqtt_internal_send_dispatched_puback(pClient, pMessage->params.id,
+																   pMessage->closedNetworkCount)) {
+			IOT_WARN("PUBACK of message %u not sent, the broker delivers it again", pMessage->params.id);
+		}
+		aws_iot_thread_mutex_lock(&(pPool->mutex));
+	}
+
+	if(0 != --pMessage->refCount) {
+		return;
+	}
+
+	if(AWS_IOT_MQTT_DISPATCH_BUFFER_SIZE == pMessage->bufSize
+	   && AWS_IOT_MQTT_DISPATCH_POOLED_BUFFERS > pPool->freeMessageCount) {
+		pMessage->pNextFree = pPool->pFreeMessages;
+		pPool->pFreeMessages = pMessage;
+		pPool->freeMessageCount++;
+		return;
+	}
+
+	aws_iot_mqtt_internal_free(pClient, pMessage);
+}
+
+/* Takes the oldest ready lane, from the given worker first and then from the others.
+ * The caller holds the pool mutex */
+static DispatchLane *_aws_iot_mqtt_dispatch_take_lane(DispatchPool *pPool, uint32_t workerIndex) {
+	DispatchWorker *pWorker;
+	DispatchLane *pLane;
+	uint32_t itr;
+
+	for(itr = 0; itr < pPool->workerCount; itr++) {
+		pWorker = &(pPool->pWorkers[(workerIndex + itr) % pPool->workerCount]);
+		pLane = pWorker->pReadyHead;
+		if(NULL != pLane) {
+			pWorker->pReadyHead = pLane->pNextReady;
+			if(NULL == pWorker->pReadyHead) {
+				pWorker->pReadyTail = NULL;
+			}
+			pLane->pNextReady = NULL;
+			return pLane;
+		}
+	}
+
+	return NULL;
+}
+
+/* Appends a lane to the ready list of a worker, the caller holds the pool mutex */
+static void _aws_iot_mqtt_dispatch_make_ready(DispatchWorker *pWorker, DispatchLane *pLane) {
+	pLane->pNextReady = NULL;
+	if(NULL == pWorker->pReadyTail) {
+		pWorker->pReadyHead = pLane;
+	} else {
+		pWorker->pReadyTail->pNextReady = pLane;
+	}
+	pWorker->pReadyTail = pLane;
+}
+
+static void *_aws_iot_mqtt_dispatch_worker(void *pArg) {
+	DispatchWorker *pWorker = (DispatchWorker *) pArg;
+	AWS_IoT_Client *pClient = pWorker->pClient;
+	DispatchPool *pPool = pClient->clientData.pDispatchPool;
+	uint32_t workerIndex = (uint32_t) (pWorker - pPool->pWorkers);
+	DispatchMessage *pMessage;
+	DispatchLane *pLane;
+	DispatchJob *pJob;
+
+	aws_iot_thread_mutex_lock(&(pPool->mutex));
+	for(;;) {
+		pLane = _aws_iot_mqtt_dispatch_take_lane(pPool, workerIndex);
+		if(NULL == pLane) {
+			/* The queued jobs are run before the pool stops */
+			if(pPool->isStopping) {
+				break;
+			}
+			pPool->idleWorkerCount++;
+			aws_iot_thread_cond_wait(&(pPool->workCond), &(pPool->mutex), AWS_IOT_MQTT_DISPATCH_IDLE_WAIT_MS);
+			pPool->idleWorkerCount--;
+			continue;
+		}
+
+		pJob = pLane->pHead;
+		pLane->pHead = pJob->pNext;
+		if(NULL == pLane->pHead) {
+			pLane->pTail = NULL;
+		}
+		aws_iot_thread_mutex_unlock(&(pPool->mutex));
+
+		pMessage = pJob->pMessage;
+		pJob->pApplicationHandler(pClient, pMessage->pTopicName, pMessage->topicNameLen, &(pMessage->params),
+								  pJob->pApplicationHandlerData);
+
+		aws_iot_thread_mutex_lock(&(pPool->mutex));
+		_aws_iot_mqtt_dispatch_release_message(pClient, pPool, pMessage);
+		pJob->pNext = pPool->pFreeJobs;
+		pPool->pFreeJobs = pJob;
+		if(AWS_IOT_MQTT_DISPATCH_MAX_QUEUED_JOBS == pPool->queuedJobCount--) {
+			aws_iot_thread_cond_broadcast(&(pPool->spaceCond));
+		}
+
+		/* Jobs queued on the lane meanwhile stay with this worker, behind its other lanes */
+		if(NULL != pLane->pHead) {
+			_aws_iot_mqtt_dispatch_make_ready(pWorker, pLane);
+		} else {
+			pLane->isScheduled = false;
+		}
+	}
+	aws_iot_thread_mutex_unlock(&(pPool->mutex));
+
+	return NULL;
+}
+
+void aws_iot_mqtt_internal_queue_dispatch_job(AWS_IoT_Client *pClient, DispatchMessage *pMessage,
+											  pApplicationHandler_t pApplicationHandler,
+											  void *pApplicationHandlerData) {
+	DispatchPool *pPool = pClient->clientData.pDispatchPool;
+	DispatchLane *pLane = &(pPool->lanes[pMessage->laneIndex]);
+	DispatchJob *pJob;
+	bool isRxThread;
+
+	aws_iot_thread_mutex_lock(&(pPool->mutex));
+
+	/* Reading waits for the workers to catch up, which bounds the memory held by queued
+	 * messages and leaves the broker to be slowed down by TCP flow control. A full duplex
+	 * RX thread reads no PUBACKs meanwhile, so blocking publishes of the workers fail
+	 * instead of holding up the workers until the command timeout */
+	if(AWS_IOT_MQTT_DISPATCH_MAX_QUEUED_JOBS <= pPool->queuedJobCount) {
+		isRxThread = aws_iot_mqtt_internal_is_rx_thread(pClient);
+		if(isRxThread) {
+			aws_iot_mqtt_internal_io_set_rx_waiting(pClient, true);
+		}
+		while(AWS_IOT_MQTT_DISPATCH_MAX_QUEUED_JOBS <= pPool->queuedJobCount) {
+			aws_iot_thread_cond_wait(&(pPool->spaceCond), &(pPool->mutex), AWS_IOT_MQTT_DISPATCH_IDLE_WAIT_MS);
+		}
+		if(isRxThread) {
+			aws_iot_mqtt_internal_io_set_rx_waiting(pClient, false);
+		}
+	}
+
+	pJob = pPool->pFreeJobs;
+	if(NULL != pJob) {
+		pPool->pFreeJobs = pJob->pNext;
+	} else {
+		pJob = (DispatchJob *) aws_iot_mqtt_internal_malloc(pClient, sizeof(DispatchJob));
+	}
+
+	if(NULL == pJob) {
+		aws_iot_thread_mutex_unlock(&(pPool->mutex));
+		IOT_WARN("No memory for a dispatch job, calling the handler from the reading thread");
+		pApplicationHandler(pClient, pMessage->pTopicName, pMessage->topicNameLen, &(pMessage->params),
+							pApplicationHandlerData);
+		return;
+	}
+
+	pJob->pNext = NULL;
+	pJob->pMessage = pMessage;
+	pJob->pApplicationHandler = pApplicationHandler;
+	pJob->pApplicationHandlerData = pApplicationHandlerData;
+	pMessage->refCount++;
+	pPool->queuedJobCount++;
+
+	if(NULL == pLane->pTail) {
+		pLane->pHead = pJob;
+	} else {
+		pLane->pTail->pNext = pJob;
+	}
+	pLane->pTail = pJob;
+
+	if(!pLane->isScheduled) {
+		pLane->isScheduled = true;
+		_aws_iot_mqtt_dispatch_make_ready(&(pPool->pWorkers[pMessage->laneIndex % pPool->workerCount]), pLane);
+		if(0 < pPool->idleWorkerCount) {
+			aws_iot_thread_cond_broadcast(&(pPool->workCond));
+		}
+	}
+
+	aws_iot_thread_mutex_unlock(&(pPool->mutex));
+}
+
+IoT_Error_t aws_iot_mqtt_internal_dispatch_to_pool(AWS_IoT_Client *pClient, char *pTopicName, uint16_t topicNameLen,
+												   IoT_Publish_Message_Params *pMessageParams) {
+	DispatchPool *pPool = pClient->clientData.pDispatchPool;
+	DispatchMessage *pMessage;
+
+	FUNC_ENTRY;
+
+	aws_iot_thread_mutex_lock(&(pPool->mutex));
+	pMessage = _aws_iot_mqtt_dispatch_take_message(pClient, pPool, topicNameLen + pMessageParams->payloadLen);
+	aws_iot_thread_mutex_unlock(&(pPool->mutex));
+
+	if(NULL == pMessage) {
+		FUNC_EXIT_RC(MQTT_MEMORY_ALLOCATION_ERROR);
+	}
+
+	pMessage->params = *pMessageParams;
+	pMessage->pTopicName = (char *) (pMessage + 1);
+	pMessage->topicNameLen = topicNameLen;
+	memcpy(pMessage->pTopicName, pTopicName, topicNameLen);
+	pMessage->params.payload = pMessage->pTopicName + topicNameLen;
+	memcpy(pMessage->params.payload, pMessageParams->payload, pMessageParams->payloadLen);
+
+	/* Held until every matching handler has been queued */
+	pMessage->refCount = 1;
+	pMessage->isAckPending = (QOS1 == pMessageParams->qos);
+	pMessage->closedNetworkCount = pClient->clientData.closedNetworkCount;
+	aws_iot_mqtt_internal_dispatch_pooled_message(pClient, pMessage);
+
+	aws_iot_thread_mutex_lock(&(pPool->mutex));
+	_aws_iot_mqtt_dispatch_release_message(pClient, pPool, pMessage);
+	aws_iot_thread_mutex_unlock(&(pPool->mutex));
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+bool aws_iot_mqtt_internal_is_dispatch_worker(AWS_IoT_Client *pClient) {
+	DispatchPool *pPool = pClient->clientData.pDispatchPool;
+	uint32_t itr;
+
+	if(NULL == pPool) {
+		return false;
+	}
+
+	for(itr = 0; itr < pPool->workerCount; itr++) {
+		if(aws_iot_thread_is_current(&(pPool->pWorkers[itr].thread))) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Stops the workers that were started and releases the pool */
+static void _aws_iot_mqtt_dispatch_release_pool(AWS_IoT_Client *pClient, uint32_t startedWorkerCount) {
+	DispatchPool *pPool = pClient->clientData.pDispatchPool;
+	DispatchMessage *pMessage;
+	DispatchJob *pJob;
+	uint32_t itr;
+
+	aws_iot_thread_mutex_lock(&(pPool->mutex));
+	pPool->isStopping = true;
+	aws_iot_thread_cond_broadcast(&(pPool->workCond));
+	aws_iot_thread_mutex_unlock(&(pPool->mutex));
+
+	for(itr = 0; itr < startedWorkerCount; itr++) {
+		aws_iot_thread_join(&(pPool->pWorkers[itr].thread));
+	}
+
+	pClient->clientData.pDispatchPool = NULL;
+
+	while(NULL != pPool->pFreeMessages) {
+		pMessage = pPool->pFreeMessages;
+		pPool->pFreeMessages = pMessage->pNextFree;
+		aws_iot_mqtt_internal_free(pClient, pMessage);
+	}
+
+	while(NULL != pPool->pFreeJobs) {
+		pJob = pPool->pFreeJobs;
+		pPool->pFreeJobs = pJob->pNext;
+		aws_iot_mqtt_internal_free(pClient, pJob);
+	}
+
+	aws_iot_thread_cond_destroy(&(pPool->spaceCond));
+	aws_iot_thread_cond_destroy(&(pPool->workCond));
+	aws_iot_thread_mutex_destroy(&(pPool->mutex));
+	aws_iot_mqtt_internal_free(pClient, pPool->pWorkers);
+	aws_iot_mqtt_internal_free(pClient, pPool);
+}
+
+IoT_Error_t aws_iot_mqtt_start_dispatch_pool(AWS_IoT_Client *pClient, uint32_t workerCount) {
+	DispatchPool *pPool;
+	uint32_t itr;
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || 0 == workerCount) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	if(NULL != pClient->clientData.pDispatchPool) {
+		FUNC_EXIT_RC(SUCCESS);
+	}
+
+	pPool = (DispatchPool *) aws_iot_mqtt_internal_malloc(pClient, sizeof(DispatchPool));
+	if(NULL == pPool) {
+		FUNC_EXIT_RC(MQTT_MEMORY_ALLOCATION_ERROR);
+	}
+	memset(pPool, 0, sizeof(DispatchPool));
+
+	pPool->pWorkers = (DispatchWorker *) aws_iot_mqtt_internal_malloc(pClient, workerCount * sizeof(DispatchWorker));
+	if(NULL == pPool->pWorkers) {
+		aws_iot_mqtt_internal_free(pClient, pPool);
+		FUNC_EXIT_RC(MQTT_MEMORY_ALLOCATION_ERROR);
+	}
+	memset(pPool->pWorkers, 0, workerCount * sizeof(DispatchWorker));
+	pPool->workerCount = workerCount;
+
+	rc = aws_iot_thread_mutex_init(&(pPool->mutex));
+	if(SUCCESS == rc) {
+		rc = aws_iot_thread_cond_init(&(pPool->workCond));
+		if(SUCCESS == rc) {
+			rc = aws_iot_thread_cond_init(&(pPool->spaceCond));
+			if(SUCCESS != rc) {
+				aws_iot_thread_cond_destroy(&(pPool->workCond));
+			}
+		}
+		if(SUCCESS != rc) {
+			aws_iot_thread_mutex_destroy(&(pPool->mutex));
+		}
+	}
+
+	if(SUCCESS != rc) {
+		aws_iot_mqtt_internal_free(pClient, pPool->pWorkers);
+		aws_iot_mqtt_internal_free(pClient, pPool);
+		FUNC_EXIT_RC(rc);
+	}
+
+	pClient->clientData.pDispatchPool = pPool;
+
+	for(itr = 0; itr < workerCount; itr++) {
+		pPool->pWorkers[itr].pClient = pClient;
+		rc = aws_iot_thread_create(&(pPool->pWorkers[itr].thread), _aws_iot_mqtt_dispatch_worker,
+								   &(pPool->pWorkers[itr]));
+		if(SUCCESS != rc) {
+			_aws_iot_mqtt_dispatch_release_pool(pClient, itr);
+			FUNC_EXIT_RC(rc);
+		}
+	}
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+IoT_Error_t aws_iot_mqtt_stop_dispatch_pool(AWS_IoT_Client *pClient) {
+	FUNC_ENTRY;
+
+	if(NULL == pClient) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	if(NULL != pClient->clientData.pDispatchPool) {
+		_aws_iot_mqtt_dispatch_release_pool(pClient, pClient->clientData.pDispatchPool->workerCount);
+	}
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+#endif /* _ENABLE_THREAD_SUPPORT_ */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,395 @@
+/*
+* Copyright 2015-2016 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License").
+* You may not use this file except in compliance with the License.
+* A copy of the License is located at
+*
+* http://aws.amazon.com/apache2.0
+*
+* or in the "license" file accompanying this file. This file is distributed
+* on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+* express or implied. See the License for the specific language governing
+* permissions and limitations under the License.
+*/
+
+/**
+ * @file aws_iot_mqtt_client_io_threads.c
+ * @brief Full duplex mode, a reader and a writer thread per client
+ *
+ * The RX thread owns the reads: it yields in a loop, dispatching messages, completing
+ * in-flight publishes and keeping the connection alive. Publishes from any thread are
+ * serialized and queued for the TX thread, so they never wait for a yield to return.
+ *
+ * The queue has many producers and a single consumer and takes no lock. A producer swaps
+ * its packet in as the new head and then links the previous head to it. The TX thread
+ * follows the links from the tail, a stub packet keeps the queue from ever being empty.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+
+#include <string.h>
+
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_client_interface.h"
+#include "aws_iot_mqtt_client_common_internal.h"
+
+static void _aws_iot_mqtt_io_queue_push(IoThreads *pIoThreads, TxPacket *pPacket) {
+	TxPacket *pPrev;
+
+	__atomic_store_n(&(pPacket->pNext), NULL, __ATOMIC_RELAXED);
+	pPrev = __atomic_exchange_n(&(pIoThreads->pQueueHead), pPacket, __ATOMIC_ACQ_REL);
+	/* Until this store the packet is queued but not yet reachable from the tail */
+	__atomic_store_n(&(pPrev->pNext), pPacket, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Take the oldest packet from the queue
+ *
+ * Only called by the TX thread, or once the TX thread has finished.
+ *
+ * @param pIoThreads I/O thread state of the client
+ *
+ * @return The packet, NULL if the queue is empty or a producer has not finished linking its packet
+ */
+static TxPacket *_aws_iot_mqtt_io_queue_pop(IoThreads *pIoThreads) {
+	TxPacket *pTail = pIoThreads->pQueueTail;
+	TxPacket *pNext = __atomic_load_n(&(pTail->pNext), __ATOMIC_ACQUIRE);
+
+	if(&(pIoThreads->queueStub) == pTail) {
+		if(NULL == pNext) {
+			return NULL;
+		}
+		pIoThreads->pQueueTail = pNext;
+		pTail = pNext;
+		pNext = __atomic_load_n(&(pTail->pNext), __ATOMIC_ACQUIRE);
+	}
+
+	if(NULL != pNext) {
+		pIoThreads->pQueueTail = pNext;
+		return pTail;
+	}
+
+	if(pTail != __atomic_load_n(&(pIoThreads->pQueueHead), __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+
+	/* The tail is the last packet, the stub goes behind it so that it can be taken */
+	_aws_iot_mqtt_io_queue_push(pIoThreads, &(pIoThreads->queueStub));
+	pNext = __atomic_load_n(&(pTail->pNext), __ATOMIC_ACQUIRE);
+	if(NULL != pNext) {
+		pIoThreads->pQueueTail = pNext;
+		return pTail;
+	}
+
+	return NULL;
+}
+
+static bool _aws_iot_mqtt_io_is_stopping(IoThreads *pIoThreads) {
+	bool isStopping;
+
+	aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+	isStopping = pIoThreads->isStopping;
+	aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+
+	return isStopping;
+}
+
+bool aws_iot_mqtt_internal_io_enter(AWS_IoT_Client *pClient) {
+	IoThreads *pIoThreads = &(pClient->clientData.ioThreads);
+	bool isEntered = false;
+
+	aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+	if(pIoThreads->isRunning) {
+		pIoThreads->publisherCount++;
+		isEntered = true;
+	}
+	aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+
+	return isEntered;
+}
+
+void aws_iot_mqtt_internal_io_leave(AWS_IoT_Client *pClient) {
+	IoThreads *pIoThreads = &(pClient->clientData.ioThreads);
+
+	aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+	pIoThreads->publisherCount--;
+	if(0 == pIoThreads->publisherCount && pIoThreads->isStopping) {
+		aws_iot_thread_cond_broadcast(&(pIoThreads->ackCond));
+	}
+	aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+}
+
+bool aws_iot_mqtt_internal_is_rx_thread(AWS_IoT_Client *pClient) {
+	/* Only called between io enter and leave, the RX thread is started then */
+	return aws_iot_thread_is_current(&(pClient->clientData.ioThreads.rxThread));
+}
+
+void aws_iot_mqtt_internal_io_set_rx_waiting(AWS_IoT_Client *pClient, bool isWaiting) {
+	IoThreads *pIoThreads = &(pClient->clientData.ioThreads);
+
+	/* Blocking publishes of the dispatch workers look at the flag when woken */
+	aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+	pIoThreads->isRxWaitingForDispatch = isWaiting;
+	if(isWaiting) {
+		aws_iot_thread_cond_broadcast(&(pIoThreads->ackCond));
+	}
+	aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+}
+
+IoT_Error_t aws_iot_mqtt_internal_queue_vectors(AWS_IoT_Client *pClient, const IoT_IoVec_t *pVectors, size_t count) {
+	IoThreads *pIoThreads;
+	TxPacket *pPacket;
+	size_t itr, length;
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || NULL == pVectors) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	pIoThreads = &(pClient->clientData.ioThreads);
+
+	length = 0;
+	for(itr = 0; itr < count; itr++) {
+		length += pVectors[itr].len;
+	}
+
+	pPacket = (TxPacket *) aws_iot_mqtt_internal_malloc(pClient, sizeof(TxPacket) + length);
+	if(NULL == pPacket) {
+		FUNC_EXIT_RC(MQTT_MEMORY_ALLOCATION_ERROR);
+	}
+
+	pPacket->len = 0;
+	for(itr = 0; itr < count; itr++) {
+		memcpy((unsigned char *) (pPacket + 1) + pPacket->len, pVectors[itr].pBase, pVectors[itr].len);
+		pPacket->len += pVectors[itr].len;
+	}
+
+	_aws_iot_mqtt_io_queue_push(pIoThreads, pPacket);
+
+	/* Pairs with the fence of the TX thread between flagging that it sleeps and looking
+	 * at the queue again, one of the two sees the other */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&(pIoThreads->isTxWaiting), __ATOMIC_RELAXED)) {
+		aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+		aws_iot_thread_cond_broadcast(&(pIoThreads->txCond));
+		aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+	}
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+/* Packets queued while the client is disconnected are dropped. QoS1 publishes stay in
+ * the in-flight window and are sent again by the RX thread after the reconnect */
+static void _aws_iot_mqtt_io_send_packet(AWS_IoT_Client *pClient, TxPacket *pPacket) {
+	IoT_IoVec_t packet;
+	Timer timer;
+	IoT_Error_t rc;
+
+	init_timer(&timer);
+	countdown_ms(&timer, pClient->clientData.commandTimeoutMs);
+
+	packet.pBase = (unsigned char *) (pPacket + 1);
+	packet.len = pPacket->len;
+	rc = aws_iot_mqtt_internal_send_vectors_if_connected(pClient, &packet, 1, &timer);
+	if(SUCCESS != rc) {
+		IOT_WARN("Queued packet dropped, error: %d", rc);
+	}
+
+	aws_iot_mqtt_internal_free(pClient, pPacket);
+}
+
+static void *_aws_iot_mqtt_io_tx_thread(void *pArg) {
+	AWS_IoT_Client *pClient = (AWS_IoT_Client *) pArg;
+	IoThreads *pIoThreads = &(pClient->clientData.ioThreads);
+	TxPacket *pPacket;
+
+	for(;;) {
+		pPacket = _aws_iot_mqtt_io_queue_pop(pIoThreads);
+		if(NULL != pPacket) {
+			_aws_iot_mqtt_io_send_packet(pClient, pPacket);
+			continue;
+		}
+
+		aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+		if(pIoThreads->isStopping) {
+			aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+			break;
+		}
+
+		__atomic_store_n(&(pIoThreads->isTxWaiting), true, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		pPacket = _aws_iot_mqtt_io_queue_pop(pIoThreads);
+		if(NULL == pPacket) {
+			aws_iot_thread_cond_wait(&(pIoThreads->txCond), &(pIoThreads->mutex),
+									 AWS_IOT_MQTT_IO_THREAD_YIELD_TIMEOUT_MS);
+		}
+		__atomic_store_n(&(pIoThreads->isTxWaiting), false, __ATOMIC_RELAXED);
+		aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+
+		if(NULL != pPacket) {
+			_aws_iot_mqtt_io_send_packet(pClient, pPacket);
+		}
+	}
+
+	return NULL;
+}
+
+static void *_aws_iot_mqtt_io_rx_thread(void *pArg) {
+	AWS_IoT_Client *pClient = (AWS_IoT_Client *) pArg;
+	IoThreads *pIoThreads = &(pClient->clientData.ioThreads);
+	IoT_Error_t rc;
+
+	while(!_aws_iot_mqtt_io_is_stopping(pIoThreads)) {
+		rc = aws_iot_mqtt_yield(pClient, AWS_IOT_MQTT_IO_THREAD_YIELD_TIMEOUT_MS);
+		if(SUCCESS == rc || NETWORK_ATTEMPTING_RECONNECT == rc || NETWORK_RECONNECTED == rc) {
+			continue;
+		}
+
+		/* Yield returns at once while the client is disconnected without auto reconnect */
+		aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+		if(!pIoThreads->isStopping) {
+			aws_iot_thread_cond_wait(&(pIoThreads->ackCond), &(pIoThreads->mutex),
+									 AWS_IOT_MQTT_IO_THREAD_YIELD_TIMEOUT_MS);
+		}
+		aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+	}
+
+	return NULL;
+}
+
+/* Called once the threads have finished and no publisher is left on the queue */
+static void _aws_iot_mqtt_io_release(AWS_IoT_Client *pClient) {
+	IoThreads *pIoThreads = &(pClient->clientData.ioThreads);
+	TxPacket *pPacket;
+
+	/* Packets queued after the TX thread finished */
+	while(NULL != (pPacket = _aws_iot_mqtt_io_queue_pop(pIoThreads))) {
+		aws_iot_mqtt_internal_free(pClient, pPacket);
+	}
+
+	pClient->clientData.isBlockOnThreadLockEnabled = pIoThreads->wasBlockOnThreadLockEnabled;
+	aws_iot_thread_cond_destroy(&(pIoThreads->ackCond));
+	aws_iot_thread_cond_destroy(&(pIoThreads->txCond));
+}
+
+IoT_Error_t aws_iot_mqtt_start_io_threads(AWS_IoT_Client *pClient) {
+	IoThreads *pIoThreads;
+	IoT_Error_t rc;
+	bool isRunning;
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	pIoThreads = &(pClient->clientData.ioThreads);
+	aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+	isRunning = pIoThreads->isRunning;
+	aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+	if(isRunning) {
+		FUNC_EXIT_RC(SUCCESS);
+	}
+
+	rc = aws_iot_thread_cond_init(&(pIoThreads->txCond));
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+
+	rc = aws_iot_thread_cond_init(&(pIoThreads->ackCond));
+	if(SUCCESS != rc) {
+		aws_iot_thread_cond_destroy(&(pIoThreads->txCond));
+		FUNC_EXIT_RC(rc);
+	}
+
+	pIoThreads->queueStub.pNext = NULL;
+	pIoThreads->queueStub.len = 0;
+	pIoThreads->pQueueHead = &(pIoThreads->queueStub);
+	pIoThreads->pQueueTail = &(pIoThreads->queueStub);
+	pIoThreads->isTxWaiting = false;
+	pIoThreads->isStopping = false;
+
+	/* Both threads write, neither may give up on the write mutex */
+	pIoThreads->wasBlockOnThreadLockEnabled = pClient->clientData.isBlockOnThreadLockEnabled;
+	pClient->clientData.isBlockOnThreadLockEnabled = true;
+
+	rc = aws_iot_thread_create(&(pIoThreads->txThread), _aws_iot_mqtt_io_tx_thread, pClient);
+	if(SUCCESS != rc) {
+		_aws_iot_mqtt_io_release(pClient);
+		FUNC_EXIT_RC(rc);
+	}
+
+	/* Publishers are let in once the RX thread exists, they compare themselves against it */
+	rc = aws_iot_thread_create(&(pIoThreads->rxThread), _aws_iot_mqtt_io_rx_thread, pClient);
+	if(SUCCESS == rc) {
+		aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+		pIoThreads->isRunning = true;
+		aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+	} else {
+		aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+		pIoThreads->isStopping = true;
+		aws_iot_thread_cond_broadcast(&(pIoThreads->txCond));
+		aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+		aws_iot_thread_join(&(pIoThreads->txThread));
+		_aws_iot_mqtt_io_release(pClient);
+		FUNC_EXIT_RC(rc);
+	}
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+IoT_Error_t aws_iot_mqtt_stop_io_threads(AWS_IoT_Client *pClient) {
+	IoThreads *pIoThreads;
+	IoT_Error_t rxRc, txRc;
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	pIoThreads = &(pClient->clientData.ioThreads);
+
+	/* New publishes go back to the state machine, the TX thread sends what is queued and exits.
+	 * Blocking publishes still waiting for their PUBACK are woken up and give up */
+	aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+	if(!pIoThreads->isRunning) {
+		aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+		FUNC_EXIT_RC(SUCCESS);
+	}
+	pIoThreads->isRunning = false;
+	pIoThreads->isStopping = true;
+	aws_iot_thread_cond_broadcast(&(pIoThreads->txCond));
+	aws_iot_thread_cond_broadcast(&(pIoThreads->ackCond));
+	aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+
+	rxRc = aws_iot_thread_join(&(pIoThreads->rxThread));
+	txRc = aws_iot_thread_join(&(pIoThreads->txThread));
+
+	/* The condition variables and the queue are released once the last publisher has left */
+	aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+	while(0 < pIoThreads->publisherCount) {
+		aws_iot_thread_cond_wait(&(pIoThreads->ackCond), &(pIoThreads->mutex), AWS_IOT_MQTT_IO_THREAD_YIELD_TIMEOUT_MS);
+	}
+	aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+
+	_aws_iot_mqtt_io_release(pClient);
+
+	if(SUCCESS != rxRc) {
+		FUNC_EXIT_RC(rxRc);
+	}
+
+	FUNC_EXIT_RC(txRc);
+}
+
+#endif /* _ENABLE_THREAD_SUPPORT_ */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,557 @@
+/*
+* Copyright 2015-2016 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License").
+* You may not use this file except in compliance with the License.
+* A copy of the License is located at
+*
+* http://aws.amazon.com/apache2.0
+*
+* or in the "license" file accompanying this file. This file is distributed
+* on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+* express or implied. See the License for the specific language governing
+* permissions and limitations under the License.
+*/
+
+/**
+ * @file aws_iot_mqtt_client_manager.c
+ * @brief Client manager API definitions
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_client_manager.h"
+#include "aws_iot_mqtt_client_common_internal.h"
+
+/* Time after which a client that was busy with an application call is tried again */
+#define AWS_IOT_MQTT_MANAGER_BUSY_RETRY_MS 10
+
+const IoT_Client_Manager_Init_Params iotClientManagerInitParamsDefault = IoT_Client_Manager_Init_Params_initializer;
+
+static void _aws_iot_mqtt_manager_lock(AWS_IoT_Client_Manager *pManager) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_lock(&(pManager->lock));
+#else
+	IOT_UNUSED(pManager);
+#endif
+}
+
+static void _aws_iot_mqtt_manager_unlock(AWS_IoT_Client_Manager *pManager) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_unlock(&(pManager->lock));
+#else
+	IOT_UNUSED(pManager);
+#endif
+}
+
+static bool _aws_iot_mqtt_manager_is_stopping(AWS_IoT_Client_Manager *pManager) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+	bool isStopping;
+
+	aws_iot_thread_mutex_lock(&(pManager->lock));
+	isStopping = pManager->isStopping;
+	aws_iot_thread_mutex_unlock(&(pManager->lock));
+
+	return isStopping;
+#else
+	IOT_UNUSED(pManager);
+	return false;
+#endif
+}
+
+/* The timer heap holds the clients that are not busy, ordered by service timer. The
+ * caller holds the lock */
+static void _aws_iot_mqtt_manager_heap_set(AWS_IoT_Client_Manager *pManager, uint32_t index,
+										   IoT_Managed_Client *pEntry) {
+	pManager->pTimerHeap[index] = pEntry;
+	pEntry->heapIndex = index;
+}
+
+static void _aws_iot_mqtt_manager_heap_sift_up(AWS_IoT_Client_Manager *pManager, uint32_t index) {
+	IoT_Managed_Client *pEntry = pManager->pTimerHeap[index];
+	uint32_t parent;
+
+	while(0 < index) {
+		parent = (index - 1) / 2;
+		if(!is_timer_before(&(pEntry->serviceTimer), &(pManager->pTimerHeap[parent]->serviceTimer))) {
+			break;
+		}
+		_aws_iot_mqtt_manager_heap_set(pManager, index, pManager->pTimerHeap[parent]);
+		index = parent;
+	}
+	_aws_iot_mqtt_manager_heap_set(pManager, index, pEntry);
+}
+
+static void _aws_iot_mqtt_manager_heap_sift_down(AWS_IoT_Client_Manager *pManager, uint32_t index) {
+	IoT_Managed_Client *pEntry = pManager->pTimerHeap[index];
+	uint32_t child;
+
+	for(;;) {
+		child = 2 * index + 1;
+		if(child >= pManager->timerHeapCount) {
+			break;
+		}
+		if(child + 1 < pManager->timerHeapCount
+		   && is_timer_before(&(pManager->pTimerHeap[child + 1]->serviceTimer),
+							  &(pManager->pTimerHeap[child]->serviceTimer))) {
+			child++;
+		}
+		if(!is_timer_before(&(pManager->pTimerHeap[child]->serviceTimer), &(pEntry->serviceTimer))) {
+			break;
+		}
+		_aws_iot_mqtt_manager_heap_set(pManager, index, pManager->pTimerHeap[child]);
+		index = child;
+	}
+	_aws_iot_mqtt_manager_heap_set(pManager, index, pEntry);
+}
+
+static void _aws_iot_mqtt_manager_heap_push(AWS_IoT_Client_Manager *pManager, IoT_Managed_Client *pEntry) {
+	_aws_iot_mqtt_manager_heap_set(pManager, pManager->timerHeapCount, pEntry);
+	pManager->timerHeapCount++;
+	_aws_iot_mqtt_manager_heap_sift_up(pManager, pEntry->heapIndex);
+}
+
+static void _aws_iot_mqtt_manager_heap_remove(AWS_IoT_Client_Manager *pManager, IoT_Managed_Client *pEntry) {
+	uint32_t index = pEntry->heapIndex;
+
+	pManager->timerHeapCount--;
+	if(index == pManager->timerHeapCount) {
+		return;
+	}
+	/* The last client takes the place of the removed one and moves to where it belongs */
+	pEntry = pManager->pTimerHeap[pManager->timerHeapCount];
+	_aws_iot_mqtt_manager_heap_set(pManager, index, pEntry);
+	if(0 < index && is_timer_before(&(pEntry->serviceTimer), &(pManager->pTimerHeap[(index - 1) / 2]->serviceTimer))) {
+		_aws_iot_mqtt_manager_heap_sift_up(pManager, index);
+	} else {
+		_aws_iot_mqtt_manager_heap_sift_down(pManager, index);
+	}
+}
+
+/**
+ * @brief Take a client whose socket is readable
+ *
+ * A client is serviced by one thread at a time. A socket event for a client that is
+ * busy is left to the thread servicing it.
+ *
+ * @param pManager Reference to the manager
+ * @param pEntry Record of the client
+ *
+ * @return true if the calling thread has to service the client
+ */
+static bool _aws_iot_mqtt_manager_claim(AWS_IoT_Client_Manager *pManager, IoT_Managed_Client *pEntry) {
+	bool isClaimed = false;
+
+	_aws_iot_mqtt_manager_lock(pManager);
+	if(NULL != pEntry->pClient) {
+		if(pEntry->isBusy) {
+			pEntry->isEventPending = true;
+		} else {
+			_aws_iot_mqtt_manager_heap_remove(pManager, pEntry);
+			pEntry->isBusy = true;
+			isClaimed = true;
+		}
+	}
+	_aws_iot_mqtt_manager_unlock(pManager);
+
+	return isClaimed;
+}
+
+/**
+ * @brief Take the client whose timer expires first
+ *
+ * @param pManager Reference to the manager
+ * @param pWait_ms Lowered to the time left on the first timer when it has not expired
+ *
+ * @return The record of the client the calling thread has to service, NULL if no timer expired
+ */
+static IoT_Managed_Client *_aws_iot_mqtt_manager_claim_due(AWS_IoT_Client_Manager *pManager, uint32_t *pWait_ms) {
+	IoT_Managed_Client *pEntry = NULL;
+	uint32_t entry_ms;
+
+	_aws_iot_mqtt_manager_lock(pManager);
+	if(0 < pManager->timerHeapCount) {
+		pEntry = pManager->pTimerHeap[0];
+		if(has_timer_expired(&(pEntry->serviceTimer))) {
+			_aws_iot_mqtt_manager_heap_remove(pManager, pEntry);
+			pEntry->isBusy = true;
+		} else {
+			entry_ms = left_ms(&(pEntry->serviceTimer));
+			if(entry_ms < *pWait_ms) {
+				*pWait_ms = entry_ms;
+			}
+			pEntry = NULL;
+		}
+	}
+	_aws_iot_mqtt_manager_unlock(pManager);
+
+	return pEntry;
+}
+
+/**
+ * @brief Service a claimed client
+ *
+ * Runs the client until nothing is left to read, sets its service timer to its next
+ * deadline, puts it back in the timer heap and asks for the next readable event of its
+ * socket.
+ *
+ * @param pManager Reference to the manager
+ * @param pEntry Record of the client, claimed by the calling thread
+ *
+ * @return Milliseconds until the client has timer work to do
+ */
+static uint32_t _aws_iot_mqtt_manager_service(AWS_IoT_Client_Manager *pManager, IoT_Managed_Client *pEntry) {
+	IoT_Error_t rc;
+	AWS_IoT_Client *pClient = pEntry->pClient;
+	uint32_t wait_ms;
+	bool isRepeat;
+
+	do {
+		rc = aws_iot_mqtt_internal_service(pClient, AWS_IOT_MQTT_MANAGER_IDLE_CHECK_INTERVAL_MS, &wait_ms);
+		if(MQTT_CLIENT_NOT_IDLE_ERROR == rc) {
+			/* An application call holds the client, its data stays unread. Rearming
+			 * the socket now would only report it again at once */
+			wait_ms = AWS_IOT_MQTT_MANAGER_BUSY_RETRY_MS;
+		}
+		countdown_ms(&(pEntry->serviceTimer), wait_ms);
+
+		_aws_iot_mqtt_manager_lock(pManager);
+		isRepeat = pEntry->isEventPending && MQTT_CLIENT_NOT_IDLE_ERROR != rc;
+		pEntry->isEventPending = false;
+		pEntry->isBusy = isRepeat;
+		if(!isRepeat) {
+			_aws_iot_mqtt_manager_heap_push(pManager, pEntry);
+		}
+		_aws_iot_mqtt_manager_unlock(pManager);
+	} while(isRepeat);
+
+	if(MQTT_CLIENT_NOT_IDLE_ERROR != rc && SUCCESS != iot_tls_event_set_rearm(&(pClient->networkStack))) {
+		IOT_ERROR("Rearming the socket of a managed client failed, it is only serviced by its timers");
+	}
+
+	return wait_ms;
+}
+
+IoT_Error_t aws_iot_mqtt_manager_init(AWS_IoT_Client_Manager *pManager, const IoT_Client_Manager_Init_Params *pParams) {
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	if(NULL == pManager) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	if(NULL == pParams) {
+		pParams = &iotClientManagerInitParamsDefault;
+	}
+
+	if(0 == pParams->maxClients) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	pManager->pClients = (IoT_Managed_Client *) calloc(pParams->maxClients, sizeof(IoT_Managed_Client));
+	if(NULL == pManager->pClients) {
+		FUNC_EXIT_RC(FAILURE);
+	}
+	pManager->pTimerHeap = (IoT_Managed_Client **) calloc(pParams->maxClients, sizeof(IoT_Managed_Client *));
+	if(NULL == pManager->pTimerHeap) {
+		free(pManager->pClients);
+		pManager->pClients = NULL;
+		FUNC_EXIT_RC(FAILURE);
+	}
+	pManager->maxClients = pParams->maxClients;
+	pManager->clientCount = 0;
+	pManager->timerHeapCount = 0;
+
+	rc = iot_tls_event_set_init(&(pManager->eventSet));
+	if(SUCCESS != rc) {
+		free(pManager->pTimerHeap);
+		free(pManager->pClients);
+		pManager->pClients = NULL;
+		FUNC_EXIT_RC(rc);
+	}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	rc = aws_iot_thread_mutex_init(&(pManager->lock));
+	if(SUCCESS != rc) {
+		iot_tls_event_set_free(&(pManager->eventSet));
+		free(pManager->pTimerHeap);
+		free(pManager->pClients);
+		pManager->pClients = NULL;
+		FUNC_EXIT_RC(rc);
+	}
+	pManager->pWorkers = NULL;
+	pManager->workerCount = (0 == pParams->workerCount) ? 1 : pParams->workerCount;
+	pManager->runningWorkerCount = 0;
+	pManager->isStopping = false;
+#endif
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+IoT_Error_t aws_iot_mqtt_manager_add_client(AWS_IoT_Client_Manager *pManager, AWS_IoT_Client *pClient) {
+	IoT_Error_t rc = MQTT_MAX_MANAGED_CLIENTS_REACHED_ERROR;
+	IoT_Managed_Client *pEntry = NULL;
+	uint32_t itr;
+
+	FUNC_ENTRY;
+
+	if(NULL == pManager || NULL == pClient || NULL == pManager->pClients) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	_aws_iot_mqtt_manager_lock(pManager);
+	for(itr = 0; itr < pManager->maxClients; itr++) {
+		if(pClient == pManager->pClients[itr].pClient) {
+			rc = SUCCESS;
+			break;
+		}
+		if(NULL == pEntry && NULL == pManager->pClients[itr].pClient) {
+			pEntry = &(pManager->pClients[itr]);
+		}
+	}
+
+	if(SUCCESS != rc && NULL != pEntry) {
+		rc = iot_tls_event_set_add(&(pManager->eventSet), &(pClient->networkStack), pEntry);
+		if(SUCCESS == rc) {
+			/* Serviced by the next pass of the manager so that its timers are known */
+			pEntry->pClient = pClient;
+			pEntry->isBusy = false;
+			pEntry->isEventPending = false;
+			init_timer(&(pEntry->serviceTimer));
+			_aws_iot_mqtt_manager_heap_push(pManager, pEntry);
+			pManager->clientCount++;
+		}
+	}
+	_aws_iot_mqtt_manager_unlock(pManager);
+
+	FUNC_EXIT_RC(rc);
+}
+
+IoT_Error_t aws_iot_mqtt_manager_remove_client(AWS_IoT_Client_Manager *pManager, AWS_IoT_Client *pClient) {
+	IoT_Error_t rc = SUCCESS;
+	uint32_t itr;
+
+	FUNC_ENTRY;
+
+	if(NULL == pManager || NULL == pClient || NULL == pManager->pClients) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	_aws_iot_mqtt_manager_lock(pManager);
+	for(itr = 0; itr < pManager->maxClients; itr++) {
+		if(pClient != pManager->pClients[itr].pClient) {
+			continue;
+		}
+		if(pManager->pClients[itr].isBusy) {
+			rc = MQTT_CLIENT_NOT_IDLE_ERROR;
+			break;
+		}
+		rc = iot_tls_event_set_remove(&(pClient->networkStack));
+		_aws_iot_mqtt_manager_heap_remove(pManager, &(pManager->pClients[itr]));
+		pManager->pClients[itr].pClient = NULL;
+		pManager->clientCount--;
+		break;
+	}
+	_aws_iot_mqtt_manager_unlock(pManager);
+
+	FUNC_EXIT_RC(rc);
+}
+
+IoT_Error_t aws_iot_mqtt_manager_run(AWS_IoT_Client_Manager *pManager, uint32_t timeout_ms) {
+	IoT_Error_t rc = SUCCESS;
+	void *pReady[AWS_IOT_MQTT_MANAGER_MAX_EVENTS];
+	IoT_Managed_Client *pEntry;
+	Timer timer;
+	uint32_t itr, wait_ms, entry_ms;
+	size_t readyCount, readyItr;
+	bool isInterrupted = false;
+
+	FUNC_ENTRY;
+
+	if(NULL == pManager || NULL == pManager->pClients) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	init_timer(&timer);
+	countdown_ms(&timer, timeout_ms);
+
+	while(!isInterrupted && !_aws_iot_mqtt_manager_is_stopping(pManager)) {
+		/* Service the clients whose timers are due, taken from the top of the timer heap, and
+		 * find the next one to expire. A client serviced here goes back into the heap, so a pass
+		 * takes at most as many clients as there are, even if some are due again at once. A wait
+		 * is never longer than the idle check interval, so that clients added meanwhile are
+		 * picked up */
+		timer_cache_now();
+		wait_ms = left_ms(&timer);
+		if(AWS_IOT_MQTT_MANAGER_IDLE_CHECK_INTERVAL_MS < wait_ms) {
+			wait_ms = AWS_IOT_MQTT_MANAGER_IDLE_CHECK_INTERVAL_MS;
+		}
+		for(itr = 0; itr < pManager->maxClients; itr++) {
+			pEntry = _aws_iot_mqtt_manager_claim_due(pManager, &wait_ms);
+			if(NULL == pEntry) {
+				break;
+			}
+			entry_ms = _aws_iot_mqtt_manager_service(pManager, pEntry);
+			if(entry_ms < wait_ms) {
+				wait_ms = entry_ms;
+			}
+			timer_cache_now();
+		}
+		timer_release_now();
+
+		if(has_timer_expired(&timer)) {
+			break;
+		}
+
+		rc = iot_tls_event_set_wait(&(pManager->eventSet), pReady, AWS_IOT_MQTT_MANAGER_MAX_EVENTS, wait_ms,
+									&readyCount, &isInterrupted);
+		if(SUCCESS != rc) {
+			break;
+		}
+
+		for(readyItr = 0; readyItr < readyCount; readyItr++) {
+			pEntry = (IoT_Managed_Client *) pReady[readyItr];
+			if(_aws_iot_mqtt_manager_claim(pManager, pEntry)) {
+				(void) _aws_iot_mqtt_manager_service(pManager, pEntry);
+			}
+		}
+	}
+
+	FUNC_EXIT_RC(rc);
+}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+static void *_aws_iot_mqtt_manager_worker(void *pArg) {
+	AWS_IoT_Client_Manager *pManager = (AWS_IoT_Client_Manager *) pArg;
+	IoT_Error_t rc;
+
+	while(!_aws_iot_mqtt_manager_is_stopping(pManager)) {
+		rc = aws_iot_mqtt_manager_run(pManager, AWS_IOT_MQTT_MANAGER_IDLE_CHECK_INTERVAL_MS);
+		if(SUCCESS != rc) {
+			IOT_ERROR("Client manager worker failed to wait for the clients, error: %d", rc);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+IoT_Error_t aws_iot_mqtt_manager_start(AWS_IoT_Client_Manager *pManager) {
+	IoT_Error_t rc = SUCCESS;
+
+	FUNC_ENTRY;
+
+	if(NULL == pManager || NULL == pManager->pClients) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	if(NULL != pManager->pWorkers) {
+		FUNC_EXIT_RC(SUCCESS);
+	}
+
+	pManager->pWorkers = (IoT_Thread_t *) calloc(pManager->workerCount, sizeof(IoT_Thread_t));
+	if(NULL == pManager->pWorkers) {
+		FUNC_EXIT_RC(FAILURE);
+	}
+
+	pManager->isStopping = false;
+	for(pManager->runningWorkerCount = 0; pManager->runningWorkerCount < pManager->workerCount;
+		pManager->runningWorkerCount++) {
+		rc = aws_iot_thread_create(&(pManager->pWorkers[pManager->runningWorkerCount]),
+								   _aws_iot_mqtt_manager_worker, pManager);
+		if(SUCCESS != rc) {
+			break;
+		}
+	}
+
+	if(SUCCESS != rc) {
+		/* Keep the original error, stopping the threads that did start */
+		aws_iot_mqtt_manager_stop(pManager);
+	}
+
+	FUNC_EXIT_RC(rc);
+}
+
+IoT_Error_t aws_iot_mqtt_manager_stop(AWS_IoT_Client_Manager *pManager) {
+	IoT_Error_t rc, joinRc;
+	uint32_t itr;
+
+	FUNC_ENTRY;
+
+	if(NULL == pManager || NULL == pManager->pClients) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	if(NULL == pManager->pWorkers) {
+		FUNC_EXIT_RC(SUCCESS);
+	}
+
+	_aws_iot_mqtt_manager_lock(pManager);
+	pManager->isStopping = true;
+	_aws_iot_mqtt_manager_unlock(pManager);
+	rc = iot_tls_event_set_interrupt(&(pManager->eventSet), true);
+	if(SUCCESS != rc) {
+		/* The workers still see the flag once their current wait times out */
+		IOT_WARN("Interrupting the client manager failed, waiting for the workers to time out");
+	}
+
+	for(itr = 0; itr < pManager->runningWorkerCount; itr++) {
+		joinRc = aws_iot_thread_join(&(pManager->pWorkers[itr]));
+		if(SUCCESS != joinRc) {
+			rc = joinRc;
+		}
+	}
+
+	if(SUCCESS == rc) {
+		rc = iot_tls_event_set_interrupt(&(pManager->eventSet), false);
+	}
+
+	free(pManager->pWorkers);
+	pManager->pWorkers = NULL;
+	pManager->runningWorkerCount = 0;
+	pManager->isStopping = false;
+
+	FUNC_EXIT_RC(rc);
+}
+#endif
+
+IoT_Error_t aws_iot_mqtt_manager_free(AWS_IoT_Client_Manager *pManager) {
+	uint32_t itr;
+
+	FUNC_ENTRY;
+
+	if(NULL == pManager || NULL == pManager->pClients) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	for(itr = 0; itr < pManager->maxClients; itr++) {
+		if(NULL != pManager->pClients[itr].pClient) {
+			iot_tls_event_set_remove(&(pManager->pClients[itr].pClient->networkStack));
+			pManager->pClients[itr].pClient = NULL;
+		}
+	}
+	pManager->clientCount = 0;
+	pManager->timerHeapCount = 0;
+
+	iot_tls_event_set_free(&(pManager->eventSet));
+	free(pManager->pTimerHeap);
+	pManager->pTimerHeap = NULL;
+	free(pManager->pClients);
+	pManager->pClients = NULL;
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_destroy(&(pManager->lock));
+#endif
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -42,6 +42,12 @@ extern "C" {
 
 #include "aws_iot_mqtt_client_common_internal.h"
 
+/* Fixed header, remaining length, topic name length and packet id */
+#define PUBLISH_MAX_HEADER_LENGTH 9
+#define PUBLISH_MAX_REMAINING_LENGTH 268435455
+/* Header, topic name, packet id and payload */
+#define PUBLISH_MAX_VECTORS 4
+
 /**
  * @param stringVar pointer to the String into which the data is to be read
  * @param stringLen pointer to variable which has the length of the string
@@ -69,8 +75,11 @@ static IoT_Error_t _aws_iot_mqtt_read_string_with_len(char **stringVar, uint16_t
 }
 
 /**
-  * Serializes the supplied publish data into the supplied buffer, ready for sending
-  * @param pTxBuf the buffer into which the packet will be serialized
+  * Serializes the header of the supplied publish into the supplied buffer, ready for sending.
+  * Only the fixed header, the topic name length and the packet identifier are written to the
+  * buffer. Topic name and payload are sent from the caller's memory, so the payload size is not
+  * limited by the buffer length
+  * @param pTxBuf the buffer into which the header will be serialized
   * @param txBufLen the length in bytes of the supplied buffer
   * @param dup uint8_t - the MQTT dup flag
   * @param qos QoS - the MQTT QoS value
@@ -80,7 +89,8 @@ static IoT_Error_t _aws_iot_mqtt_read_string_with_len(char **stringVar, uint16_t
   * @param topicNameLen uint16_t - the length of the Topic Name
   * @param pPayload byte buffer - the MQTT publish payload
   * @param payloadLen size_t - the length of the MQTT payload
-  * @param pSerializedLen uint32_t - pointer to the variable that stores serialized len
+  * @param pVectors IoT_IoVec_t[PUBLISH_MAX_VECTORS] - filled with the buffers making up the packet
+  * @param pVectorCount size_t - pointer to the variable that stores the number of buffers used
   *
   * @return An IoT Error Type defining successful/failed call
   */
@@ -88,24 +98,21 @@ static IoT_Error_t _aws_iot_mqtt_internal_serialize_publish(unsigned char *pTxBu
 															QoS qos, uint8_t retained, uint16_t packetId,
 															const char *pTopicName, uint16_t topicNameLen,
 															const unsigned char *pPayload, size_t payloadLen,
-															uint32_t *pSerializedLen) {
+															IoT_IoVec_t *pVectors, size_t *pVectorCount) {
 	unsigned char *ptr;
-	uint32_t rem_len;
+	size_t rem_len;
 	MQTTHeader header = {0};
 
 	FUNC_ENTRY;
-	if(NULL == pTxBuf || NULL == pPayload || NULL == pSerializedLen) {
+	if(NULL == pTxBuf || NULL == pPayload || NULL == pVectors || NULL == pVectorCount) {
 		FUNC_EXIT_RC(NULL_VALUE_ERROR);
 	}
 
-	ptr = pTxBuf;
-	rem_len = 0;
-
-	rem_len += (uint32_t) (topicNameLen + payloadLen + 2);
+	rem_len = (size_t) topicNameLen + payloadLen + 2;
 	if(qos > 0) {
 		rem_len += 2; /* packetId */
 	}
-	if(aws_iot_mqtt_internal_get_final_packet_length_from_remaining_length(rem_len) > txBufLen) {
+	if(PUBLISH_MAX_REMAINING_LENGTH < rem_len || PUBLISH_MAX_HEADER_LENGTH > txBufLen) {
 		FUNC_EXIT_RC(MQTT_TX_BUFFER_TOO_SHORT_ERROR);
 	}
 
@@ -113,24 +120,80 @@ static IoT_Error_t _aws_iot_mqtt_internal_serialize_publish(unsigned char *pTxBu
 	if(SUCCESS != rc) {
 		FUNC_EXIT_RC(rc);
 	}
+
+	ptr = pTxBuf;
 	aws_iot_mqtt_internal_write_char(&ptr, header.byte); /* write header */
 
-	ptr += aws_iot_mqtt_internal_write_len_to_buffer(ptr, rem_len); /* write remaining length */;
+	ptr += aws_iot_mqtt_internal_write_len_to_buffer(ptr, (uint32_t) rem_len); /* write remaining length */;
+
+	aws_iot_mqtt_internal_write_uint_16(&ptr, topicNameLen);
 
-	aws_iot_mqtt_internal_write_utf8_string(&ptr, pTopicName, topicNameLen);
+	*pVectorCount = 0;
+	pVectors[*pVectorCount].pBase = pTxBuf;
+	pVectors[(*pVectorCount)++].len = (size_t) (ptr - pTxBuf);
+	if(0 < topicNameLen) {
+		pVectors[*pVectorCount].pBase = (const unsigned char *) pTopicName;
+		pVectors[(*pVectorCount)++].len = topicNameLen;
+	}
 
 	if(qos > 0) {
+		pVectors[*pVectorCount].pBase = ptr;
 		aws_iot_mqtt_internal_write_uint_16(&ptr, packetId);
+		pVectors[(*pVectorCount)++].len = 2;
 	}
 
-	memcpy(ptr, pPayload, payloadLen);
-	ptr += payloadLen;
-
-	*pSerializedLen = (uint32_t) (ptr - pTxBuf);
+	if(0 < payloadLen) {
+		pVectors[*pVectorCount].pBase = pPayload;
+		pVectors[(*pVectorCount)++].len = payloadLen;
+	}
 
 	FUNC_EXIT_RC(SUCCESS);
 }
 
+/**
+ * @brief Send a PUBLISH packet
+ *
+ * Serializes the publish header and sends it together with the topic name and the
+ * payload, which are passed to the network layer in place. If the client packs
+ * publishes, a coalescable publish is added to the packed ones instead.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param dup MQTT dup flag, set when this is a retransmission
+ * @param pTopicName Topic Name to publish to
+ * @param topicNameLen Length of the topic name
+ * @param pParams Pointer to Publish Message parameters
+ * @param isCoalescable Set to false if the publish has to leave before the call returns
+ * @param pTimer Timer for the send operation
+ *
+ * @return An IoT Error Type defining successful/failed send
+ */
+static IoT_Error_t _aws_iot_mqtt_internal_send_publish(AWS_IoT_Client *pClient, uint8_t dup, const char *pTopicName,
+													   uint16_t topicNameLen, IoT_Publish_Message_Params *pParams,
+													   bool isCoalescable, Timer *pTimer) {
+	unsigned char header[PUBLISH_MAX_HEADER_LENGTH];
+	IoT_IoVec_t vectors[PUBLISH_MAX_VECTORS];
+	size_t vectorCount = 0;
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	rc = _aws_iot_mqtt_internal_serialize_publish(header, sizeof(header), dup, pParams->qos, pParams->isRetained,
+												  pParams->id, pTopicName, topicNameLen,
+												  (unsigned char *) pParams->payload, pParams->payloadLen, vectors,
+												  &vectorCount);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+
+	if(isCoalescable) {
+		rc = aws_iot_mqtt_internal_coalesce_vectors(pClient, vectors, vectorCount, pTimer);
+	} else {
+		rc = aws_iot_mqtt_internal_send_vectors(pClient, vectors, vectorCount, pTimer);
+	}
+
+	FUNC_EXIT_RC(rc);
+}
+
 /**
   * Serializes the ack packet into the supplied buffer.
   * @param pTxBuf the buffer into which the packet will be serialized
@@ -176,6 +239,241 @@ IoT_Error_t aws_iot_mqtt_internal_serialize_ack(unsigned char *pTxBuf, size_t tx
 	FUNC_EXIT_RC(SUCCESS);
 }
 
+/**
+ * @brief Reserve a slot in the in-flight window for an asynchronous QoS1 publish
+ *
+ * Packet ids are drawn until one maps to a free slot. The window is never full
+ * at this point, so this terminates within AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES draws.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pPacketId Returns the packet id assigned to the publish
+ *
+ * @return Pointer to the reserved slot, NULL if the window is full
+ */
+static InflightPublish *_aws_iot_mqtt_internal_reserve_inflight_slot(AWS_IoT_Client *pClient, uint16_t *pPacketId) {
+	InflightPublish *pSlot;
+	uint16_t packetId;
+
+	if(AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES <= pClient->clientData.inflightPublishCount) {
+		return NULL;
+	}
+
+	do {
+		packetId = aws_iot_mqtt_get_next_packet_id(pClient);
+		pSlot = &(pClient->clientData.inflightPublishes[packetId % AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES]);
+	} while(pSlot->isInUse);
+
+	*pPacketId = packetId;
+	return pSlot;
+}
+
+/* In full duplex mode the in-flight window is shared by the publishing threads and the RX thread */
+static void _aws_iot_mqtt_internal_lock_inflight(AWS_IoT_Client *pClient) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_lock(&(pClient->clientData.inflight_mutex));
+#else
+	IOT_UNUSED(pClient);
+#endif
+}
+
+static void _aws_iot_mqtt_internal_unlock_inflight(AWS_IoT_Client *pClient) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+	aws_iot_thread_mutex_unlock(&(pClient->clientData.inflight_mutex));
+#else
+	IOT_UNUSED(pClient);
+#endif
+}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+/**
+ * @brief Completion of a blocking QoS1 publish in full duplex mode
+ */
+typedef struct {
+	IoT_Error_t status;
+	bool isComplete;
+} PublishWaiter;
+
+/* Completion handler of blocking QoS1 publishes, called by the RX thread with the PUBACK */
+static void _aws_iot_mqtt_internal_complete_waiter(AWS_IoT_Client *pClient, uint16_t packetId, IoT_Error_t status,
+												   void *pCompleteHandlerData) {
+	PublishWaiter *pWaiter = (PublishWaiter *) pCompleteHandlerData;
+
+	IOT_UNUSED(packetId);
+
+	aws_iot_thread_mutex_lock(&(pClient->clientData.ioThreads.mutex));
+	pWaiter->status = status;
+	pWaiter->isComplete = true;
+	aws_iot_thread_cond_broadcast(&(pClient->clientData.ioThreads.ackCond));
+	aws_iot_thread_mutex_unlock(&(pClient->clientData.ioThreads.mutex));
+}
+
+/**
+ * @brief Wait for the PUBACK of a blocking QoS1 publish in full duplex mode
+ *
+ * If no PUBACK arrives within the command timeout, or the I/O threads are being stopped,
+ * the publish is taken out of the in-flight window, unless the RX thread is completing it
+ * at that moment. The same happens at once for a publish from a dispatch worker while the
+ * RX thread waits for room in the dispatch pool, as it reads no PUBACK until the workers
+ * have caught up.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pSlot In-flight slot of the publish
+ * @param packetId Packet id of the publish
+ * @param pWaiter Completion filled in by _aws_iot_mqtt_internal_complete_waiter
+ *
+ * @return SUCCESS, MQTT_REQUEST_TIMEOUT_ERROR if no PUBACK arrived in time, or
+ * MQTT_BLOCKING_PUBLISH_ON_RX_THREAD_ERROR if the RX thread waits for the dispatch worker
+ */
+static IoT_Error_t _aws_iot_mqtt_internal_wait_for_puback(AWS_IoT_Client *pClient, InflightPublish *pSlot,
+														  uint16_t packetId, PublishWaiter *pWaiter) {
+	IoThreads *pIoThreads = &(pClient->clientData.ioThreads);
+	bool isDispatchWorker = false;
+	bool isRxBlocked = false;
+	bool isTimedOut = false;
+	Timer timer;
+
+	init_timer(&timer);
+	countdown_ms(&timer, pClient->clientData.commandTimeoutMs);
+
+	aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+	while(!pWaiter->isComplete && !pIoThreads->isStopping && !has_timer_expired(&timer)) {
+		/* The pool is in use by the RX thread while the flag is set */
+		if(pIoThreads->isRxWaitingForDispatch) {
+			isDispatchWorker = aws_iot_mqtt_internal_is_dispatch_worker(pClient);
+			if(isDispatchWorker) {
+				isRxBlocked = true;
+				break;
+			}
+		}
+		aws_iot_thread_cond_wait(&(pIoThreads->ackCond), &(pIoThreads->mutex), left_ms(&timer));
+	}
+	aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+
+	if(!pWaiter->isComplete) {
+		_aws_iot_mqtt_internal_lock_inflight(pClient);
+		if(pSlot->isInUse && packetId == pSlot->params.id && pWaiter == pSlot->pCompleteHandlerData) {
+			pSlot->isInUse = false;
+			pSlot->pTopicName = NULL;
+			pClient->clientData.inflightPublishCount--;
+			isTimedOut = true;
+		}
+		_aws_iot_mqtt_internal_unlock_inflight(pClient);
+	}
+
+	if(isTimedOut && isRxBlocked) {
+		IOT_ERROR("Blocking QoS1 publish from a dispatch worker while the RX thread waits for the workers");
+		return MQTT_BLOCKING_PUBLISH_ON_RX_THREAD_ERROR;
+	}
+
+	if(isTimedOut) {
+		return MQTT_REQUEST_TIMEOUT_ERROR;
+	}
+
+	/* The RX thread took the slot, the completion follows shortly */
+	aws_iot_thread_mutex_lock(&(pIoThreads->mutex));
+	while(!pWaiter->isComplete) {
+		aws_iot_thread_cond_wait(&(pIoThreads->ackCond), &(pIoThreads->mutex), AWS_IOT_MQTT_IO_THREAD_YIELD_TIMEOUT_MS);
+	}
+	aws_iot_thread_mutex_unlock(&(pIoThreads->mutex));
+
+	return pWaiter->status;
+}
+
+/**
+ * @brief Queue a publish for the TX thread in full duplex mode
+ *
+ * The packet is serialized into its own allocation, so topic and payload of QoS0 publishes
+ * can be reused as soon as the call returns. QoS1 publishes are added to the in-flight
+ * window before they are queued so that a PUBACK can never arrive for an unknown packet id.
+ * The client state is not changed, publishing never contends with the RX thread.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pTopicName Topic Name to publish to
+ * @param topicNameLen Length of the topic name
+ * @param pParams Pointer to Publish Message parameters
+ * @param pCompleteHandler Handler called once the publish is complete, can be NULL
+ * @param pCompleteHandlerData Data to be passed as argument to the completion handler
+ * @param isBlocking Wait for the PUBACK of a QoS1 publish
+ *
+ * @return An IoT Error Type defining successful/failed publish, MQTT_BLOCKING_PUBLISH_ON_RX_THREAD_ERROR
+ * if a blocking QoS1 publish is called on the RX thread, which would never read its PUBACK
+ */
+static IoT_Error_t _aws_iot_mqtt_internal_queue_publish(AWS_IoT_Client *pClient, const char *pTopicName,
+														uint16_t topicNameLen, IoT_Publish_Message_Params *pParams,
+														pPublishCompleteHandler_t pCompleteHandler,
+														void *pCompleteHandlerData, bool isBlocking) {
+	unsigned char header[PUBLISH_MAX_HEADER_LENGTH];
+	IoT_IoVec_t vectors[PUBLISH_MAX_VECTORS];
+	size_t vectorCount = 0;
+	InflightPublish *pSlot = NULL;
+	PublishWaiter waiter;
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	waiter.status = SUCCESS;
+	waiter.isComplete = false;
+
+	if(QOS1 == pParams->qos && isBlocking && aws_iot_mqtt_internal_is_rx_thread(pClient)) {
+		IOT_ERROR("Blocking QoS1 publish from a handler on the RX thread, use aws_iot_mqtt_publish_async");
+		FUNC_EXIT_RC(MQTT_BLOCKING_PUBLISH_ON_RX_THREAD_ERROR);
+	}
+
+	if(QOS1 == pParams->qos) {
+		_aws_iot_mqtt_internal_lock_inflight(pClient);
+		pSlot = _aws_iot_mqtt_internal_reserve_inflight_slot(pClient, &(pParams->id));
+		if(NULL != pSlot) {
+			pSlot->pTopicName = pTopicName;
+			pSlot->topicNameLen = topicNameLen;
+			pSlot->params = *pParams;
+			pSlot->pCompleteHandler = isBlocking ? _aws_iot_mqtt_internal_complete_waiter : pCompleteHandler;
+			pSlot->pCompleteHandlerData = isBlocking ? (void *) &waiter : pCompleteHandlerData;
+			pSlot->isInUse = true;
+			pClient->clientData.inflightPublishCount++;
+			countdown_ms(&(pSlot->retryTimer), AWS_IOT_MQTT_PUBLISH_RETRY_INTERVAL_MS);
+		}
+		_aws_iot_mqtt_internal_unlock_inflight(pClient);
+
+		if(NULL == pSlot) {
+			FUNC_EXIT_RC(MQTT_MAX_INFLIGHT_PUBLISHES_REACHED_ERROR);
+		}
+	}
+
+	rc = _aws_iot_mqtt_internal_serialize_publish(header, sizeof(header), 0, pParams->qos, pParams->isRetained,
+												  pParams->id, pTopicName, topicNameLen,
+												  (unsigned char *) pParams->payload, pParams->payloadLen, vectors,
+												  &vectorCount);
+	if(SUCCESS == rc) {
+		rc = aws_iot_mqtt_internal_queue_vectors(pClient, vectors, vectorCount);
+	}
+
+	if(SUCCESS != rc) {
+		if(NULL != pSlot) {
+			/* Nothing was queued, the publish is not tracked */
+			_aws_iot_mqtt_internal_lock_inflight(pClient);
+			pSlot->isInUse = false;
+			pSlot->pTopicName = NULL;
+			pClient->clientData.inflightPublishCount--;
+			_aws_iot_mqtt_internal_unlock_inflight(pClient);
+		}
+		FUNC_EXIT_RC(rc);
+	}
+
+	if(NULL == pSlot) {
+		if(NULL != pCompleteHandler) {
+			pCompleteHandler(pClient, pParams->id, SUCCESS, pCompleteHandlerData);
+		}
+		FUNC_EXIT_RC(SUCCESS);
+	}
+
+	if(isBlocking) {
+		rc = _aws_iot_mqtt_internal_wait_for_puback(pClient, pSlot, pParams->id, &waiter);
+	}
+
+	FUNC_EXIT_RC(rc);
+}
+#endif
+
 /**
  * @brief Publish an MQTT message on a topic
  *
@@ -196,7 +494,6 @@ IoT_Error_t aws_iot_mqtt_internal_serialize_ack(unsigned char *pTxBuf, size_t tx
 static IoT_Error_t _aws_iot_mqtt_internal_publish(AWS_IoT_Client *pClient, const char *pTopicName,
 												  uint16_t topicNameLen, IoT_Publish_Message_Params *pParams) {
 	Timer timer;
-	uint32_t len = 0;
 	uint16_t packet_id;
 	unsigned char dup, type;
 	IoT_Error_t rc;
@@ -210,16 +507,9 @@ static IoT_Error_t _aws_iot_mqtt_internal_publish(AWS_IoT_Client *pClient, const
 		pParams->id = aws_iot_mqtt_get_next_packet_id(pClient);
 	}
 
-	rc = _aws_iot_mqtt_internal_serialize_publish(pClient->clientData.writeBuf, pClient->clientData.writeBufSize, 0,
-												  pParams->qos, pParams->isRetained, pParams->id, pTopicName,
-												  topicNameLen, (unsigned char *) pParams->payload,
-												  pParams->payloadLen, &len);
-	if(SUCCESS != rc) {
-		FUNC_EXIT_RC(rc);
-	}
-
-	/* send the publish packet */
-	rc = aws_iot_mqtt_internal_send_packet(pClient, len, &timer);
+	/* send the publish packet, a QoS0 publish may be packed with others */
+	rc = _aws_iot_mqtt_internal_send_publish(pClient, 0, pTopicName, topicNameLen, pParams, QOS0 == pParams->qos,
+											 &timer);
 	if(SUCCESS != rc) {
 		FUNC_EXIT_RC(rc);
 	}
@@ -273,6 +563,15 @@ IoT_Error_t aws_iot_mqtt_publish(AWS_IoT_Client *pClient, const char *pTopicName
 		FUNC_EXIT_RC(NETWORK_DISCONNECTED_ERROR);
 	}
 
+#ifdef _ENABLE_THREAD_SUPPORT_
+	if(aws_iot_mqtt_internal_io_enter(pClient)) {
+		/* The RX thread yields all the time, the publish goes to the TX thread instead */
+		rc = _aws_iot_mqtt_internal_queue_publish(pClient, pTopicName, topicNameLen, pParams, NULL, NULL, true);
+		aws_iot_mqtt_internal_io_leave(pClient);
+		FUNC_EXIT_RC(rc);
+	}
+#endif
+
 	clientState = aws_iot_mqtt_get_client_state(pClient);
 	if(CLIENT_STATE_CONNECTED_IDLE != clientState && CLIENT_STATE_CONNECTED_WAIT_FOR_CB_RETURN != clientState) {
 		FUNC_EXIT_RC(MQTT_CLIENT_NOT_IDLE_ERROR);
@@ -293,6 +592,520 @@ IoT_Error_t aws_iot_mqtt_publish(AWS_IoT_Client *pClient, const char *pTopicName
 	FUNC_EXIT_RC(pubRc);
 }
 
+/**
+ * @brief Send the PUBLISH packet for an in-flight slot
+ *
+ * Sends the publish from the memory referenced by the slot and restarts its retry timer.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pSlot In-flight slot to send
+ * @param dup MQTT dup flag, set when this is a retransmission
+ *
+ * @return An IoT Error Type defining successful/failed send
+ */
+static IoT_Error_t _aws_iot_mqtt_internal_send_inflight_publish(AWS_IoT_Client *pClient, InflightPublish *pSlot,
+																 uint8_t dup) {
+	Timer timer;
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	init_timer(&timer);
+	countdown_ms(&timer, pClient->clientData.commandTimeoutMs);
+
+	countdown_ms(&(pSlot->retryTimer), AWS_IOT_MQTT_PUBLISH_RETRY_INTERVAL_MS);
+	rc = _aws_iot_mqtt_internal_send_publish(pClient, dup, pSlot->pTopicName, pSlot->topicNameLen,
+											 &(pSlot->params), 0 == dup, &timer);
+
+	FUNC_EXIT_RC(rc);
+}
+
+/**
+ * @brief Publish an MQTT message on a topic without waiting for the PUBACK
+ *
+ * Called to publish an MQTT message on a topic.
+ * @note Call is non-blocking. QoS 1 messages are added to the in-flight window and
+ * completed from yield when the PUBACK arrives.
+ * This is the outer function which does the validations and client state changes
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pTopicName Topic Name to publish to
+ * @param topicNameLen Length of the topic name
+ * @param pParams Pointer to Publish Message parameters
+ * @param pCompleteHandler Handler called once the publish is complete, can be NULL
+ * @param pCompleteHandlerData Data to be passed as argument to the completion handler
+ *
+ * @return An IoT Error Type defining successful/failed publish
+ */
+IoT_Error_t aws_iot_mqtt_publish_async(AWS_IoT_Client *pClient, const char *pTopicName, uint16_t topicNameLen,
+									   IoT_Publish_Message_Params *pParams,
+									   pPublishCompleteHandler_t pCompleteHandler, void *pCompleteHandlerData) {
+	IoT_Error_t rc, pubRc;
+	ClientState clientState;
+	InflightPublish *pSlot;
+	Timer timer;
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || NULL == pTopicName || 0 == topicNameLen || NULL == pParams) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	if(!aws_iot_mqtt_is_client_connected(pClient)) {
+		FUNC_EXIT_RC(NETWORK_DISCONNECTED_ERROR);
+	}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	if(aws_iot_mqtt_internal_io_enter(pClient)) {
+		rc = _aws_iot_mqtt_internal_queue_publish(pClient, pTopicName, topicNameLen, pParams, pCompleteHandler,
+												  pCompleteHandlerData, false);
+		aws_iot_mqtt_internal_io_leave(pClient);
+		FUNC_EXIT_RC(rc);
+	}
+#endif
+
+	clientState = aws_iot_mqtt_get_client_state(pClient);
+	if(CLIENT_STATE_CONNECTED_IDLE != clientState && CLIENT_STATE_CONNECTED_WAIT_FOR_CB_RETURN != clientState) {
+		FUNC_EXIT_RC(MQTT_CLIENT_NOT_IDLE_ERROR);
+	}
+
+	pSlot = NULL;
+	if(QOS1 == pParams->qos) {
+		pSlot = _aws_iot_mqtt_internal_reserve_inflight_slot(pClient, &(pParams->id));
+		if(NULL == pSlot) {
+			FUNC_EXIT_RC(MQTT_MAX_INFLIGHT_PUBLISHES_REACHED_ERROR);
+		}
+	}
+
+	rc = aws_iot_mqtt_set_client_state(pClient, clientState, CLIENT_STATE_CONNECTED_PUBLISH_IN_PROGRESS);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+
+	if(NULL != pSlot) {
+		pSlot->pTopicName = pTopicName;
+		pSlot->topicNameLen = topicNameLen;
+		pSlot->params = *pParams;
+		pSlot->pCompleteHandler = pCompleteHandler;
+		pSlot->pCompleteHandlerData = pCompleteHandlerData;
+		pSlot->isInUse = true;
+		pClient->clientData.inflightPublishCount++;
+
+		/* A publish that could not be sent is not tracked, the caller gets the error instead */
+		pubRc = _aws_iot_mqtt_internal_send_inflight_publish(pClient, pSlot, 0);
+		if(SUCCESS != pubRc) {
+			pSlot->isInUse = false;
+			pClient->clientData.inflightPublishCount--;
+		}
+	} else {
+		init_timer(&timer);
+		countdown_ms(&timer, pClient->clientData.commandTimeoutMs);
+		pubRc = _aws_iot_mqtt_internal_send_publish(pClient, 0, pTopicName, topicNameLen, pParams, true, &timer);
+	}
+
+	rc = aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_CONNECTED_PUBLISH_IN_PROGRESS, clientState);
+	if(SUCCESS == pubRc && SUCCESS != rc) {
+		pubRc = rc;
+	}
+
+	if(NULL == pSlot && SUCCESS == pubRc && NULL != pCompleteHandler) {
+		pCompleteHandler(pClient, pParams->id, SUCCESS, pCompleteHandlerData);
+	}
+
+	FUNC_EXIT_RC(pubRc);
+}
+
+/**
+ * @brief Release the in-flight slots of batch entries that did not reach the network
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pEntries Batch entries
+ * @param firstEntry Index of the first entry to release
+ * @param endEntry Index behind the last entry to release
+ */
+static void _aws_iot_mqtt_internal_release_batch_slots(AWS_IoT_Client *pClient, IoT_Publish_Batch_Entry *pEntries,
+													   size_t firstEntry, size_t endEntry) {
+	InflightPublish *pSlot;
+	size_t itr;
+
+	for(itr = firstEntry; itr < endEntry; itr++) {
+		if(QOS1 != pEntries[itr].params.qos) {
+			continue;
+		}
+		pSlot = &(pClient->clientData.inflightPublishes[pEntries[itr].params.id % AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES]);
+		pSlot->isInUse = false;
+		pClient->clientData.inflightPublishCount--;
+	}
+}
+
+/**
+ * @brief Publish several MQTT messages together
+ *
+ * Serializes the messages back to back into the write buffer, which is sent in a single
+ * write, so that they share TLS records. A message too large for the write buffer is sent
+ * on its own. This is the internal function which is called by the publish batch API to
+ * perform the operation. Not meant to be called directly as it doesn't do validations or
+ * client state changes
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pEntries Messages to publish
+ * @param entryCount Number of messages
+ * @param pCompleteHandler Handler called once each publish is complete, can be NULL
+ * @param pCompleteHandlerData Data to be passed as argument to the completion handler
+ *
+ * @return An IoT Error Type defining successful/failed publish
+ */
+static IoT_Error_t _aws_iot_mqtt_internal_publish_batch(AWS_IoT_Client *pClient, IoT_Publish_Batch_Entry *pEntries,
+														size_t entryCount, pPublishCompleteHandler_t pCompleteHandler,
+														void *pCompleteHandlerData) {
+	unsigned char header[PUBLISH_MAX_HEADER_LENGTH];
+	IoT_IoVec_t vectors[PUBLISH_MAX_VECTORS];
+	IoT_IoVec_t packed;
+	size_t itr, vectorItr, vectorCount, packetLen, firstUnsentEntry, endEntry;
+	InflightPublish *pSlot;
+	Timer timer;
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	init_timer(&timer);
+	countdown_ms(&timer, pClient->clientData.commandTimeoutMs);
+
+	packed.pBase = pClient->clientData.writeBuf;
+	packed.len = 0;
+	firstUnsentEntry = 0;
+	endEntry = 0;
+	rc = SUCCESS;
+
+	for(itr = 0; itr < entryCount && SUCCESS == rc; itr++) {
+		endEntry = itr + 1;
+		if(QOS1 == pEntries[itr].params.qos) {
+			pSlot = _aws_iot_mqtt_internal_reserve_inflight_slot(pClient, &(pEntries[itr].params.id));
+			pSlot->pTopicName = pEntries[itr].pTopicName;
+			pSlot->topicNameLen = pEntries[itr].topicNameLen;
+			pSlot->params = pEntries[itr].params;
+			pSlot->pCompleteHandler = pCompleteHandler;
+			pSlot->pCompleteHandlerData = pCompleteHandlerData;
+			pSlot->isInUse = true;
+			pClient->clientData.inflightPublishCount++;
+			countdown_ms(&(pSlot->retryTimer), AWS_IOT_MQTT_PUBLISH_RETRY_INTERVAL_MS);
+		}
+
+		rc = _aws_iot_mqtt_internal_serialize_publish(header, sizeof(header), 0, pEntries[itr].params.qos,
+													  pEntries[itr].params.isRetained, pEntries[itr].params.id,
+													  pEntries[itr].pTopicName, pEntries[itr].topicNameLen,
+													  (unsigned char *) pEntries[itr].params.payload,
+													  pEntries[itr].params.payloadLen, vectors, &vectorCount);
+		if(SUCCESS != rc) {
+			break;
+		}
+
+		packetLen = 0;
+		for(vectorItr = 0; vectorItr < vectorCount; vectorItr++) {
+			packetLen += vectors[vectorItr].len;
+		}
+
+		if(packed.len + packetLen > pClient->clientData.writeBufSize && 0 < packed.len) {
+			rc = aws_iot_mqtt_internal_send_vectors(pClient, &packed, 1, &timer);
+			if(SUCCESS != rc) {
+				break;
+			}
+			packed.len = 0;
+			firstUnsentEntry = itr;
+		}
+
+		if(packetLen > pClient->clientData.writeBufSize) {
+			rc = aws_iot_mqtt_internal_send_vectors(pClient, vectors, vectorCount, &timer);
+			if(SUCCESS == rc) {
+				firstUnsentEntry = itr + 1;
+			}
+			continue;
+		}
+
+		for(vectorItr = 0; vectorItr < vectorCount; vectorItr++) {
+			memcpy(pClient->clientData.writeBuf + packed.len, vectors[vectorItr].pBase, vectors[vectorItr].len);
+			packed.len += vectors[vectorItr].len;
+		}
+	}
+
+	if(SUCCESS == rc && 0 < packed.len) {
+		rc = aws_iot_mqtt_internal_send_vectors(pClient, &packed, 1, &timer);
+	}
+
+	if(SUCCESS != rc) {
+		/* Entries that reached the network stay in flight, the rest is not tracked */
+		_aws_iot_mqtt_internal_release_batch_slots(pClient, pEntries, firstUnsentEntry, endEntry);
+		FUNC_EXIT_RC(rc);
+	}
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+/**
+ * @brief Publish several MQTT messages together
+ *
+ * Called to publish a batch of MQTT messages, packed so that they share TLS records.
+ * @note Call is non-blocking. QoS 1 messages are added to the in-flight window and
+ * completed from yield when the PUBACK arrives.
+ * This is the outer function which does the validations and calls the internal publish batch above
+ * to perform the actual operation. It is also responsible for client state changes
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pEntries Messages to publish
+ * @param entryCount Number of messages
+ * @param pCompleteHandler Handler called once each publish is complete, can be NULL
+ * @param pCompleteHandlerData Data to be passed as argument to the completion handler
+ *
+ * @return An IoT Error Type defining successful/failed publish
+ */
+IoT_Error_t aws_iot_mqtt_publish_batch(AWS_IoT_Client *pClient, IoT_Publish_Batch_Entry *pEntries, size_t entryCount,
+									   pPublishCompleteHandler_t pCompleteHandler, void *pCompleteHandlerData) {
+	IoT_Error_t rc, pubRc;
+	ClientState clientState;
+	size_t itr, qos1Count;
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || NULL == pEntries || 0 == entryCount) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	qos1Count = 0;
+	for(itr = 0; itr < entryCount; itr++) {
+		if(NULL == pEntries[itr].pTopicName || 0 == pEntries[itr].topicNameLen) {
+			FUNC_EXIT_RC(NULL_VALUE_ERROR);
+		}
+		if(QOS1 == pEntries[itr].params.qos) {
+			qos1Count++;
+		}
+	}
+
+	if(!aws_iot_mqtt_is_client_connected(pClient)) {
+		FUNC_EXIT_RC(NETWORK_DISCONNECTED_ERROR);
+	}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	if(aws_iot_mqtt_internal_io_enter(pClient)) {
+		/* Entries are queued one by one, the TX thread sends them back to back */
+		rc = SUCCESS;
+		for(itr = 0; SUCCESS == rc && itr < entryCount; itr++) {
+			rc = _aws_iot_mqtt_internal_queue_publish(pClient, pEntries[itr].pTopicName, pEntries[itr].topicNameLen,
+													  &(pEntries[itr].params), pCompleteHandler,
+													  pCompleteHandlerData, false);
+		}
+		aws_iot_mqtt_internal_io_leave(pClient);
+		FUNC_EXIT_RC(rc);
+	}
+#endif
+
+	clientState = aws_iot_mqtt_get_client_state(pClient);
+	if(CLIENT_STATE_CONNECTED_IDLE != clientState && CLIENT_STATE_CONNECTED_WAIT_FOR_CB_RETURN != clientState) {
+		FUNC_EXIT_RC(MQTT_CLIENT_NOT_IDLE_ERROR);
+	}
+
+	/* The whole batch has to fit in the in-flight window */
+	if(pClient->clientData.inflightPublishCount + qos1Count > AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES) {
+		FUNC_EXIT_RC(MQTT_MAX_INFLIGHT_PUBLISHES_REACHED_ERROR);
+	}
+
+	rc = aws_iot_mqtt_set_client_state(pClient, clientState, CLIENT_STATE_CONNECTED_PUBLISH_IN_PROGRESS);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+
+	pubRc = _aws_iot_mqtt_internal_publish_batch(pClient, pEntries, entryCount, pCompleteHandler,
+												 pCompleteHandlerData);
+
+	rc = aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_CONNECTED_PUBLISH_IN_PROGRESS, clientState);
+	if(SUCCESS == pubRc && SUCCESS != rc) {
+		pubRc = rc;
+	}
+
+	if(SUCCESS == pubRc && NULL != pCompleteHandler) {
+		for(itr = 0; itr < entryCount; itr++) {
+			if(QOS1 != pEntries[itr].params.qos) {
+				pCompleteHandler(pClient, pEntries[itr].params.id, SUCCESS, pCompleteHandlerData);
+			}
+		}
+	}
+
+	FUNC_EXIT_RC(pubRc);
+}
+
+/**
+ * @brief Match a received PUBACK against the in-flight window
+ *
+ * Called from cycle read with the PUBACK in the read buffer. If the packet id belongs
+ * to an asynchronous publish, the slot is released and its completion handler is called.
+ * Otherwise the PUBACK is left for a blocking publish waiting on it.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pIsConsumed Set to true if the PUBACK completed an asynchronous publish
+ *
+ * @return An IoT Error Type defining successful/failed processing
+ */
+IoT_Error_t aws_iot_mqtt_internal_handle_inflight_puback(AWS_IoT_Client *pClient, bool *pIsConsumed) {
+	unsigned char type, dup;
+	uint16_t packetId;
+	InflightPublish *pSlot;
+	pPublishCompleteHandler_t pCompleteHandler;
+	void *pCompleteHandlerData;
+	ClientState clientState;
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	*pIsConsumed = false;
+
+	rc = aws_iot_mqtt_internal_deserialize_ack(&type, &dup, &packetId, pClient->clientData.readBuf,
+											   pClient->clientData.readBufSize);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+
+	_aws_iot_mqtt_internal_lock_inflight(pClient);
+	pSlot = &(pClient->clientData.inflightPublishes[packetId % AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES]);
+	if(!pSlot->isInUse || packetId != pSlot->params.id) {
+		_aws_iot_mqtt_internal_unlock_inflight(pClient);
+		FUNC_EXIT_RC(SUCCESS);
+	}
+
+	/* Release the slot before the callback so the handler can publish again */
+	pCompleteHandler = pSlot->pCompleteHandler;
+	pCompleteHandlerData = pSlot->pCompleteHandlerData;
+	pSlot->isInUse = false;
+	pSlot->pTopicName = NULL;
+	pClient->clientData.inflightPublishCount--;
+	_aws_iot_mqtt_internal_unlock_inflight(pClient);
+	*pIsConsumed = true;
+
+	if(NULL == pCompleteHandler) {
+		FUNC_EXIT_RC(SUCCESS);
+	}
+
+	clientState = aws_iot_mqtt_get_client_state(pClient);
+	rc = aws_iot_mqtt_set_client_state(pClient, clientState, CLIENT_STATE_CONNECTED_WAIT_FOR_CB_RETURN);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+	timer_release_now();
+	pCompleteHandler(pClient, packetId, SUCCESS, pCompleteHandlerData);
+	rc = aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_CONNECTED_WAIT_FOR_CB_RETURN, clientState);
+
+	FUNC_EXIT_RC(rc);
+}
+
+/**
+ * @brief Retransmit unacknowledged asynchronous publishes
+ *
+ * Every in-flight publish whose retry timer has expired is sent again with the DUP flag set.
+ * After a reconnect all of them are sent regardless of their timers.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param isForced Retransmit all in-flight publishes without checking the retry timers
+ *
+ * @return An IoT Error Type defining successful/failed retransmission
+ */
+IoT_Error_t aws_iot_mqtt_internal_resend_inflight_publishes(AWS_IoT_Client *pClient, bool isForced) {
+	uint32_t itr;
+	InflightPublish *pSlot;
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	/* A blocking publish that timed out releases its slot under the lock, so the
+	 * topic and payload a slot refers to stay valid while it is sent */
+	rc = SUCCESS;
+	_aws_iot_mqtt_internal_lock_inflight(pClient);
+	for(itr = 0; itr < AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES && 0 < pClient->clientData.inflightPublishCount; ++itr) {
+		pSlot = &(pClient->clientData.inflightPublishes[itr]);
+		if(!pSlot->isInUse || (!isForced && !has_timer_expired(&(pSlot->retryTimer)))) {
+			continue;
+		}
+
+		rc = _aws_iot_mqtt_internal_send_inflight_publish(pClient, pSlot, 1);
+		if(SUCCESS != rc) {
+			break;
+		}
+	}
+	_aws_iot_mqtt_internal_unlock_inflight(pClient);
+
+	FUNC_EXIT_RC(rc);
+}
+
+/**
+ * @brief Fail every publish of the in-flight window
+ *
+ * Called once the publishes can no longer be acknowledged: on a disconnect requested by the
+ * application, on a lost connection that is not reconnected automatically and when the client
+ * is freed. The slots are released before the completion handlers are called, so topic and
+ * payload can be released by the handlers.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param status Status passed to the completion handlers
+ */
+void aws_iot_mqtt_internal_abort_inflight_publishes(AWS_IoT_Client *pClient, IoT_Error_t status) {
+	InflightPublish aborted[AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES];
+	uint32_t itr, abortedCount;
+	InflightPublish *pSlot;
+
+	abortedCount = 0;
+	_aws_iot_mqtt_internal_lock_inflight(pClient);
+	for(itr = 0; itr < AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES && 0 < pClient->clientData.inflightPublishCount; ++itr) {
+		pSlot = &(pClient->clientData.inflightPublishes[itr]);
+		if(!pSlot->isInUse) {
+			continue;
+		}
+
+		aborted[abortedCount++] = *pSlot;
+		pSlot->isInUse = false;
+		pSlot->pTopicName = NULL;
+		pClient->clientData.inflightPublishCount--;
+	}
+	_aws_iot_mqtt_internal_unlock_inflight(pClient);
+
+	/* Called from yield, where the time of the pass is cached */
+	timer_release_now();
+	for(itr = 0; itr < abortedCount; ++itr) {
+		if(NULL != aborted[itr].pCompleteHandler) {
+			aborted[itr].pCompleteHandler(pClient, aborted[itr].params.id, status, aborted[itr].pCompleteHandlerData);
+		}
+	}
+}
+
+/**
+ * @brief Time until the next in-flight publish is due to be sent again
+ *
+ * @param pClient Reference to the IoT Client
+ * @param maxWait_ms Value returned when no retry is due sooner
+ *
+ * @return Milliseconds until the earliest retry timer expires, at most maxWait_ms
+ */
+uint32_t aws_iot_mqtt_internal_next_inflight_retry_ms(AWS_IoT_Client *pClient, uint32_t maxWait_ms) {
+	uint32_t itr, retry_ms;
+	InflightPublish *pSlot;
+
+	_aws_iot_mqtt_internal_lock_inflight(pClient);
+	for(itr = 0; itr < AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISHES && 0 < pClient->clientData.inflightPublishCount; ++itr) {
+		pSlot = &(pClient->clientData.inflightPublishes[itr]);
+		if(!pSlot->isInUse) {
+			continue;
+		}
+
+		retry_ms = left_ms(&(pSlot->retryTimer));
+		if(retry_ms < maxWait_ms) {
+			maxWait_ms = retry_ms;
+		}
+	}
+	_aws_iot_mqtt_internal_unlock_inflight(pClient);
+
+	return maxWait_ms;
+}
+
 /**
   * Deserializes the supplied (wire) buffer into publish data
   * @param dup returned uint8_t - the MQTT dup flag
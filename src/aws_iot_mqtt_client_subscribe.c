@@ -168,21 +168,6 @@ static IoT_Error_t _aws_iot_mqtt_deserialize_suback(uint16_t *pPacketId, uint32_
 	FUNC_EXIT_RC(SUCCESS);
 }
 
-/* Returns MAX_MESSAGE_HANDLERS value if no free index is available */
-static uint32_t _aws_iot_mqtt_get_free_message_handler_index(AWS_IoT_Client *pClient) {
-	uint32_t itr;
-
-	FUNC_ENTRY;
-
-	for(itr = 0; itr < AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS; itr++) {
-		if(pClient->clientData.messageHandlers[itr].topicName == NULL) {
-			break;
-		}
-	}
-
-	FUNC_EXIT_RC(itr);
-}
-
 /**
  * @brief Subscribe to an MQTT topic.
  *
@@ -196,15 +181,19 @@ static uint32_t _aws_iot_mqtt_get_free_message_handler_index(AWS_IoT_Client *pCl
  * @param pTopicName Topic Name to publish to
  * @param topicNameLen Length of the topic name
  * @param pApplicationHandler_t Reference to the handler function for this subscription
+ * @param pStreamChunkHandler Reference to the chunk handler of a streaming subscription
+ * @param pStreamCompleteHandler Reference to the completion handler of a streaming subscription
  *
  * @return An IoT Error Type defining successful/failed subscription
  */
 static IoT_Error_t _aws_iot_mqtt_internal_subscribe(AWS_IoT_Client *pClient, const char *pTopicName,
 													uint16_t topicNameLen, QoS qos,
 													pApplicationHandler_t pApplicationHandler,
+													pStreamChunkHandler_t pStreamChunkHandler,
+													pStreamCompleteHandler_t pStreamCompleteHandler,
 													void *pApplicationHandlerData) {
 	uint16_t txPacketId, rxPacketId;
-	uint32_t serializedLen, indexOfFreeMessageHandler, count;
+	uint32_t serializedLen, count, handlerIndex;
 	IoT_Error_t rc;
 	Timer timer;
 	QoS grantedQoS[3] = {QOS0, QOS0, QOS0};
@@ -224,27 +213,32 @@ static IoT_Error_t _aws_iot_mqtt_internal_subscribe(AWS_IoT_Client *pClient, con
 		FUNC_EXIT_RC(rc);
 	}
 
-	indexOfFreeMessageHandler = _aws_iot_mqtt_get_free_message_handler_index(pClient);
-	if(AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS <= indexOfFreeMessageHandler) {
-		FUNC_EXIT_RC(MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR);
+	/* The handler is registered up front so that the subscription table is known to have room for it.
+	 * Only this handler is removed again if the broker does not acknowledge the subscription, the filter
+	 * may have other handlers the broker acknowledged before */
+	rc = aws_iot_mqtt_internal_add_subscription(pClient, pTopicName, topicNameLen, qos, pApplicationHandler,
+												pStreamChunkHandler, pStreamCompleteHandler, pApplicationHandlerData,
+												&handlerIndex);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
 	}
 
 	/* send the subscribe packet */
 	rc = aws_iot_mqtt_internal_send_packet(pClient, serializedLen, &timer);
-	if(SUCCESS != rc) {
-		FUNC_EXIT_RC(rc);
-	}
 
 	/* wait for suback */
-	rc = aws_iot_mqtt_internal_wait_for_read(pClient, SUBACK, &timer);
-	if(SUCCESS != rc) {
-		FUNC_EXIT_RC(rc);
+	if(SUCCESS == rc) {
+		rc = aws_iot_mqtt_internal_wait_for_read(pClient, SUBACK, &timer);
 	}
 
 	/* Granted QoS can be 0, 1 or 2 */
-	rc = _aws_iot_mqtt_deserialize_suback(&rxPacketId, 1, &count, grantedQoS, pClient->clientData.readBuf,
-										  pClient->clientData.readBufSize);
+	if(SUCCESS == rc) {
+		rc = _aws_iot_mqtt_deserialize_suback(&rxPacketId, 1, &count, grantedQoS, pClient->clientData.readBuf,
+											  pClient->clientData.readBufSize);
+	}
+
 	if(SUCCESS != rc) {
+		aws_iot_mqtt_internal_remove_subscription_handler(pClient, handlerIndex);
 		FUNC_EXIT_RC(rc);
 	}
 
@@ -255,46 +249,35 @@ static IoT_Error_t _aws_iot_mqtt_internal_subscribe(AWS_IoT_Client *pClient, con
 	//	return RX_MESSAGE_INVALID_ERROR;
 	//}
 
-	pClient->clientData.messageHandlers[indexOfFreeMessageHandler].topicName =
-			pTopicName;
-	pClient->clientData.messageHandlers[indexOfFreeMessageHandler].topicNameLen =
-			topicNameLen;
-	pClient->clientData.messageHandlers[indexOfFreeMessageHandler].pApplicationHandler =
-			pApplicationHandler;
-	pClient->clientData.messageHandlers[indexOfFreeMessageHandler].pApplicationHandlerData =
-			pApplicationHandlerData;
-	pClient->clientData.messageHandlers[indexOfFreeMessageHandler].qos = qos;
-
 	FUNC_EXIT_RC(SUCCESS);
 }
 
 /**
  * @brief Subscribe to an MQTT topic.
  *
- * Called to send a subscribe message to the broker requesting a subscription
- * to an MQTT topic. This is the outer function which does the validations and
- * calls the internal subscribe above to perform the actual operation.
- * It is also responsible for client state changes
+ * Does the validations and client state changes shared by the subscribe APIs
+ * and calls the internal subscribe above to perform the actual operation.
  * @note Call is blocking.  The call returns after the receipt of the SUBACK control packet.
  *
  * @param pClient Reference to the IoT Client
  * @param pTopicName Topic Name to publish to
  * @param topicNameLen Length of the topic name
  * @param pApplicationHandler_t Reference to the handler function for this subscription
+ * @param pStreamChunkHandler Reference to the chunk handler of a streaming subscription
+ * @param pStreamCompleteHandler Reference to the completion handler of a streaming subscription
  *
  * @return An IoT Error Type defining successful/failed subscription
  */
-IoT_Error_t aws_iot_mqtt_subscribe(AWS_IoT_Client *pClient, const char *pTopicName, uint16_t topicNameLen,
-								   QoS qos, pApplicationHandler_t pApplicationHandler, void *pApplicationHandlerData) {
+static IoT_Error_t _aws_iot_mqtt_subscribe(AWS_IoT_Client *pClient, const char *pTopicName, uint16_t topicNameLen,
+										   QoS qos, pApplicationHandler_t pApplicationHandler,
+										   pStreamChunkHandler_t pStreamChunkHandler,
+										   pStreamCompleteHandler_t pStreamCompleteHandler,
+										   void *pApplicationHandlerData) {
 	ClientState clientState;
 	IoT_Error_t rc, subRc;
 
 	FUNC_ENTRY;
 
-	if(NULL == pClient || NULL == pTopicName || NULL == pApplicationHandler) {
-		FUNC_EXIT_RC(NULL_VALUE_ERROR);
-	}
-
 	if(!aws_iot_mqtt_is_client_connected(pClient)) {
 		FUNC_EXIT_RC(NETWORK_DISCONNECTED_ERROR);
 	}
@@ -309,8 +292,8 @@ IoT_Error_t aws_iot_mqtt_subscribe(AWS_IoT_Client *pClient, const char *pTopicNa
 		FUNC_EXIT_RC(rc);
 	}
 
-	subRc = _aws_iot_mqtt_internal_subscribe(pClient, pTopicName, topicNameLen, qos,
-											 pApplicationHandler, pApplicationHandlerData);
+	subRc = _aws_iot_mqtt_internal_subscribe(pClient, pTopicName, topicNameLen, qos, pApplicationHandler,
+											 pStreamChunkHandler, pStreamCompleteHandler, pApplicationHandlerData);
 
 	rc = aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_CONNECTED_SUBSCRIBE_IN_PROGRESS, clientState);
 	if(SUCCESS == subRc && SUCCESS != rc) {
@@ -320,6 +303,72 @@ IoT_Error_t aws_iot_mqtt_subscribe(AWS_IoT_Client *pClient, const char *pTopicNa
 	FUNC_EXIT_RC(subRc);
 }
 
+/**
+ * @brief Subscribe to an MQTT topic.
+ *
+ * Called to send a subscribe message to the broker requesting a subscription
+ * to an MQTT topic. This is the outer function which does the validations and
+ * calls the internal subscribe above to perform the actual operation.
+ * It is also responsible for client state changes
+ * @note Call is blocking.  The call returns after the receipt of the SUBACK control packet.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pTopicName Topic Name to publish to
+ * @param topicNameLen Length of the topic name
+ * @param pApplicationHandler_t Reference to the handler function for this subscription
+ *
+ * @return An IoT Error Type defining successful/failed subscription
+ */
+IoT_Error_t aws_iot_mqtt_subscribe(AWS_IoT_Client *pClient, const char *pTopicName, uint16_t topicNameLen,
+								   QoS qos, pApplicationHandler_t pApplicationHandler, void *pApplicationHandlerData) {
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || NULL == pTopicName || NULL == pApplicationHandler) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	rc = _aws_iot_mqtt_subscribe(pClient, pTopicName, topicNameLen, qos, pApplicationHandler, NULL, NULL,
+								 pApplicationHandlerData);
+
+	FUNC_EXIT_RC(rc);
+}
+
+/**
+ * @brief Subscribe to an MQTT topic and receive its messages in chunks.
+ *
+ * Called to send a subscribe message to the broker requesting a subscription
+ * to an MQTT topic. Payloads are handed to pChunkHandler as they are read, so
+ * messages larger than the read buffer are received instead of dropped
+ * @note Call is blocking.  The call returns after the receipt of the SUBACK control packet.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pTopicName Topic Name to publish to
+ * @param topicNameLen Length of the topic name
+ * @param pChunkHandler Reference to the function handling each payload chunk
+ * @param pCompleteHandler Reference to the function called once a message is complete, can be NULL
+ * @param pHandlerData Data to be passed as argument to both callbacks
+ *
+ * @return An IoT Error Type defining successful/failed subscription
+ */
+IoT_Error_t aws_iot_mqtt_subscribe_streaming(AWS_IoT_Client *pClient, const char *pTopicName, uint16_t topicNameLen,
+											 QoS qos, pStreamChunkHandler_t pChunkHandler,
+											 pStreamCompleteHandler_t pCompleteHandler, void *pHandlerData) {
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || NULL == pTopicName || NULL == pChunkHandler) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	rc = _aws_iot_mqtt_subscribe(pClient, pTopicName, topicNameLen, qos, NULL, pChunkHandler, pCompleteHandler,
+								 pHandlerData);
+
+	FUNC_EXIT_RC(rc);
+}
+
 /**
  * @brief Subscribe to an MQTT topic.
  *
@@ -335,27 +384,31 @@ IoT_Error_t aws_iot_mqtt_subscribe(AWS_IoT_Client *pClient, const char *pTopicNa
  */
 static IoT_Error_t _aws_iot_mqtt_internal_resubscribe(AWS_IoT_Client *pClient) {
 	uint16_t packetId;
-	uint32_t len, count, existingSubCount, itr;
+	uint32_t len, count, itr;
 	IoT_Error_t rc;
 	Timer timer;
 	QoS grantedQoS[3] = {QOS0, QOS0, QOS0};
+	MessageHandlers *pHandler;
 
 	FUNC_ENTRY;
 
 	packetId = 0;
 	len = 0;
 	count = 0;
-	existingSubCount = _aws_iot_mqtt_get_free_message_handler_index(pClient);
 
-	for(itr = 0; itr < existingSubCount; itr++) {
+	for(itr = 0; itr < pClient->clientData.subscriptions.maxSubscriptions; itr++) {
+		pHandler = &(pClient->clientData.subscriptions.pHandlers[itr]);
+		if(NULL == pHandler->topicName || pHandler->isPendingRemoval) {
+			continue;
+		}
+
 		init_timer(&timer);
 		countdown_ms(&timer, pClient->clientData.commandTimeoutMs);
 
 		rc = _aws_iot_mqtt_serialize_subscribe(pClient->clientData.writeBuf, pClient->clientData.writeBufSize, 0,
 											   aws_iot_mqtt_get_next_packet_id(pClient), 1,
-											   &(pClient->clientData.messageHandlers[itr].topicName),
-											   &(pClient->clientData.messageHandlers[itr].topicNameLen),
-											   &(pClient->clientData.messageHandlers[itr].qos), &len);
+											   &(pHandler->topicName), &(pHandler->topicNameLen),
+											   &(pHandler->qos), &len);
 		if(SUCCESS != rc) {
 			FUNC_EXIT_RC(rc);
 		}
@@ -0,0 +1,699 @@
+/*
+* Copyright 2015-2016 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License").
+* You may not use this file except in compliance with the License.
+* A copy of the License is located at
+*
+* http://aws.amazon.com/apache2.0
+*
+* or in the "license" file accompanying this file. This file is distributed
+* on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+* express or implied. See the License for the specific language governing
+* permissions and limitations under the License.
+*/
+
+/**
+ * @file aws_iot_mqtt_client_subscription_index.c
+ * @brief MQTT client subscription table and incoming message dispatch
+ *
+ * Topic filters without wildcards are kept in a hash table keyed by the full topic,
+ * so an incoming publish is matched with one hash and one compare. Filters containing
+ * '+' or '#' are kept in a trie with one node per topic level, so matching costs one
+ * step per level of the incoming topic instead of one full compare per subscription.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "aws_iot_mqtt_client_common_internal.h"
+
+#define SUBSCRIPTION_INDEX_NONE 0xFFFFFFFFu
+
+#define TOPIC_LEVEL_SEPARATOR '/'
+#define TOPIC_SINGLE_LEVEL_WILDCARD '+'
+#define TOPIC_MULTI_LEVEL_WILDCARD '#'
+
+/* What a dispatch hands to every matching handler */
+typedef struct {
+	char *pTopicName;
+	uint16_t topicNameLen;
+	IoT_Publish_Message_Params *pMessageParams;
+	MessageStream *pStream;		/* NULL for a message held completely in the read buffer */
+	bool isStreamComplete;
+	IoT_Error_t streamStatus;
+#ifdef _ENABLE_THREAD_SUPPORT_
+	DispatchMessage *pPooledMessage;	/* Set when the handlers are called by the dispatch pool */
+#endif
+} DispatchContext;
+
+/* Nodes other than the root are kept in a hash table keyed by parent and topic level,
+ * so finding a child costs the same however many children a level has */
+struct _SubscriptionTrieNode {
+	SubscriptionTrieNode *pParent;
+	SubscriptionTrieNode *pNextInBucket;
+	SubscriptionTrieNode *pSingleLevelChild;	/* Child for a '+' topic level */
+	uint32_t childCount;
+	uint32_t levelHash;
+	uint32_t firstHandlerIndex;			/* Filters ending at this level */
+	uint32_t firstMultiLevelHandlerIndex;		/* Filters ending with '#' after this level */
+	uint16_t levelLen;
+	char level[];
+};
+
+static uint32_t _aws_iot_mqtt_subscription_hash(const char *pStr, uint16_t len) {
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+	uint16_t itr;
+
+	for(itr = 0; itr < len; itr++) {
+		hash ^= (unsigned char) pStr[itr];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static bool _aws_iot_mqtt_is_wildcard_filter(const char *pTopicFilter, uint16_t topicFilterLen) {
+	return NULL != memchr(pTopicFilter, TOPIC_SINGLE_LEVEL_WILDCARD, topicFilterLen)
+		   || NULL != memchr(pTopicFilter, TOPIC_MULTI_LEVEL_WILDCARD, topicFilterLen);
+}
+
+/* Returns the length of the topic level starting at pLevel */
+static uint16_t _aws_iot_mqtt_topic_level_len(const char *pLevel, const char *pEnd) {
+	const char *pSeparator = memchr(pLevel, TOPIC_LEVEL_SEPARATOR, (size_t) (pEnd - pLevel));
+
+	return (uint16_t) ((NULL == pSeparator ? pEnd : pSeparator) - pLevel);
+}
+
+static bool _aws_iot_mqtt_is_same_topic(MessageHandlers *pHandler, const char *pTopic, uint16_t topicLen) {
+	return NULL != pHandler->topicName && topicLen == pHandler->topicNameLen
+		   && 0 == memcmp(pHandler->topicName, pTopic, topicLen);
+}
+
+static SubscriptionTrieNode **_aws_iot_mqtt_trie_bucket(AWS_IoT_Client *pClient, SubscriptionTrieNode *pParent,
+														uint32_t levelHash) {
+	SubscriptionIndex *pIndex = &(pClient->clientData.subscriptions);
+	uint32_t parentHash = (uint32_t) (((uintptr_t) pParent >> 3) * 2654435761u);
+
+	return &(pIndex->pNodeBuckets[(levelHash ^ parentHash) & pIndex->bucketMask]);
+}
+
+static SubscriptionTrieNode *_aws_iot_mqtt_trie_find_child(AWS_IoT_Client *pClient, SubscriptionTrieNode *pNode,
+														   const char *pLevel, uint16_t levelLen, uint32_t levelHash) {
+	SubscriptionTrieNode *pChild;
+
+	if(1 == levelLen && TOPIC_SINGLE_LEVEL_WILDCARD == pLevel[0]) {
+		return pNode->pSingleLevelChild;
+	}
+
+	if(0 == pNode->childCount) {
+		return NULL;
+	}
+
+	for(pChild = *_aws_iot_mqtt_trie_bucket(pClient, pNode, levelHash); NULL != pChild;
+		pChild = pChild->pNextInBucket) {
+		if(pNode == pChild->pParent && levelHash == pChild->levelHash && levelLen == pChild->levelLen
+		   && 0 == memcmp(pChild->level, pLevel, levelLen)) {
+			return pChild;
+		}
+	}
+
+	return NULL;
+}
+
+static SubscriptionTrieNode *_aws_iot_mqtt_trie_new_node(AWS_IoT_Client *pClient, SubscriptionTrieNode *pParent,
+														 const char *pLevel, uint16_t levelLen, uint32_t levelHash) {
+	SubscriptionTrieNode *pNode, **ppBucket;
+
+	pNode = (SubscriptionTrieNode *) aws_iot_mqtt_internal_malloc(pClient, sizeof(SubscriptionTrieNode) + levelLen);
+	if(NULL == pNode) {
+		return NULL;
+	}
+
+	pNode->pParent = pParent;
+	pNode->pNextInBucket = NULL;
+	pNode->pSingleLevelChild = NULL;
+	pNode->childCount = 0;
+	pNode->levelHash = levelHash;
+	pNode->firstHandlerIndex = SUBSCRIPTION_INDEX_NONE;
+	pNode->firstMultiLevelHandlerIndex = SUBSCRIPTION_INDEX_NONE;
+	pNode->levelLen = levelLen;
+	if(0 < levelLen) {
+		memcpy(pNode->level, pLevel, levelLen);
+	}
+
+	if(NULL != pParent) {
+		ppBucket = _aws_iot_mqtt_trie_bucket(pClient, pParent, levelHash);
+		pNode->pNextInBucket = *ppBucket;
+		*ppBucket = pNode;
+		pParent->childCount++;
+		if(1 == levelLen && TOPIC_SINGLE_LEVEL_WILDCARD == pLevel[0]) {
+			pParent->pSingleLevelChild = pNode;
+		}
+	}
+
+	return pNode;
+}
+
+/* Frees empty nodes from pNode up towards the root, the root itself is kept */
+static void _aws_iot_mqtt_trie_prune(AWS_IoT_Client *pClient, SubscriptionTrieNode *pNode) {
+	SubscriptionTrieNode *pParent, **ppLink;
+
+	while(NULL != pNode->pParent && 0 == pNode->childCount
+		  && SUBSCRIPTION_INDEX_NONE == pNode->firstHandlerIndex
+		  && SUBSCRIPTION_INDEX_NONE == pNode->firstMultiLevelHandlerIndex) {
+		pParent = pNode->pParent;
+		for(ppLink = _aws_iot_mqtt_trie_bucket(pClient, pParent, pNode->levelHash); *ppLink != pNode;
+			ppLink = &((*ppLink)->pNextInBucket)) {
+		}
+		*ppLink = pNode->pNextInBucket;
+		pParent->childCount--;
+		if(pParent->pSingleLevelChild == pNode) {
+			pParent->pSingleLevelChild = NULL;
+		}
+		aws_iot_mqtt_internal_free(pClient, pNode);
+		pNode = pParent;
+	}
+}
+
+/**
+ * @brief Find the handler list a topic filter belongs to
+ *
+ * @param pClient Reference to the IoT Client
+ * @param pTopicFilter Topic filter
+ * @param topicFilterLen Length of the topic filter
+ * @param isCreate Create missing trie nodes on the way
+ * @param ppNode Returns the trie node owning the list, NULL for exact topic filters
+ *
+ * @return Pointer to the head index of the list, NULL if it does not exist and isCreate is false
+ */
+static uint32_t *_aws_iot_mqtt_find_handler_list(AWS_IoT_Client *pClient, const char *pTopicFilter,
+												 uint16_t topicFilterLen, bool isCreate,
+												 SubscriptionTrieNode **ppNode) {
+	SubscriptionIndex *pIndex = &(pClient->clientData.subscriptions);
+	SubscriptionTrieNode *pNode, *pChild;
+	const char *pLevel, *pEnd;
+	uint16_t levelLen;
+	uint32_t levelHash;
+
+	*ppNode = NULL;
+
+	if(!_aws_iot_mqtt_is_wildcard_filter(pTopicFilter, topicFilterLen)) {
+		return &(pIndex->pBuckets[_aws_iot_mqtt_subscription_hash(pTopicFilter, topicFilterLen)
+								  & pIndex->bucketMask]);
+	}
+
+	if(NULL == pIndex->pWildcardRoot) {
+		if(!isCreate) {
+			return NULL;
+		}
+		pIndex->pWildcardRoot = _aws_iot_mqtt_trie_new_node(pClient, NULL, NULL, 0, 0);
+		if(NULL == pIndex->pWildcardRoot) {
+			return NULL;
+		}
+	}
+
+	pNode = pIndex->pWildcardRoot;
+	pLevel = pTopicFilter;
+	pEnd = pTopicFilter + topicFilterLen;
+
+	while(true) {
+		levelLen = _aws_iot_mqtt_topic_level_len(pLevel, pEnd);
+		if(1 == levelLen && TOPIC_MULTI_LEVEL_WILDCARD == pLevel[0] && pLevel + 1 == pEnd) {
+			*ppNode = pNode;
+			return &(pNode->firstMultiLevelHandlerIndex);
+		}
+
+		levelHash = _aws_iot_mqtt_subscription_hash(pLevel, levelLen);
+		pChild = _aws_iot_mqtt_trie_find_child(pClient, pNode, pLevel, levelLen, levelHash);
+		if(NULL == pChild) {
+			if(!isCreate) {
+				return NULL;
+			}
+			pChild = _aws_iot_mqtt_trie_new_node(pClient, pNode, pLevel, levelLen, levelHash);
+			if(NULL == pChild) {
+				_aws_iot_mqtt_trie_prune(pClient, pNode);
+				return NULL;
+			}
+		}
+		pNode = pChild;
+
+		pLevel += levelLen;
+		if(pLevel == pEnd) {
+			*ppNode = pNode;
+			return &(pNode->firstHandlerIndex);
+		}
+		pLevel++; /* skip the separator */
+	}
+}
+
+/* Unlinks every handler of the list that matches pTopicFilter, or is pending removal if pTopicFilter is NULL */
+static bool _aws_iot_mqtt_unlink_handlers(AWS_IoT_Client *pClient, uint32_t *pListHead, const char *pTopicFilter,
+										  uint16_t topicFilterLen) {
+	SubscriptionIndex *pIndex = &(pClient->clientData.subscriptions);
+	MessageHandlers *pHandler;
+	uint32_t *pLink, handlerIndex;
+	bool isRemoved = false;
+
+	pLink = pListHead;
+	while(SUBSCRIPTION_INDEX_NONE != *pLink) {
+		handlerIndex = *pLink;
+		pHandler = &(pIndex->pHandlers[handlerIndex]);
+		if((NULL == pTopicFilter && pHandler->isPendingRemoval)
+		   || (NULL != pTopicFilter && _aws_iot_mqtt_is_same_topic(pHandler, pTopicFilter, topicFilterLen))) {
+			*pLink = pHandler->nextIndex;
+			pHandler->topicName = NULL;
+			if(NULL != pHandler->pStreamChunkHandler) {
+				pIndex->streamingCount--;
+			}
+			pHandler->pApplicationHandler = NULL;
+			pHandler->pStreamChunkHandler = NULL;
+			pHandler->pStreamCompleteHandler = NULL;
+			pHandler->pApplicationHandlerData = NULL;
+			pHandler->isPendingRemoval = false;
+			pHandler->nextIndex = pIndex->freeIndex;
+			pIndex->freeIndex = handlerIndex;
+			isRemoved = true;
+		} else {
+			pLink = &(pHandler->nextIndex);
+		}
+	}
+
+	return isRemoved;
+}
+
+/* Removes the handlers of one topic filter from the index, and prunes the trie */
+static bool _aws_iot_mqtt_remove_handlers(AWS_IoT_Client *pClient, const char *pTopicFilter, uint16_t topicFilterLen,
+										  bool isPendingOnly) {
+	SubscriptionTrieNode *pNode;
+	uint32_t *pListHead;
+	bool isRemoved;
+
+	pListHead = _aws_iot_mqtt_find_handler_list(pClient, pTopicFilter, topicFilterLen, false, &pNode);
+	if(NULL == pListHead) {
+		return false;
+	}
+
+	isRemoved = _aws_iot_mqtt_unlink_handlers(pClient, pListHead, isPendingOnly ? NULL : pTopicFilter,
+											  topicFilterLen);
+	if(NULL != pNode) {
+		_aws_iot_mqtt_trie_prune(pClient, pNode);
+	}
+
+	return isRemoved;
+}
+
+static void _aws_iot_mqtt_call_handler(AWS_IoT_Client *pClient, MessageHandlers *pHandler,
+									   const DispatchContext *pContext) {
+	IoT_Publish_Message_Params *pParams = pContext->pMessageParams;
+	MessageStream *pStream = pContext->pStream;
+
+	/* A packet taken from the read buffer was read without releasing the time cached by yield */
+	timer_release_now();
+	if(NULL == pStream) {
+#ifdef _ENABLE_THREAD_SUPPORT_
+		if(NULL != pContext->pPooledMessage && NULL != pHandler->pApplicationHandler) {
+			aws_iot_mqtt_internal_queue_dispatch_job(pClient, pContext->pPooledMessage,
+													 pHandler->pApplicationHandler,
+													 pHandler->pApplicationHandlerData);
+			return;
+		}
+#endif
+		if(NULL != pHandler->pApplicationHandler) {
+			pHandler->pApplicationHandler(pClient, pContext->pTopicName, pContext->topicNameLen, pParams,
+										  pHandler->pApplicationHandlerData);
+		} else if(NULL != pHandler->pStreamChunkHandler) {
+			/* A message that fits the read buffer is streamed as a single chunk */
+			pHandler->pStreamChunkHandler(pClient, pContext->pTopicName, pContext->topicNameLen, pParams, 0,
+										  pParams->payloadLen, pHandler->pApplicationHandlerData);
+			if(NULL != pHandler->pStreamCompleteHandler) {
+				pHandler->pStreamCompleteHandler(pClient, pContext->pTopicName, pContext->topicNameLen, pParams,
+												 SUCCESS, pHandler->pApplicationHandlerData);
+			}
+		}
+		return;
+	}
+
+	/* Handlers for whole messages never see a partial one */
+	if(pContext->isStreamComplete) {
+		if(NULL != pHandler->pStreamCompleteHandler) {
+			pHandler->pStreamCompleteHandler(pClient, pContext->pTopicName, pContext->topicNameLen, pParams,
+											 pContext->streamStatus, pHandler->pApplicationHandlerData);
+		}
+	} else if(NULL != pHandler->pStreamChunkHandler) {
+		pHandler->pStreamChunkHandler(pClient, pContext->pTopicName, pContext->topicNameLen, pParams,
+									  pStream->payloadOffset, pStream->payloadTotalLen,
+									  pHandler->pApplicationHandlerData);
+	}
+}
+
+static void _aws_iot_mqtt_call_handlers(AWS_IoT_Client *pClient, uint32_t handlerIndex,
+										const DispatchContext *pContext, bool isExactMatch) {
+	MessageHandlers *pHandler;
+
+	while(SUBSCRIPTION_INDEX_NONE != handlerIndex) {
+		pHandler = &(pClient->clientData.subscriptions.pHandlers[handlerIndex]);
+		if(!pHandler->isPendingRemoval && NULL != pHandler->topicName
+		   && (!isExactMatch || _aws_iot_mqtt_is_same_topic(pHandler, pContext->pTopicName,
+															 pContext->topicNameLen))) {
+			_aws_iot_mqtt_call_handler(pClient, pHandler, pContext);
+		}
+		handlerIndex = pHandler->nextIndex;
+	}
+}
+
+static void _aws_iot_mqtt_trie_dispatch(AWS_IoT_Client *pClient, SubscriptionTrieNode *pNode, const char *pLevel,
+										const DispatchContext *pContext) {
+	const char *pEnd = pContext->pTopicName + pContext->topicNameLen;
+	SubscriptionTrieNode *pChild;
+	uint16_t levelLen;
+
+	/* '#' matches the parent level as well as every level below it */
+	_aws_iot_mqtt_call_handlers(pClient, pNode->firstMultiLevelHandlerIndex, pContext, false);
+
+	if(NULL == pLevel) {
+		_aws_iot_mqtt_call_handlers(pClient, pNode->firstHandlerIndex, pContext, false);
+		return;
+	}
+
+	levelLen = _aws_iot_mqtt_topic_level_len(pLevel, pEnd);
+	pChild = _aws_iot_mqtt_trie_find_child(pClient, pNode, pLevel, levelLen,
+										   _aws_iot_mqtt_subscription_hash(pLevel, levelLen));
+	pLevel = (pLevel + levelLen == pEnd) ? NULL : pLevel + levelLen + 1;
+
+	if(NULL != pChild && pChild != pNode->pSingleLevelChild) {
+		_aws_iot_mqtt_trie_dispatch(pClient, pChild, pLevel, pContext);
+	}
+	if(NULL != pNode->pSingleLevelChild) {
+		_aws_iot_mqtt_trie_dispatch(pClient, pNode->pSingleLevelChild, pLevel, pContext);
+	}
+}
+
+/* Completes the removals deferred while a dispatch was in progress */
+static void _aws_iot_mqtt_remove_pending_handlers(AWS_IoT_Client *pClient) {
+	SubscriptionIndex *pIndex = &(pClient->clientData.subscriptions);
+	MessageHandlers *pHandler;
+	uint32_t itr;
+
+	for(itr = 0; itr < pIndex->maxSubscriptions; itr++) {
+		pHandler = &(pIndex->pHandlers[itr]);
+		if(pHandler->isPendingRemoval) {
+			_aws_iot_mqtt_remove_handlers(pClient, pHandler->topicName, pHandler->topicNameLen, true);
+		}
+	}
+
+	pIndex->isRemovalPending = false;
+}
+
+IoT_Error_t aws_iot_mqtt_internal_init_subscriptions(AWS_IoT_Client *pClient, uint32_t maxSubscriptions) {
+	SubscriptionIndex *pIndex = &(pClient->clientData.subscriptions);
+	uint32_t itr, bucketCount;
+
+	FUNC_ENTRY;
+
+	if(0 == maxSubscriptions || SUBSCRIPTION_INDEX_NONE == maxSubscriptions) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	bucketCount = 1;
+	while(bucketCount < maxSubscriptions && bucketCount < 0x80000000u) {
+		bucketCount <<= 1;
+	}
+
+	pIndex->pHandlers = (MessageHandlers *) aws_iot_mqtt_internal_malloc(pClient,
+																		 maxSubscriptions * sizeof(MessageHandlers));
+	pIndex->pBuckets = (uint32_t *) aws_iot_mqtt_internal_malloc(pClient, bucketCount * sizeof(uint32_t));
+	pIndex->pNodeBuckets = (SubscriptionTrieNode **) aws_iot_mqtt_internal_malloc(
+			pClient, bucketCount * sizeof(SubscriptionTrieNode *));
+	if(NULL == pIndex->pHandlers || NULL == pIndex->pBuckets || NULL == pIndex->pNodeBuckets) {
+		aws_iot_mqtt_internal_free(pClient, pIndex->pHandlers);
+		aws_iot_mqtt_internal_free(pClient, pIndex->pBuckets);
+		aws_iot_mqtt_internal_free(pClient, pIndex->pNodeBuckets);
+		pIndex->pHandlers = NULL;
+		pIndex->pBuckets = NULL;
+		pIndex->pNodeBuckets = NULL;
+		FUNC_EXIT_RC(MQTT_MEMORY_ALLOCATION_ERROR);
+	}
+
+	for(itr = 0; itr < maxSubscriptions; itr++) {
+		pIndex->pHandlers[itr].topicName = NULL;
+		pIndex->pHandlers[itr].topicNameLen = 0;
+		pIndex->pHandlers[itr].qos = QOS0;
+		pIndex->pHandlers[itr].pApplicationHandler = NULL;
+		pIndex->pHandlers[itr].pStreamChunkHandler = NULL;
+		pIndex->pHandlers[itr].pStreamCompleteHandler = NULL;
+		pIndex->pHandlers[itr].pApplicationHandlerData = NULL;
+		pIndex->pHandlers[itr].isPendingRemoval = false;
+		pIndex->pHandlers[itr].nextIndex = (itr + 1 < maxSubscriptions) ? itr + 1 : SUBSCRIPTION_INDEX_NONE;
+	}
+	for(itr = 0; itr < bucketCount; itr++) {
+		pIndex->pBuckets[itr] = SUBSCRIPTION_INDEX_NONE;
+		pIndex->pNodeBuckets[itr] = NULL;
+	}
+
+	pIndex->maxSubscriptions = maxSubscriptions;
+	pIndex->bucketMask = bucketCount - 1;
+	pIndex->freeIndex = 0;
+	pIndex->pWildcardRoot = NULL;
+	pIndex->dispatchDepth = 0;
+	pIndex->streamingCount = 0;
+	pIndex->isRemovalPending = false;
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+void aws_iot_mqtt_internal_free_subscriptions(AWS_IoT_Client *pClient) {
+	SubscriptionIndex *pIndex = &(pClient->clientData.subscriptions);
+	SubscriptionTrieNode *pNode, *pNext;
+	uint32_t itr;
+
+	if(NULL != pIndex->pNodeBuckets) {
+		for(itr = 0; itr <= pIndex->bucketMask; itr++) {
+			for(pNode = pIndex->pNodeBuckets[itr]; NULL != pNode; pNode = pNext) {
+				pNext = pNode->pNextInBucket;
+				aws_iot_mqtt_internal_free(pClient, pNode);
+			}
+		}
+	}
+	aws_iot_mqtt_internal_free(pClient, pIndex->pWildcardRoot);
+	aws_iot_mqtt_internal_free(pClient, pIndex->pHandlers);
+	aws_iot_mqtt_internal_free(pClient, pIndex->pBuckets);
+	aws_iot_mqtt_internal_free(pClient, pIndex->pNodeBuckets);
+
+	pIndex->pHandlers = NULL;
+	pIndex->pBuckets = NULL;
+	pIndex->pNodeBuckets = NULL;
+	pIndex->pWildcardRoot = NULL;
+	pIndex->maxSubscriptions = 0;
+	pIndex->streamingCount = 0;
+	pIndex->freeIndex = SUBSCRIPTION_INDEX_NONE;
+}
+
+IoT_Error_t aws_iot_mqtt_internal_add_subscription(AWS_IoT_Client *pClient, const char *pTopicFilter,
+												   uint16_t topicFilterLen, QoS qos,
+												   pApplicationHandler_t pApplicationHandler,
+												   pStreamChunkHandler_t pStreamChunkHandler,
+												   pStreamCompleteHandler_t pStreamCompleteHandler,
+												   void *pApplicationHandlerData, uint32_t *pHandlerIndex) {
+	SubscriptionIndex *pIndex = &(pClient->clientData.subscriptions);
+	SubscriptionTrieNode *pNode;
+	MessageHandlers *pHandler;
+	uint32_t *pListHead, handlerIndex;
+
+	FUNC_ENTRY;
+
+	if(SUBSCRIPTION_INDEX_NONE == pIndex->freeIndex) {
+		FUNC_EXIT_RC(MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR);
+	}
+
+	pListHead = _aws_iot_mqtt_find_handler_list(pClient, pTopicFilter, topicFilterLen, true, &pNode);
+	if(NULL == pListHead) {
+		FUNC_EXIT_RC(MQTT_MEMORY_ALLOCATION_ERROR);
+	}
+
+	handlerIndex = pIndex->freeIndex;
+	pHandler = &(pIndex->pHandlers[handlerIndex]);
+	pIndex->freeIndex = pHandler->nextIndex;
+
+	pHandler->topicName = pTopicFilter;
+	pHandler->topicNameLen = topicFilterLen;
+	pHandler->qos = qos;
+	pHandler->pApplicationHandler = pApplicationHandler;
+	pHandler->pStreamChunkHandler = pStreamChunkHandler;
+	pHandler->pStreamCompleteHandler = pStreamCompleteHandler;
+	pHandler->pApplicationHandlerData = pApplicationHandlerData;
+	pHandler->isPendingRemoval = false;
+	if(NULL != pStreamChunkHandler) {
+		pIndex->streamingCount++;
+	}
+
+	/* Prepending keeps a dispatch in progress from seeing handlers added by its callbacks */
+	pHandler->nextIndex = *pListHead;
+	*pListHead = handlerIndex;
+
+	if(NULL != pHandlerIndex) {
+		*pHandlerIndex = handlerIndex;
+	}
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+bool aws_iot_mqtt_internal_has_subscription(AWS_IoT_Client *pClient, const char *pTopicFilter,
+											uint16_t topicFilterLen) {
+	SubscriptionTrieNode *pNode;
+	MessageHandlers *pHandler;
+	uint32_t *pListHead, handlerIndex;
+
+	pListHead = _aws_iot_mqtt_find_handler_list(pClient, pTopicFilter, topicFilterLen, false, &pNode);
+	if(NULL == pListHead) {
+		return false;
+	}
+
+	for(handlerIndex = *pListHead; SUBSCRIPTION_INDEX_NONE != handlerIndex; handlerIndex = pHandler->nextIndex) {
+		pHandler = &(pClient->clientData.subscriptions.pHandlers[handlerIndex]);
+		if(!pHandler->isPendingRemoval && _aws_iot_mqtt_is_same_topic(pHandler, pTopicFilter, topicFilterLen)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+IoT_Error_t aws_iot_mqtt_internal_remove_subscription(AWS_IoT_Client *pClient, const char *pTopicFilter,
+													  uint16_t topicFilterLen) {
+	SubscriptionIndex *pIndex = &(pClient->clientData.subscriptions);
+	SubscriptionTrieNode *pNode;
+	MessageHandlers *pHandler;
+	uint32_t *pListHead, handlerIndex;
+	bool isRemoved = false;
+
+	FUNC_ENTRY;
+
+	if(0 == pIndex->dispatchDepth) {
+		/* Every handler registered for the filter is removed, in case the same topic
+		 * is registered with 2 callbacks. Unlikely scenario */
+		isRemoved = _aws_iot_mqtt_remove_handlers(pClient, pTopicFilter, topicFilterLen, false);
+		FUNC_EXIT_RC(isRemoved ? SUCCESS : FAILURE);
+	}
+
+	/* A dispatch is walking the lists, only mark the handlers until it returns */
+	pListHead = _aws_iot_mqtt_find_handler_list(pClient, pTopicFilter, topicFilterLen, false, &pNode);
+	if(NULL != pListHead) {
+		for(handlerIndex = *pListHead; SUBSCRIPTION_INDEX_NONE != handlerIndex; handlerIndex = pHandler->nextIndex) {
+			pHandler = &(pIndex->pHandlers[handlerIndex]);
+			if(_aws_iot_mqtt_is_same_topic(pHandler, pTopicFilter, topicFilterLen)) {
+				pHandler->isPendingRemoval = true;
+				pIndex->isRemovalPending = true;
+				isRemoved = true;
+			}
+		}
+	}
+
+	FUNC_EXIT_RC(isRemoved ? SUCCESS : FAILURE);
+}
+
+IoT_Error_t aws_iot_mqtt_internal_remove_subscription_handler(AWS_IoT_Client *pClient, uint32_t handlerIndex) {
+	SubscriptionIndex *pIndex = &(pClient->clientData.subscriptions);
+	MessageHandlers *pHandler;
+
+	FUNC_ENTRY;
+
+	if(handlerIndex >= pIndex->maxSubscriptions || NULL == pIndex->pHandlers[handlerIndex].topicName) {
+		FUNC_EXIT_RC(FAILURE);
+	}
+
+	/* Only this handler is marked, the others registered for the same filter stay */
+	pHandler = &(pIndex->pHandlers[handlerIndex]);
+	pHandler->isPendingRemoval = true;
+	if(0 == pIndex->dispatchDepth) {
+		_aws_iot_mqtt_remove_handlers(pClient, pHandler->topicName, pHandler->topicNameLen, true);
+	} else {
+		pIndex->isRemovalPending = true;
+	}
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
+static void _aws_iot_mqtt_dispatch(AWS_IoT_Client *pClient, const DispatchContext *pContext) {
+	SubscriptionIndex *pIndex = &(pClient->clientData.subscriptions);
+
+	if(NULL == pIndex->pHandlers) {
+		return;
+	}
+
+	pIndex->dispatchDepth++;
+
+	_aws_iot_mqtt_call_handlers(pClient, pIndex->pBuckets[_aws_iot_mqtt_subscription_hash(pContext->pTopicName,
+																						   pContext->topicNameLen)
+														  & pIndex->bucketMask],
+								pContext, true);
+
+	if(NULL != pIndex->pWildcardRoot) {
+		_aws_iot_mqtt_trie_dispatch(pClient, pIndex->pWildcardRoot, pContext->pTopicName, pContext);
+	}
+
+	pIndex->dispatchDepth--;
+
+	if(0 == pIndex->dispatchDepth && pIndex->isRemovalPending) {
+		_aws_iot_mqtt_remove_pending_handlers(pClient);
+	}
+}
+
+void aws_iot_mqtt_internal_dispatch_message(AWS_IoT_Client *pClient, char *pTopicName, uint16_t topicNameLen,
+											IoT_Publish_Message_Params *pMessageParams) {
+	DispatchContext context;
+
+	context.pTopicName = pTopicName;
+	context.topicNameLen = topicNameLen;
+	context.pMessageParams = pMessageParams;
+	context.pStream = NULL;
+	context.isStreamComplete = false;
+	context.streamStatus = SUCCESS;
+#ifdef _ENABLE_THREAD_SUPPORT_
+	context.pPooledMessage = NULL;
+#endif
+
+	_aws_iot_mqtt_dispatch(pClient, &context);
+}
+
+void aws_iot_mqtt_internal_dispatch_stream(AWS_IoT_Client *pClient, MessageStream *pStream, bool isComplete,
+										   IoT_Error_t status) {
+	DispatchContext context;
+
+	context.pTopicName = pStream->pTopicName;
+	context.topicNameLen = pStream->topicNameLen;
+	context.pMessageParams = &(pStream->params);
+	context.pStream = pStream;
+	context.isStreamComplete = isComplete;
+	context.streamStatus = status;
+#ifdef _ENABLE_THREAD_SUPPORT_
+	context.pPooledMessage = NULL;
+#endif
+
+	_aws_iot_mqtt_dispatch(pClient, &context);
+}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+void aws_iot_mqtt_internal_dispatch_pooled_message(AWS_IoT_Client *pClient, DispatchMessage *pMessage) {
+	DispatchContext context;
+
+	context.pTopicName = pMessage->pTopicName;
+	context.topicNameLen = pMessage->topicNameLen;
+	context.pMessageParams = &(pMessage->params);
+	context.pStream = NULL;
+	context.isStreamComplete = false;
+	context.streamStatus = SUCCESS;
+	context.pPooledMessage = pMessage;
+
+	pMessage->laneIndex = _aws_iot_mqtt_subscription_hash(pMessage->pTopicName, pMessage->topicNameLen)
+						  % AWS_IOT_MQTT_DISPATCH_LANES;
+
+	_aws_iot_mqtt_dispatch(pClient, &context);
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -136,21 +136,11 @@ static IoT_Error_t _aws_iot_mqtt_internal_unsubscribe(AWS_IoT_Client *pClient, c
 	Timer timer;
 
 	uint32_t serializedLen = 0;
-	uint32_t i = 0;
 	IoT_Error_t rc;
-	bool subscriptionExists = false;
 
 	FUNC_ENTRY;
 
-	/* Remove from message handler array */
-	for(i = 0; i < AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS; ++i) {
-		if(pClient->clientData.messageHandlers[i].topicName != NULL &&
-		   (strcmp(pClient->clientData.messageHandlers[i].topicName, pTopicFilter) == 0)) {
-			subscriptionExists = true;
-		}
-	}
-
-	if(false == subscriptionExists) {
+	if(!aws_iot_mqtt_internal_has_subscription(pClient, pTopicFilter, topicFilterLen)) {
 		FUNC_EXIT_RC(FAILURE);
 	}
 
@@ -181,17 +171,10 @@ static IoT_Error_t _aws_iot_mqtt_internal_unsubscribe(AWS_IoT_Client *pClient, c
 		FUNC_EXIT_RC(rc);
 	}
 
-	/* Remove from message handler array */
-	for(i = 0; i < AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS; ++i) {
-		if(pClient->clientData.messageHandlers[i].topicName != NULL &&
-		   (strcmp(pClient->clientData.messageHandlers[i].topicName, pTopicFilter) == 0)) {
-			pClient->clientData.messageHandlers[i].topicName = NULL;
-			/* We don't want to break here, in case the same topic is registered
-             * with 2 callbacks. Unlikely scenario */
-		}
-	}
+	/* Remove from the subscription table */
+	rc = aws_iot_mqtt_internal_remove_subscription(pClient, pTopicFilter, topicFilterLen);
 
-	FUNC_EXIT_RC(SUCCESS);
+	FUNC_EXIT_RC(rc);
 }
 
 /**
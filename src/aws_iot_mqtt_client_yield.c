@@ -46,8 +46,7 @@ extern "C" {
   */
 static void _aws_iot_mqtt_force_client_disconnect(AWS_IoT_Client *pClient) {
 	pClient->clientStatus.clientState = CLIENT_STATE_DISCONNECTED_ERROR;
-	pClient->networkStack.disconnect(&(pClient->networkStack));
-	pClient->networkStack.destroy(&(pClient->networkStack));
+	aws_iot_mqtt_internal_close_network(pClient);
 }
 
 static IoT_Error_t _aws_iot_mqtt_handle_disconnect(AWS_IoT_Client *pClient) {
@@ -55,13 +54,20 @@ static IoT_Error_t _aws_iot_mqtt_handle_disconnect(AWS_IoT_Client *pClient) {
 
 	FUNC_ENTRY;
 
-	rc = aws_iot_mqtt_disconnect(pClient);
+	rc = aws_iot_mqtt_internal_disconnect_keep_inflight(pClient);
 	if(rc != SUCCESS) {
 		// If the aws_iot_mqtt_internal_send_packet prevents us from sending a disconnect packet then we have to clean the stack
 		_aws_iot_mqtt_force_client_disconnect(pClient);
 	}
 
+	/* In-flight publishes are only sent again by an automatic reconnect */
+	if(!pClient->clientStatus.isAutoReconnectEnabled) {
+		aws_iot_mqtt_internal_abort_inflight_publishes(pClient, NETWORK_DISCONNECTED_ERROR);
+	}
+
 	if(NULL != pClient->clientData.disconnectHandler) {
+		/* Timers the handler arms or checks read the clock */
+		timer_release_now();
 		pClient->clientData.disconnectHandler(pClient, pClient->clientData.disconnectHandlerData);
 	}
 
@@ -71,12 +77,43 @@ static IoT_Error_t _aws_iot_mqtt_handle_disconnect(AWS_IoT_Client *pClient) {
 }
 
 
-static IoT_Error_t _aws_iot_mqtt_handle_reconnect(AWS_IoT_Client *pClient) {
+/**
+ * @brief Start the network connect of a reconnect, or take the one in progress forward
+ *
+ * Used by the client manager, which calls again when the socket of the connect is ready
+ * or the time given by the connectLeftMs function of the network has passed.
+ *
+ * @param pClient Reference to the IoT Client
+ *
+ * @return SUCCESS once connected, NETWORK_CONNECT_IN_PROGRESS while waiting for the socket,
+ *         or the error that ended the connect
+ */
+static IoT_Error_t _aws_iot_mqtt_advance_network_connect(AWS_IoT_Client *pClient) {
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	timer_release_now();
+	if(pClient->clientStatus.isNetworkConnecting) {
+		rc = pClient->networkStack.connectContinue(&(pClient->networkStack));
+	} else {
+		rc = pClient->networkStack.connectStart(&(pClient->networkStack), NULL);
+	}
+
+	pClient->clientStatus.isNetworkConnecting = (NETWORK_CONNECT_IN_PROGRESS == rc);
+	if(SUCCESS != rc && NETWORK_CONNECT_IN_PROGRESS != rc) {
+		aws_iot_mqtt_internal_close_network(pClient);
+	}
+
+	FUNC_EXIT_RC(rc);
+}
+
+static IoT_Error_t _aws_iot_mqtt_handle_reconnect(AWS_IoT_Client *pClient, bool isNonBlocking) {
 	IoT_Error_t rc;
 
 	FUNC_ENTRY;
 
-	if(!has_timer_expired(&(pClient->reconnectDelayTimer))) {
+	if(!pClient->clientStatus.isNetworkConnecting && !has_timer_expired(&(pClient->reconnectDelayTimer))) {
 		/* Timer has not expired. Not time to attempt reconnect yet.
 		 * Return attempting reconnect */
 		FUNC_EXIT_RC(NETWORK_ATTEMPTING_RECONNECT);
@@ -88,7 +125,18 @@ static IoT_Error_t _aws_iot_mqtt_handle_reconnect(AWS_IoT_Client *pClient) {
 	}
 
 	if(NETWORK_PHYSICAL_LAYER_CONNECTED == rc) {
-		rc = aws_iot_mqtt_attempt_reconnect(pClient);
+		if(isNonBlocking && NULL != pClient->networkStack.connectStart) {
+			/* The thread is not held up by the TCP connect and the TLS handshake */
+			rc = _aws_iot_mqtt_advance_network_connect(pClient);
+			if(NETWORK_CONNECT_IN_PROGRESS == rc) {
+				FUNC_EXIT_RC(NETWORK_ATTEMPTING_RECONNECT);
+			}
+			if(SUCCESS == rc) {
+				rc = aws_iot_mqtt_internal_complete_reconnect(pClient);
+			}
+		} else {
+			rc = aws_iot_mqtt_attempt_reconnect(pClient);
+		}
 		if(NETWORK_RECONNECTED == rc) {
 			rc = aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_CONNECTED_IDLE,
 											   CLIENT_STATE_CONNECTED_YIELD_IN_PROGRESS);
@@ -157,6 +205,60 @@ static IoT_Error_t _aws_iot_mqtt_keep_alive(AWS_IoT_Client *pClient) {
 	FUNC_EXIT_RC(SUCCESS);
 }
 
+/**
+ * @brief Time until the next timer the yield loop acts on expires
+ *
+ * Covers the keep alive, sending packed publishes and retransmitting in-flight publishes.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param wait_ms Value returned when no timer expires sooner
+ *
+ * @return Milliseconds the client can wait for data before it has work to do, at most wait_ms
+ */
+static uint32_t _aws_iot_mqtt_next_deadline_ms(AWS_IoT_Client *pClient, uint32_t wait_ms) {
+	uint32_t timer_ms;
+
+	if(0 != pClient->clientData.keepAliveInterval) {
+		timer_ms = left_ms(&(pClient->pingTimer));
+		if(timer_ms < wait_ms) {
+			wait_ms = timer_ms;
+		}
+	}
+
+	if(0 < pClient->clientData.coalesceLen) {
+		timer_ms = left_ms(&(pClient->clientData.coalesceTimer));
+		if(timer_ms < wait_ms) {
+			wait_ms = timer_ms;
+		}
+	}
+
+	return aws_iot_mqtt_internal_next_inflight_retry_ms(pClient, wait_ms);
+}
+
+/**
+ * @brief Block until there is data to read or the wait time is over
+ *
+ * Network layers that cannot wait on their connection return at once and leave the
+ * waiting to the read timeout, as before.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param wait_ms Maximum time to wait in milliseconds
+ *
+ * @return true if the next cycle read may find data
+ */
+static bool _aws_iot_mqtt_wait_for_data(AWS_IoT_Client *pClient, uint32_t wait_ms) {
+	if(NULL == pClient->networkStack.waitReadable) {
+		return true;
+	}
+
+	if(aws_iot_mqtt_internal_is_read_pending(pClient)) {
+		return true;
+	}
+
+	timer_release_now();
+	return SUCCESS == pClient->networkStack.waitReadable(&(pClient->networkStack), wait_ms);
+}
+
 /**
  * @brief Yield to the MQTT client
  *
@@ -166,20 +268,25 @@ static IoT_Error_t _aws_iot_mqtt_keep_alive(AWS_IoT_Client *pClient) {
  * must be called at a rate faster than the keepalive interval.  It must also be called
  * at a rate faster than the incoming message rate as this is the only way the client receives
  * processing time to manage incoming messages.
+ * Between events the thread blocks on the connection until data arrives or the next timer
+ * the client acts on expires.
  * This is the internal function which is called by the yield API to perform the operation.
  * Not meant to be called directly as it doesn't do validations or client state changes
  *
  * @param pClient Reference to the IoT Client
  * @param timeout_ms Maximum number of milliseconds to pass thread execution to the client.
+ * @param isNonBlocking Return as soon as no data is left to read instead of waiting for more
  *
  * @return An IoT Error Type defining successful/failed client processing.
  *         If this call results in an error it is likely the MQTT connection has dropped.
  *         iot_is_mqtt_connected can be called to confirm.
  */
-static IoT_Error_t _aws_iot_mqtt_internal_yield(AWS_IoT_Client *pClient, uint32_t timeout_ms) {
+static IoT_Error_t _aws_iot_mqtt_internal_yield(AWS_IoT_Client *pClient, uint32_t timeout_ms, bool isNonBlocking) {
 	IoT_Error_t yieldRc = SUCCESS;
 
+	bool isDataReady;
 	uint8_t packet_type;
+	uint32_t wait_ms, reconnect_ms;
 	ClientState clientState;
 	Timer timer;
 	init_timer(&timer);
@@ -187,31 +294,62 @@ static IoT_Error_t _aws_iot_mqtt_internal_yield(AWS_IoT_Client *pClient, uint32_
 
 	FUNC_ENTRY;
 
-	while(!has_timer_expired(&timer)) {
+	/* Each pass reads the clock once for all the timers it checks. Network reads and writes
+	 * release the cached time, so nothing waits on it */
+	for(timer_cache_now(); !has_timer_expired(&timer); timer_cache_now()) {
 		clientState = aws_iot_mqtt_get_client_state(pClient);
 		if(CLIENT_STATE_PENDING_RECONNECT == clientState) {
 			if(AWS_IOT_MQTT_MAX_RECONNECT_WAIT_INTERVAL < pClient->clientData.currentReconnectWaitInterval) {
 				yieldRc = NETWORK_RECONNECT_TIMED_OUT_ERROR;
 				break;
 			}
-			yieldRc = _aws_iot_mqtt_handle_reconnect(pClient);
+			yieldRc = _aws_iot_mqtt_handle_reconnect(pClient, isNonBlocking);
+			if(NETWORK_ATTEMPTING_RECONNECT == yieldRc && isNonBlocking) {
+				break;
+			}
+			if(NETWORK_ATTEMPTING_RECONNECT == yieldRc && NULL != pClient->networkStack.waitReadable) {
+				/* Sleep until the next attempt is due instead of polling the backoff timer,
+				 * the network layer waits out the timeout when it has no connection */
+				reconnect_ms = left_ms(&(pClient->reconnectDelayTimer));
+				wait_ms = left_ms(&timer);
+				timer_release_now();
+				pClient->networkStack.waitReadable(&(pClient->networkStack),
+												   (reconnect_ms < wait_ms) ? reconnect_ms : wait_ms);
+			}
 			/* Network reconnect attempted, check if yield timer expired before
 			 * doing anything else */
 			continue;
 		}
 
-		yieldRc = aws_iot_mqtt_internal_cycle_read(pClient, &timer, &packet_type);
+		/* Packed publishes are sent once they waited for publishCoalesceDelay_ms */
+		yieldRc = aws_iot_mqtt_internal_flush_coalesced(pClient, &timer, false);
 		if(SUCCESS != yieldRc) {
 			break;
 		}
 
-		yieldRc = _aws_iot_mqtt_keep_alive(pClient);
+		wait_ms = isNonBlocking ? 0 : _aws_iot_mqtt_next_deadline_ms(pClient, left_ms(&timer));
+		isDataReady = _aws_iot_mqtt_wait_for_data(pClient, wait_ms);
+		if(isDataReady) {
+			yieldRc = aws_iot_mqtt_internal_cycle_read(pClient, &timer, &packet_type);
+			if(NETWORK_SSL_READ_ERROR == yieldRc) {
+				/* The server closed the connection, no need to wait for a ping to go unanswered */
+				yieldRc = _aws_iot_mqtt_handle_disconnect(pClient);
+			} else if(SUCCESS != yieldRc) {
+				break;
+			}
+		}
+
+		if(SUCCESS == yieldRc) {
+			timer_cache_now();
+			yieldRc = _aws_iot_mqtt_keep_alive(pClient);
+		}
 		if(NETWORK_DISCONNECTED_ERROR == yieldRc) {
 			pClient->clientData.counterNetworkDisconnected++;
 			if(1 == pClient->clientStatus.isAutoReconnectEnabled) {
 				yieldRc = aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_DISCONNECTED_ERROR,
 														CLIENT_STATE_PENDING_RECONNECT);
 				if(SUCCESS != yieldRc) {
+					timer_release_now();
 					FUNC_EXIT_RC(yieldRc);
 				}
 
@@ -227,31 +365,31 @@ static IoT_Error_t _aws_iot_mqtt_internal_yield(AWS_IoT_Client *pClient, uint32_
 		} else if(SUCCESS != yieldRc) {
 			break;
 		}
+
+		yieldRc = aws_iot_mqtt_internal_resend_inflight_publishes(pClient, false);
+		if(SUCCESS != yieldRc || (isNonBlocking && !isDataReady)) {
+			break;
+		}
 	}
 
+	timer_release_now();
+
 	FUNC_EXIT_RC(yieldRc);
 }
 
 /**
- * @brief Yield to the MQTT client
+ * @brief Validate the client state and run the internal yield
  *
- * Called to yield the current thread to the underlying MQTT client.  This time is used by
- * the MQTT client to manage PING requests to monitor the health of the TCP connection as
- * well as periodically check the socket receive buffer for subscribe messages.  Yield()
- * must be called at a rate faster than the keepalive interval.  It must also be called
- * at a rate faster than the incoming message rate as this is the only way the client receives
- * processing time to manage incoming messages.
- * This is the outer function which does the validations and calls the internal yield above
- * to perform the actual operation. It is also responsible for client state changes
+ * Does the validations and client state changes of a yield, shared by the yield API and
+ * the client manager.
  *
  * @param pClient Reference to the IoT Client
  * @param timeout_ms Maximum number of milliseconds to pass thread execution to the client.
+ * @param isNonBlocking Return as soon as no data is left to read instead of waiting for more
  *
  * @return An IoT Error Type defining successful/failed client processing.
- *         If this call results in an error it is likely the MQTT connection has dropped.
- *         iot_is_mqtt_connected can be called to confirm.
  */
-IoT_Error_t aws_iot_mqtt_yield(AWS_IoT_Client *pClient, uint32_t timeout_ms) {
+static IoT_Error_t _aws_iot_mqtt_yield(AWS_IoT_Client *pClient, uint32_t timeout_ms, bool isNonBlocking) {
 	IoT_Error_t rc, yieldRc;
 	ClientState clientState;
 
@@ -285,7 +423,7 @@ IoT_Error_t aws_iot_mqtt_yield(AWS_IoT_Client *pClient, uint32_t timeout_ms) {
 		}
 	}
 
-	yieldRc = _aws_iot_mqtt_internal_yield(pClient, timeout_ms);
+	yieldRc = _aws_iot_mqtt_internal_yield(pClient, timeout_ms, isNonBlocking);
 
 	if(NETWORK_DISCONNECTED_ERROR != yieldRc && NETWORK_ATTEMPTING_RECONNECT != yieldRc) {
 		rc = aws_iot_mqtt_set_client_state(pClient, CLIENT_STATE_CONNECTED_YIELD_IN_PROGRESS,
@@ -298,6 +436,72 @@ IoT_Error_t aws_iot_mqtt_yield(AWS_IoT_Client *pClient, uint32_t timeout_ms) {
 	FUNC_EXIT_RC(yieldRc);
 }
 
+/**
+ * @brief Yield to the MQTT client
+ *
+ * Called to yield the current thread to the underlying MQTT client.  This time is used by
+ * the MQTT client to manage PING requests to monitor the health of the TCP connection as
+ * well as periodically check the socket receive buffer for subscribe messages.  Yield()
+ * must be called at a rate faster than the keepalive interval.  It must also be called
+ * at a rate faster than the incoming message rate as this is the only way the client receives
+ * processing time to manage incoming messages.
+ * This is the outer function which does the validations and calls the internal yield above
+ * to perform the actual operation. It is also responsible for client state changes
+ *
+ * @param pClient Reference to the IoT Client
+ * @param timeout_ms Maximum number of milliseconds to pass thread execution to the client.
+ *
+ * @return An IoT Error Type defining successful/failed client processing.
+ *         If this call results in an error it is likely the MQTT connection has dropped.
+ *         iot_is_mqtt_connected can be called to confirm.
+ */
+IoT_Error_t aws_iot_mqtt_yield(AWS_IoT_Client *pClient, uint32_t timeout_ms) {
+	IoT_Error_t rc;
+
+	rc = _aws_iot_mqtt_yield(pClient, timeout_ms, false);
+	FUNC_EXIT_RC(rc);
+}
+
+/**
+ * @brief Do the work that is due for a client without waiting for data
+ *
+ * Reads and handles every packet that has arrived, then runs the keep alive, reconnect and
+ * retransmission timers once. Used by the client manager, which waits for the data instead.
+ * A reconnect connects the network without blocking when the network supports it, each call
+ * takes the connect forward until the TLS handshake is done and the CONNECT is sent.
+ *
+ * @param pClient Reference to the IoT Client
+ * @param maxWait_ms Longest time the client may be left alone
+ * @param pWait_ms Set to the time until the client has timer work to do, at most maxWait_ms
+ *
+ * @return An IoT Error Type defining successful/failed client processing.
+ *         MQTT_CLIENT_NOT_IDLE_ERROR if another operation is in progress on the client.
+ */
+IoT_Error_t aws_iot_mqtt_internal_service(AWS_IoT_Client *pClient, uint32_t maxWait_ms, uint32_t *pWait_ms) {
+	IoT_Error_t rc;
+	ClientState clientState;
+	uint32_t reconnect_ms;
+
+	rc = _aws_iot_mqtt_yield(pClient, AWS_IOT_MQTT_MANAGER_SERVICE_TIMEOUT_MS, true);
+
+	*pWait_ms = maxWait_ms;
+	clientState = aws_iot_mqtt_get_client_state(pClient);
+	if(CLIENT_STATE_PENDING_RECONNECT == clientState) {
+		reconnect_ms = left_ms(&(pClient->reconnectDelayTimer));
+		if(pClient->clientStatus.isNetworkConnecting) {
+			/* Its socket wakes the manager as well */
+			pClient->networkStack.connectLeftMs(&(pClient->networkStack), &reconnect_ms);
+		}
+		if(reconnect_ms < maxWait_ms) {
+			*pWait_ms = reconnect_ms;
+		}
+	} else if(aws_iot_mqtt_is_client_connected(pClient)) {
+		*pWait_ms = _aws_iot_mqtt_next_deadline_ms(pClient, maxWait_ms);
+	}
+
+	FUNC_EXIT_RC(rc);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -33,7 +33,7 @@ extern "C" {
 #include "aws_iot_shadow_records.h"
 
 const ShadowInitParameters_t ShadowInitParametersDefault = {(char *) AWS_IOT_MQTT_HOST, AWS_IOT_MQTT_PORT, NULL, NULL,
-															NULL, false, NULL};
+															NULL, false, NULL, NULL};
 
 const ShadowConnectParameters_t ShadowConnectParametersDefault = {(char *) AWS_IOT_MY_THING_NAME,
 																  (char *) AWS_IOT_MQTT_CLIENT_ID, 0};
@@ -55,7 +55,7 @@ void aws_iot_shadow_disable_discard_old_delta_msgs(void) {
 }
 
 IoT_Error_t aws_iot_shadow_init(AWS_IoT_Client *pClient, ShadowInitParameters_t *pParams) {
-	IoT_Client_Init_Params mqttInitParams;
+	IoT_Client_Init_Params mqttInitParams = iotClientInitParamsDefault;
 	IoT_Error_t rc;
 
 	FUNC_ENTRY;
@@ -74,6 +74,7 @@ IoT_Error_t aws_iot_shadow_init(AWS_IoT_Client *pClient, ShadowInitParameters_t
 	mqttInitParams.tlsHandshakeTimeout_ms = 5000;
 	mqttInitParams.isSSLHostnameVerify = true;
 	mqttInitParams.disconnectHandler = pParams->disconnectHandler;
+	mqttInitParams.pTransportName = pParams->pTransportName;
 
 	rc = aws_iot_mqtt_init(pClient, &mqttInitParams);
 	if(SUCCESS != rc) {
@@ -83,6 +84,7 @@ IoT_Error_t aws_iot_shadow_init(AWS_IoT_Client *pClient, ShadowInitParameters_t
 	resetClientTokenSequenceNum();
 	aws_iot_shadow_reset_last_received_version();
 	initDeltaTokens();
+	initReportedAttributes();
 
 	FUNC_EXIT_RC(SUCCESS);
 }
@@ -141,12 +143,27 @@ IoT_Error_t aws_iot_shadow_register_delta(AWS_IoT_Client *pMqttClient, jsonStruc
 }
 
 IoT_Error_t aws_iot_shadow_yield(AWS_IoT_Client *pClient, uint32_t timeout) {
+	IoT_Error_t rc;
+	Timer yieldTimer;
+	uint32_t slice_ms;
+
 	if(NULL == pClient) {
 		return NULL_VALUE_ERROR;
 	}
 
-	HandleExpiredResponseCallbacks();
-	return aws_iot_mqtt_yield(pClient, timeout);
+	init_timer(&yieldTimer);
+	countdown_ms(&yieldTimer, timeout);
+
+	/* The MQTT yield sleeps until data arrives, so it is cut at the next ack expiry
+	 * for the timeout callback to be called on time */
+	slice_ms = timeout;
+	do {
+		HandleExpiredResponseCallbacks();
+		rc = aws_iot_mqtt_yield(pClient, getTimeToNextAckExpiryMs(slice_ms));
+		slice_ms = left_ms(&yieldTimer);
+	} while(SUCCESS == rc && 0 < slice_ms);
+
+	return rc;
 }
 
 IoT_Error_t aws_iot_shadow_disconnect(AWS_IoT_Client *pClient) {
@@ -172,6 +189,51 @@ IoT_Error_t aws_iot_shadow_update(AWS_IoT_Client *pClient, const char *pThingNam
 	FUNC_EXIT_RC(rc);
 }
 
+IoT_Error_t aws_iot_shadow_register_reported(AWS_IoT_Client *pClient, jsonStruct_t *pStruct, double deadband) {
+	if(NULL == pClient || NULL == pStruct || NULL == pStruct->pKey || NULL == pStruct->pData) {
+		return NULL_VALUE_ERROR;
+	}
+
+	return registerReportedAttribute(pStruct, deadband);
+}
+
+/* The ack of a report has to be waited for to know its values were accepted, even when nobody else needs it */
+static void ignoreReportedAck(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+							  const char *pReceivedJsonDocument, void *pContextData) {
+	IOT_UNUSED(pThingName);
+	IOT_UNUSED(action);
+	IOT_UNUSED(status);
+	IOT_UNUSED(pReceivedJsonDocument);
+	IOT_UNUSED(pContextData);
+}
+
+IoT_Error_t aws_iot_shadow_update_reported(AWS_IoT_Client *pClient, const char *pThingName, char *pJsonString,
+										   size_t maxSizeOfJsonString, fpActionCallback_t callback,
+										   void *pContextData, uint8_t timeout_seconds, bool isPersistentSubscribe) {
+	IoT_Error_t rc;
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || NULL == pThingName || NULL == pJsonString) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	if(!aws_iot_mqtt_is_client_connected(pClient)) {
+		FUNC_EXIT_RC(MQTT_CONNECTION_ERROR);
+	}
+
+	rc = buildReportedDiff(pJsonString, maxSizeOfJsonString);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+
+	rc = aws_iot_shadow_internal_action(pThingName, SHADOW_UPDATE, pJsonString,
+										(NULL != callback) ? callback : ignoreReportedAck, pContextData,
+										timeout_seconds, isPersistentSubscribe);
+
+	FUNC_EXIT_RC(rc);
+}
+
 IoT_Error_t aws_iot_shadow_delete(AWS_IoT_Client *pClient, const char *pThingName, fpActionCallback_t callback,
 								  void *pContextData, uint8_t timeout_seconds, bool isPersistentSubscribe) {
 	char deleteRequestJsonBuf[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
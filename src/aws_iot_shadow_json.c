@@ -31,6 +31,7 @@ extern "C" {
 
 #include <string.h>
 #include <stdbool.h>
+#include <math.h>
 
 #include "aws_iot_json_utils.h"
 #include "aws_iot_log.h"
@@ -41,10 +42,6 @@ extern char mqttClientID[MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES];
 
 static uint32_t clientTokenNum = 0;
 
-//helper functions
-static IoT_Error_t convertDataToString(char *pStringBuffer, size_t maxSizoStringBuffer, JsonPrimitiveType type,
-									   void *pData);
-
 void resetClientTokenSequenceNum(void) {
 	clientTokenNum = 0;
 }
@@ -72,147 +69,404 @@ static inline IoT_Error_t checkReturnValueOfSnPrintf(int32_t snPrintfReturn, siz
 	return SUCCESS;
 }
 
-IoT_Error_t aws_iot_shadow_init_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
+/* Appends text to the document, unless it does not fit with the null terminator */
+static void appendJsonText(jsonBuilder_t *pBuilder, const char *pText, size_t textLen) {
+	if(SUCCESS != pBuilder->rc) {
+		return;
+	}
 
-	IoT_Error_t ret_val = SUCCESS;
-	int32_t snPrintfReturn = 0;
+	if(textLen >= pBuilder->bufferSize - pBuilder->length) {
+		pBuilder->rc = SHADOW_JSON_BUFFER_TRUNCATED;
+		return;
+	}
 
-	if(pJsonDocument == NULL) {
+	memcpy(pBuilder->pBuffer + pBuilder->length, pText, textLen);
+	pBuilder->length += textLen;
+	pBuilder->pBuffer[pBuilder->length] = '\0';
+}
+
+/* Writes the decimal digits of value so they end at pEnd, returns where they start */
+static char *formatJsonDigits(char *pEnd, uint32_t value) {
+	do {
+		*--pEnd = (char) ('0' + value % 10);
+		value /= 10;
+	} while(value != 0);
+
+	return pEnd;
+}
+
+static void appendJsonInteger(jsonBuilder_t *pBuilder, uint32_t magnitude, bool isNegative) {
+	char digits[11];
+	char *pStart = formatJsonDigits(digits + sizeof(digits), magnitude);
+
+	if(isNegative) {
+		*--pStart = '-';
+	}
+	appendJsonText(pBuilder, pStart, (size_t) (digits + sizeof(digits) - pStart));
+}
+
+static void appendJsonSignedInteger(jsonBuilder_t *pBuilder, int32_t value) {
+	if(value < 0) {
+		appendJsonInteger(pBuilder, 0u - (uint32_t) value, true);
+	} else {
+		appendJsonInteger(pBuilder, (uint32_t) value, false);
+	}
+}
+
+/* Formats as "%f" does. Values below JSON_FAST_DOUBLE_LIMIT are rounded to 6 decimals with integer arithmetic,
+ * the others and those too close to half way between two results for the rounding to be certain go to snprintf */
+#define JSON_FAST_DOUBLE_LIMIT 1e9
+static void appendJsonDouble(jsonBuilder_t *pBuilder, double value) {
+	char digits[19];
+	char *pEnd = digits + sizeof(digits);
+	char *pStart;
+	double magnitude = signbit(value) ? -value : value;
+	double scaled, rest;
+	uint64_t units;
+	uint32_t fraction;
+	uint8_t i;
+	int32_t snPrintfReturn;
+
+	if(magnitude < JSON_FAST_DOUBLE_LIMIT) {
+		scaled = magnitude * 1e6;
+		units = (uint64_t) scaled;
+		rest = scaled - (double) units;
+		/* scaled is off by half an ulp at most, which only matters this close to .5 */
+		if(rest - 0.5 > scaled * 1e-15 || 0.5 - rest > scaled * 1e-15) {
+			if(rest > 0.5) {
+				units++;
+			}
+			fraction = (uint32_t) (units % 1000000);
+			for(i = 0; i < 6; i++) {
+				*--pEnd = (char) ('0' + fraction % 10);
+				fraction /= 10;
+			}
+			*--pEnd = '.';
+			pStart = formatJsonDigits(pEnd, (uint32_t) (units / 1000000));
+			if(signbit(value)) {
+				*--pStart = '-';
+			}
+			appendJsonText(pBuilder, pStart, (size_t) (digits + sizeof(digits) - pStart));
+			return;
+		}
+	}
+
+	if(SUCCESS != pBuilder->rc) {
+		return;
+	}
+	snPrintfReturn = snprintf(pBuilder->pBuffer + pBuilder->length, pBuilder->bufferSize - pBuilder->length, "%f",
+							  value);
+	pBuilder->rc = checkReturnValueOfSnPrintf(snPrintfReturn, pBuilder->bufferSize - pBuilder->length);
+	if(SUCCESS == pBuilder->rc) {
+		pBuilder->length += (size_t) snPrintfReturn;
+	} else {
+		pBuilder->pBuffer[pBuilder->length] = '\0';
+	}
+}
+
+/* Writes the comma before a member and its key, arrays have no keys */
+static void appendJsonMemberStart(jsonBuilder_t *pBuilder, const char *pKey) {
+	uint32_t levelBit;
+
+	if(SUCCESS != pBuilder->rc) {
+		return;
+	}
+	if(pBuilder->depth == 0) {
+		pBuilder->rc = SHADOW_JSON_ERROR;
+		return;
+	}
+
+	levelBit = 1u << (pBuilder->depth - 1);
+	if(pBuilder->hasMembersMask & levelBit) {
+		appendJsonText(pBuilder, ",", 1);
+	}
+	pBuilder->hasMembersMask |= levelBit;
+
+	if(!(pBuilder->isArrayMask & levelBit)) {
+		if(pKey == NULL) {
+			pBuilder->rc = NULL_VALUE_ERROR;
+			return;
+		}
+		appendJsonText(pBuilder, "\"", 1);
+		appendJsonText(pBuilder, pKey, strlen(pKey));
+		appendJsonText(pBuilder, "\":", 2);
+	}
+}
+
+static void openJsonValue(jsonBuilder_t *pBuilder, bool isArray) {
+	uint32_t levelBit;
+
+	if(SUCCESS != pBuilder->rc) {
+		return;
+	}
+	if(pBuilder->depth >= JSON_BUILDER_MAX_DEPTH) {
+		pBuilder->rc = SHADOW_JSON_ERROR;
+		return;
+	}
+
+	appendJsonText(pBuilder, isArray ? "[" : "{", 1);
+	levelBit = 1u << pBuilder->depth;
+	pBuilder->hasMembersMask &= ~levelBit;
+	if(isArray) {
+		pBuilder->isArrayMask |= levelBit;
+	} else {
+		pBuilder->isArrayMask &= ~levelBit;
+	}
+	pBuilder->depth++;
+}
+
+/* The document and its state object are only closed by aws_iot_shadow_json_builder_finalize */
+static void closeJsonValue(jsonBuilder_t *pBuilder, bool isArray) {
+	if(SUCCESS != pBuilder->rc) {
+		return;
+	}
+	if(pBuilder->depth <= 2 || isArray != ((pBuilder->isArrayMask & (1u << (pBuilder->depth - 1))) != 0)) {
+		pBuilder->rc = SHADOW_JSON_ERROR;
+		return;
+	}
+
+	appendJsonText(pBuilder, isArray ? "]" : "}", 1);
+	pBuilder->depth--;
+}
+
+/* Continues a document written up to length, in its state object after a { or a , */
+static void attachJsonBuilder(jsonBuilder_t *pBuilder, char *pJsonDocument, size_t maxSizeOfJsonDocument,
+							  size_t length) {
+	pBuilder->pBuffer = pJsonDocument;
+	pBuilder->bufferSize = maxSizeOfJsonDocument;
+	pBuilder->length = length;
+	pBuilder->rc = SUCCESS;
+	pBuilder->depth = 2;
+	pBuilder->hasMembersMask = 0;
+	pBuilder->isArrayMask = 0;
+	pJsonDocument[length] = '\0';
+}
+
+IoT_Error_t aws_iot_shadow_json_builder_init(jsonBuilder_t *pBuilder, char *pJsonDocument,
+											 size_t maxSizeOfJsonDocument) {
+	if(pBuilder == NULL || pJsonDocument == NULL) {
 		return NULL_VALUE_ERROR;
 	}
-	snPrintfReturn = snprintf(pJsonDocument, maxSizeOfJsonDocument, "{\"state\":{");
 
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, maxSizeOfJsonDocument);
+	pBuilder->pBuffer = pJsonDocument;
+	pBuilder->bufferSize = maxSizeOfJsonDocument;
+	pBuilder->length = 0;
+	pBuilder->rc = SUCCESS;
+	pBuilder->depth = 0;
+	pBuilder->hasMembersMask = 0;
+	pBuilder->isArrayMask = 0;
 
-	return ret_val;
+	openJsonValue(pBuilder, false);
+	appendJsonMemberStart(pBuilder, "state");
+	openJsonValue(pBuilder, false);
 
+	return pBuilder->rc;
 }
 
-IoT_Error_t aws_iot_shadow_add_desired(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
-	IoT_Error_t ret_val = SUCCESS;
-	size_t tempSize = 0;
-	int8_t i;
-	size_t remSizeOfJsonBuffer = maxSizeOfJsonDocument;
-	int32_t snPrintfReturn = 0;
-	va_list pArgs;
-	va_start(pArgs, count);
-	jsonStruct_t *pTemporary;
+IoT_Error_t aws_iot_shadow_json_builder_begin_object(jsonBuilder_t *pBuilder, const char *pKey) {
+	if(pBuilder == NULL) {
+		return NULL_VALUE_ERROR;
+	}
 
-	if(pJsonDocument == NULL) {
+	appendJsonMemberStart(pBuilder, pKey);
+	openJsonValue(pBuilder, false);
+
+	return pBuilder->rc;
+}
+
+IoT_Error_t aws_iot_shadow_json_builder_end_object(jsonBuilder_t *pBuilder) {
+	if(pBuilder == NULL) {
 		return NULL_VALUE_ERROR;
 	}
 
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1) {
-		return SHADOW_JSON_ERROR;
+	closeJsonValue(pBuilder, false);
+
+	return pBuilder->rc;
+}
+
+IoT_Error_t aws_iot_shadow_json_builder_begin_array(jsonBuilder_t *pBuilder, const char *pKey) {
+	if(pBuilder == NULL) {
+		return NULL_VALUE_ERROR;
 	}
-	remSizeOfJsonBuffer = tempSize;
 
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"desired\":{");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+	appendJsonMemberStart(pBuilder, pKey);
+	openJsonValue(pBuilder, true);
+
+	return pBuilder->rc;
+}
 
-	if(ret_val != SUCCESS) {
-		return ret_val;
+IoT_Error_t aws_iot_shadow_json_builder_end_array(jsonBuilder_t *pBuilder) {
+	if(pBuilder == NULL) {
+		return NULL_VALUE_ERROR;
 	}
 
-	for(i = 0; i < count; i++) {
-		tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-		if(tempSize <= 1) {
-			return SHADOW_JSON_ERROR;
-		}
-		remSizeOfJsonBuffer = tempSize;
-		pTemporary = va_arg (pArgs, jsonStruct_t *);
-		if(pTemporary != NULL) {
-			snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"%s\":",
-									  pTemporary->pKey);
-			ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
-			if(ret_val != SUCCESS) {
-				return ret_val;
-			}
-			if(pTemporary->pKey != NULL && pTemporary->pData != NULL) {
-				ret_val = convertDataToString(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer,
-											  pTemporary->type, pTemporary->pData);
+	closeJsonValue(pBuilder, true);
+
+	return pBuilder->rc;
+}
+
+IoT_Error_t aws_iot_shadow_json_builder_add(jsonBuilder_t *pBuilder, const jsonStruct_t *pStruct) {
+	const jsonObject_t *pObject;
+	uint8_t i;
+
+	if(pBuilder == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	if(SUCCESS == pBuilder->rc && (pStruct == NULL || pStruct->pData == NULL)) {
+		pBuilder->rc = NULL_VALUE_ERROR;
+	}
+
+	appendJsonMemberStart(pBuilder, pStruct != NULL ? pStruct->pKey : NULL);
+	if(SUCCESS != pBuilder->rc) {
+		return pBuilder->rc;
+	}
+
+	switch(pStruct->type) {
+		case SHADOW_JSON_INT32:
+			appendJsonSignedInteger(pBuilder, *(int32_t *) (pStruct->pData));
+			break;
+		case SHADOW_JSON_INT16:
+			appendJsonSignedInteger(pBuilder, *(int16_t *) (pStruct->pData));
+			break;
+		case SHADOW_JSON_INT8:
+			appendJsonSignedInteger(pBuilder, *(int8_t *) (pStruct->pData));
+			break;
+		case SHADOW_JSON_UINT32:
+			appendJsonInteger(pBuilder, *(uint32_t *) (pStruct->pData), false);
+			break;
+		case SHADOW_JSON_UINT16:
+			appendJsonInteger(pBuilder, *(uint16_t *) (pStruct->pData), false);
+			break;
+		case SHADOW_JSON_UINT8:
+			appendJsonInteger(pBuilder, *(uint8_t *) (pStruct->pData), false);
+			break;
+		case SHADOW_JSON_DOUBLE:
+			appendJsonDouble(pBuilder, *(double *) (pStruct->pData));
+			break;
+		case SHADOW_JSON_FLOAT:
+			appendJsonDouble(pBuilder, *(float *) (pStruct->pData));
+			break;
+		case SHADOW_JSON_BOOL:
+			if(*(bool *) (pStruct->pData)) {
+				appendJsonText(pBuilder, "true", 4);
 			} else {
-				return NULL_VALUE_ERROR;
+				appendJsonText(pBuilder, "false", 5);
 			}
-			if(ret_val != SUCCESS) {
-				return ret_val;
+			break;
+		case SHADOW_JSON_STRING:
+			appendJsonText(pBuilder, "\"", 1);
+			appendJsonText(pBuilder, (const char *) (pStruct->pData), strlen((const char *) (pStruct->pData)));
+			appendJsonText(pBuilder, "\"", 1);
+			break;
+		case SHADOW_JSON_OBJECT:
+			appendJsonText(pBuilder, (const char *) (pStruct->pData), strlen((const char *) (pStruct->pData)));
+			break;
+		case SHADOW_JSON_STRUCT:
+			pObject = (const jsonObject_t *) (pStruct->pData);
+			openJsonValue(pBuilder, false);
+			for(i = 0; i < pObject->memberCount; i++) {
+				aws_iot_shadow_json_builder_add(pBuilder, &(pObject->pMembers[i]));
 			}
-		} else {
-			return NULL_VALUE_ERROR;
-		}
+			closeJsonValue(pBuilder, false);
+			break;
 	}
 
-	va_end(pArgs);
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument) - 1, remSizeOfJsonBuffer, "},");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
-	return ret_val;
+	return pBuilder->rc;
 }
 
-IoT_Error_t aws_iot_shadow_add_reported(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
-	IoT_Error_t ret_val = SUCCESS;
+IoT_Error_t aws_iot_shadow_json_builder_finalize(jsonBuilder_t *pBuilder) {
+	if(pBuilder == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	if(SUCCESS == pBuilder->rc && pBuilder->depth != 2) {
+		pBuilder->rc = SHADOW_JSON_ERROR;
+	}
+
+	appendJsonText(pBuilder, "}, \"" SHADOW_CLIENT_TOKEN_STRING "\":\"", strlen("}, \"" SHADOW_CLIENT_TOKEN_STRING "\":\""));
+	if(SUCCESS == pBuilder->rc) {
+		appendJsonText(pBuilder, mqttClientID, strlen(mqttClientID));
+		appendJsonText(pBuilder, "-", 1);
+		appendJsonSignedInteger(pBuilder, (int32_t) clientTokenNum++);
+	}
+	appendJsonText(pBuilder, "\"}", 2);
+	if(SUCCESS == pBuilder->rc) {
+		pBuilder->depth = 0;
+	}
 
-	int8_t i;
-	size_t remSizeOfJsonBuffer = maxSizeOfJsonDocument;
+	return pBuilder->rc;
+}
+
+IoT_Error_t aws_iot_shadow_init_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
+
+	IoT_Error_t ret_val = SUCCESS;
 	int32_t snPrintfReturn = 0;
-	size_t tempSize = 0;
-	va_list pArgs;
-	va_start(pArgs, count);
-	jsonStruct_t *pTemporary;
 
 	if(pJsonDocument == NULL) {
 		return NULL_VALUE_ERROR;
 	}
+	snPrintfReturn = snprintf(pJsonDocument, maxSizeOfJsonDocument, "{\"state\":{");
 
+	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, maxSizeOfJsonDocument);
 
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1) {
-		return SHADOW_JSON_ERROR;
-	}
-	remSizeOfJsonBuffer = tempSize;
+	return ret_val;
+
+}
 
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"reported\":{");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+/* Adds "<pSectionKey>":{<members>}, to the document, after its state object or the section before */
+static IoT_Error_t addJsonSection(char *pJsonDocument, size_t maxSizeOfJsonDocument, const char *pSectionKey,
+								  uint8_t count, va_list pArgs) {
+	jsonBuilder_t builder;
+	size_t length;
+	uint8_t i;
+	jsonStruct_t *pTemporary;
 
-	if(ret_val != SUCCESS) {
-		return ret_val;
+	if(pJsonDocument == NULL) {
+		return NULL_VALUE_ERROR;
 	}
 
-	for(i = 0; i < count; i++) {
-		tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-		if(tempSize <= 1) {
-			return SHADOW_JSON_ERROR;
-		}
-		remSizeOfJsonBuffer = tempSize;
+	length = strlen(pJsonDocument);
+	if(length >= maxSizeOfJsonDocument || maxSizeOfJsonDocument - length <= 1) {
+		return SHADOW_JSON_ERROR;
+	}
+
+	attachJsonBuilder(&builder, pJsonDocument, maxSizeOfJsonDocument, length);
+	aws_iot_shadow_json_builder_begin_object(&builder, pSectionKey);
 
+	for(i = 0; i < count && SUCCESS == builder.rc; i++) {
 		pTemporary = va_arg (pArgs, jsonStruct_t *);
-		if(pTemporary != NULL) {
-			snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"%s\":",
-									  pTemporary->pKey);
-			ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
-			if(ret_val != SUCCESS) {
-				return ret_val;
-			}
-			if(pTemporary->pKey != NULL && pTemporary->pData != NULL) {
-				ret_val = convertDataToString(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer,
-											  pTemporary->type, pTemporary->pData);
-			} else {
-				return NULL_VALUE_ERROR;
-			}
-			if(ret_val != SUCCESS) {
-				return ret_val;
-			}
-		} else {
+		if(pTemporary == NULL || pTemporary->pKey == NULL || pTemporary->pData == NULL) {
 			return NULL_VALUE_ERROR;
 		}
+		aws_iot_shadow_json_builder_add(&builder, pTemporary);
 	}
 
+	aws_iot_shadow_json_builder_end_object(&builder);
+	appendJsonText(&builder, ",", 1);
+
+	return builder.rc;
+}
+
+IoT_Error_t aws_iot_shadow_add_desired(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
+	IoT_Error_t ret_val;
+	va_list pArgs;
+
+	va_start(pArgs, count);
+	ret_val = addJsonSection(pJsonDocument, maxSizeOfJsonDocument, "desired", count, pArgs);
 	va_end(pArgs);
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument) - 1, remSizeOfJsonBuffer, "},");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+
 	return ret_val;
 }
 
+IoT_Error_t aws_iot_shadow_add_reported(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
+	IoT_Error_t ret_val;
+	va_list pArgs;
+
+	va_start(pArgs, count);
+	ret_val = addJsonSection(pJsonDocument, maxSizeOfJsonDocument, SHADOW_REPORTED_STRING, count, pArgs);
+	va_end(pArgs);
+
+	return ret_val;
+}
 
 int32_t FillWithClientTokenSize(char *pBufferToBeUpdatedWithClientToken, size_t maxSizeOfJsonDocument) {
 	int32_t snPrintfReturn;
@@ -231,106 +485,136 @@ IoT_Error_t aws_iot_fill_with_client_token(char *pBufferToBeUpdatedWithClientTok
 }
 
 IoT_Error_t aws_iot_finalize_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
-	size_t remSizeOfJsonBuffer = maxSizeOfJsonDocument;
-	int32_t snPrintfReturn = 0;
-	size_t tempSize = 0;
-	IoT_Error_t ret_val = SUCCESS;
+	jsonBuilder_t builder;
+	size_t length;
 
 	if(pJsonDocument == NULL) {
 		return NULL_VALUE_ERROR;
 	}
 
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1) {
+	length = strlen(pJsonDocument);
+	if(length == 0 || length >= maxSizeOfJsonDocument || maxSizeOfJsonDocument - length <= 1) {
 		return SHADOW_JSON_ERROR;
 	}
-	remSizeOfJsonBuffer = tempSize;
 
-	// strlen(ShadowTxBuffer) - 1 is to ensure we remove the last ,(comma) that was added
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument) - 1, remSizeOfJsonBuffer, "}, \"%s\":\"",
-							  SHADOW_CLIENT_TOKEN_STRING);
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+	// length - 1 is to ensure we remove the last ,(comma) that was added
+	attachJsonBuilder(&builder, pJsonDocument, maxSizeOfJsonDocument, length - 1);
 
-	if(ret_val != SUCCESS) {
-		return ret_val;
-	}
-	// refactor this XXX repeated code
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1) {
-		return SHADOW_JSON_ERROR;
-	}
-	remSizeOfJsonBuffer = tempSize;
+	return aws_iot_shadow_json_builder_finalize(&builder);
+}
 
+void FillWithClientToken(char *pBufferToBeUpdatedWithClientToken) {
+	sprintf(pBufferToBeUpdatedWithClientToken, "%s-%d", mqttClientID, clientTokenNum++);
+}
 
-	snPrintfReturn = FillWithClientTokenSize(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer);
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+static jsmn_parser shadowJsonParser;
+static ShadowJsonDocument_t shadowTxDocument;
 
-	if(ret_val != SUCCESS) {
-		return ret_val;
-	}
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1) {
-		return SHADOW_JSON_ERROR;
+/* Index of the token after the value at valueIndex and everything nested in it */
+static int32_t skipJsonValue(const ShadowJsonDocument_t *pDocument, int32_t valueIndex) {
+	int32_t pending = 1;
+
+	while(pending > 0 && valueIndex < pDocument->tokenCount) {
+		pending += pDocument->tokens[valueIndex].size - 1;
+		valueIndex++;
 	}
-	remSizeOfJsonBuffer = tempSize;
 
+	return valueIndex;
+}
 
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"}");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+static bool isJsonDocumentKey(const ShadowJsonDocument_t *pDocument, int32_t keyIndex, const char *pKey,
+							  size_t keyLen) {
+	const jsmntok_t *pToken = &(pDocument->tokens[keyIndex]);
 
-	return ret_val;
+	return pToken->type == JSMN_STRING && (size_t) (pToken->end - pToken->start) == keyLen &&
+		   strncmp(pDocument->pJson + pToken->start, pKey, keyLen) == 0;
 }
 
-void FillWithClientToken(char *pBufferToBeUpdatedWithClientToken) {
-	sprintf(pBufferToBeUpdatedWithClientToken, "%s-%d", mqttClientID, clientTokenNum++);
-}
+/* Walks the members of an object once, setting the value token of each key found in ppKeys */
+static void findJsonDocumentKeys(const ShadowJsonDocument_t *pDocument, int32_t objectIndex, const char **ppKeys,
+								 int32_t **ppValueIndexes, uint8_t keyCount) {
+	int32_t i, pairCount;
+	uint8_t j;
 
-static IoT_Error_t convertDataToString(char *pStringBuffer, size_t maxSizoStringBuffer, JsonPrimitiveType type,
-									   void *pData) {
-	int32_t snPrintfReturn = 0;
-	IoT_Error_t ret_val = SUCCESS;
+	if(objectIndex < 0 || pDocument->tokens[objectIndex].type != JSMN_OBJECT) {
+		return;
+	}
 
-	if(maxSizoStringBuffer == 0) {
-		return SHADOW_JSON_ERROR;
+	/* jsmn counts both the keys and the values of an object in its size */
+	pairCount = pDocument->tokens[objectIndex].size / 2;
+	i = objectIndex + 1;
+	while(pairCount-- > 0 && i + 1 < pDocument->tokenCount) {
+		for(j = 0; j < keyCount; j++) {
+			if(isJsonDocumentKey(pDocument, i, ppKeys[j], strlen(ppKeys[j]))) {
+				*(ppValueIndexes[j]) = i + 1;
+				break;
+			}
+		}
+		i = skipJsonValue(pDocument, i + 1);
 	}
+}
 
-	if(type == SHADOW_JSON_INT32) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIi32",", *(int32_t *) (pData));
-	} else if(type == SHADOW_JSON_INT16) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIi16",", *(int16_t *) (pData));
-	} else if(type == SHADOW_JSON_INT8) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIi8",", *(int8_t *) (pData));
-	} else if(type == SHADOW_JSON_UINT32) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIu32",", *(uint32_t *) (pData));
-	} else if(type == SHADOW_JSON_UINT16) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIu16",", *(uint16_t *) (pData));
-	} else if(type == SHADOW_JSON_UINT8) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%" PRIu8",", *(uint8_t *) (pData));
-	} else if(type == SHADOW_JSON_DOUBLE) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%f,", *(double *) (pData));
-	} else if(type == SHADOW_JSON_FLOAT) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%f,", *(float *) (pData));
-	} else if(type == SHADOW_JSON_BOOL) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%s,", *(bool *) (pData) ? "true" : "false");
-	} else if(type == SHADOW_JSON_STRING) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "\"%s\",", (char *) (pData));
-	}
-
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, maxSizoStringBuffer);
+int32_t findJsonDocumentKey(const ShadowJsonDocument_t *pDocument, int32_t objectIndex, const char *pKey) {
+	int32_t valueIndex = -1;
+	int32_t *pValueIndex = &valueIndex;
 
-	return ret_val;
+	findJsonDocumentKeys(pDocument, objectIndex, &pKey, &pValueIndex, 1);
+
+	return valueIndex;
 }
 
-static jsmn_parser shadowJsonParser;
-static jsmntok_t jsonTokenStruct[MAX_JSON_TOKEN_EXPECTED];
+int32_t findJsonDocumentKeyAtAnyDepth(const ShadowJsonDocument_t *pDocument, const char *pKey, size_t keyLen) {
+	int32_t foundIndex = -1;
+	int32_t objectIndex, i, pairCount;
 
-bool isJsonValidAndParse(const char *pJsonDocument, void *pJsonHandler, int32_t *pTokenCount) {
+	/* Every key is a member of one object. The objects start in the order of the document, so none after
+	 * the key found first can hold an earlier one */
+	for(objectIndex = 0; objectIndex < pDocument->tokenCount; objectIndex++) {
+		if(foundIndex >= 0 && objectIndex > foundIndex) {
+			break;
+		}
+		if(pDocument->tokens[objectIndex].type != JSMN_OBJECT) {
+			continue;
+		}
+
+		pairCount = pDocument->tokens[objectIndex].size / 2;
+		i = objectIndex + 1;
+		while(pairCount-- > 0 && i + 1 < pDocument->tokenCount) {
+			if(isJsonDocumentKey(pDocument, i, pKey, keyLen)) {
+				if(foundIndex < 0 || i < foundIndex) {
+					foundIndex = i;
+				}
+				break;
+			}
+			i = skipJsonValue(pDocument, i + 1);
+		}
+	}
+
+	return foundIndex;
+}
+
+bool parseJsonDocument(ShadowJsonDocument_t *pDocument, const char *pJson, size_t jsonLen) {
 	int32_t tokenCount;
+	const char *pTopLevelKeys[] = {SHADOW_VERSION_STRING, SHADOW_CLIENT_TOKEN_STRING, SHADOW_STATE_STRING};
+	int32_t *pTopLevelIndexes[] = {&(pDocument->versionIndex), &(pDocument->clientTokenIndex),
+								   &(pDocument->stateIndex)};
+	const char *pStateKeys[] = {"desired", "reported", "delta"};
+	int32_t *pStateIndexes[] = {&(pDocument->desiredIndex), &(pDocument->reportedIndex), &(pDocument->deltaIndex)};
+
+	pDocument->pJson = pJson;
+	pDocument->jsonLen = jsonLen;
+	pDocument->tokenCount = 0;
+	pDocument->versionIndex = -1;
+	pDocument->clientTokenIndex = -1;
+	pDocument->stateIndex = -1;
+	pDocument->desiredIndex = -1;
+	pDocument->reportedIndex = -1;
+	pDocument->deltaIndex = -1;
 
 	jsmn_init(&shadowJsonParser);
 
-	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, strlen(pJsonDocument), jsonTokenStruct,
-							sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
+	tokenCount = jsmn_parse(&shadowJsonParser, pJson, jsonLen, pDocument->tokens,
+							sizeof(pDocument->tokens) / sizeof(pDocument->tokens[0]));
 
 	if(tokenCount < 0) {
 		IOT_WARN("Failed to parse JSON: %d\n", tokenCount);
@@ -338,13 +622,14 @@ bool isJsonValidAndParse(const char *pJsonDocument, void *pJsonHandler, int32_t
 	}
 
 	/* Assume the top-level element is an object */
-	if(tokenCount < 1 || jsonTokenStruct[0].type != JSMN_OBJECT) {
+	if(tokenCount < 1 || pDocument->tokens[0].type != JSMN_OBJECT) {
 		IOT_WARN("Top Level is not an object\n");
 		return false;
 	}
 
-	pJsonHandler = (void *) jsonTokenStruct;
-	*pTokenCount = tokenCount;
+	pDocument->tokenCount = tokenCount;
+	findJsonDocumentKeys(pDocument, 0, pTopLevelKeys, pTopLevelIndexes, 3);
+	findJsonDocumentKeys(pDocument, pDocument->stateIndex, pStateKeys, pStateIndexes, 3);
 
 	return true;
 }
@@ -374,95 +659,260 @@ static IoT_Error_t UpdateValueIfNoObject(const char *pJsonString, jsonStruct_t *
 	return ret_val;
 }
 
-bool isJsonKeyMatchingAndUpdateValue(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount,
-									 jsonStruct_t *pDataStruct, uint32_t *pDataLength, int32_t *pDataPosition) {
-	int32_t i;
-	uint32_t dataLength;
-	jsmntok_t *pJsonTokenStruct;
-	jsmntok_t dataToken;
-
-	pJsonTokenStruct = (jsmntok_t *) pJsonHandler;
-	for(i = 1; i < tokenCount; i++) {
-		if(jsoneq(pJsonDocument, &(jsonTokenStruct[i]), pDataStruct->pKey) == 0) {
-			dataToken = jsonTokenStruct[i + 1];
-			dataLength = (uint32_t) (dataToken.end - dataToken.start);
-			UpdateValueIfNoObject(pJsonDocument, pDataStruct, dataToken);
-			*pDataPosition = dataToken.start;
-			*pDataLength = dataLength;
-			return true;
+static IoT_Error_t updateJsonStructValueAtDepth(const ShadowJsonDocument_t *pDocument, int32_t valueIndex,
+												jsonStruct_t *pDataStruct, uint8_t depth);
+
+/* Decodes the members of the object at objectIndex into those of pObject, one walk over the object */
+static IoT_Error_t decodeJsonObject(const ShadowJsonDocument_t *pDocument, int32_t objectIndex,
+									const jsonObject_t *pObject, uint8_t depth) {
+	IoT_Error_t ret_val = SUCCESS;
+	IoT_Error_t memberRc;
+	int32_t i, pairCount;
+	uint8_t j;
+	jsonStruct_t *pMember;
+	const jsmntok_t *pValueToken;
+
+	if(pDocument->tokens[objectIndex].type != JSMN_OBJECT || depth >= MAX_JSON_DEPTH_EXPECTED) {
+		return JSON_PARSE_ERROR;
+	}
+
+	pairCount = pDocument->tokens[objectIndex].size / 2;
+	i = objectIndex + 1;
+	while(pairCount-- > 0 && i + 1 < pDocument->tokenCount) {
+		for(j = 0; j < pObject->memberCount; j++) {
+			pMember = &(pObject->pMembers[j]);
+			if(pMember->pKey != NULL && isJsonDocumentKey(pDocument, i, pMember->pKey, strlen(pMember->pKey))) {
+				memberRc = updateJsonStructValueAtDepth(pDocument, i + 1, pMember, (uint8_t) (depth + 1));
+				if(SUCCESS != memberRc) {
+					ret_val = memberRc;
+				} else if(pMember->cb != NULL) {
+					pValueToken = &(pDocument->tokens[i + 1]);
+					pMember->cb(pDocument->pJson + pValueToken->start,
+								(uint32_t) (pValueToken->end - pValueToken->start), pMember);
+				}
+				break;
+			}
+		}
+		i = skipJsonValue(pDocument, i + 1);
+	}
+
+	return ret_val;
+}
+
+static IoT_Error_t updateJsonStructValueAtDepth(const ShadowJsonDocument_t *pDocument, int32_t valueIndex,
+												jsonStruct_t *pDataStruct, uint8_t depth) {
+	if(pDataStruct->type == SHADOW_JSON_STRUCT) {
+		if(pDataStruct->pData == NULL) {
+			return SUCCESS;
 		}
+		return decodeJsonObject(pDocument, valueIndex, (const jsonObject_t *) pDataStruct->pData, depth);
 	}
-	return false;
+
+	return UpdateValueIfNoObject(pDocument->pJson, pDataStruct, pDocument->tokens[valueIndex]);
 }
 
-bool isReceivedJsonValid(const char *pJsonDocument) {
-	int32_t tokenCount;
+IoT_Error_t updateJsonStructValue(const ShadowJsonDocument_t *pDocument, int32_t valueIndex,
+								  jsonStruct_t *pDataStruct) {
+	return updateJsonStructValueAtDepth(pDocument, valueIndex, pDataStruct, 0);
+}
 
-	jsmn_init(&shadowJsonParser);
+/* Objects nested in a SHADOW_JSON_STRUCT, its own included. The count stops past the limit, so a jsonObject_t that
+ * contains itself ends too */
+static uint8_t jsonStructDepth(const jsonStruct_t *pDataStruct, uint8_t depth) {
+	const jsonObject_t *pObject;
+	uint8_t deepest, memberDepth;
+	uint8_t j;
 
-	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, strlen(pJsonDocument), jsonTokenStruct,
-							sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
+	if(pDataStruct->type != SHADOW_JSON_STRUCT || pDataStruct->pData == NULL) {
+		return depth;
+	}
 
-	if(tokenCount < 0) {
-		IOT_WARN("Failed to parse JSON: %d\n", tokenCount);
+	depth++;
+	deepest = depth;
+	pObject = (const jsonObject_t *) pDataStruct->pData;
+	for(j = 0; j < pObject->memberCount && depth <= MAX_JSON_DEPTH_EXPECTED; j++) {
+		memberDepth = jsonStructDepth(&(pObject->pMembers[j]), depth);
+		if(memberDepth > deepest) {
+			deepest = memberDepth;
+		}
+	}
+
+	return deepest;
+}
+
+bool isJsonStructDecodable(const jsonStruct_t *pDataStruct) {
+	return jsonStructDepth(pDataStruct, 0) <= MAX_JSON_DEPTH_EXPECTED;
+}
+
+bool walkJsonDocumentKeys(const ShadowJsonDocument_t *pDocument, int32_t objectIndex,
+						  JsonDocumentKeyHandler_t handler, void *pContext) {
+	int32_t pairsLeft[MAX_JSON_DEPTH_EXPECTED];
+	uint32_t pathHashes[MAX_JSON_DEPTH_EXPECTED];
+	JsonDocumentKeyPath_t path;
+	int32_t level = 0;
+	int32_t i, valueIndex;
+	const char *pKey;
+	size_t keyLen;
+	const jsmntok_t *pValueToken;
+	bool isComplete = true;
+
+	if(objectIndex < 0 || pDocument->tokens[objectIndex].type != JSMN_OBJECT) {
+		return true;
+	}
+
+	pairsLeft[0] = pDocument->tokens[objectIndex].size / 2;
+	i = objectIndex + 1;
+	while(level >= 0 && i + 1 < pDocument->tokenCount) {
+		if(pairsLeft[level] == 0) {
+			level--;
+			continue;
+		}
+		pairsLeft[level]--;
+
+		pKey = pDocument->pJson + pDocument->tokens[i].start;
+		keyLen = (size_t) (pDocument->tokens[i].end - pDocument->tokens[i].start);
+		path.keyIndexes[level] = i;
+		path.keyCount = (uint8_t) (level + 1);
+		path.keyHash = hashJsonKey(pKey, keyLen);
+		if(level == 0) {
+			path.pathHash = path.keyHash;
+		} else {
+			path.pathHash = extendJsonKeyHash(extendJsonKeyHash(pathHashes[level - 1], ".", 1), pKey, keyLen);
+		}
+		pathHashes[level] = path.pathHash;
+
+		handler(pDocument, &path, pContext);
+
+		valueIndex = i + 1;
+		pValueToken = &(pDocument->tokens[valueIndex]);
+		if(pValueToken->type == JSMN_OBJECT && level + 1 < MAX_JSON_DEPTH_EXPECTED) {
+			level++;
+			pairsLeft[level] = pValueToken->size / 2;
+			i = valueIndex + 1;
+		} else {
+			i = skipJsonValue(pDocument, valueIndex);
+			/* An array of primitives spans one token per element, more means it holds objects or arrays */
+			if((pValueToken->type == JSMN_OBJECT && pValueToken->size > 0)
+			   || (pValueToken->type == JSMN_ARRAY && i - valueIndex > pValueToken->size + 1)) {
+				isComplete = false;
+			}
+		}
+	}
+
+	return isComplete;
+}
+
+bool isJsonDocumentPath(const ShadowJsonDocument_t *pDocument, const JsonDocumentKeyPath_t *pPath, uint8_t firstKey,
+						const char *pKeyPath, size_t keyPathLen) {
+	const jsmntok_t *pKeyToken;
+	size_t keyLen;
+	size_t offset = 0;
+	uint8_t i;
+
+	if(firstKey >= pPath->keyCount) {
 		return false;
 	}
 
-	/* Assume the top-level element is an object */
-	if(tokenCount < 1 || jsonTokenStruct[0].type != JSMN_OBJECT) {
+	for(i = firstKey; i < pPath->keyCount; i++) {
+		if(i > firstKey) {
+			if(offset >= keyPathLen || pKeyPath[offset] != '.') {
+				return false;
+			}
+			offset++;
+		}
+		pKeyToken = &(pDocument->tokens[pPath->keyIndexes[i]]);
+		keyLen = (size_t) (pKeyToken->end - pKeyToken->start);
+		if(keyPathLen - offset < keyLen || strncmp(pKeyPath + offset, pDocument->pJson + pKeyToken->start, keyLen) != 0) {
+			return false;
+		}
+		offset += keyLen;
+	}
+
+	return offset == keyPathLen;
+}
+
+/* 32 bit FNV-1a */
+uint32_t extendJsonKeyHash(uint32_t hash, const char *pKey, size_t keyLen) {
+	size_t i;
+
+	for(i = 0; i < keyLen; i++) {
+		hash ^= (uint8_t) pKey[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+uint32_t hashJsonKey(const char *pKey, size_t keyLen) {
+	return extendJsonKeyHash(2166136261u, pKey, keyLen);
+}
+
+bool extractDocumentClientToken(const ShadowJsonDocument_t *pDocument, char *pExtractedClientToken,
+								size_t maxSizeOfClientToken) {
+	const jsmntok_t *pToken;
+	size_t length;
+
+	if(pDocument->clientTokenIndex < 0) {
 		return false;
 	}
 
+	pToken = &(pDocument->tokens[pDocument->clientTokenIndex]);
+	length = (size_t) (pToken->end - pToken->start);
+	if(pToken->type != JSMN_STRING || length >= maxSizeOfClientToken) {
+		return false;
+	}
+
+	memcpy(pExtractedClientToken, pDocument->pJson + pToken->start, length);
+	pExtractedClientToken[length] = '\0';
 	return true;
 }
 
-bool extractClientToken(const char *pJsonDocument, char *pExtractedClientToken) {
-	jsmn_init(&shadowJsonParser);
-	int32_t tokenCount, i;
-	uint8_t length;
-	jsmntok_t ClientJsonToken;
+bool extractDocumentVersionNumber(const ShadowJsonDocument_t *pDocument, uint32_t *pVersionNumber) {
+	jsmntok_t versionToken;
 
-	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, strlen(pJsonDocument), jsonTokenStruct,
-							sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
-
-	if(tokenCount < 0) {
-		IOT_WARN("Failed to parse JSON: %d\n", tokenCount);
+	if(pDocument->versionIndex < 0) {
 		return false;
 	}
 
-	/* Assume the top-level element is an object */
-	if(tokenCount < 1 || jsonTokenStruct[0].type != JSMN_OBJECT) {
+	versionToken = pDocument->tokens[pDocument->versionIndex];
+	return parseUnsignedInteger32Value(pVersionNumber, pDocument->pJson, &versionToken) == SUCCESS;
+}
+
+bool extractClientToken(const char *pJsonDocument, char *pExtractedClientToken) {
+	if(!parseJsonDocument(&shadowTxDocument, pJsonDocument, strlen(pJsonDocument))) {
 		return false;
 	}
 
-	for(i = 1; i < tokenCount; i++) {
-		if(jsoneq(pJsonDocument, &jsonTokenStruct[i], SHADOW_CLIENT_TOKEN_STRING) == 0) {
-			ClientJsonToken = jsonTokenStruct[i + 1];
-			length = (uint8_t) (ClientJsonToken.end - ClientJsonToken.start);
-			strncpy(pExtractedClientToken, pJsonDocument + ClientJsonToken.start, length);
-			pExtractedClientToken[length] = '\0';
-			return true;
-		}
+	return extractDocumentClientToken(&shadowTxDocument, pExtractedClientToken, MAX_SIZE_CLIENT_ID_WITH_SEQUENCE);
+}
+
+/* The deprecated functions below share the document of extractClientToken, as they used to
+ * share its tokens */
+bool isJsonValidAndParse(const char *pJsonDocument, void *pJsonHandler, int32_t *pTokenCount) {
+	IOT_UNUSED(pJsonHandler);
+
+	if(!parseJsonDocument(&shadowTxDocument, pJsonDocument, strlen(pJsonDocument))) {
+		return false;
 	}
 
-	return false;
+	*pTokenCount = shadowTxDocument.tokenCount;
+	return true;
 }
 
-bool extractVersionNumber(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount, uint32_t *pVersionNumber) {
-	int32_t i;
-	IoT_Error_t ret_val = SUCCESS;
+bool isReceivedJsonValid(const char *pJsonDocument) {
+	return parseJsonDocument(&shadowTxDocument, pJsonDocument, strlen(pJsonDocument));
+}
 
+bool extractVersionNumber(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount, uint32_t *pVersionNumber) {
 	IOT_UNUSED(pJsonHandler);
+	IOT_UNUSED(tokenCount);
 
-	for(i = 1; i < tokenCount; i++) {
-		if(jsoneq(pJsonDocument, &(jsonTokenStruct[i]), SHADOW_VERSION_STRING) == 0) {
-			ret_val = parseUnsignedInteger32Value(pVersionNumber, pJsonDocument, &jsonTokenStruct[i + 1]);
-			if(ret_val == SUCCESS) {
-				return true;
-			}
-		}
+	if(shadowTxDocument.pJson != pJsonDocument
+	   && !parseJsonDocument(&shadowTxDocument, pJsonDocument, strlen(pJsonDocument))) {
+		return false;
 	}
-	return false;
+
+	return extractDocumentVersionNumber(&shadowTxDocument, pVersionNumber);
 }
 
 #ifdef __cplusplus
@@ -31,6 +31,7 @@ extern "C" {
 #include "aws_iot_json_utils.h"
 #include "aws_iot_log.h"
 #include "aws_iot_shadow_json.h"
+#include "aws_iot_shadow_key.h"
 #include "aws_iot_config.h"
 
 typedef struct {
@@ -45,11 +46,26 @@ typedef struct {
 
 typedef struct {
 	const char *pKey;
+	size_t keyLen;
+	uint32_t keyHash;	///< Hash of the key, or of the path from the document root for a path
+	bool isPath;		///< The key is a path from the state object, with the keys joined with '.'
 	void *pStruct;
 	jsonStructCallback_t callback;
+	uint32_t lastDeltaNum;	///< Delta the key was last found in, only its first occurrence in a delta is used
 	bool isFree;
 } JsonTokenTable_t;
 
+typedef struct {
+	jsonStruct_t *pStruct;
+	double deadband;		///< A number is reported once it moved this much from the accepted value, 0 for any change
+	bool isAcked;			///< A report of the attribute was accepted, the accepted value is known
+	bool isPending;			///< The attribute is in the report waiting for its ack
+	double ackedValue;		///< Value last accepted, for the number types and SHADOW_JSON_BOOL
+	char ackedJson[MAX_SIZE_OF_REPORTED_ATTRIBUTE_JSON];	///< JSON last accepted, for the string, object and struct types, empty if it was too long to keep
+	double pendingValue;
+	char pendingJson[MAX_SIZE_OF_REPORTED_ATTRIBUTE_JSON];
+} ReportedAttribute_t;
+
 typedef struct {
 	char Topic[MAX_SHADOW_TOPIC_LENGTH_BYTES];
 	uint8_t count;
@@ -75,9 +91,19 @@ SubscriptionRecord_t SubscriptionList[MAX_TOPICS_AT_ANY_GIVEN_TIME];
 
 #define SUBSCRIBE_SETTLING_TIME 2
 char shadowRxBuf[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+static ShadowJsonDocument_t shadowRxDocument;
 
 static JsonTokenTable_t tokenTable[MAX_JSON_TOKEN_EXPECTED];
 static uint32_t tokenTableIndex = 0;
+
+/* Open addressing index of tokenTable by key hash, holding the table index + 1 and 0 for a free slot */
+#define DELTA_KEY_INDEX_SIZE (2 * MAX_JSON_TOKEN_EXPECTED)
+static uint16_t deltaKeyIndex[DELTA_KEY_INDEX_SIZE];
+static uint32_t deltaNum = 0;
+
+static ReportedAttribute_t reportedAttributes[MAX_REPORTED_ATTRIBUTES_REGISTERED];
+static uint8_t reportedAttributeCount = 0;
+static char pendingReportClientToken[MAX_SIZE_CLIENT_ID_WITH_SEQUENCE];	///< Client token of the last report built, empty if none
 static bool deltaTopicSubscribedFlag = false;
 uint32_t shadowJsonVersionNum = 0;
 bool shadowDiscardOldDeltaFlag = true;
@@ -101,13 +127,40 @@ void initDeltaTokens(void) {
 	for(i = 0; i < MAX_JSON_TOKEN_EXPECTED; i++) {
 		tokenTable[i].isFree = true;
 	}
+	for(i = 0; i < DELTA_KEY_INDEX_SIZE; i++) {
+		deltaKeyIndex[i] = 0;
+	}
 	tokenTableIndex = 0;
 	deltaTopicSubscribedFlag = false;
 }
 
+/* Names in a key, 2 for "motor.speed" */
+static uint32_t countDeltaKeyNames(const char *pKey) {
+	uint32_t nameCount = 1;
+
+	for(; *pKey != '\0'; pKey++) {
+		if(*pKey == '.') {
+			nameCount++;
+		}
+	}
+
+	return nameCount;
+}
+
 IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct) {
 
 	IoT_Error_t rc = SUCCESS;
+	uint32_t slot;
+
+	if(NULL == pStruct->pKey) {
+		return NULL_VALUE_ERROR;
+	}
+
+	/* The walk over a delta visits MAX_JSON_DEPTH_EXPECTED levels of keys, the first one being "state". A
+	 * longer path or a jsonObject_t nesting more objects than are decoded could never be matched in full */
+	if(countDeltaKeyNames(pStruct->pKey) >= MAX_JSON_DEPTH_EXPECTED || !isJsonStructDecodable(pStruct)) {
+		return FAILURE;
+	}
 
 	if(!deltaTopicSubscribedFlag) {
 		snprintf(shadowDeltaTopic, MAX_SHADOW_TOPIC_LENGTH_BYTES, "$aws/things/%s/shadow/update/delta", myThingName);
@@ -121,14 +174,222 @@ IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct) {
 	}
 
 	tokenTable[tokenTableIndex].pKey = pStruct->pKey;
+	tokenTable[tokenTableIndex].keyLen = strlen(pStruct->pKey);
+	tokenTable[tokenTableIndex].isPath = (strchr(pStruct->pKey, '.') != NULL);
+	if(tokenTable[tokenTableIndex].isPath) {
+		tokenTable[tokenTableIndex].keyHash = extendJsonKeyHash(hashJsonKey(SHADOW_STATE_STRING ".",
+																			strlen(SHADOW_STATE_STRING ".")),
+																pStruct->pKey, tokenTable[tokenTableIndex].keyLen);
+	} else {
+		tokenTable[tokenTableIndex].keyHash = hashJsonKey(pStruct->pKey, tokenTable[tokenTableIndex].keyLen);
+	}
 	tokenTable[tokenTableIndex].callback = pStruct->cb;
 	tokenTable[tokenTableIndex].pStruct = pStruct;
+	tokenTable[tokenTableIndex].lastDeltaNum = 0;
 	tokenTable[tokenTableIndex].isFree = false;
+
+	/* The index is never more than half full, a free slot is always found */
+	slot = tokenTable[tokenTableIndex].keyHash % DELTA_KEY_INDEX_SIZE;
+	while(deltaKeyIndex[slot] != 0) {
+		slot = (slot + 1) % DELTA_KEY_INDEX_SIZE;
+	}
+	deltaKeyIndex[slot] = (uint16_t) (tokenTableIndex + 1);
 	tokenTableIndex++;
 
 	return rc;
 }
 
+void initReportedAttributes(void) {
+	reportedAttributeCount = 0;
+	pendingReportClientToken[0] = '\0';
+}
+
+IoT_Error_t registerReportedAttribute(jsonStruct_t *pStruct, double deadband) {
+	uint8_t i;
+
+	for(i = 0; i < reportedAttributeCount; i++) {
+		if(reportedAttributes[i].pStruct == pStruct) {
+			break;
+		}
+	}
+
+	if(i >= MAX_REPORTED_ATTRIBUTES_REGISTERED) {
+		return FAILURE;
+	}
+	if(i == reportedAttributeCount) {
+		reportedAttributeCount++;
+	}
+
+	/* Registering an attribute again changes its deadband and reports it on the next update */
+	reportedAttributes[i].pStruct = pStruct;
+	reportedAttributes[i].deadband = deadband;
+	reportedAttributes[i].isAcked = false;
+	reportedAttributes[i].isPending = false;
+
+	return SUCCESS;
+}
+
+/* Reads the number and bool types as a double, the others are compared by their JSON */
+static bool readReportedNumber(const jsonStruct_t *pStruct, double *pValue) {
+	switch(pStruct->type) {
+		case SHADOW_JSON_INT32:
+			*pValue = *(int32_t *) (pStruct->pData);
+			break;
+		case SHADOW_JSON_INT16:
+			*pValue = *(int16_t *) (pStruct->pData);
+			break;
+		case SHADOW_JSON_INT8:
+			*pValue = *(int8_t *) (pStruct->pData);
+			break;
+		case SHADOW_JSON_UINT32:
+			*pValue = *(uint32_t *) (pStruct->pData);
+			break;
+		case SHADOW_JSON_UINT16:
+			*pValue = *(uint16_t *) (pStruct->pData);
+			break;
+		case SHADOW_JSON_UINT8:
+			*pValue = *(uint8_t *) (pStruct->pData);
+			break;
+		case SHADOW_JSON_FLOAT:
+			*pValue = *(float *) (pStruct->pData);
+			break;
+		case SHADOW_JSON_DOUBLE:
+			*pValue = *(double *) (pStruct->pData);
+			break;
+		case SHADOW_JSON_BOOL:
+			*pValue = *(bool *) (pStruct->pData) ? 1 : 0;
+			break;
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+IoT_Error_t buildReportedDiff(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
+	jsonBuilder_t builder;
+	jsonBuilder_t beforeAttribute;
+	ReportedAttribute_t *pAttribute;
+	bool isNumber;
+	bool isIncluded[MAX_REPORTED_ATTRIBUTES_REGISTERED];
+	double values[MAX_REPORTED_ATTRIBUTES_REGISTERED];
+	double change;
+	size_t valueStart, valueLen;
+	uint8_t i, includedCount = 0;
+	IoT_Error_t rc;
+
+	/* Only the ack of the last report built is waited for. The service may still apply a report that is
+	 * superseded or timed out, so the value of its attributes is no longer known and they are sent until
+	 * a report of them is accepted */
+	for(i = 0; i < reportedAttributeCount; i++) {
+		if(reportedAttributes[i].isPending) {
+			reportedAttributes[i].isAcked = false;
+			reportedAttributes[i].isPending = false;
+		}
+	}
+	pendingReportClientToken[0] = '\0';
+
+	aws_iot_shadow_json_builder_init(&builder, pJsonDocument, maxSizeOfJsonDocument);
+	aws_iot_shadow_json_builder_begin_object(&builder, SHADOW_REPORTED_STRING);
+
+	/* Every attribute is compared with the value last accepted, not the one last sent,
+	 * so a report that is rejected or lost is sent again by the next one */
+	for(i = 0; i < reportedAttributeCount && SUCCESS == builder.rc; i++) {
+		pAttribute = &reportedAttributes[i];
+		isIncluded[i] = false;
+		values[i] = 0;
+
+		isNumber = readReportedNumber(pAttribute->pStruct, &values[i]);
+		if(isNumber && pAttribute->isAcked) {
+			change = values[i] - pAttribute->ackedValue;
+			if(change < 0) {
+				change = -change;
+			}
+			if(values[i] == pAttribute->ackedValue || change < pAttribute->deadband) {
+				continue;
+			}
+		}
+
+		beforeAttribute = builder;
+		aws_iot_shadow_json_builder_add(&builder, pAttribute->pStruct);
+		if(SUCCESS != builder.rc) {
+			break;
+		}
+
+		if(!isNumber) {
+			/* The separator is left out, it depends on the attributes written before */
+			valueStart = beforeAttribute.length;
+			if(pJsonDocument[valueStart] == ',') {
+				valueStart++;
+			}
+			valueLen = builder.length - valueStart;
+			if(pAttribute->isAcked && strlen(pAttribute->ackedJson) == valueLen
+			   && 0 == memcmp(pAttribute->ackedJson, pJsonDocument + valueStart, valueLen)) {
+				builder = beforeAttribute;
+				pJsonDocument[builder.length] = '\0';
+				continue;
+			}
+			if(valueLen < sizeof(pAttribute->pendingJson)) {
+				memcpy(pAttribute->pendingJson, pJsonDocument + valueStart, valueLen);
+				pAttribute->pendingJson[valueLen] = '\0';
+			} else {
+				/* Nothing matches an empty JSON, the attribute is reported every time */
+				pAttribute->pendingJson[0] = '\0';
+			}
+		}
+
+		isIncluded[i] = true;
+		includedCount++;
+	}
+
+	if(SUCCESS == builder.rc && 0 == includedCount) {
+		return SHADOW_NOTHING_TO_REPORT;
+	}
+
+	aws_iot_shadow_json_builder_end_object(&builder);
+	rc = aws_iot_shadow_json_builder_finalize(&builder);
+	if(SUCCESS != rc) {
+		return rc;
+	}
+
+	if(!extractClientToken(pJsonDocument, pendingReportClientToken)) {
+		pendingReportClientToken[0] = '\0';
+		return SHADOW_JSON_ERROR;
+	}
+
+	for(i = 0; i < reportedAttributeCount; i++) {
+		reportedAttributes[i].isPending = isIncluded[i];
+		if(isIncluded[i]) {
+			reportedAttributes[i].pendingValue = values[i];
+		}
+	}
+
+	return SUCCESS;
+}
+
+/* The values of the report become the accepted ones once the service accepted it. A rejected report
+ * changed nothing, the values accepted before are still those of the service */
+static void settleReportedAttributes(const char *pClientToken, bool isAccepted) {
+	uint8_t i;
+
+	if(pendingReportClientToken[0] == '\0' || strcmp(pendingReportClientToken, pClientToken) != 0) {
+		return;
+	}
+
+	for(i = 0; i < reportedAttributeCount; i++) {
+		if(reportedAttributes[i].isPending) {
+			if(isAccepted) {
+				reportedAttributes[i].ackedValue = reportedAttributes[i].pendingValue;
+				memcpy(reportedAttributes[i].ackedJson, reportedAttributes[i].pendingJson,
+					   sizeof(reportedAttributes[i].ackedJson));
+				reportedAttributes[i].isAcked = true;
+			}
+			reportedAttributes[i].isPending = false;
+		}
+	}
+	pendingReportClientToken[0] = '\0';
+}
+
 static int16_t getNextFreeIndexOfSubscriptionList(void) {
 	uint8_t i;
 	for(i = 0; i < MAX_TOPICS_AT_ANY_GIVEN_TIME; i++) {
@@ -179,9 +440,7 @@ static bool isAckForMyThingName(const char *pTopicName) {
 
 static void AckStatusCallback(AWS_IoT_Client *pClient, char *topicName, uint16_t topicNameLen,
 							  IoT_Publish_Message_Params *params, void *pData) {
-	int32_t tokenCount;
 	uint8_t i;
-	void *pJsonHandler = NULL;
 	char temporaryClientToken[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
 
 	IOT_UNUSED(pClient);
@@ -194,23 +453,23 @@ static void AckStatusCallback(AWS_IoT_Client *pClient, char *topicName, uint16_t
 	}
 
 	memcpy(shadowRxBuf, params->payload, params->payloadLen);
-	shadowRxBuf[params->payloadLen] = '\0';    // jsmn_parse relies on a string
+	shadowRxBuf[params->payloadLen] = '\0';    // callbacks get the document as a string
 
-	if(!isJsonValidAndParse(shadowRxBuf, pJsonHandler, &tokenCount)) {
+	if(!parseJsonDocument(&shadowRxDocument, shadowRxBuf, params->payloadLen)) {
 		IOT_WARN("Received JSON is not valid");
 		return;
 	}
 
 	if(isAckForMyThingName(topicName)) {
 		uint32_t tempVersionNumber = 0;
-		if(extractVersionNumber(shadowRxBuf, pJsonHandler, tokenCount, &tempVersionNumber)) {
+		if(extractDocumentVersionNumber(&shadowRxDocument, &tempVersionNumber)) {
 			if(tempVersionNumber > shadowJsonVersionNum) {
 				shadowJsonVersionNum = tempVersionNumber;
 			}
 		}
 	}
 
-	if(extractClientToken(shadowRxBuf, temporaryClientToken)) {
+	if(extractDocumentClientToken(&shadowRxDocument, temporaryClientToken, sizeof(temporaryClientToken))) {
 		for(i = 0; i < MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
 			if(!AckWaitList[i].isFree) {
 				if(strcmp(AckWaitList[i].clientTokenID, temporaryClientToken) == 0) {
@@ -221,6 +480,9 @@ static void AckStatusCallback(AWS_IoT_Client *pClient, char *topicName, uint16_t
 						status = SHADOW_ACK_REJECTED;
 					}
 					if(status == SHADOW_ACK_ACCEPTED || status == SHADOW_ACK_REJECTED) {
+						if(AckWaitList[i].action == SHADOW_UPDATE) {
+							settleReportedAttributes(temporaryClientToken, status == SHADOW_ACK_ACCEPTED);
+						}
 						if(AckWaitList[i].callback != NULL) {
 							AckWaitList[i].callback(AckWaitList[i].thingName, AckWaitList[i].action, status,
 													shadowRxBuf, AckWaitList[i].pCallbackContext);
@@ -466,13 +728,96 @@ void HandleExpiredResponseCallbacks(void) {
 	}
 }
 
+uint32_t getTimeToNextAckExpiryMs(uint32_t maxWait_ms) {
+	uint8_t i;
+	uint32_t expiry_ms;
+	for(i = 0; i < MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
+		if(!AckWaitList[i].isFree) {
+			/* An ack less than a millisecond from expiring still gets a slice to expire in */
+			expiry_ms = left_ms(&(AckWaitList[i].timer));
+			if(0 == expiry_ms) {
+				expiry_ms = 1;
+			}
+			if(expiry_ms < maxWait_ms) {
+				maxWait_ms = expiry_ms;
+			}
+		}
+	}
+	return maxWait_ms;
+}
+
+/* Updates and calls back a registered jsonStruct_t with the value of the key at keyIndex */
+static void applyDeltaKey(const ShadowJsonDocument_t *pDocument, JsonTokenTable_t *pEntry, int32_t keyIndex) {
+	const jsmntok_t *pValueToken = &(pDocument->tokens[keyIndex + 1]);
+
+	pEntry->lastDeltaNum = deltaNum;
+	updateJsonStructValue(pDocument, keyIndex + 1, (jsonStruct_t *) pEntry->pStruct);
+	if(pEntry->callback != NULL) {
+		pEntry->callback(pDocument->pJson + pValueToken->start, (uint32_t) (pValueToken->end - pValueToken->start),
+						 (jsonStruct_t *) pEntry->pStruct);
+	}
+}
+
+/* Updates and calls back the registered jsonStruct_t matching the key, if this is their first match in the delta */
+static void dispatchDeltaKey(const ShadowJsonDocument_t *pDocument, const JsonDocumentKeyPath_t *pPath, uint32_t hash,
+							 bool isPath) {
+	int32_t keyIndex = pPath->keyIndexes[pPath->keyCount - 1];
+	const jsmntok_t *pKeyToken = &(pDocument->tokens[keyIndex]);
+	size_t keyLen = (size_t) (pKeyToken->end - pKeyToken->start);
+	uint32_t slot = hash % DELTA_KEY_INDEX_SIZE;
+	JsonTokenTable_t *pEntry;
+	bool isMatching;
+
+	while(deltaKeyIndex[slot] != 0) {
+		pEntry = &tokenTable[deltaKeyIndex[slot] - 1];
+		if(!pEntry->isFree && pEntry->isPath == isPath && pEntry->lastDeltaNum != deltaNum && pEntry->keyHash == hash) {
+			if(isPath) {
+				isMatching = isJsonDocumentPath(pDocument, pPath, 1, pEntry->pKey, pEntry->keyLen);
+			} else {
+				isMatching = pEntry->keyLen == keyLen &&
+							 strncmp(pEntry->pKey, pDocument->pJson + pKeyToken->start, keyLen) == 0;
+			}
+			if(isMatching) {
+				applyDeltaKey(pDocument, pEntry, keyIndex);
+			}
+		}
+		slot = (slot + 1) % DELTA_KEY_INDEX_SIZE;
+	}
+}
+
+static void deltaKeyHandler(const ShadowJsonDocument_t *pDocument, const JsonDocumentKeyPath_t *pPath,
+							void *pContext) {
+	IOT_UNUSED(pContext);
+
+	/* Keys registered by name match at any depth */
+	dispatchDeltaKey(pDocument, pPath, pPath->keyHash, false);
+
+	/* Keys registered by path only match below the state object */
+	if(pPath->keyCount > 1 && pPath->keyIndexes[0] + 1 == pDocument->stateIndex) {
+		dispatchDeltaKey(pDocument, pPath, pPath->pathHash, true);
+	}
+}
+
+/* Keys registered by name matched inside arrays and at any depth before the walk, they are still looked for there */
+static void dispatchSkippedDeltaKeys(const ShadowJsonDocument_t *pDocument) {
+	JsonTokenTable_t *pEntry;
+	int32_t keyIndex;
+	uint32_t i;
+
+	for(i = 0; i < tokenTableIndex; i++) {
+		pEntry = &tokenTable[i];
+		if(pEntry->isFree || pEntry->isPath || pEntry->lastDeltaNum == deltaNum) {
+			continue;
+		}
+		keyIndex = findJsonDocumentKeyAtAnyDepth(pDocument, pEntry->pKey, pEntry->keyLen);
+		if(keyIndex >= 0) {
+			applyDeltaKey(pDocument, pEntry, keyIndex);
+		}
+	}
+}
+
 static void shadow_delta_callback(AWS_IoT_Client *pClient, char *topicName,
 								  uint16_t topicNameLen, IoT_Publish_Message_Params *params, void *pData) {
-	int32_t tokenCount;
-	uint32_t i = 0;
-	void *pJsonHandler = NULL;
-	int32_t DataPosition;
-	uint32_t dataLength;
 	uint32_t tempVersionNumber = 0;
 
 	FUNC_ENTRY;
@@ -488,15 +833,15 @@ static void shadow_delta_callback(AWS_IoT_Client *pClient, char *topicName,
 	}
 
 	memcpy(shadowRxBuf, params->payload, params->payloadLen);
-	shadowRxBuf[params->payloadLen] = '\0';    // jsmn_parse relies on a string
+	shadowRxBuf[params->payloadLen] = '\0';    // callbacks get the document as a string
 
-	if(!isJsonValidAndParse(shadowRxBuf, pJsonHandler, &tokenCount)) {
+	if(!parseJsonDocument(&shadowRxDocument, shadowRxBuf, params->payloadLen)) {
 		IOT_WARN("Received JSON is not valid");
 		return;
 	}
 
 	if(shadowDiscardOldDeltaFlag) {
-		if(extractVersionNumber(shadowRxBuf, pJsonHandler, tokenCount, &tempVersionNumber)) {
+		if(extractDocumentVersionNumber(&shadowRxDocument, &tempVersionNumber)) {
 			if(tempVersionNumber > shadowJsonVersionNum) {
 				shadowJsonVersionNum = tempVersionNumber;
 			} else {
@@ -507,16 +852,10 @@ static void shadow_delta_callback(AWS_IoT_Client *pClient, char *topicName,
 		}
 	}
 
-	for(i = 0; i < tokenTableIndex; i++) {
-		if(!tokenTable[i].isFree) {
-			if(isJsonKeyMatchingAndUpdateValue(shadowRxBuf, pJsonHandler, tokenCount,
-											   (jsonStruct_t *) tokenTable[i].pStruct, &dataLength, &DataPosition)) {
-				if(tokenTable[i].callback != NULL) {
-					tokenTable[i].callback(shadowRxBuf + DataPosition, dataLength,
-										   (jsonStruct_t *) tokenTable[i].pStruct);
-				}
-			}
-		}
+	/* The whole document is walked, a key registered as "state" gets the whole delta */
+	deltaNum++;
+	if(!walkJsonDocumentKeys(&shadowRxDocument, 0, deltaKeyHandler, NULL)) {
+		dispatchSkippedDeltaKeys(&shadowRxDocument);
 	}
 }
 
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file address_cache_test.c
+ * @brief Checks the address racing of the TLS connect and the network address cache
+ *
+ * A TLS server runs on a thread of this process and listens on the same port of 127.0.0.1
+ * and ::1. The connects go to a made up host name, which a stub resolver turns into the
+ * addresses each check asks for:
+ *  - ipv4, ipv6: a connect over each family
+ *  - fallback:   the first address refuses the connect, the connect goes on with the next
+ *                one of the other family, which the cache tries first from then on
+ *  - cache hit:  a second connect does not call the resolver
+ *  - expiry:     the host is resolved again once the TTL given by the resolver passed
+ *  - stale:      expired addresses are still used when the host cannot be resolved again
+ *
+ * Usage: address_cache_test [port]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "network_interface.h"
+#include "tls_test_server.h"
+
+#define TEST_DEFAULT_PORT "18886"
+#define TEST_HOST "broker.test"
+#define TEST_TIMEOUT_MS 5000
+#define TEST_POLL_MS 50
+#define TEST_MAX_STUB_ADDRESSES 4
+
+typedef struct {
+	TlsTestServer tls;			///< Listens on 127.0.0.1 and ::1
+	volatile int isStopping;
+	volatile uint32_t acceptCount;
+	volatile int lastFamily;		///< Family of the listener of the last connection
+} Server;
+
+/* What the stub resolver answers */
+static const char *stubAddresses[TEST_MAX_STUB_ADDRESSES];
+static size_t stubCount;
+static uint32_t stubTtlSec;
+static IoT_Error_t stubRc;
+static uint32_t stubCalls;
+
+static TlsTestCredentials credentials;
+
+static IoT_Error_t stub_resolve(const char *pHost, NetworkAddress *pAddresses, size_t maxCount, size_t *pCount,
+								uint32_t *pTtlSec) {
+	struct sockaddr_in *pIn;
+	struct sockaddr_in6 *pIn6;
+	size_t itr;
+
+	stubCalls++;
+	*pCount = 0;
+	*pTtlSec = stubTtlSec;
+
+	if(SUCCESS != stubRc || 0 != strcmp(TEST_HOST, pHost)) {
+		return (SUCCESS != stubRc) ? stubRc : NETWORK_ERR_NET_UNKNOWN_HOST;
+	}
+
+	for(itr = 0; itr < stubCount && *pCount < maxCount; itr++) {
+		memset(&(pAddresses[*pCount]), 0, sizeof(NetworkAddress));
+		pIn = (struct sockaddr_in *) &(pAddresses[*pCount].addr);
+		pIn6 = (struct sockaddr_in6 *) &(pAddresses[*pCount].addr);
+		if(1 == inet_pton(AF_INET, stubAddresses[itr], &(pIn->sin_addr))) {
+			pIn->sin_family = AF_INET;
+			pAddresses[*pCount].addrLen = sizeof(struct sockaddr_in);
+		} else if(1 == inet_pton(AF_INET6, stubAddresses[itr], &(pIn6->sin6_addr))) {
+			pIn6->sin6_family = AF_INET6;
+			pAddresses[*pCount].addrLen = sizeof(struct sockaddr_in6);
+		} else {
+			continue;
+		}
+		(*pCount)++;
+	}
+
+	return SUCCESS;
+}
+
+static void stub_set(uint32_t ttlSec, const char *pFirst, const char *pSecond) {
+	stubCount = 0;
+	stubAddresses[stubCount++] = pFirst;
+	if(NULL != pSecond) {
+		stubAddresses[stubCount++] = pSecond;
+	}
+	stubTtlSec = ttlSec;
+	stubRc = SUCCESS;
+}
+
+/* Does the handshake of each connection and keeps it until the client closes it */
+static void *server_thread(void *pArg) {
+	Server *pServer = (Server *) pArg;
+	mbedtls_net_context fd;
+	mbedtls_ssl_context ssl;
+	unsigned char buf[64];
+	int family;
+
+	while(!pServer->isStopping) {
+		mbedtls_net_init(&fd);
+		mbedtls_ssl_init(&ssl);
+		if(0 != tls_test_server_accept(&pServer->tls, &fd, TEST_POLL_MS, &family)
+		   || 0 != mbedtls_ssl_setup(&ssl, &pServer->tls.conf)) {
+			mbedtls_ssl_free(&ssl);
+			mbedtls_net_free(&fd);
+			continue;
+		}
+		pServer->lastFamily = family;
+		pServer->acceptCount++;
+		mbedtls_ssl_set_bio(&ssl, &fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+		if(0 == tls_test_server_handshake(&ssl)) {
+			while(0 < mbedtls_ssl_read(&ssl, buf, sizeof(buf)));
+		}
+
+		mbedtls_ssl_free(&ssl);
+		mbedtls_net_free(&fd);
+	}
+
+	return NULL;
+}
+
+static int server_init(Server *pServer, const char *pPort) {
+	pServer->isStopping = 0;
+	pServer->acceptCount = 0;
+	pServer->lastFamily = AF_UNSPEC;
+
+	if(0 != tls_test_server_init(&pServer->tls, "address_cache_test")
+	   || 0 != tls_test_server_configure(&pServer->tls, TLS_TEST_KEY_EC)) {
+		return -1;
+	}
+	return tls_test_server_listen(&pServer->tls, pPort, true);
+}
+
+/* Connects to the test host through the cache and closes the connection again */
+static IoT_Error_t connect_once(NetworkAddressCache *pCache, uint16_t port) {
+	Network network;
+	IoT_Error_t rc;
+
+	rc = iot_tls_init(&network, credentials.caPath, credentials.certPath, credentials.keyPath, TEST_HOST, port,
+					  TEST_TIMEOUT_MS, false);
+	if(SUCCESS != rc) {
+		return rc;
+	}
+	iot_tls_set_address_cache(&network, pCache);
+
+	rc = iot_tls_connect(&network, NULL);
+	if(SUCCESS == rc) {
+		iot_tls_disconnect(&network);
+	}
+	iot_tls_destroy(&network);
+
+	return rc;
+}
+
+static int check(const char *pName, IoT_Error_t rc, int isPassed) {
+	printf("%-12s rc=%-4d %s\n", pName, rc, (SUCCESS == rc && isPassed) ? "ok" : "FAILED");
+	return (SUCCESS == rc && isPassed) ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+	const char *pPort = TEST_DEFAULT_PORT;
+	NetworkAddressCache cache;
+	NetworkAddressCacheEntry *pEntry;
+	Server server;
+	pthread_t serverThread;
+	uint16_t port;
+	uint32_t calls, accepts;
+	IoT_Error_t rc;
+	int failCount = 0;
+
+	if(argc >= 2) {
+		pPort = argv[1];
+	}
+	port = (uint16_t) atoi(pPort);
+
+	if(0 != tls_test_write_credentials(&credentials, TLS_TEST_KEY_EC)) {
+		printf("Writing the test certificates failed\n");
+		return -1;
+	}
+
+	if(0 != server_init(&server, pPort) || 0 != pthread_create(&serverThread, NULL, server_thread, &server)) {
+		printf("Starting the TLS server on port %s failed\n", pPort);
+		return -1;
+	}
+
+	if(SUCCESS != iot_tls_address_cache_init(&cache, stub_resolve)) {
+		printf("Address cache init failed\n");
+		return -1;
+	}
+
+	stub_set(AWS_IOT_NETWORK_ADDRESS_CACHE_TTL_SEC, "127.0.0.1", NULL);
+	rc = connect_once(&cache, port);
+	failCount += check("ipv4", rc, AF_INET == server.lastFamily && 1 == stubCalls && 1 == cache.resolveCount);
+
+	iot_tls_address_cache_flush(&cache);
+	stub_set(AWS_IOT_NETWORK_ADDRESS_CACHE_TTL_SEC, "::1", NULL);
+	rc = connect_once(&cache, port);
+	failCount += check("ipv6", rc, AF_INET6 == server.lastFamily && 2 == stubCalls);
+
+	/* Nothing listens on 127.0.0.2, so the connect is refused there */
+	iot_tls_address_cache_flush(&cache);
+	stub_set(AWS_IOT_NETWORK_ADDRESS_CACHE_TTL_SEC, "127.0.0.2", "::1");
+	accepts = server.acceptCount;
+	rc = connect_once(&cache, port);
+	pEntry = &(cache.entries[0]);
+	failCount += check("fallback", rc, AF_INET6 == server.lastFamily && accepts + 1 == server.acceptCount
+					   && 0 == strcmp(TEST_HOST, pEntry->host) && 2 == pEntry->addressCount
+					   && AF_INET6 == pEntry->addresses[0].addr.ss_family);
+
+	calls = stubCalls;
+	rc = connect_once(&cache, port);
+	failCount += check("cache hit", rc, calls == stubCalls && AF_INET6 == server.lastFamily);
+
+	iot_tls_address_cache_flush(&cache);
+	stub_set(1, "127.0.0.1", NULL);
+	rc = connect_once(&cache, port);
+	calls = stubCalls;
+	if(SUCCESS == rc) {
+		usleep(1100 * 1000);
+		rc = connect_once(&cache, port);
+	}
+	failCount += check("expiry", rc, calls + 1 == stubCalls && AF_INET == server.lastFamily);
+
+	usleep(1100 * 1000);
+	stubRc = NETWORK_ERR_NET_UNKNOWN_HOST;
+	calls = stubCalls;
+	rc = connect_once(&cache, port);
+	failCount += check("stale", rc, calls + 1 == stubCalls && AF_INET == server.lastFamily);
+
+	iot_tls_address_cache_free(&cache);
+	server.isStopping = 1;
+	pthread_join(serverThread, NULL);
+	tls_test_server_free(&server.tls);
+	tls_test_remove_credentials(&credentials);
+
+	printf("%s\n", (0 == failCount) ? "PASS" : "FAIL");
+	return (0 == failCount) ? 0 : -1;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file tls_test_server.c
+ * @brief TLS peer for the tests and benchmarks that connect the SDK to a server of their own process
+ */
+
+#include "tls_test_server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "mbedtls/certs.h"
+
+static int write_temp_file(char *pPath, const char *pTemplate, const char *pData) {
+	size_t len = strlen(pData);
+	int fd;
+
+	snprintf(pPath, TLS_TEST_PATH_LEN, "%s", pTemplate);
+	fd = mkstemp(pPath);
+	if(0 > fd) {
+		pPath[0] = '\0';
+		return -1;
+	}
+	if(write(fd, pData, len) != (ssize_t) len) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+int tls_test_write_credentials(TlsTestCredentials *pCredentials, TlsTestKeyType clientKeyType) {
+	const char *pCert = (TLS_TEST_KEY_EC == clientKeyType) ? mbedtls_test_cli_crt_ec : mbedtls_test_cli_crt_rsa;
+	const char *pKey = (TLS_TEST_KEY_EC == clientKeyType) ? mbedtls_test_cli_key_ec : mbedtls_test_cli_key_rsa;
+
+	pCredentials->caPath[0] = '\0';
+	pCredentials->certPath[0] = '\0';
+	pCredentials->keyPath[0] = '\0';
+
+	if(0 != write_temp_file(pCredentials->caPath, "/tmp/tls_test_ca_XXXXXX", mbedtls_test_cas_pem)
+	   || 0 != write_temp_file(pCredentials->certPath, "/tmp/tls_test_cert_XXXXXX", pCert)
+	   || 0 != write_temp_file(pCredentials->keyPath, "/tmp/tls_test_key_XXXXXX", pKey)) {
+		tls_test_remove_credentials(pCredentials);
+		return -1;
+	}
+
+	return 0;
+}
+
+void tls_test_remove_credentials(TlsTestCredentials *pCredentials) {
+	if('\0' != pCredentials->caPath[0]) {
+		unlink(pCredentials->caPath);
+	}
+	if('\0' != pCredentials->certPath[0]) {
+		unlink(pCredentials->certPath);
+	}
+	if('\0' != pCredentials->keyPath[0]) {
+		unlink(pCredentials->keyPath);
+	}
+}
+
+int tls_test_server_init(TlsTestServer *pServer, const char *pPers) {
+	size_t itr;
+
+	for(itr = 0; itr < TLS_TEST_SERVER_MAX_LISTENERS; itr++) {
+		mbedtls_net_init(&(pServer->listenFds[itr]));
+		pServer->listenFamilies[itr] = AF_UNSPEC;
+	}
+	pServer->listenCount = 0;
+	pServer->isConfigured = false;
+	mbedtls_entropy_init(&pServer->entropy);
+	mbedtls_ctr_drbg_init(&pServer->ctrDrbg);
+
+	return (0 == mbedtls_ctr_drbg_seed(&pServer->ctrDrbg, mbedtls_entropy_func, &pServer->entropy,
+									   (const unsigned char *) pPers, strlen(pPers))) ? 0 : -1;
+}
+
+int tls_test_server_listen(TlsTestServer *pServer, const char *pPort, bool isDualStack) {
+	if(0 != mbedtls_net_bind(&(pServer->listenFds[pServer->listenCount]), "127.0.0.1", pPort,
+							 MBEDTLS_NET_PROTO_TCP)) {
+		return -1;
+	}
+	pServer->listenFamilies[pServer->listenCount++] = AF_INET;
+
+	if(isDualStack) {
+		if(0 != mbedtls_net_bind(&(pServer->listenFds[pServer->listenCount]), "::1", pPort, MBEDTLS_NET_PROTO_TCP)) {
+			return -1;
+		}
+		pServer->listenFamilies[pServer->listenCount++] = AF_INET6;
+	}
+
+	return 0;
+}
+
+int tls_test_server_configure(TlsTestServer *pServer, TlsTestKeyType serverKeyType) {
+	const char *pCert = (TLS_TEST_KEY_EC == serverKeyType) ? mbedtls_test_srv_crt_ec : mbedtls_test_srv_crt_rsa;
+	const char *pKey = (TLS_TEST_KEY_EC == serverKeyType) ? mbedtls_test_srv_key_ec : mbedtls_test_srv_key_rsa;
+
+	tls_test_server_unconfigure(pServer);
+
+	mbedtls_ssl_config_init(&pServer->conf);
+	mbedtls_x509_crt_init(&pServer->caChain);
+	mbedtls_x509_crt_init(&pServer->cert);
+	mbedtls_pk_init(&pServer->key);
+	pServer->isConfigured = true;
+
+	if(0 != mbedtls_x509_crt_parse(&pServer->cert, (const unsigned char *) pCert, strlen(pCert) + 1)
+	   || 0 != mbedtls_x509_crt_parse(&pServer->caChain, (const unsigned char *) mbedtls_test_cas_pem,
+									  mbedtls_test_cas_pem_len)
+	   || 0 != mbedtls_pk_parse_key(&pServer->key, (const unsigned char *) pKey, strlen(pKey) + 1, NULL, 0)
+	   || 0 != mbedtls_ssl_config_defaults(&pServer->conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+										   MBEDTLS_SSL_PRESET_DEFAULT)
+	   || 0 != mbedtls_ssl_conf_own_cert(&pServer->conf, &pServer->cert, &pServer->key)) {
+		return -1;
+	}
+	mbedtls_ssl_conf_rng(&pServer->conf, mbedtls_ctr_drbg_random, &pServer->ctrDrbg);
+	mbedtls_ssl_conf_authmode(&pServer->conf, MBEDTLS_SSL_VERIFY_NONE);
+	mbedtls_ssl_conf_ca_chain(&pServer->conf, &pServer->caChain, NULL);
+
+	return 0;
+}
+
+void tls_test_server_unconfigure(TlsTestServer *pServer) {
+	if(!pServer->isConfigured) {
+		return;
+	}
+
+	mbedtls_ssl_config_free(&pServer->conf);
+	mbedtls_x509_crt_free(&pServer->caChain);
+	mbedtls_x509_crt_free(&pServer->cert);
+	mbedtls_pk_free(&pServer->key);
+	pServer->isConfigured = false;
+}
+
+int tls_test_server_accept(TlsTestServer *pServer, mbedtls_net_context *pFd, int timeoutMs, int *pFamily) {
+	struct pollfd pfds[TLS_TEST_SERVER_MAX_LISTENERS];
+	size_t itr;
+	int ret;
+
+	for(itr = 0; itr < pServer->listenCount; itr++) {
+		pfds[itr].fd = pServer->listenFds[itr].fd;
+		pfds[itr].events = POLLIN;
+		pfds[itr].revents = 0;
+	}
+
+	ret = poll(pfds, pServer->listenCount, timeoutMs);
+	if(0 == ret) {
+		return 1;
+	}
+	if(0 > ret) {
+		return -1;
+	}
+
+	for(itr = 0; itr < pServer->listenCount; itr++) {
+		if(0 != (pfds[itr].revents & POLLIN)) {
+			if(0 != mbedtls_net_accept(&(pServer->listenFds[itr]), pFd, NULL, 0, NULL)) {
+				return -1;
+			}
+			if(NULL != pFamily) {
+				*pFamily = pServer->listenFamilies[itr];
+			}
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int tls_test_server_handshake(mbedtls_ssl_context *pSsl) {
+	int ret;
+
+	while(0 != (ret = mbedtls_ssl_handshake(pSsl))) {
+		if(MBEDTLS_ERR_SSL_WANT_READ != ret && MBEDTLS_ERR_SSL_WANT_WRITE != ret && MBEDTLS_ERR_SSL_TIMEOUT != ret) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+int tls_test_read_all(mbedtls_ssl_context *pSsl, unsigned char *pBuf, size_t len) {
+	size_t got = 0;
+	int ret;
+
+	while(got < len) {
+		ret = mbedtls_ssl_read(pSsl, pBuf + got, len - got);
+		if(MBEDTLS_ERR_SSL_WANT_READ == ret || MBEDTLS_ERR_SSL_WANT_WRITE == ret || MBEDTLS_ERR_SSL_TIMEOUT == ret) {
+			continue;
+		}
+		if(0 >= ret) {
+			return -1;
+		}
+		got += (size_t) ret;
+	}
+
+	return 0;
+}
+
+int tls_test_write_all(mbedtls_ssl_context *pSsl, const unsigned char *pBuf, size_t len) {
+	size_t sent = 0;
+	int ret;
+
+	while(sent < len) {
+		ret = mbedtls_ssl_write(pSsl, pBuf + sent, len - sent);
+		if(MBEDTLS_ERR_SSL_WANT_READ == ret || MBEDTLS_ERR_SSL_WANT_WRITE == ret) {
+			continue;
+		}
+		if(0 >= ret) {
+			return -1;
+		}
+		sent += (size_t) ret;
+	}
+
+	return 0;
+}
+
+void tls_test_server_free(TlsTestServer *pServer) {
+	size_t itr;
+
+	for(itr = 0; itr < TLS_TEST_SERVER_MAX_LISTENERS; itr++) {
+		mbedtls_net_free(&(pServer->listenFds[itr]));
+	}
+	pServer->listenCount = 0;
+	tls_test_server_unconfigure(pServer);
+	mbedtls_ctr_drbg_free(&pServer->ctrDrbg);
+	mbedtls_entropy_free(&pServer->entropy);
+}
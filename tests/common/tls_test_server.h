@@ -0,0 +1,163 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file tls_test_server.h
+ * @brief TLS peer for the tests and benchmarks that connect the SDK to a server of their own process
+ *
+ * The server listens on 127.0.0.1, and on ::1 as well if asked to, and presents the mbedTLS test
+ * certificate of the key type it is configured with. What it does with a connection is up to the
+ * caller, which accepts, sets the SSL context up with its own I/O functions and runs the handshake
+ * with the functions below, usually on a thread of its own.
+ *
+ * The client side gets the matching test credentials written to temporary files, since the SDK
+ * loads them from paths.
+ */
+
+#ifndef TESTS_COMMON_TLS_TEST_SERVER_H_
+#define TESTS_COMMON_TLS_TEST_SERVER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "mbedtls/net.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+#define TLS_TEST_SERVER_MAX_LISTENERS 2
+#define TLS_TEST_PATH_LEN 40
+
+/**
+ * @brief Key type of the mbedTLS test certificates, usable as an array index
+ */
+typedef enum {
+	TLS_TEST_KEY_RSA = 0,
+	TLS_TEST_KEY_EC = 1
+} TlsTestKeyType;
+
+/**
+ * @brief Paths of the temporary files holding the client credentials
+ */
+typedef struct {
+	char caPath[TLS_TEST_PATH_LEN];		///< The test CAs, which signed both server certificates
+	char certPath[TLS_TEST_PATH_LEN];	///< Client certificate
+	char keyPath[TLS_TEST_PATH_LEN];	///< Client private key
+} TlsTestCredentials;
+
+/**
+ * @brief A TLS server on the loopback interface
+ *
+ * conf can be changed between tls_test_server_configure and the first accept, to pick cipher
+ * suites, curves, a session cache or a read timeout.
+ */
+typedef struct {
+	mbedtls_net_context listenFds[TLS_TEST_SERVER_MAX_LISTENERS];
+	int listenFamilies[TLS_TEST_SERVER_MAX_LISTENERS];	///< AF_INET or AF_INET6 for each listener
+	size_t listenCount;
+	mbedtls_ssl_config conf;
+	mbedtls_x509_crt caChain;	///< Verifies client certificates when the authentication mode asks for them
+	mbedtls_x509_crt cert;
+	mbedtls_pk_context key;
+	mbedtls_entropy_context entropy;
+	mbedtls_ctr_drbg_context ctrDrbg;
+	bool isConfigured;
+} TlsTestServer;
+
+/**
+ * @brief Write the test CAs and the client certificate and key of a key type to temporary files
+ *
+ * @param pCredentials Receives the paths of the files
+ * @param clientKeyType Key type of the client certificate
+ * @return 0, or -1 if a file could not be written
+ */
+int tls_test_write_credentials(TlsTestCredentials *pCredentials, TlsTestKeyType clientKeyType);
+
+/**
+ * @brief Remove the files written by tls_test_write_credentials
+ */
+void tls_test_remove_credentials(TlsTestCredentials *pCredentials);
+
+/**
+ * @brief Initialize the server and seed its random generator
+ *
+ * @param pServer Server to initialize
+ * @param pPers Personalization string of the random generator, usually the program name
+ * @return 0, or -1 if the random generator could not be seeded
+ */
+int tls_test_server_init(TlsTestServer *pServer, const char *pPers);
+
+/**
+ * @brief Listen on a port of 127.0.0.1, and of ::1 as well if isDualStack is set
+ *
+ * @return 0, or -1 if a listener could not be bound
+ */
+int tls_test_server_listen(TlsTestServer *pServer, const char *pPort, bool isDualStack);
+
+/**
+ * @brief Load the server certificate of a key type and set up conf with it
+ *
+ * Client certificates are not asked for. The previous configuration is freed first, so a server
+ * can be configured again between connections.
+ *
+ * @return 0, or -1 if the certificate or the configuration could not be set up
+ */
+int tls_test_server_configure(TlsTestServer *pServer, TlsTestKeyType serverKeyType);
+
+/**
+ * @brief Free the configuration set up by tls_test_server_configure
+ */
+void tls_test_server_unconfigure(TlsTestServer *pServer);
+
+/**
+ * @brief Accept a connection on any of the listeners
+ *
+ * @param pServer Server to accept on
+ * @param pFd Receives the connection, initialized by the caller
+ * @param timeoutMs Longest time to wait for a connection, negative to wait until one comes
+ * @param pFamily Receives the family of the listener that accepted, or NULL
+ * @return 0, 1 if no connection came in time, or -1 if accepting failed
+ */
+int tls_test_server_accept(TlsTestServer *pServer, mbedtls_net_context *pFd, int timeoutMs, int *pFamily);
+
+/**
+ * @brief Run the handshake of a set up SSL context until it completes or fails
+ *
+ * @return 0, or the mbedTLS error that ended the handshake
+ */
+int tls_test_server_handshake(mbedtls_ssl_context *pSsl);
+
+/**
+ * @brief Read exactly len bytes, retrying reads that would block or timed out
+ *
+ * @return 0, or -1 if the connection failed or was closed first
+ */
+int tls_test_read_all(mbedtls_ssl_context *pSsl, unsigned char *pBuf, size_t len);
+
+/**
+ * @brief Write exactly len bytes, retrying writes that would block
+ *
+ * @return 0, or -1 if the connection failed
+ */
+int tls_test_write_all(mbedtls_ssl_context *pSsl, const unsigned char *pBuf, size_t len);
+
+/**
+ * @brief Close the listeners and free the server, configured or not
+ */
+void tls_test_server_free(TlsTestServer *pServer);
+
+#endif /* TESTS_COMMON_TLS_TEST_SERVER_H_ */
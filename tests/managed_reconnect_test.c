@@ -0,0 +1,311 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file managed_reconnect_test.c
+ * @brief Checks that a reconnect of a managed client does not block the manager
+ *
+ * A TLS server speaking just enough MQTT for a connect runs on a thread of this process and
+ * listens on localhost with the mbedTLS test certificates. A client over the "tls" transport
+ * connects to it and is handed to a client manager. The server then drops the connection and
+ * holds back the handshake of the next one for TEST_HANDSHAKE_DELAY_MS. The manager is run in
+ * short slices until the client is connected again:
+ *  - the client must reconnect, over a second connection to the server
+ *  - no slice may take as long as the held back handshake, which a blocking connect would
+ *
+ * Usage: managed_reconnect_test [port]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_client_interface.h"
+#include "aws_iot_mqtt_client_manager.h"
+#include "tls_test_server.h"
+
+#define TEST_DEFAULT_PORT "18885"
+#define TEST_HANDSHAKE_DELAY_MS 1000
+#define TEST_SLICE_MS 20
+#define TEST_TIMEOUT_MS 15000
+#define TEST_SERVER_READ_TIMEOUT_MS 50
+#define TEST_BUF_LEN 1024
+
+typedef struct {
+	TlsTestServer tls;
+	volatile uint32_t handshakeDelayMs;	///< Sleep before the handshake of the next connection
+	volatile int isDropping;		///< Close the connection being served
+	volatile uint32_t connectCount;		///< CONNECT packets answered
+} Server;
+
+static double now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+}
+
+/* Reads len bytes. Returns 1 if the read timed out before the first byte, so the caller can look at its flags */
+static int server_read(mbedtls_ssl_context *pSsl, unsigned char *pBuf, size_t len, int isFirstByte) {
+	size_t got = 0;
+	int ret;
+
+	while(got < len) {
+		ret = mbedtls_ssl_read(pSsl, pBuf + got, len - got);
+		if(MBEDTLS_ERR_SSL_TIMEOUT == ret && isFirstByte && 0 == got) {
+			return 1;
+		}
+		if(MBEDTLS_ERR_SSL_WANT_READ == ret || MBEDTLS_ERR_SSL_WANT_WRITE == ret || MBEDTLS_ERR_SSL_TIMEOUT == ret) {
+			continue;
+		}
+		if(0 >= ret) {
+			return -1;
+		}
+		got += (size_t) ret;
+	}
+	return 0;
+}
+
+/* Answers CONNECT, SUBSCRIBE and PINGREQ until the client disconnects or the connection is dropped */
+static void server_serve(Server *pServer, mbedtls_ssl_context *pSsl) {
+	unsigned char buf[TEST_BUF_LEN];
+	unsigned char header, byte, reply[5];
+	uint32_t remainingLen, multiplier;
+	int ret;
+
+	for(;;) {
+		ret = server_read(pSsl, &header, 1, 1);
+		if(1 == ret) {
+			if(pServer->isDropping) {
+				pServer->isDropping = 0;
+				return;
+			}
+			continue;
+		}
+		if(0 != ret) {
+			return;
+		}
+
+		remainingLen = 0;
+		multiplier = 1;
+		do {
+			if(0 != server_read(pSsl, &byte, 1, 0)) {
+				return;
+			}
+			remainingLen += (byte & 127) * multiplier;
+			multiplier *= 128;
+		} while(byte & 128);
+		if(TEST_BUF_LEN < remainingLen || (0 < remainingLen && 0 != server_read(pSsl, buf, remainingLen, 0))) {
+			return;
+		}
+
+		switch(header >> 4) {
+			case 1:
+				reply[0] = 0x20;
+				reply[1] = 2;
+				reply[2] = 0;
+				reply[3] = 0;
+				pServer->connectCount++;
+				ret = tls_test_write_all(pSsl, reply, 4);
+				break;
+			case 8:
+				reply[0] = 0x90;
+				reply[1] = 3;
+				reply[2] = buf[0];
+				reply[3] = buf[1];
+				reply[4] = 0;
+				ret = tls_test_write_all(pSsl, reply, 5);
+				break;
+			case 12:
+				reply[0] = 0xd0;
+				reply[1] = 0;
+				ret = tls_test_write_all(pSsl, reply, 2);
+				break;
+			case 14:
+				return;
+			default:
+				ret = 0;
+				break;
+		}
+		if(0 != ret) {
+			return;
+		}
+	}
+}
+
+/* Serves the first connection and the one the client reconnects with */
+static void *server_thread(void *pArg) {
+	Server *pServer = (Server *) pArg;
+	mbedtls_net_context fd;
+	mbedtls_ssl_context ssl;
+	int itr;
+
+	for(itr = 0; itr < 2; itr++) {
+		mbedtls_net_init(&fd);
+		mbedtls_ssl_init(&ssl);
+
+		if(0 != tls_test_server_accept(&pServer->tls, &fd, -1, NULL)
+		   || 0 != mbedtls_ssl_setup(&ssl, &pServer->tls.conf)) {
+			mbedtls_ssl_free(&ssl);
+			mbedtls_net_free(&fd);
+			break;
+		}
+		mbedtls_ssl_set_bio(&ssl, &fd, mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
+
+		usleep(pServer->handshakeDelayMs * 1000);
+		if(0 == tls_test_server_handshake(&ssl)) {
+			server_serve(pServer, &ssl);
+		}
+
+		mbedtls_ssl_free(&ssl);
+		mbedtls_net_free(&fd);
+	}
+
+	return NULL;
+}
+
+static int server_init(Server *pServer, const char *pPort) {
+	pServer->handshakeDelayMs = 0;
+	pServer->isDropping = 0;
+	pServer->connectCount = 0;
+
+	if(0 != tls_test_server_init(&pServer->tls, "managed_reconnect_test")
+	   || 0 != tls_test_server_configure(&pServer->tls, TLS_TEST_KEY_EC)) {
+		return -1;
+	}
+	mbedtls_ssl_conf_read_timeout(&pServer->tls.conf, TEST_SERVER_READ_TIMEOUT_MS);
+
+	return tls_test_server_listen(&pServer->tls, pPort, false);
+}
+
+int main(int argc, char **argv) {
+	const char *pPort = TEST_DEFAULT_PORT;
+	IoT_Client_Init_Params initParams = iotClientInitParamsDefault;
+	IoT_Client_Connect_Params connectParams = iotClientConnectParamsDefault;
+	IoT_Client_Manager_Init_Params managerParams = iotClientManagerInitParamsDefault;
+	IoT_Publish_Message_Params publishParams;
+	AWS_IoT_Client_Manager manager;
+	AWS_IoT_Client client;
+	Server server;
+	TlsTestCredentials credentials;
+	pthread_t serverThread;
+	double start, sliceStart, slice, maxSlice = 0;
+	uint32_t sliceCount = 0;
+	IoT_Error_t rc;
+	int isFailed = 0;
+
+	if(argc >= 2) {
+		pPort = argv[1];
+	}
+
+	if(0 != tls_test_write_credentials(&credentials, TLS_TEST_KEY_EC)) {
+		printf("Writing the test certificates failed\n");
+		return -1;
+	}
+
+	if(0 != server_init(&server, pPort) || 0 != pthread_create(&serverThread, NULL, server_thread, &server)) {
+		printf("Starting the TLS server on port %s failed\n", pPort);
+		return -1;
+	}
+
+	initParams.pHostURL = "127.0.0.1";
+	initParams.port = (uint16_t) atoi(pPort);
+	initParams.pRootCALocation = credentials.caPath;
+	initParams.pDeviceCertLocation = credentials.certPath;
+	initParams.pDevicePrivateKeyLocation = credentials.keyPath;
+	initParams.isSSLHostnameVerify = false;
+	initParams.enableAutoReconnect = true;
+	initParams.mqttCommandTimeout_ms = 5000;
+	initParams.tlsHandshakeTimeout_ms = 5000;
+	connectParams.pClientID = "managed_reconnect_test";
+	connectParams.clientIDLen = (uint16_t) strlen(connectParams.pClientID);
+	connectParams.keepAliveIntervalInSec = 600;
+
+	rc = aws_iot_mqtt_init(&client, &initParams);
+	if(SUCCESS == rc) {
+		rc = aws_iot_mqtt_connect(&client, &connectParams);
+	}
+	if(SUCCESS == rc) {
+		rc = aws_iot_mqtt_manager_init(&manager, &managerParams);
+	}
+	if(SUCCESS == rc) {
+		rc = aws_iot_mqtt_manager_add_client(&manager, &client);
+	}
+	if(SUCCESS != rc) {
+		printf("Connecting the managed client failed: %d\n", rc);
+		return -1;
+	}
+
+	/* The next handshake is held back, the manager must keep running meanwhile */
+	server.handshakeDelayMs = TEST_HANDSHAKE_DELAY_MS;
+	server.isDropping = 1;
+
+	start = now_ms();
+	while(TEST_TIMEOUT_MS > now_ms() - start
+		  && (2 > server.connectCount || !aws_iot_mqtt_is_client_connected(&client))) {
+		sliceStart = now_ms();
+		rc = aws_iot_mqtt_manager_run(&manager, TEST_SLICE_MS);
+		slice = now_ms() - sliceStart;
+		if(SUCCESS != rc) {
+			printf("Running the manager failed: %d\n", rc);
+			isFailed = 1;
+			break;
+		}
+		if(slice > maxSlice) {
+			maxSlice = slice;
+		}
+		sliceCount++;
+	}
+
+	printf("%-12s %s after %.0f ms\n", "reconnect", aws_iot_mqtt_is_client_connected(&client) ? "done" : "FAILED",
+		   now_ms() - start);
+	printf("%-12s %u connections\n", "server", server.connectCount);
+	printf("%-12s %u slices of %u ms, longest %.0f ms, handshake held back %u ms\n", "manager", sliceCount,
+		   TEST_SLICE_MS, maxSlice, TEST_HANDSHAKE_DELAY_MS);
+
+	if(!aws_iot_mqtt_is_client_connected(&client) || 2 != server.connectCount) {
+		isFailed = 1;
+	}
+	if(TEST_HANDSHAKE_DELAY_MS / 2 <= maxSlice) {
+		printf("The manager was blocked by the reconnect\n");
+		isFailed = 1;
+	}
+
+	/* The reconnected client works */
+	memset(&publishParams, 0, sizeof(publishParams));
+	publishParams.qos = QOS0;
+	publishParams.payload = "{}";
+	publishParams.payloadLen = 2;
+	rc = aws_iot_mqtt_publish(&client, "managed/reconnect", 17, &publishParams);
+	if(SUCCESS != rc) {
+		printf("Publishing after the reconnect failed: %d\n", rc);
+		isFailed = 1;
+	}
+
+	aws_iot_mqtt_manager_remove_client(&manager, &client);
+	aws_iot_mqtt_manager_free(&manager);
+	aws_iot_mqtt_disconnect(&client);
+	aws_iot_mqtt_free(&client);
+	pthread_join(serverThread, NULL);
+	tls_test_server_free(&server.tls);
+	tls_test_remove_credentials(&credentials);
+
+	printf("%s\n", isFailed ? "FAIL" : "PASS");
+	return isFailed ? -1 : 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file shadow_delta_test.c
+ * @brief Checks which members of a delta the keys registered with aws_iot_shadow_register_delta match
+ *
+ * The shadow client connects over the "memory" transport, and the test writes the packets of the
+ * broker to the peer end of the pipe itself, ahead of the calls that read them. A key registered by
+ * name is sent in deltas where it is:
+ *  - object: a member of the state object
+ *  - nested: a member of an object in the state object
+ *  - array:  a member of an object inside an array
+ *  - deep:   a member of an object nested deeper than MAX_JSON_DEPTH_EXPECTED
+ *  - first:  both a member of the state object and of an object inside an array, only the first
+ *            one is taken and the callback is called once
+ *  - path:   a key registered as a path of MAX_JSON_DEPTH_EXPECTED - 1 names, the longest matched
+ *
+ * Registrations that could never match are refused:
+ *  - long path:   a path of MAX_JSON_DEPTH_EXPECTED names
+ *  - deep struct: a SHADOW_JSON_STRUCT nesting one object more than are decoded
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_shadow_interface.h"
+#include "network_interface.h"
+
+#define TEST_MEMORY_NAME "shadow_delta_test"
+#define TEST_THING_NAME "test"
+#define TEST_DELTA_TOPIC "$aws/things/" TEST_THING_NAME "/shadow/update/delta"
+#define TEST_PACKET_LEN 512
+#define TEST_PATH_LEN 64
+
+static int peerFd = -1;
+static uint32_t callbackCount = 0;
+static int32_t speed = 0;
+
+static IoT_Error_t peer_accept(int fd, void *pContext) {
+	static const unsigned char connack[] = {0x20, 0x02, 0x00, 0x00};
+
+	IOT_UNUSED(pContext);
+
+	peerFd = fd;
+	return (sizeof(connack) == write(fd, connack, sizeof(connack))) ? SUCCESS : FAILURE;
+}
+
+static int peer_write_suback(void) {
+	/* The packet id of a SUBACK is not checked by the client */
+	static const unsigned char suback[] = {0x90, 0x03, 0x00, 0x01, 0x00};
+
+	return (sizeof(suback) == write(peerFd, suback, sizeof(suback))) ? 0 : -1;
+}
+
+static int peer_write_publish(const char *pTopic, const char *pPayload) {
+	unsigned char packet[TEST_PACKET_LEN];
+	size_t topicLen = strlen(pTopic), payloadLen = strlen(pPayload);
+	size_t remainingLen = 2 + topicLen + payloadLen;
+	size_t len = 0;
+
+	if(TEST_PACKET_LEN < 3 + remainingLen) {
+		return -1;
+	}
+
+	packet[len++] = 0x30;
+	do {
+		packet[len] = (unsigned char) (remainingLen % 128);
+		remainingLen /= 128;
+		if(0 < remainingLen) {
+			packet[len] |= 128;
+		}
+		len++;
+	} while(0 < remainingLen);
+	packet[len++] = (unsigned char) (topicLen >> 8);
+	packet[len++] = (unsigned char) (topicLen & 0xFF);
+	memcpy(packet + len, pTopic, topicLen);
+	len += topicLen;
+	memcpy(packet + len, pPayload, payloadLen);
+	len += payloadLen;
+
+	return ((ssize_t) len == write(peerFd, packet, len)) ? 0 : -1;
+}
+
+static void speed_callback(const char *pJsonValueBuffer, uint32_t valueLength, jsonStruct_t *pContext) {
+	IOT_UNUSED(pJsonValueBuffer);
+	IOT_UNUSED(valueLength);
+	IOT_UNUSED(pContext);
+	callbackCount++;
+}
+
+/* Builds "p1.p2..." of nameCount names, and the delta giving that member the value nameCount */
+static void build_path(char *pPath, char *pDelta, uint32_t nameCount) {
+	uint32_t i;
+	size_t pathLen = 0, deltaLen = 0;
+
+	deltaLen += (size_t) sprintf(pDelta + deltaLen, "{\"state\":");
+	for(i = 1; i <= nameCount; i++) {
+		pathLen += (size_t) sprintf(pPath + pathLen, "%sp%u", (1 < i) ? "." : "", i);
+		deltaLen += (size_t) sprintf(pDelta + deltaLen, "{\"p%u\":", i);
+	}
+	deltaLen += (size_t) sprintf(pDelta + deltaLen, "%u", nameCount);
+	for(i = 0; i < nameCount; i++) {
+		pDelta[deltaLen++] = '}';
+	}
+	sprintf(pDelta + deltaLen, ",\"version\":%u}", 100 + nameCount);
+}
+
+static int check_refused(AWS_IoT_Client *pClient, const char *pName, jsonStruct_t *pStruct) {
+	IoT_Error_t rc = aws_iot_shadow_register_delta(pClient, pStruct);
+
+	printf("%-12s rc=%-4d %s\n", pName, rc, (FAILURE == rc) ? "ok" : "FAILED");
+	return (FAILURE == rc) ? 0 : 1;
+}
+
+/* Sends a delta and checks the value and the number of callbacks it gave */
+static int check_delta(AWS_IoT_Client *pClient, const char *pName, const char *pDelta, int32_t expectedSpeed) {
+	IoT_Error_t rc;
+	int isPassed;
+
+	speed = 0;
+	callbackCount = 0;
+	if(0 != peer_write_publish(TEST_DELTA_TOPIC, pDelta)) {
+		printf("Writing the delta failed\n");
+		return 1;
+	}
+	rc = aws_iot_shadow_yield(pClient, 100);
+
+	isPassed = SUCCESS == rc && expectedSpeed == speed && 1 == callbackCount;
+	printf("%-12s rc=%-4d speed %-3d callbacks %u %s\n", pName, rc, speed, callbackCount, isPassed ? "ok" : "FAILED");
+	return isPassed ? 0 : 1;
+}
+
+int main(void) {
+	ShadowInitParameters_t initParams = ShadowInitParametersDefault;
+	ShadowConnectParameters_t connectParams = ShadowConnectParametersDefault;
+	jsonStruct_t speedHandler = {"speed", &speed, SHADOW_JSON_INT32, speed_callback};
+	char path[TEST_PATH_LEN], longPath[TEST_PATH_LEN];
+	char pathDelta[TEST_PACKET_LEN], longPathDelta[TEST_PACKET_LEN];
+	jsonStruct_t pathHandler = {path, &speed, SHADOW_JSON_INT32, speed_callback};
+	jsonStruct_t longPathHandler = {longPath, &speed, SHADOW_JSON_INT32, speed_callback};
+	/* levels[i] is an object holding levels[i + 1], the last one is a number */
+	jsonStruct_t levels[MAX_JSON_DEPTH_EXPECTED + 2];
+	jsonObject_t objects[MAX_JSON_DEPTH_EXPECTED + 1];
+	uint32_t i;
+	AWS_IoT_Client client;
+	IoT_Error_t rc;
+	int failCount = 0;
+
+	if(SUCCESS != iot_memory_listen(TEST_MEMORY_NAME, peer_accept, NULL)) {
+		printf("Listening on the memory transport failed\n");
+		return -1;
+	}
+
+	initParams.pTransportName = "memory";
+	initParams.pHost = TEST_MEMORY_NAME;
+	initParams.port = 1;
+	connectParams.pMyThingName = TEST_THING_NAME;
+	connectParams.pMqttClientId = "shadow_delta_test";
+	connectParams.mqttClientIdLen = (uint16_t) strlen(connectParams.pMqttClientId);
+
+	rc = aws_iot_shadow_init(&client, &initParams);
+	if(SUCCESS == rc) {
+		rc = aws_iot_shadow_connect(&client, &connectParams);
+	}
+	if(SUCCESS == rc) {
+		rc = (0 == peer_write_suback()) ? aws_iot_shadow_register_delta(&client, &speedHandler) : FAILURE;
+	}
+	if(SUCCESS == rc) {
+		build_path(path, pathDelta, MAX_JSON_DEPTH_EXPECTED - 1);
+		rc = aws_iot_shadow_register_delta(&client, &pathHandler);
+	}
+	if(SUCCESS != rc) {
+		printf("Connecting the shadow client failed: %d\n", rc);
+		return -1;
+	}
+
+	build_path(longPath, longPathDelta, MAX_JSON_DEPTH_EXPECTED);
+	failCount += check_refused(&client, "long path", &longPathHandler);
+
+	for(i = 0; i <= MAX_JSON_DEPTH_EXPECTED; i++) {
+		objects[i].pMembers = &levels[i + 1];
+		objects[i].memberCount = 1;
+		levels[i].pKey = "level";
+		levels[i].pData = &objects[i];
+		levels[i].type = SHADOW_JSON_STRUCT;
+		levels[i].cb = NULL;
+	}
+	levels[i].pKey = "level";
+	levels[i].pData = &speed;
+	levels[i].type = SHADOW_JSON_INT32;
+	levels[i].cb = NULL;
+	failCount += check_refused(&client, "deep struct", &levels[0]);
+
+	failCount += check_delta(&client, "object", "{\"state\":{\"speed\":1},\"version\":1}", 1);
+	failCount += check_delta(&client, "nested", "{\"state\":{\"motor\":{\"speed\":2}},\"version\":2}", 2);
+	failCount += check_delta(&client, "array",
+							 "{\"state\":{\"motors\":[{\"id\":\"left\"},{\"id\":\"right\",\"speed\":3}]},\"version\":3}", 3);
+	failCount += check_delta(&client, "deep",
+							 "{\"state\":{\"a\":{\"b\":{\"c\":{\"d\":{\"e\":{\"f\":{\"g\":{\"h\":{\"speed\":4}}}}}}}}},"
+							 "\"version\":4}", 4);
+	failCount += check_delta(&client, "first",
+							 "{\"state\":{\"speed\":5,\"motors\":[{\"speed\":6}]},\"version\":5}", 5);
+	failCount += check_delta(&client, "path", pathDelta, MAX_JSON_DEPTH_EXPECTED - 1);
+
+	aws_iot_shadow_disconnect(&client);
+	aws_iot_mqtt_free(&client);
+	iot_memory_unlisten(TEST_MEMORY_NAME);
+	close(peerFd);
+
+	printf("%s\n", (0 == failCount) ? "PASS" : "FAIL");
+	return (0 == failCount) ? 0 : -1;
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file shadow_json_builder_test.c
+ * @brief Checks that the shadow JSON add/finalize API builds the same documents as before jsonBuilder_t
+ *
+ * Documents of random attributes are built three ways: with the old snprintf implementation of
+ * benchmarks/baseline, with aws_iot_shadow_add_reported and its neighbours, and with a jsonBuilder_t.
+ * All three must give the same bytes. The attributes cover every primitive type, and the doubles and
+ * floats are drawn to hit the cases the builder formats without snprintf, the values close to half
+ * way between two roundings and the values it hands to snprintf.
+ *  - reported: a reported section
+ *  - both:     a reported and a desired section
+ *  - small:    both sections into buffers of random sizes, many of which are too small. The API must
+ *              fail where the baseline fails and give the same document where it succeeds
+ *
+ * Usage: shadow_json_builder_test [documents]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_shadow_json.h"
+#include "aws_iot_shadow_records.h"
+#include "shadow_json_baseline.h"
+
+#define TEST_DEFAULT_DOCUMENTS 100000
+#define TEST_ATTRIBUTES 10
+#define TEST_DOCUMENT_LEN 1024
+#define TEST_MAX_STRING_LEN 40
+
+typedef enum {
+	TEST_REPORTED, TEST_BOTH, TEST_SMALL
+} TestCase_t;
+
+typedef struct {
+	int32_t i32;
+	int16_t i16;
+	int8_t i8;
+	uint32_t u32;
+	uint16_t u16;
+	uint8_t u8;
+	double d;
+	float f;
+	bool b;
+	char string[TEST_MAX_STRING_LEN + 1];
+} TestValues_t;
+
+static uint64_t randomState = 88172645463325252ull;
+
+static uint64_t nextRandom(void) {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return randomState;
+}
+
+static double randomDouble(void) {
+	uint64_t bits;
+	double d;
+
+	switch(nextRandom() % 8) {
+		case 0:
+			/* Any bit pattern, including NaN, infinities and huge values */
+			bits = nextRandom();
+			memcpy(&d, &bits, sizeof(d));
+			return d;
+		case 1:
+			return (double) ((int64_t) (nextRandom() % 2000000001ull) - 1000000000ll) / 1e6;
+		case 2:
+			/* Half way between two six decimal roundings */
+			return ((double) ((int64_t) (nextRandom() % 20000001ull) - 10000000ll) + 0.5) / 1e6;
+		case 3:
+			return (double) ((int64_t) (nextRandom() % 2000001ull) - 1000000ll) / 100.0;
+		case 4:
+			return ldexp((double) (nextRandom() % (1ull << 53)), -(int) (nextRandom() % 80));
+		case 5:
+			return -ldexp((double) (nextRandom() % (1ull << 53)), -(int) (nextRandom() % 60) + 10);
+		case 6:
+			/* Around the largest value the builder formats itself */
+			return ((nextRandom() % 2) ? -1.0 : 1.0) * (999999999.9999995 + (double) (nextRandom() % 100) * 1e-7);
+		default:
+			return (double) (float) ((double) ((int64_t) (nextRandom() % 2000000001ull) - 1000000000ll) / 1e4);
+	}
+}
+
+static void randomValues(TestValues_t *pValues, uint32_t document) {
+	size_t i, length = (size_t) (nextRandom() % (TEST_MAX_STRING_LEN + 1));
+
+	pValues->i32 = (int32_t) nextRandom();
+	pValues->i16 = (int16_t) nextRandom();
+	pValues->i8 = (int8_t) nextRandom();
+	pValues->u32 = (uint32_t) nextRandom();
+	pValues->u16 = (uint16_t) nextRandom();
+	pValues->u8 = (uint8_t) nextRandom();
+	pValues->d = randomDouble();
+	pValues->f = (float) randomDouble();
+	pValues->b = (0 != nextRandom() % 2);
+	for(i = 0; i < length; i++) {
+		/* Printable characters that need no escaping, neither implementation escapes */
+		pValues->string[i] = (char) ('0' + nextRandom() % ('z' - '0' + 1));
+	}
+	pValues->string[length] = '\0';
+
+	if(0 == document % 4) {
+		pValues->i32 = (nextRandom() % 2) ? INT32_MIN : INT32_MAX;
+		pValues->u32 = UINT32_MAX;
+		pValues->f = -0.0f;
+	}
+}
+
+static IoT_Error_t buildWithBaseline(char *pJsonDocument, size_t size, jsonStruct_t *pAttributes, uint8_t count,
+									 TestCase_t testCase) {
+	IoT_Error_t rc = baseline_aws_iot_shadow_init_json_document(pJsonDocument, size);
+
+	if(SUCCESS == rc) {
+		rc = baseline_aws_iot_shadow_add_reported(pJsonDocument, size, count, &pAttributes[0], &pAttributes[1],
+												  &pAttributes[2], &pAttributes[3], &pAttributes[4], &pAttributes[5],
+												  &pAttributes[6], &pAttributes[7], &pAttributes[8], &pAttributes[9]);
+	}
+	if(SUCCESS == rc && TEST_REPORTED != testCase) {
+		rc = baseline_aws_iot_shadow_add_desired(pJsonDocument, size, 2, &pAttributes[6], &pAttributes[0]);
+	}
+	if(SUCCESS == rc) {
+		rc = baseline_aws_iot_finalize_json_document(pJsonDocument, size);
+	}
+
+	return rc;
+}
+
+static IoT_Error_t buildWithApi(char *pJsonDocument, size_t size, jsonStruct_t *pAttributes, uint8_t count,
+								TestCase_t testCase) {
+	IoT_Error_t rc = aws_iot_shadow_init_json_document(pJsonDocument, size);
+
+	if(SUCCESS == rc) {
+		rc = aws_iot_shadow_add_reported(pJsonDocument, size, count, &pAttributes[0], &pAttributes[1],
+										 &pAttributes[2], &pAttributes[3], &pAttributes[4], &pAttributes[5],
+										 &pAttributes[6], &pAttributes[7], &pAttributes[8], &pAttributes[9]);
+	}
+	if(SUCCESS == rc && TEST_REPORTED != testCase) {
+		rc = aws_iot_shadow_add_desired(pJsonDocument, size, 2, &pAttributes[6], &pAttributes[0]);
+	}
+	if(SUCCESS == rc) {
+		rc = aws_iot_finalize_json_document(pJsonDocument, size);
+	}
+
+	return rc;
+}
+
+static IoT_Error_t buildWithBuilder(char *pJsonDocument, size_t size, jsonStruct_t *pAttributes, uint8_t count,
+									TestCase_t testCase) {
+	jsonBuilder_t builder;
+	uint8_t i;
+
+	aws_iot_shadow_json_builder_init(&builder, pJsonDocument, size);
+	aws_iot_shadow_json_builder_begin_object(&builder, "reported");
+	for(i = 0; i < count; i++) {
+		aws_iot_shadow_json_builder_add(&builder, &pAttributes[i]);
+	}
+	aws_iot_shadow_json_builder_end_object(&builder);
+	if(TEST_REPORTED != testCase) {
+		aws_iot_shadow_json_builder_begin_object(&builder, "desired");
+		aws_iot_shadow_json_builder_add(&builder, &pAttributes[6]);
+		aws_iot_shadow_json_builder_add(&builder, &pAttributes[0]);
+		aws_iot_shadow_json_builder_end_object(&builder);
+	}
+
+	return aws_iot_shadow_json_builder_finalize(&builder);
+}
+
+/* Returns the number of documents that differ */
+static uint32_t runCase(const char *pName, TestCase_t testCase, uint32_t documents) {
+	/* The baseline can write past the size it is given, so every buffer has room to spare */
+	static char baselineDocument[2 * TEST_DOCUMENT_LEN];
+	static char apiDocument[2 * TEST_DOCUMENT_LEN];
+	static char builderDocument[2 * TEST_DOCUMENT_LEN];
+	TestValues_t values;
+	jsonStruct_t attributes[TEST_ATTRIBUTES] = {
+			{"temperature", &values.i32, SHADOW_JSON_INT32, NULL},
+			{"rssi", &values.i16, SHADOW_JSON_INT16, NULL},
+			{"offset", &values.i8, SHADOW_JSON_INT8, NULL},
+			{"uptime", &values.u32, SHADOW_JSON_UINT32, NULL},
+			{"port", &values.u16, SHADOW_JSON_UINT16, NULL},
+			{"battery", &values.u8, SHADOW_JSON_UINT8, NULL},
+			{"humidity", &values.d, SHADOW_JSON_DOUBLE, NULL},
+			{"voltage", &values.f, SHADOW_JSON_FLOAT, NULL},
+			{"on", &values.b, SHADOW_JSON_BOOL, NULL},
+			{"mode", values.string, SHADOW_JSON_STRING, NULL}
+	};
+	uint32_t i, built = 0, failed = 0, overrun = 0, mismatches = 0;
+	uint8_t count;
+	size_t size;
+	IoT_Error_t baselineRc, apiRc, builderRc;
+	bool isSame;
+
+	for(i = 0; i < documents; i++) {
+		randomValues(&values, i);
+		count = (uint8_t) (TEST_REPORTED == testCase ? 1 + nextRandom() % TEST_ATTRIBUTES : TEST_ATTRIBUTES);
+		size = (TEST_SMALL == testCase) ? 2 + (size_t) (nextRandom() % 600) : TEST_DOCUMENT_LEN;
+
+		/* The three documents get the same client token */
+		resetClientTokenSequenceNum();
+		baselineRc = buildWithBaseline(baselineDocument, size, attributes, count, testCase);
+		resetClientTokenSequenceNum();
+		apiRc = buildWithApi(apiDocument, size, attributes, count, testCase);
+		resetClientTokenSequenceNum();
+		builderRc = buildWithBuilder(builderDocument, size, attributes, count, testCase);
+
+		if(strlen(baselineDocument) >= size) {
+			/* The baseline wrote past the buffer, which the API no longer does */
+			overrun++;
+			continue;
+		}
+		if(SUCCESS == baselineRc) {
+			built++;
+			isSame = SUCCESS == apiRc && SUCCESS == builderRc && 0 == strcmp(baselineDocument, apiDocument)
+					 && 0 == strcmp(baselineDocument, builderDocument);
+		} else {
+			failed++;
+			isSame = SUCCESS != apiRc && SUCCESS != builderRc;
+		}
+		if(!isSame && 0 == mismatches++) {
+			printf("%s document %u differs, rc %d/%d/%d:\n baseline %s\n api      %s\n builder  %s\n", pName, i,
+				   baselineRc, apiRc, builderRc, baselineDocument, apiDocument, builderDocument);
+		}
+	}
+
+	printf("%-10s %10u %10u %10u %10u %s\n", pName, built, failed, overrun, mismatches,
+		   (0 == mismatches) ? "ok" : "FAILED");
+	return mismatches;
+}
+
+int main(int argc, char **argv) {
+	uint32_t documents = TEST_DEFAULT_DOCUMENTS;
+	uint32_t mismatches = 0;
+
+	if(argc >= 2) {
+		documents = (uint32_t) atoi(argv[1]);
+	}
+	if(0 == documents) {
+		documents = 1;
+	}
+	snprintf(mqttClientID, MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES, "shadow-json-test");
+
+	printf("%-10s %10s %10s %10s %10s\n", "case", "built", "failed", "overrun", "mismatches");
+	mismatches += runCase("reported", TEST_REPORTED, documents);
+	mismatches += runCase("both", TEST_BOTH, documents);
+	mismatches += runCase("small", TEST_SMALL, documents);
+
+	printf("%s\n", (0 == mismatches) ? "PASS" : "FAIL");
+	return (0 == mismatches) ? 0 : -1;
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file subscribe_failure_test.c
+ * @brief Checks that a failed subscribe only removes its own handler
+ *
+ * The client connects over the "memory" transport, and the test writes the packets of the broker
+ * to the peer end of the pipe itself, ahead of the calls that read them:
+ *  - first:   a subscribe that gets its SUBACK
+ *  - second:  a subscribe to the same filter that never gets one and times out
+ *  - publish: a message on the filter still reaches the handler of the first subscribe, and not
+ *             the one of the second
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_client_interface.h"
+#include "network_interface.h"
+
+#define TEST_MEMORY_NAME "subscribe_failure_test"
+#define TEST_TOPIC "test/subscribe/failure"
+#define TEST_COMMAND_TIMEOUT_MS 200
+
+static int peerFd = -1;
+static uint32_t firstCount = 0;
+static uint32_t secondCount = 0;
+
+static IoT_Error_t peer_accept(int fd, void *pContext) {
+	static const unsigned char connack[] = {0x20, 0x02, 0x00, 0x00};
+
+	IOT_UNUSED(pContext);
+
+	peerFd = fd;
+	return (sizeof(connack) == write(fd, connack, sizeof(connack))) ? SUCCESS : FAILURE;
+}
+
+static int peer_write_suback(void) {
+	/* The packet id of a SUBACK is not checked by the client */
+	static const unsigned char suback[] = {0x90, 0x03, 0x00, 0x01, 0x00};
+
+	return (sizeof(suback) == write(peerFd, suback, sizeof(suback))) ? 0 : -1;
+}
+
+static int peer_write_publish(const char *pTopic, const char *pPayload) {
+	unsigned char packet[128];
+	size_t topicLen = strlen(pTopic), payloadLen = strlen(pPayload);
+	size_t len = 0;
+
+	packet[len++] = 0x30;
+	packet[len++] = (unsigned char) (2 + topicLen + payloadLen);
+	packet[len++] = (unsigned char) (topicLen >> 8);
+	packet[len++] = (unsigned char) (topicLen & 0xFF);
+	memcpy(packet + len, pTopic, topicLen);
+	len += topicLen;
+	memcpy(packet + len, pPayload, payloadLen);
+	len += payloadLen;
+
+	return ((ssize_t) len == write(peerFd, packet, len)) ? 0 : -1;
+}
+
+static void first_handler(AWS_IoT_Client *pClient, char *pTopicName, uint16_t topicNameLen,
+						  IoT_Publish_Message_Params *pParams, void *pData) {
+	IOT_UNUSED(pClient);
+	IOT_UNUSED(pTopicName);
+	IOT_UNUSED(topicNameLen);
+	IOT_UNUSED(pParams);
+	IOT_UNUSED(pData);
+	firstCount++;
+}
+
+static void second_handler(AWS_IoT_Client *pClient, char *pTopicName, uint16_t topicNameLen,
+						   IoT_Publish_Message_Params *pParams, void *pData) {
+	IOT_UNUSED(pClient);
+	IOT_UNUSED(pTopicName);
+	IOT_UNUSED(topicNameLen);
+	IOT_UNUSED(pParams);
+	IOT_UNUSED(pData);
+	secondCount++;
+}
+
+static int report(const char *pName, IoT_Error_t rc, int isPassed) {
+	printf("%-12s rc=%-4d %s\n", pName, rc, isPassed ? "ok" : "FAILED");
+	return isPassed ? 0 : 1;
+}
+
+int main(void) {
+	IoT_Client_Init_Params initParams = iotClientInitParamsDefault;
+	IoT_Client_Connect_Params connectParams = iotClientConnectParamsDefault;
+	AWS_IoT_Client client;
+	IoT_Error_t rc;
+	int failCount = 0;
+
+	if(SUCCESS != iot_memory_listen(TEST_MEMORY_NAME, peer_accept, NULL)) {
+		printf("Listening on the memory transport failed\n");
+		return -1;
+	}
+
+	initParams.pTransportName = "memory";
+	initParams.pHostURL = TEST_MEMORY_NAME;
+	initParams.port = 1;
+	initParams.mqttCommandTimeout_ms = TEST_COMMAND_TIMEOUT_MS;
+	connectParams.pClientID = "subscribe_failure_test";
+	connectParams.clientIDLen = (uint16_t) strlen(connectParams.pClientID);
+	connectParams.keepAliveIntervalInSec = 600;
+
+	rc = aws_iot_mqtt_init(&client, &initParams);
+	if(SUCCESS == rc) {
+		rc = aws_iot_mqtt_connect(&client, &connectParams);
+	}
+	if(SUCCESS != rc) {
+		printf("Connecting the client failed: %d\n", rc);
+		return -1;
+	}
+
+	if(0 != peer_write_suback()) {
+		printf("Writing the SUBACK failed\n");
+		return -1;
+	}
+	rc = aws_iot_mqtt_subscribe(&client, TEST_TOPIC, (uint16_t) strlen(TEST_TOPIC), QOS0, first_handler, NULL);
+	failCount += report("first", rc, SUCCESS == rc);
+
+	rc = aws_iot_mqtt_subscribe(&client, TEST_TOPIC, (uint16_t) strlen(TEST_TOPIC), QOS0, second_handler, NULL);
+	failCount += report("second", rc, SUCCESS != rc);
+
+	if(0 != peer_write_publish(TEST_TOPIC, "{}")) {
+		printf("Writing the PUBLISH failed\n");
+		return -1;
+	}
+	rc = aws_iot_mqtt_yield(&client, 100);
+	printf("%-12s first handler %u, second handler %u\n", "publish", firstCount, secondCount);
+	failCount += report("publish", rc, SUCCESS == rc && 1 == firstCount && 0 == secondCount);
+
+	aws_iot_mqtt_disconnect(&client);
+	aws_iot_mqtt_free(&client);
+	iot_memory_unlisten(TEST_MEMORY_NAME);
+	close(peerFd);
+
+	printf("%s\n", (0 == failCount) ? "PASS" : "FAIL");
+	return (0 == failCount) ? 0 : -1;
+}